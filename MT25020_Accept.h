@@ -0,0 +1,228 @@
+#ifndef ACCEPT_H
+#define ACCEPT_H
+
+// Listening sockets and the thread-per-connection accept loop.
+//
+// A1, A2, A3, A5 and --pipeline share this loop: it waits for a --max-conns
+// slot, accepts, sets up --ktls, then hands the socket to a new handler
+// thread. Connection setup is what short-lived connections pay for, so each
+// step can be changed from the command line:
+//
+//   --accept4         accept4() without the peer address and with
+//                     SOCK_CLOEXEC, instead of accept() copying the address out
+//   --acceptors=N     N accept threads, each with its own SO_REUSEPORT
+//                     listener, so the kernel spreads new connections over N
+//                     accept queues and no single thread takes them all
+//   --fastopen[=Q]    TCP_FASTOPEN: a client with a cookie sends its request
+//                     in the SYN and it is readable as soon as the socket is
+//                     accepted (Q pending fast-open requests, default 256)
+//   --defer-accept[=S] TCP_DEFER_ACCEPT: accept() only returns once the
+//                     client has sent data, up to S seconds (default 1)
+//
+// The last two only help if the client speaks first, i.e. with --rpc. The
+// reactors and the pool always accept with accept4() on SO_REUSEPORT
+// listeners. They and A4 take the two socket options but not --acceptors.
+// With several acceptors, --max-conns can be overshot by up to N-1
+// connections, because each acceptor checks for a slot on its own.
+
+#include "MT25020_Common.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Placement.h"
+#include "MT25020_Tls.h"
+#include <netinet/tcp.h>
+#include <signal.h>
+
+#ifndef TCP_FASTOPEN
+#define TCP_FASTOPEN 23
+#endif
+
+#define FASTOPEN_SYSCTL "/proc/sys/net/ipv4/tcp_fastopen"
+#define FASTOPEN_SERVER_BIT 0x2     // tcp_fastopen: accept data in the SYN
+#define FASTOPEN_CLIENT_BIT 0x1     // tcp_fastopen: send data in the SYN
+
+// Whether the tcp_fastopen sysctl has `bit` set; warns if not.
+static inline int fastopen_enabled(int bit) {
+    FILE *f = fopen(FASTOPEN_SYSCTL, "r");
+    int value = 0;
+    if (!f) return 1;               // cannot tell; let the kernel decide
+    if (fscanf(f, "%i", &value) != 1) value = 0;
+    fclose(f);
+    if (value & bit) return 1;
+    fprintf(stderr, "TCP Fast Open is disabled for %s (%s=%d; set bit %d)\n",
+            bit == FASTOPEN_SERVER_BIT ? "servers" : "clients", FASTOPEN_SYSCTL, value, bit);
+    return 0;
+}
+
+// Apply --fastopen and --defer-accept to a listening socket.
+static inline int listener_tune(int fd, const ServerOptions *opts) {
+    static int checked;             // listeners are all opened by the main thread
+    if (opts->fastopen > 0 && !checked++) fastopen_enabled(FASTOPEN_SERVER_BIT);
+    if (opts->fastopen > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &opts->fastopen, sizeof(opts->fastopen)) < 0) {
+        perror("TCP_FASTOPEN failed");
+        return -1;
+    }
+    if (opts->defer_accept > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opts->defer_accept,
+                   sizeof(opts->defer_accept)) < 0) {
+        perror("TCP_DEFER_ACCEPT failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Blocking listener on opts->port; SO_REUSEPORT so that several can share
+// the port. Returns the socket, or -1 (with a message).
+static inline int server_listen(const ServerOptions *opts, int reuseport) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts->port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, MAX_CLIENTS) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    if (listener_tune(fd, opts) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct AcceptLoop;
+
+// Start serving an accepted socket. Returns -1 if the connection has to be
+// dropped; the loop then closes it.
+typedef int (*AcceptSpawnFn)(struct AcceptLoop *loop, int fd, int id);
+
+typedef struct AcceptLoop {
+    const char *name;
+    const ServerOptions *opts;
+    Placement *placement;
+    void *(*handler)(void*);                // default spawn: thread with ServerThreadArgs
+    const struct SendStrategy *strategy;    // ServerThreadArgs.strategy
+    AcceptSpawnFn spawn;                    // NULL: accept_spawn_thread
+    void *ctx;                              // for a custom spawn
+    int next_id;
+    pthread_mutex_t placement_lock;         // Placement's round-robin cursor
+} AcceptLoop;
+
+typedef struct {
+    AcceptLoop *loop;
+    int listen_fd;
+} Acceptor;
+
+static inline int accept_spawn_thread(AcceptLoop *loop, int fd, int id) {
+    ServerThreadArgs *args = (ServerThreadArgs*)malloc(sizeof(ServerThreadArgs));
+    if (!args) return -1;
+    args->client_socket = fd;
+    args->thread_id = id;
+    args->message_size = loop->opts->message_size;
+    args->opts = loop->opts;
+    args->strategy = loop->strategy;
+    pthread_t t;
+    if (placement_spawn(loop->placement, fd, &t, loop->handler, args) != 0) {
+        free(args);
+        return -1;
+    }
+    pthread_detach(t);
+    return 0;
+}
+
+static inline void* acceptor_thread(void *arg) {
+    Acceptor *a = (Acceptor*)arg;
+    AcceptLoop *loop = a->loop;
+    const ServerOptions *opts = loop->opts;
+    AcceptSpawnFn spawn = loop->spawn ? loop->spawn : accept_spawn_thread;
+    int shared_placement = opts->acceptors > 1 && loop->placement->enabled;
+
+    while (1) {
+        // --max-conns: further clients wait in the listen backlog
+        connection_wait_slot(opts->max_conns);
+        struct sockaddr_in client_addr;
+        socklen_t len = sizeof(client_addr);
+        int fd = opts->accept4 ? accept4(a->listen_fd, NULL, NULL, SOCK_CLOEXEC)
+                               : accept(a->listen_fd, (struct sockaddr*)&client_addr, &len);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) perror("Accept failed");
+            continue;
+        }
+        if (ktls_server_setup(opts, fd) < 0) {
+            close(fd);
+            continue;
+        }
+        connection_opened(loop->name);
+        int id = __atomic_fetch_add(&loop->next_id, 1, __ATOMIC_RELAXED);
+        if (shared_placement) pthread_mutex_lock(&loop->placement_lock);
+        int rc = spawn(loop, fd, id);
+        if (shared_placement) pthread_mutex_unlock(&loop->placement_lock);
+        if (rc < 0) {
+            // Out of threads or memory: drop this client rather than leak its socket.
+            fprintf(stderr, "Failed to start a handler thread; connection dropped\n");
+            close(fd);
+            connection_closed();
+        }
+    }
+    return NULL;
+}
+
+// Open opts->acceptors listeners and accept on all of them; the calling
+// thread runs the last one. Returns only if setup fails.
+static inline int run_accept_loop(AcceptLoop *loop) {
+    const ServerOptions *opts = loop->opts;
+    int n = opts->acceptors > 0 ? opts->acceptors : 1;
+    Acceptor *acceptors = (Acceptor*)calloc(n, sizeof(Acceptor));
+    if (!acceptors) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+    // A client hanging up (every --churn connection does) must end its
+    // handler with EPIPE, not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&loop->placement_lock, NULL);
+    for (int i = 0; i < n; i++) {
+        acceptors[i].loop = loop;
+        acceptors[i].listen_fd = server_listen(opts, n > 1);
+        if (acceptors[i].listen_fd < 0) return -1;
+    }
+    printf("%s Server listening on 0.0.0.0:%d (%d acceptor%s, %s", loop->name, opts->port, n,
+           n > 1 ? "s on SO_REUSEPORT" : "", opts->accept4 ? "accept4" : "accept");
+    if (opts->fastopen > 0) printf(", fastopen queue %d", opts->fastopen);
+    if (opts->defer_accept > 0) printf(", defer-accept %d s", opts->defer_accept);
+    printf(")\n");
+    fflush(stdout);
+    placement_print(loop->placement, loop->name);
+
+    for (int i = 0; i < n - 1; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, acceptor_thread, &acceptors[i]) != 0) {
+            fprintf(stderr, "Failed to start acceptor %d\n", i);
+            return -1;
+        }
+        pthread_detach(t);
+    }
+    acceptor_thread(&acceptors[n - 1]);
+    return 0;
+}
+
+#endif
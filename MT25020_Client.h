@@ -0,0 +1,1612 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+// Receiver shared by every MT25020_Part_*_Client.
+//
+// The clients only differ in which server they are pointed at, so the
+// receive loop, option parsing and reporting live here and each Part client
+// is a thin main(). Besides the original copying recv() loop, the client can
+// receive with TCP_ZEROCOPY_RECEIVE (--zerocopy-rx): page-aligned payload is
+// mapped straight from the socket receive queue into a per-thread mmap
+// window, and only the unaligned remainder is copied.
+//
+// With --rpc the client instead sends an RpcRequest and times the round trip
+// to the end of the reply. --rate turns that into an open-loop generator:
+// requests are issued on a fixed schedule whether or not earlier replies
+// have arrived, and latency is measured from each request's *intended* send
+// time, so a stalled server cannot hide its queueing delay by slowing the
+// client down (coordinated omission).
+//
+// --recv-batch=K is the receive side of server --batch: each recv() drains
+// up to K messages' worth of whatever is queued instead of stopping at every
+// field, and the messages one call completes share the time since the
+// previous completion. Every mode reports receive syscalls per message.
+//
+// --frame expects the server's --frame stream: message boundaries come from
+// the headers, and every message's sequence number, length and CRC-32C are
+// checked as it arrives (see MT25020_Frame.h). Any mismatch is counted and
+// reported on the Integrity line.
+//
+// --rx-timestamps reads with recvmsg() to get the kernel's software RX
+// timestamp of the last segment each read returned, and reports how long
+// completed messages sat between the receive stack and the application
+// (wire-to-app). Together with the server's --tx-timestamps this splits
+// the latency into its kernel and application parts (MT25020_Timestamp.h).
+//
+// --udp receives a server --udp flow per thread with recvmmsg(), up to
+// --recv-batch buffers per call, coalesced by UDP_GRO with --gro. Latency
+// is then the one-way delay from the sender building a message to its last
+// datagram arriving, and loss and reordering come from the datagram
+// sequence numbers (MT25020_Udp.h).
+//
+// --ktls puts every connection into kernel TLS with the server's fixed test
+// keys (MT25020_Tls.h), so recv() returns data the kernel has already
+// decrypted and every receive mode measures the cost of TLS.
+//
+// --churn=N measures connection setup instead of steady streaming: every
+// thread connects, takes N messages (or N --rpc replies), closes, and
+// starts over. Latency is then connect-to-first-byte, with the connect()
+// (handshake) time reported beside it, and the rate is connections per
+// second. --fastopen sends the first --rpc request in the SYN. The client
+// closes first and keeps every TIME_WAIT socket, so beyond loopback the
+// rate relies on net.ipv4.tcp_tw_reuse=1 to get its ports back.
+//
+// --pipeline receives a server --pipeline stream: each thread reads framed
+// blocks and hands them to shared decompressor threads, which check them
+// and record the latency from production to decoding (MT25020_Pipeline.h).
+
+#include "MT25020_Common.h"
+#include "MT25020_Histogram.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Stats.h"
+#include "MT25020_Series.h"
+#include "MT25020_Frame.h"
+#include "MT25020_Timestamp.h"
+#include "MT25020_Udp.h"
+#include "MT25020_Tls.h"
+#include "MT25020_Pipeline.h"
+#include <math.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE 35
+#endif
+
+// Full kernel layout of struct tcp_zerocopy_receive; glibc only declares
+// the first three fields, and copybuf is what lets the kernel copy the
+// unaligned tail for us in the same call.
+typedef struct {
+    uint64_t address;
+    uint32_t length;
+    uint32_t recv_skip_hint;
+    uint32_t inq;
+    int32_t err;
+    uint64_t copybuf_address;
+    int32_t copybuf_len;
+    uint32_t flags;
+    uint64_t msg_control;
+    uint64_t msg_controllen;
+    uint32_t msg_flags;
+    uint32_t reserved;
+} TcpZcReceive;
+
+#define ZC_RX_WINDOW (2 << 20)      // bytes of address space mapped per call
+#define ZC_RX_COPYBUF (64 << 10)    // kernel-copied tail buffer
+
+#define RPC_MAX_OUTSTANDING 4096    // requests in flight per connection
+#define RPC_RECV_CHUNK (64 << 10)
+
+#define CHURN_RX_TIMEOUT_MS 100     // --churn: recv() wait between duration checks
+
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+
+#define EPOLL_CLIENT_MAX_EVENTS 256
+#define EPOLL_CLIENT_CHUNK (64 << 10)
+#define EPOLL_CLIENT_READ_BUDGET (256 << 10)    // bytes per connection per wake-up
+
+typedef struct {
+    char *server_ip;
+    int port;
+    int message_size;
+    int num_threads;
+    int duration;
+    int zerocopy_rx;        // receive with TCP_ZEROCOPY_RECEIVE
+    const char *hist_out;   // dump the merged latency histogram here
+    int rpc;                // request/response instead of streaming
+    double rate;            // --rpc open-loop target, requests/s over all threads
+    int poisson;            // exponential inter-arrival times (else constant)
+    int workers;            // >0: epoll worker threads multiplexing the connections
+    int perf_counters;      // per-thread perf_event_open counters
+    const char *json_out;   // append a structured run record here
+    const char *label;      // implementation name stored in the record
+    int rep;                // repetition number stored in the record
+    int interval_ms;        // >0: per-connection throughput time series
+    const char *series_out; // write the time series here (CSV)
+    int recv_batch;         // >1: drain up to this many messages per recv()
+    int frame;              // verify the server's --frame headers and payload CRCs
+    int rx_timestamps;      // kernel RX timestamps: wire-to-app per message
+    int udp;                // receive a server --udp flow instead of a TCP stream
+    int gro;                // --udp: let the kernel coalesce datagrams (UDP_GRO)
+    int ktls;               // decrypt (and encrypt requests) with kernel TLS
+    int pipeline;           // >0: hand received blocks to this many decompressor threads
+    int churn;              // >0: reconnect after this many messages (or --rpc replies)
+    int fastopen;           // --churn --rpc: send the first request in the SYN
+} ClientOptions;
+
+static inline void client_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s <server_ip> <port> <message_size> <num_connections> [options]\n"
+            "  --zerocopy-rx   map received pages with TCP_ZEROCOPY_RECEIVE, copy only the tail\n"
+            "  --hist-out=FILE write the merged latency histogram in mergeable text form\n"
+            "  --rpc           request/response: one request per message, latency = round trip\n"
+            "  --rate=R        open loop: issue R requests/s in total (implies --rpc)\n"
+            "  --arrival=KIND  open-loop inter-arrival times: poisson (default) or constant\n"
+            "  --workers=N     drive the connections from N epoll threads instead of one\n"
+            "                  thread per connection\n"
+            "  --perf          count cycles, instructions, cache misses, ... per thread\n"
+            "  --duration=S    measure for S seconds (default %d)\n"
+            "  --json=FILE     append this run's metrics as one JSON record\n"
+            "  --label=NAME    implementation name for the record (default: server ip:port)\n"
+            "  --rep=N         repetition number for the record\n"
+            "  --interval=MS   sample per-connection throughput every MS ms (1-1000)\n"
+            "  --series-out=FILE write the time series as CSV (default interval 100 ms)\n"
+            "  --recv-batch=K  drain up to K messages per recv() (1-%d, streaming recv only)\n"
+            "  --frame         expect framed messages (server --frame) and verify their\n"
+            "                  sequence numbers and CRC-32C\n"
+            "  --rx-timestamps report wire-to-app time per message from kernel RX\n"
+            "                  timestamps (streaming recv only)\n"
+            "  --udp           receive a server --udp flow per connection with recvmmsg()\n"
+            "                  (--recv-batch: buffers per call) and report loss/reordering\n"
+            "  --gro           --udp: receive coalesced datagram runs (UDP_GRO)\n"
+            "  --ktls          decrypt in the kernel with the server's --ktls test keys\n"
+            "  --pipeline[=D]  receive server --pipeline blocks and decode them on D\n"
+            "                  decompressor threads (default 1)\n"
+            "  --churn=N       connect, receive N messages (--rpc: N replies), close, repeat;\n"
+            "                  reports connections/s and connect-to-first-byte latency\n"
+            "  --fastopen      --churn --rpc: send the first request in the SYN (TCP Fast Open)\n",
+            prog, DURATION_SEC, MAX_BATCH);
+}
+
+// Returns 0 on success, -1 on bad arguments (usage already printed).
+static inline int parse_client_options(int argc, char *argv[], ClientOptions *opts) {
+    static const struct option long_opts[] = {
+        {"zerocopy-rx", no_argument, NULL, 'z'},
+        {"hist-out", required_argument, NULL, 'o'},
+        {"rpc", no_argument, NULL, 'R'},
+        {"rate", required_argument, NULL, 'r'},
+        {"arrival", required_argument, NULL, 'a'},
+        {"workers", required_argument, NULL, 'w'},
+        {"perf", no_argument, NULL, 'P'},
+        {"duration", required_argument, NULL, 'd'},
+        {"json", required_argument, NULL, 'j'},
+        {"label", required_argument, NULL, 'l'},
+        {"rep", required_argument, NULL, 'n'},
+        {"interval", required_argument, NULL, 'I'},
+        {"series-out", required_argument, NULL, 's'},
+        {"recv-batch", required_argument, NULL, 'B'},
+        {"frame", no_argument, NULL, 'F'},
+        {"rx-timestamps", no_argument, NULL, 'T'},
+        {"udp", no_argument, NULL, 'u'},
+        {"gro", no_argument, NULL, 'G'},
+        {"ktls", no_argument, NULL, 'k'},
+        {"pipeline", optional_argument, NULL, 'p'},
+        {"churn", required_argument, NULL, 'c'},
+        {"fastopen", no_argument, NULL, 'O'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(opts, 0, sizeof(*opts));
+    opts->duration = DURATION_SEC;
+    opts->poisson = 1;
+    opts->recv_batch = 1;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'z':
+            opts->zerocopy_rx = 1;
+            break;
+        case 'o':
+            opts->hist_out = optarg;
+            break;
+        case 'R':
+            opts->rpc = 1;
+            break;
+        case 'r':
+            opts->rate = atof(optarg);
+            opts->rpc = 1;
+            if (opts->rate <= 0) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'a':
+            if (strcmp(optarg, "poisson") == 0) opts->poisson = 1;
+            else if (strcmp(optarg, "constant") == 0) opts->poisson = 0;
+            else {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'P':
+            opts->perf_counters = 1;
+            break;
+        case 'w':
+            opts->workers = atoi(optarg);
+            if (opts->workers <= 0) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'd':
+            opts->duration = atoi(optarg);
+            if (opts->duration <= 0) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'j':
+            opts->json_out = optarg;
+            break;
+        case 'l':
+            opts->label = optarg;
+            break;
+        case 'n':
+            opts->rep = atoi(optarg);
+            break;
+        case 'I':
+            opts->interval_ms = atoi(optarg);
+            if (opts->interval_ms <= 0 || opts->interval_ms > 1000) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 's':
+            opts->series_out = optarg;
+            break;
+        case 'B':
+            opts->recv_batch = atoi(optarg);
+            if (opts->recv_batch < 1 || opts->recv_batch > MAX_BATCH) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'F':
+            opts->frame = 1;
+            break;
+        case 'T':
+            opts->rx_timestamps = 1;
+            break;
+        case 'u':
+            opts->udp = 1;
+            break;
+        case 'G':
+            opts->gro = 1;
+            break;
+        case 'k':
+            opts->ktls = 1;
+            break;
+        case 'p':
+            opts->pipeline = optarg ? atoi(optarg) : 1;
+            if (opts->pipeline <= 0) opts->pipeline = 1;
+            break;
+        case 'c':
+            opts->churn = atoi(optarg);
+            if (opts->churn <= 0) {
+                client_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'O':
+            opts->fastopen = 1;
+            break;
+        default:
+            client_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - optind != 4) {
+        client_usage(argv[0]);
+        return -1;
+    }
+    opts->server_ip = argv[optind];
+    opts->port = atoi(argv[optind + 1]);
+    opts->message_size = atoi(argv[optind + 2]);
+    opts->num_threads = atoi(argv[optind + 3]);
+    if (opts->message_size < NUM_FIELDS || opts->num_threads <= 0) {
+        client_usage(argv[0]);
+        return -1;
+    }
+    if (opts->rpc && opts->message_size % NUM_FIELDS != 0) {
+        fprintf(stderr, "--rpc needs a message size that is a multiple of %d\n", NUM_FIELDS);
+        return -1;
+    }
+    if (opts->workers > 0 && (opts->rpc || opts->zerocopy_rx)) {
+        fprintf(stderr, "--workers only supports the streaming recv() receiver\n");
+        return -1;
+    }
+    if (opts->workers > opts->num_threads) opts->workers = opts->num_threads;
+    if (opts->series_out && opts->interval_ms == 0) opts->interval_ms = 100;
+    if (opts->rpc && opts->zerocopy_rx) {
+        fprintf(stderr, "--zerocopy-rx is not used in --rpc mode\n");
+        opts->zerocopy_rx = 0;
+    }
+    if (opts->recv_batch > 1 && (opts->rpc || opts->zerocopy_rx || opts->workers > 0 ||
+                                 opts->pipeline || opts->churn)) {
+        fprintf(stderr, "--recv-batch only applies to the streaming recv() receiver; ignored\n");
+        opts->recv_batch = 1;
+    }
+    if (opts->frame && opts->rpc) {
+        fprintf(stderr, "--frame only applies to streaming; ignored with --rpc\n");
+        opts->frame = 0;
+    }
+    if (opts->frame && opts->zerocopy_rx) {
+        // Mapped pages are never read, so there is nothing to verify.
+        fprintf(stderr, "--frame needs the payload in user memory; not with --zerocopy-rx\n");
+        return -1;
+    }
+    if (opts->udp && (opts->rpc || opts->zerocopy_rx || opts->workers > 0 || opts->rx_timestamps)) {
+        fprintf(stderr, "--udp has its own receiver; not with --rpc/--zerocopy-rx/--workers/"
+                        "--rx-timestamps\n");
+        return -1;
+    }
+    if (opts->ktls && (opts->udp || opts->zerocopy_rx || opts->rx_timestamps)) {
+        // Decrypted records are copied out of the TLS layer: there are no
+        // socket pages to map and no per-segment timestamps.
+        fprintf(stderr, "--ktls only supports copying TCP receives; not with --udp/"
+                        "--zerocopy-rx/--rx-timestamps\n");
+        return -1;
+    }
+    if (opts->pipeline && (opts->rpc || opts->zerocopy_rx || opts->workers > 0 || opts->udp ||
+                           opts->rx_timestamps)) {
+        fprintf(stderr, "--pipeline has its own receiver; not with --rpc/--zerocopy-rx/--workers/"
+                        "--udp/--rx-timestamps\n");
+        return -1;
+    }
+    if (opts->churn && (opts->rate > 0 || opts->zerocopy_rx || opts->workers > 0 || opts->udp ||
+                        opts->rx_timestamps || opts->pipeline)) {
+        fprintf(stderr, "--churn has its own closed-loop receiver; not with --rate/--zerocopy-rx/"
+                        "--workers/--udp/--rx-timestamps/--pipeline\n");
+        return -1;
+    }
+    if (opts->fastopen && (!opts->churn || !opts->rpc)) {
+        // Only a request can ride in the SYN, and only reconnects use it.
+        fprintf(stderr, "--fastopen only applies to --churn --rpc; ignored\n");
+        opts->fastopen = 0;
+    }
+    if (opts->fastopen && opts->ktls) {
+        // TLS keys go onto an established socket; fast open defers the
+        // handshake to the first send.
+        fprintf(stderr, "--fastopen cannot be combined with --ktls\n");
+        return -1;
+    }
+    if (opts->gro && !opts->udp) {
+        fprintf(stderr, "--gro only applies to --udp; ignored\n");
+        opts->gro = 0;
+    }
+    if (opts->rx_timestamps && (opts->rpc || opts->zerocopy_rx || opts->workers > 0)) {
+        fprintf(stderr, "--rx-timestamps only applies to the streaming recv() receiver; ignored\n");
+        opts->rx_timestamps = 0;
+    }
+    return 0;
+}
+
+typedef struct {
+    int thread_id;
+    int fd;                     // already-connected socket, or -1 to connect
+    char *server_ip;
+    int port;
+    int message_size;
+    int duration;
+    double *throughput;
+    double *latency;
+    long long *bytes_sent;
+    long long *rx_zerocopy;
+    long long *rx_copied;
+    long long *requests;        // --rpc: replies completed
+    long long *syscalls;        // receive-path system calls
+    long long *connects;        // --churn: connections completed
+    long long *connect_failures;    // --churn: connections refused or cut short
+    FrameCounts *integrity;     // --frame: per-connection verification results
+    UdpRxCounts *udp;           // --udp: per-connection datagram accounting
+    LatencyHistogram *hist;     // this thread's histogram, merged by main
+    LatencyHistogram *rx_hist;  // --rx-timestamps: this thread's wire-to-app times
+    LatencyHistogram *connect_hist; // --churn: this thread's connect() times
+    PerfCounters *perf;         // this thread's counter deltas, summed by main
+    ThroughputSeries *series;   // shared; this thread writes its connections' rows
+    PipeClient *pipe;           // --pipeline: decompressor stage shared by all threads
+    const ClientOptions *opts;
+} ClientThreadArgs;
+
+// --- TCP_ZEROCOPY_RECEIVE reader ---
+
+typedef struct {
+    int sock;
+    char *window;               // PROT_READ mapping of the socket
+    size_t mapped_avail;        // mapped bytes not consumed yet
+    char *copybuf;
+    size_t copy_avail;          // kernel-copied bytes not consumed yet
+    long long bytes_zerocopy;
+    long long bytes_copied;
+} ZcRx;
+
+static inline int zc_rx_init(ZcRx *rx, int sock) {
+    memset(rx, 0, sizeof(*rx));
+    rx->sock = sock;
+    rx->window = mmap(NULL, ZC_RX_WINDOW, PROT_READ, MAP_SHARED, sock, 0);
+    if (rx->window == MAP_FAILED) return -1;
+    rx->copybuf = (char*)malloc(ZC_RX_COPYBUF);
+    if (!rx->copybuf) {
+        munmap(rx->window, ZC_RX_WINDOW);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void zc_rx_free(ZcRx *rx) {
+    munmap(rx->window, ZC_RX_WINDOW);
+    free(rx->copybuf);
+}
+
+// Consume up to `want` bytes from the stream. Returns bytes consumed,
+// 0 on EOF, -1 on error.
+static inline ssize_t zc_rx_read(ZcRx *rx, size_t want) {
+    while (1) {
+        if (rx->mapped_avail > 0) {
+            size_t n = want < rx->mapped_avail ? want : rx->mapped_avail;
+            rx->mapped_avail -= n;
+            rx->bytes_zerocopy += n;
+            return n;
+        }
+        if (rx->copy_avail > 0) {
+            size_t n = want < rx->copy_avail ? want : rx->copy_avail;
+            rx->copy_avail -= n;
+            rx->bytes_copied += n;
+            return n;
+        }
+
+        // Remap the window over the next page-aligned part of the receive
+        // queue; the kernel zaps the previous mapping in the same call.
+        TcpZcReceive zc;
+        memset(&zc, 0, sizeof(zc));
+        zc.address = (uint64_t)(unsigned long)rx->window;
+        zc.length = ZC_RX_WINDOW;
+        zc.copybuf_address = (uint64_t)(unsigned long)rx->copybuf;
+        zc.copybuf_len = ZC_RX_COPYBUF;
+        socklen_t len = sizeof(zc);
+        if (getsockopt(rx->sock, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &len) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (zc.err) {
+            errno = -zc.err;
+            return -1;
+        }
+
+        rx->mapped_avail = zc.length;
+        if (zc.copybuf_len > 0) rx->copy_avail = zc.copybuf_len;
+        if (rx->mapped_avail || rx->copy_avail) continue;
+
+        if (zc.recv_skip_hint == 0) {
+            // Nothing queued: wait for data. On hangup fall through to
+            // recv(), which drains what is left and reports EOF.
+            struct pollfd pfd = { .fd = rx->sock, .events = POLLIN | POLLRDHUP };
+            if (poll(&pfd, 1, -1) < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (!(pfd.revents & (POLLHUP | POLLRDHUP | POLLERR))) continue;
+        }
+
+        // Unaligned data the kernel neither mapped nor copied: read it.
+        size_t chunk = zc.recv_skip_hint ? zc.recv_skip_hint : want;
+        if (chunk > want) chunk = want;
+        if (chunk > ZC_RX_COPYBUF) chunk = ZC_RX_COPYBUF;
+        ssize_t n = recv(rx->sock, rx->copybuf, chunk, 0);
+        if (n > 0) rx->bytes_copied += n;
+        return n;
+    }
+}
+
+// --- Per-connection receive loop ---
+
+static inline int client_connect(const ClientThreadArgs *args) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(args->port);
+    inet_pton(AF_INET, args->server_ip, &server_addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Connect failed");
+        close(sock);
+        return -1;
+    }
+    if (args->opts->ktls && ktls_enable(sock, KTLS_CLIENT) < 0) {
+        perror("Kernel TLS setup failed");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// recv() that also keeps the RX timestamp when `rxs` is non-NULL.
+static inline ssize_t client_recv(int sock, void *buf, size_t len, RxStamps *rxs) {
+    return rxs ? rx_stamps_recv(rxs, sock, buf, len) : recv(sock, buf, len, 0);
+}
+
+void* client_thread(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    int sock = args->fd >= 0 ? args->fd : client_connect(args);
+    if (sock < 0) return NULL;
+
+    int field_size = args->message_size / NUM_FIELDS;
+    // --frame: a message on the wire is its header plus the payload, and a
+    // non-draining recv() may take the header together with the first field.
+    int framed = opts->frame;
+    size_t record = args->message_size + (framed ? sizeof(FrameHeader) : 0);
+    size_t chunk = field_size + (framed ? sizeof(FrameHeader) : 0);
+    size_t drain = opts->recv_batch > 1 ? record * opts->recv_batch : 0;
+    char *buffer = (char*)malloc(drain ? drain : chunk);
+    if (!buffer) {
+        close(sock);
+        return NULL;
+    }
+
+    ZcRx rx;
+    int zerocopy = opts->zerocopy_rx;
+    if (zerocopy && zc_rx_init(&rx, sock) < 0) {
+        perror("TCP_ZEROCOPY_RECEIVE unavailable, falling back to recv");
+        zerocopy = 0;
+    }
+
+    LatencyHistogram *hist = args->hist;
+    long long bytes_received = 0;
+    long long syscalls = 0;
+    size_t partial = 0;         // --recv-batch: bytes of an unfinished message
+    FrameParser fp;
+    frame_parser_init(&fp, args->message_size);
+    RxStamps rx_stamps;
+    RxStamps *rxs = NULL;
+    if (args->rx_hist && rx_stamps_init(&rx_stamps, sock, args->rx_hist) == 0) rxs = &rx_stamps;
+    perf_counters_open(args->perf, opts->perf_counters);
+
+    // One clock read per message: the end of one message is the start of
+    // the next, and the same timestamp drives the duration check.
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+    series_start(args->series, now);
+    long long last_done = now;
+
+    while (now < end_ns) {
+        long long msg_start = now;
+
+        if (drain) {
+            ssize_t n = client_recv(sock, buffer, drain - partial, rxs);
+            syscalls++;
+            if (n <= 0) goto done;
+            bytes_received += n;
+            now = get_time_ns();
+            long long completed;
+            if (framed) {
+                completed = frame_parse(&fp, buffer, n);
+                if (completed < 0) {
+                    now = get_time_ns();
+                    break;
+                }
+            } else {
+                partial += n;
+                completed = partial / record;
+                partial %= record;
+            }
+            if (completed > 0) {
+                hist_record_n(hist, (now - last_done) / completed, completed);
+                series_record(args->series, args->thread_id, now, completed * record);
+                frame_settle(&fp, now);
+                if (rxs) rx_stamps_complete(rxs, now, completed);
+                last_done = now;
+            }
+            continue;
+        }
+
+        if (framed) {
+            // Never read past the current frame, so each message gets its
+            // own completion timestamp.
+            long completed = 0;
+            while (completed == 0) {
+                size_t want = frame_remaining(&fp);
+                if (want > chunk) want = chunk;
+                ssize_t n = client_recv(sock, buffer, want, rxs);
+                syscalls++;
+                if (n <= 0) goto done;
+                bytes_received += n;
+                completed = frame_parse(&fp, buffer, n);
+            }
+            if (completed < 0) {
+                now = get_time_ns();
+                break;
+            }
+        } else if (zerocopy) {
+            size_t received = 0;
+            while (received < (size_t)args->message_size) {
+                ssize_t n = zc_rx_read(&rx, args->message_size - received);
+                if (n <= 0) goto done;
+                received += n;
+            }
+            bytes_received += received;
+        } else {
+            for (int i = 0; i < NUM_FIELDS; i++) {
+                ssize_t received = 0;
+                while (received < field_size) {
+                    ssize_t n = client_recv(sock, buffer + received, field_size - received, rxs);
+                    syscalls++;
+                    if (n <= 0) goto done;
+                    received += n;
+                }
+                bytes_received += received;
+            }
+        }
+
+        now = get_time_ns();
+        hist_record(hist, now - msg_start);
+        series_record(args->series, args->thread_id, now, record);
+        frame_settle(&fp, now);
+        if (rxs) rx_stamps_complete(rxs, now, 1);
+    }
+
+    double elapsed = (now - start_ns) / 1e9;
+
+    args->throughput[args->thread_id] = (bytes_received * 8.0) / (elapsed * 1e9);
+    args->latency[args->thread_id] = hist_mean(hist) / 1000.0;
+    args->bytes_sent[args->thread_id] = bytes_received;
+    args->syscalls[args->thread_id] = syscalls;
+    if (framed) args->integrity[args->thread_id] = fp.counts;
+    if (zerocopy) {
+        args->rx_zerocopy[args->thread_id] = rx.bytes_zerocopy;
+        args->rx_copied[args->thread_id] = rx.bytes_copied;
+    }
+
+done:
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+    if (zerocopy) zc_rx_free(&rx);
+    free(buffer);
+    close(sock);
+    return NULL;
+}
+
+// --- Request/response loop (--rpc, --rate) ---
+
+// Gap to the next intended send time, in ns.
+static inline long long rpc_interarrival_ns(double rate, int poisson, unsigned short seed[3]) {
+    double mean = 1e9 / rate;
+    if (!poisson) return (long long)mean;
+    return (long long)(-log(1.0 - erand48(seed)) * mean);
+}
+
+static inline int send_all(int sock, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(sock, (const char*)buf + done, len - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+void* rpc_client_thread(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    int sock = client_connect(args);
+    if (sock < 0) return NULL;
+
+    // Requests are tiny; don't let Nagle hold them behind an unacked one.
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    char *buffer = (char*)malloc(RPC_RECV_CHUNK);
+    long long *intended = (long long*)malloc(RPC_MAX_OUTSTANDING * sizeof(long long));
+    if (!buffer || !intended) {
+        free(buffer);
+        free(intended);
+        close(sock);
+        return NULL;
+    }
+
+    // Each connection carries an equal share of the target rate.
+    double rate = opts->rate / opts->num_threads;
+    unsigned short seed[3] = { (unsigned short)args->thread_id, (unsigned short)getpid(),
+                               (unsigned short)get_time_ns() };
+
+    LatencyHistogram *hist = args->hist;
+    RpcRequest req = { RPC_MAGIC, (uint32_t)args->message_size, 0 };
+    long long sent = 0, completed = 0;
+    long long bytes_received = 0;
+    long long syscalls = 0;
+    size_t partial = 0;         // bytes of the oldest outstanding reply received
+
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+    series_start(args->series, now);
+    long long next_send = now;
+    perf_counters_open(args->perf, opts->perf_counters);
+
+    while (now < end_ns) {
+        // Issue every request that is due. Closed loop: only when idle.
+        // Open loop: catch up on the schedule, so a stall produces a burst
+        // whose latency still counts from the original intended times.
+        while (sent - completed < RPC_MAX_OUTSTANDING &&
+               (rate > 0 ? next_send <= now : sent == completed)) {
+            intended[sent % RPC_MAX_OUTSTANDING] = rate > 0 ? next_send : now;
+            req.id = sent++;
+            if (send_all(sock, &req, sizeof(req)) < 0) goto done;
+            syscalls++;
+            if (rate > 0) next_send += rpc_interarrival_ns(rate, opts->poisson, seed);
+        }
+
+        // Wait for reply bytes, but no longer than the next scheduled send.
+        long long wake = end_ns;
+        if (rate > 0 && sent - completed < RPC_MAX_OUTSTANDING && next_send < wake)
+            wake = next_send;
+        struct timespec ts = { (wake - now) / 1000000000LL, (wake - now) % 1000000000LL };
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int ready = ppoll(&pfd, 1, &ts, NULL);
+        if (ready < 0 && errno != EINTR) goto done;
+
+        if (ready > 0) {
+            ssize_t n = recv(sock, buffer, RPC_RECV_CHUNK, MSG_DONTWAIT);
+            syscalls++;
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) goto done;
+            now = get_time_ns();
+            if (n > 0) {
+                bytes_received += n;
+                series_record(args->series, args->thread_id, now, n);
+                partial += n;
+                // Replies arrive in request order; one read may finish several.
+                while (partial >= (size_t)args->message_size && completed < sent) {
+                    partial -= args->message_size;
+                    hist_record(hist, now - intended[completed % RPC_MAX_OUTSTANDING]);
+                    completed++;
+                }
+            }
+            continue;
+        }
+        now = get_time_ns();
+    }
+
+    double elapsed = (now - start_ns) / 1e9;
+
+    args->throughput[args->thread_id] = (bytes_received * 8.0) / (elapsed * 1e9);
+    args->latency[args->thread_id] = hist_mean(hist) / 1000.0;
+    args->bytes_sent[args->thread_id] = bytes_received;
+    args->requests[args->thread_id] = completed;
+    args->syscalls[args->thread_id] = syscalls;
+
+done:
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+    free(intended);
+    free(buffer);
+    close(sock);
+    return NULL;
+}
+
+// --- Connection churn (--churn) ---
+
+// One churn connection: socket(), then connect(). With --fastopen the
+// connect() returns at once and the first send() carries the request in
+// the SYN (or a normal handshake while there is no cookie yet).
+static inline int churn_connect(const ClientThreadArgs *args, const struct sockaddr_in *server) {
+    const ClientOptions *opts = args->opts;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct timeval tv = { 0, CHURN_RX_TIMEOUT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    if (opts->rpc) setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (opts->fastopen && setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one)) < 0) {
+        close(sock);
+        return -1;
+    }
+    if (connect(sock, (const struct sockaddr*)server, sizeof(*server)) < 0 ||
+        (opts->ktls && ktls_enable(sock, KTLS_CLIENT) < 0)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Receive and discard `len` bytes, noting when the first one arrived.
+// Returns 1, 0 once `end_ns` passes first, or -1 on EOF or error.
+static inline int churn_recv(int sock, char *buffer, size_t len, long long end_ns,
+                             long long *first_ns, long long *syscalls) {
+    while (len > 0) {
+        ssize_t n = recv(sock, buffer, len < RPC_RECV_CHUNK ? len : RPC_RECV_CHUNK, 0);
+        (*syscalls)++;
+        if (n > 0) {
+            if (*first_ns == 0) *first_ns = get_time_ns();
+            len -= n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (get_time_ns() >= end_ns) return 0;
+            continue;
+        }
+        return -1;
+    }
+    return 1;
+}
+
+// Closed loop over short-lived connections: connect, take --churn messages
+// (or --rpc replies, one request at a time), close, and again. Latency is
+// from socket() to the first byte of the first message, so it covers the
+// handshake, the server's accept and handler start-up, and its first send.
+void* churn_client_thread(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(args->port);
+    inet_pton(AF_INET, args->server_ip, &server.sin_addr);
+
+    char *buffer = (char*)malloc(RPC_RECV_CHUNK);
+    if (!buffer) return NULL;
+    // --frame: a streamed message is its header plus the payload.
+    size_t record = args->message_size + (opts->frame && !opts->rpc ? sizeof(FrameHeader) : 0);
+    RpcRequest req = { RPC_MAGIC, (uint32_t)args->message_size, 0 };
+    LatencyHistogram *hist = args->hist;
+    long long bytes_received = 0;
+    long long syscalls = 0;
+    long long connects = 0;
+    long long failures = 0;
+    perf_counters_open(args->perf, opts->perf_counters);
+
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+    series_start(args->series, now);
+    while (now < end_ns) {
+        long long t0 = now;
+        int sock = churn_connect(args, &server);
+        syscalls += 2;
+        if (sock < 0) {
+            // Refused, or out of ephemeral ports: back off instead of spinning.
+            failures++;
+            usleep(1000);
+            now = get_time_ns();
+            continue;
+        }
+        now = get_time_ns();
+        hist_record(args->connect_hist, now - t0);
+
+        long long first_ns = 0;
+        int rc = 1;
+        if (opts->rpc) {
+            for (int k = 0; k < opts->churn && rc > 0; k++) {
+                req.id = k;
+                rc = send_all(sock, &req, sizeof(req)) < 0 ? -1 : 1;
+                syscalls++;
+                if (rc > 0) rc = churn_recv(sock, buffer, args->message_size, end_ns, &first_ns,
+                                            &syscalls);
+            }
+        } else {
+            rc = churn_recv(sock, buffer, record * opts->churn, end_ns, &first_ns, &syscalls);
+        }
+        close(sock);
+        syscalls++;
+        now = get_time_ns();
+        if (rc == 0) break;     // the run ended mid-connection
+        if (rc < 0) {
+            failures++;
+            continue;
+        }
+        connects++;
+        bytes_received += record * opts->churn;
+        hist_record(hist, first_ns - t0);
+        series_record(args->series, args->thread_id, now, record * opts->churn);
+    }
+
+    double elapsed = (now - start_ns) / 1e9;
+    args->throughput[args->thread_id] = (bytes_received * 8.0) / (elapsed * 1e9);
+    args->latency[args->thread_id] = hist_mean(hist) / 1000.0;
+    args->bytes_sent[args->thread_id] = bytes_received;
+    args->syscalls[args->thread_id] = syscalls;
+    args->connects[args->thread_id] = connects;
+    args->connect_failures[args->thread_id] = failures;
+    if (opts->rpc) args->requests[args->thread_id] = connects * opts->churn;
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+    free(buffer);
+    return NULL;
+}
+
+// --- Event-driven client (--workers) ---
+
+// One worker thread multiplexes every connection i with i % workers == id.
+// Reads are level-triggered and capped per wake-up, so a fast connection
+// cannot starve the others; message boundaries are tracked per connection
+// exactly as the blocking loop does, and results land in the same
+// per-connection slots that client_thread fills.
+
+typedef struct {
+    int fd;
+    int index;                  // slot in the per-connection result arrays
+    int connected;
+    size_t partial;             // bytes of the current message received
+    FrameParser frame;          // --frame: boundaries and verification instead
+    long long start_ns;         // connect completion
+    long long end_ns;           // close, or 0 while open
+    long long msg_start_ns;
+    long long bytes;
+    long long messages;
+    long long syscalls;
+    double latency_sum_ns;
+} EpollClientConn;
+
+static inline void epoll_client_close(int epfd, EpollClientConn *c, long long now) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->end_ns = now;
+}
+
+// Returns 0 if the connection stays open, -1 if the peer went away (or,
+// with --frame, the stream could not be parsed).
+static inline int epoll_client_read(EpollClientConn *c, char *buffer, int message_size,
+                                    int framed, LatencyHistogram *hist,
+                                    ThroughputSeries *series) {
+    size_t record = message_size + (framed ? sizeof(FrameHeader) : 0);
+    size_t budget = EPOLL_CLIENT_READ_BUDGET;
+    while (budget > 0) {
+        // Never read past the current message, so each one gets its own
+        // completion timestamp like in the blocking loop.
+        size_t want = framed ? frame_remaining(&c->frame) : message_size - c->partial;
+        if (want > EPOLL_CLIENT_CHUNK) want = EPOLL_CLIENT_CHUNK;
+        ssize_t n = recv(c->fd, buffer, want, MSG_DONTWAIT);
+        c->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (n == 0) return -1;
+        c->bytes += n;
+        budget = (size_t)n < budget ? budget - n : 0;
+        long completed;
+        if (framed) {
+            completed = frame_parse(&c->frame, buffer, n);
+            if (completed < 0) return -1;
+        } else {
+            c->partial += n;
+            completed = c->partial == (size_t)message_size;
+            if (completed) c->partial = 0;
+        }
+        if (completed) {
+            long long now = get_time_ns();
+            hist_record(hist, now - c->msg_start_ns);
+            series_record(series, c->index, now, record);
+            frame_settle(&c->frame, now);
+            c->latency_sum_ns += now - c->msg_start_ns;
+            c->msg_start_ns = now;
+            c->messages++;
+        }
+    }
+    return 0;
+}
+
+void* epoll_client_worker(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    int workers = opts->workers;
+    int count = (opts->num_threads - args->thread_id + workers - 1) / workers;
+
+    EpollClientConn *conns = (EpollClientConn*)calloc(count, sizeof(EpollClientConn));
+    char *buffer = (char*)malloc(EPOLL_CLIENT_CHUNK);
+    int epfd = epoll_create1(0);
+    if (!conns || !buffer || epfd < 0) {
+        fprintf(stderr, "Worker %d setup failed\n", args->thread_id);
+        free(conns);
+        free(buffer);
+        if (epfd >= 0) close(epfd);
+        return NULL;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(args->port);
+    inet_pton(AF_INET, args->server_ip, &server_addr.sin_addr);
+
+    // Slots the loop below never reaches must not look like fd 0 (stdin)
+    // to the cleanup.
+    for (int i = 0; i < count; i++) conns[i].fd = -1;
+
+    // Start every connect at once; EPOLLOUT reports each completion.
+    int open_conns = 0;
+    for (int i = 0; i < count; i++) {
+        EpollClientConn *c = &conns[i];
+        c->index = args->thread_id + i * workers;
+        frame_parser_init(&c->frame, args->message_size);
+        c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (c->fd < 0) {
+            perror("Socket creation failed");
+            break;
+        }
+        if (connect(c->fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 &&
+            errno != EINPROGRESS) {
+            perror("Connect failed");
+            close(c->fd);
+            c->fd = -1;
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        open_conns++;
+    }
+
+    struct epoll_event events[EPOLL_CLIENT_MAX_EVENTS];
+    perf_counters_open(args->perf, opts->perf_counters);
+    long long now = get_time_ns();
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+
+    while (now < end_ns && open_conns > 0) {
+        int timeout_ms = (int)((end_ns - now + 999999) / 1000000);
+        int n = epoll_wait(epfd, events, EPOLL_CLIENT_MAX_EVENTS, timeout_ms);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait failed");
+            break;
+        }
+        now = get_time_ns();
+
+        for (int i = 0; i < n; i++) {
+            EpollClientConn *c = (EpollClientConn*)events[i].data.ptr;
+            if (!c->connected) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (!err && opts->ktls && ktls_enable(c->fd, KTLS_CLIENT) < 0) {
+                    perror("Kernel TLS setup failed");
+                    err = errno;
+                }
+                if (err || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                    fprintf(stderr, "Connect failed: %s\n", strerror(err ? err : ECONNRESET));
+                    epoll_client_close(epfd, c, now);
+                    open_conns--;
+                    continue;
+                }
+                c->connected = 1;
+                c->start_ns = c->msg_start_ns = now;
+                series_start(args->series, now);
+                struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+                epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                continue;
+            }
+            if (epoll_client_read(c, buffer, args->message_size, opts->frame, args->hist,
+                                  args->series) < 0) {
+                epoll_client_close(epfd, c, get_time_ns());
+                open_conns--;
+            }
+        }
+    }
+
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+
+    now = get_time_ns();
+    for (int i = 0; i < count; i++) {
+        EpollClientConn *c = &conns[i];
+        if (c->fd >= 0) epoll_client_close(epfd, c, now);
+        if (!c->connected) continue;
+        double elapsed = (c->end_ns - c->start_ns) / 1e9;
+        if (elapsed > 0) args->throughput[c->index] = (c->bytes * 8.0) / (elapsed * 1e9);
+        if (c->messages) args->latency[c->index] = c->latency_sum_ns / c->messages / 1000.0;
+        args->bytes_sent[c->index] = c->bytes;
+        args->syscalls[c->index] = c->syscalls;
+        if (opts->frame) args->integrity[c->index] = c->frame.counts;
+    }
+
+    close(epfd);
+    free(buffer);
+    free(conns);
+    return NULL;
+}
+
+// --- UDP receiver ---
+
+// Say hello until the flow starts. Returns 0 once a datagram is queued.
+static inline int udp_client_hello(int sock, const struct sockaddr_in *server) {
+    for (int i = 0; i < UDP_HELLO_TRIES; i++) {
+        if (udp_control_send(sock, server, UDP_HELLO) < 0) return -1;
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        if (poll(&pfd, 1, UDP_HELLO_WAIT_MS) > 0) return 0;
+    }
+    errno = ETIMEDOUT;
+    return -1;
+}
+
+void* udp_client_thread(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    int vlen = opts->recv_batch;
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(args->port);
+    inet_pton(AF_INET, args->server_ip, &server.sin_addr);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return NULL;
+    }
+    // UDP has no flow control: a deep queue absorbs the sender's bursts.
+    int rcvbuf = 8 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = { 0, UDP_RX_TIMEOUT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    if (opts->gro && setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+        perror("UDP_GRO unavailable, receiving datagrams one by one");
+
+    char *buffers = (char*)malloc((size_t)vlen * UDP_RX_BUFFER);
+    struct mmsghdr *msgs = (struct mmsghdr*)calloc(vlen, sizeof(struct mmsghdr));
+    struct iovec *iov = (struct iovec*)calloc(vlen, sizeof(struct iovec));
+    UdpGsoCmsg *cmsgs = (UdpGsoCmsg*)calloc(vlen, sizeof(UdpGsoCmsg));
+    if (!buffers || !msgs || !iov || !cmsgs) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        goto out;
+    }
+    if (udp_client_hello(sock, &server) < 0) {
+        fprintf(stderr, "No datagrams from %s:%d (is the server running with --udp?)\n",
+                args->server_ip, args->port);
+        goto out;
+    }
+
+    LatencyHistogram *hist = args->hist;
+    UdpRx rx;
+    udp_rx_init(&rx, (args->message_size / NUM_FIELDS) * NUM_FIELDS, opts->frame);
+    long long bytes_received = 0;
+    long long syscalls = 0;
+    perf_counters_open(args->perf, opts->perf_counters);
+
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+    series_start(args->series, now);
+    while (now < end_ns) {
+        for (int i = 0; i < vlen; i++) {
+            iov[i].iov_base = buffers + (size_t)i * UDP_RX_BUFFER;
+            iov[i].iov_len = UDP_RX_BUFFER;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = cmsgs[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(cmsgs[i].buf);
+        }
+        int n = recvmmsg(sock, msgs, vlen, MSG_WAITFORONE, NULL);
+        syscalls++;
+        now = get_time_ns();
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+            perror("recvmmsg failed");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            const char *buf = (const char*)iov[i].iov_base;
+            size_t len = msgs[i].msg_len;
+            // With GRO one buffer holds a run of datagrams of `seg` bytes,
+            // the last possibly shorter.
+            size_t seg = len;
+            for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm;
+                 cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+                if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                    int gso_size;
+                    memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+                    if (gso_size > 0) seg = gso_size;
+                }
+            }
+            rx.counts.buffers++;
+            for (size_t off = 0; off < len; off += seg) {
+                size_t dlen = len - off < seg ? len - off : seg;
+                int64_t send_ns;
+                int done = udp_rx_datagram(&rx, buf + off, dlen, &send_ns);
+                if (done < 0) continue;
+                bytes_received += dlen - sizeof(FrameHeader);
+                if (done) {
+                    hist_record(hist, now - send_ns);
+                    series_record(args->series, args->thread_id, now, rx.message_size);
+                }
+            }
+        }
+    }
+
+    double elapsed = (now - start_ns) / 1e9;
+    args->throughput[args->thread_id] = (bytes_received * 8.0) / (elapsed * 1e9);
+    args->latency[args->thread_id] = hist_mean(hist) / 1000.0;
+    args->bytes_sent[args->thread_id] = bytes_received;
+    args->syscalls[args->thread_id] = syscalls;
+    args->udp[args->thread_id] = rx.counts;
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+out:
+    udp_control_send(sock, &server, UDP_BYE);
+    close(sock);
+    free(cmsgs);
+    free(iov);
+    free(msgs);
+    free(buffers);
+    return NULL;
+}
+
+// --- Pipelined receiver (--pipeline) ---
+
+// Read exactly `len` bytes. Returns 1, 0 once `end_ns` passes first, or -1
+// on EOF or error. The socket's receive timeout bounds each wait.
+static inline int pipe_recv_exact(int sock, char *buf, size_t len, long long end_ns,
+                                  long long *syscalls) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(sock, buf + got, len - got, 0);
+        (*syscalls)++;
+        if (n > 0) {
+            got += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (get_time_ns() >= end_ns) return 0;
+            continue;
+        }
+        return -1;
+    }
+    return 1;
+}
+
+// Receive framed blocks and hand them to the decompressor threads, which
+// record each block's latency (produced to decoded) in this connection's
+// histogram. Throughput counts decoded bytes.
+void* pipe_client_thread(void* arg) {
+    ClientThreadArgs *args = (ClientThreadArgs*)arg;
+    const ClientOptions *opts = args->opts;
+    PipeClient *pc = args->pipe;
+    PipeClientConn *conn = &pc->conns[args->thread_id];
+    int sock = args->fd >= 0 ? args->fd : client_connect(args);
+    if (sock < 0) return NULL;
+    struct timeval tv = { 0, PIPE_RX_TIMEOUT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    conn->hist = args->hist;
+    long long bytes_received = 0;
+    long long bytes_decoded = 0;
+    long long syscalls = 0;
+    uint64_t next_seq = 0;
+    perf_counters_open(args->perf, opts->perf_counters);
+
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)args->duration * 1000000000LL;
+    series_start(args->series, now);
+    while (now < end_ns) {
+        FrameHeader hdr;
+        int rc = pipe_recv_exact(sock, (char*)&hdr, sizeof(hdr), end_ns, &syscalls);
+        if (rc <= 0) break;
+        long long t0 = get_time_ns();
+        if (hdr.magic != FRAME_MAGIC || hdr.length == 0 || hdr.length > PIPE_MAX_BLOCK ||
+            hdr.reserved > PIPE_MAX_BLOCK || hdr.length > lz_bound(hdr.reserved)) {
+            __atomic_fetch_add(&pc->framing_errors, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (hdr.seq != next_seq) __atomic_fetch_add(&pc->seq_errors, 1, __ATOMIC_RELAXED);
+        next_seq = hdr.seq + 1;
+
+        long long wait_ns = 0;
+        PipeBlock *b = pipe_pop(&pc->free, &wait_ns);
+        if (pipe_block_reserve(b, hdr.length, hdr.reserved) < 0) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            pipe_push(&pc->free, b, &wait_ns);
+            break;
+        }
+        rc = pipe_recv_exact(sock, b->wire, hdr.length, end_ns, &syscalls);
+        if (rc <= 0) {
+            pipe_push(&pc->free, b, &wait_ns);
+            break;
+        }
+        now = get_time_ns();
+        b->hdr = hdr;
+        b->conn = args->thread_id;
+        bytes_received += sizeof(hdr) + hdr.length;
+        bytes_decoded += hdr.reserved;
+        series_record(args->series, args->thread_id, now, hdr.reserved);
+        __atomic_fetch_add(&conn->pending, 1, __ATOMIC_RELAXED);
+        // Busy: taking the payload off the socket; waiting for a free block
+        // or for room in the decode queue counts as blocked.
+        long long busy_ns = now - t0 - wait_ns;
+        pipe_push(&pc->decode, b, &wait_ns);
+        now = get_time_ns();
+        pipe_stage_add(&pc->receive, sizeof(hdr) + hdr.length, hdr.reserved, busy_ns, wait_ns);
+    }
+    // The decompressors may still hold this connection's last blocks.
+    while (__atomic_load_n(&conn->pending, __ATOMIC_ACQUIRE) > 0) usleep(100);
+
+    double elapsed = (now - start_ns) / 1e9;
+    pthread_mutex_lock(&conn->lock);
+    args->throughput[args->thread_id] = (bytes_decoded * 8.0) / (elapsed * 1e9);
+    args->latency[args->thread_id] = hist_mean(conn->hist) / 1000.0;
+    pthread_mutex_unlock(&conn->lock);
+    args->bytes_sent[args->thread_id] = bytes_received;
+    args->syscalls[args->thread_id] = syscalls;
+    perf_counters_delta(args->perf);
+    perf_counters_close(args->perf);
+    close(sock);
+    return NULL;
+}
+
+// Thousands of connections need more descriptors than the default soft
+// limit; raise it as far as the hard limit allows.
+static inline void raise_fd_limit(int needed) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur >= (rlim_t)needed) return;
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t)needed
+                  ? (rlim_t)needed : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur < (rlim_t)needed)
+        fprintf(stderr, "Descriptor limit %ld is below %d connections\n",
+                (long)rl.rlim_cur, needed);
+}
+
+static inline int client_main(int argc, char *argv[]) {
+    ClientOptions opts;
+    if (parse_client_options(argc, argv, &opts) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (opts.ktls && !ktls_available()) {
+        exit(EXIT_FAILURE);
+    }
+    if (opts.fastopen) fastopen_enabled(FASTOPEN_CLIENT_BIT);
+
+    // Results are per connection; threads are one per connection, or the
+    // --workers event loops that multiplex them.
+    int num_conns = opts.num_threads;
+    int num_threads = opts.workers > 0 ? opts.workers : num_conns;
+    raise_fd_limit(num_conns + 64);
+
+    pthread_t *threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    ClientThreadArgs *args = (ClientThreadArgs*)calloc(num_threads, sizeof(ClientThreadArgs));
+    double *throughput = (double*)calloc(num_conns, sizeof(double));
+    double *latency = (double*)calloc(num_conns, sizeof(double));
+    long long *bytes_sent = (long long*)calloc(num_conns, sizeof(long long));
+    long long *rx_zerocopy = (long long*)calloc(num_conns, sizeof(long long));
+    long long *rx_copied = (long long*)calloc(num_conns, sizeof(long long));
+    long long *requests = (long long*)calloc(num_conns, sizeof(long long));
+    long long *syscalls = (long long*)calloc(num_conns, sizeof(long long));
+    long long *connects = (long long*)calloc(num_conns, sizeof(long long));
+    long long *connect_failures = (long long*)calloc(num_conns, sizeof(long long));
+    FrameCounts *integrity = (FrameCounts*)calloc(num_conns, sizeof(FrameCounts));
+    UdpRxCounts *udp = (UdpRxCounts*)calloc(num_conns, sizeof(UdpRxCounts));
+    // ~18 KB each: one per thread, not per connection.
+    LatencyHistogram *hists = (LatencyHistogram*)malloc(num_threads * sizeof(LatencyHistogram));
+    LatencyHistogram *rx_hists = opts.rx_timestamps ?
+        (LatencyHistogram*)malloc(num_threads * sizeof(LatencyHistogram)) : NULL;
+    LatencyHistogram *connect_hists = opts.churn ?
+        (LatencyHistogram*)malloc(num_threads * sizeof(LatencyHistogram)) : NULL;
+    PerfCounters *perf = (PerfCounters*)calloc(num_threads, sizeof(PerfCounters));
+    ThroughputSeries series;
+    if (!threads || !args || !throughput || !latency || !bytes_sent ||
+        !rx_zerocopy || !rx_copied || !requests || !syscalls || !integrity || !udp || !hists ||
+        !perf || !connects || !connect_failures ||
+        (opts.rx_timestamps && !rx_hists) || (opts.churn && !connect_hists) ||
+        series_init(&series, num_conns, opts.duration, opts.interval_ms) < 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    void *(*thread_fn)(void*) = client_thread;
+    if (opts.workers > 0) thread_fn = epoll_client_worker;
+    else if (opts.churn) thread_fn = churn_client_thread;
+    else if (opts.rpc) thread_fn = rpc_client_thread;
+    else if (opts.udp) thread_fn = udp_client_thread;
+    else if (opts.pipeline) thread_fn = pipe_client_thread;
+    PipeClient *pipe = NULL;
+    if (opts.pipeline && !(pipe = pipe_client_start(opts.pipeline, num_conns, opts.frame))) {
+        fprintf(stderr, "Failed to start the decompressor threads\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        hist_init(&hists[i]);
+        if (rx_hists) hist_init(&rx_hists[i]);
+        if (connect_hists) hist_init(&connect_hists[i]);
+
+        args[i].thread_id = i;
+        args[i].fd = -1;
+        args[i].server_ip = opts.server_ip;
+        args[i].port = opts.port;
+        args[i].message_size = opts.message_size;
+        args[i].duration = opts.duration;
+        args[i].throughput = throughput;
+        args[i].latency = latency;
+        args[i].bytes_sent = bytes_sent;
+        args[i].rx_zerocopy = rx_zerocopy;
+        args[i].rx_copied = rx_copied;
+        args[i].requests = requests;
+        args[i].syscalls = syscalls;
+        args[i].connects = connects;
+        args[i].connect_failures = connect_failures;
+        args[i].integrity = integrity;
+        args[i].udp = udp;
+        args[i].hist = &hists[i];
+        args[i].rx_hist = rx_hists ? &rx_hists[i] : NULL;
+        args[i].connect_hist = connect_hists ? &connect_hists[i] : NULL;
+        args[i].perf = &perf[i];
+        args[i].series = &series;
+        args[i].pipe = pipe;
+        args[i].opts = &opts;
+
+        if (pthread_create(&threads[i], NULL, thread_fn, &args[i]) != 0) {
+            fprintf(stderr, "Failed to start thread %d; running with %d\n", i, started);
+            break;
+        }
+        started++;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (pipe) pipe_client_stop(pipe);
+
+    double total_throughput = 0;
+    double avg_latency = 0;
+    long long total_bytes = 0;
+    long long total_zerocopy = 0;
+    long long total_copied = 0;
+    long long total_requests = 0;
+    long long total_syscalls = 0;
+    FrameCounts total_integrity;
+    memset(&total_integrity, 0, sizeof(total_integrity));
+    UdpRxCounts total_udp;
+    memset(&total_udp, 0, sizeof(total_udp));
+    LatencyHistogram merged;
+    hist_init(&merged);
+    LatencyHistogram rx_merged;
+    hist_init(&rx_merged);
+    LatencyHistogram connect_merged;
+    hist_init(&connect_merged);
+    long long total_connects = 0;
+    long long total_connect_failures = 0;
+    PerfCounters perf_total;
+    memset(&perf_total, 0, sizeof(perf_total));
+
+    for (int i = 0; i < started; i++) {
+        hist_merge(&merged, &hists[i]);
+        if (rx_hists) hist_merge(&rx_merged, &rx_hists[i]);
+        if (connect_hists) hist_merge(&connect_merged, &connect_hists[i]);
+        perf_counters_add(&perf_total, &perf[i]);
+    }
+    for (int i = 0; i < num_conns; i++) {
+        total_throughput += throughput[i];
+        avg_latency += latency[i];
+        total_bytes += bytes_sent[i];
+        total_zerocopy += rx_zerocopy[i];
+        total_copied += rx_copied[i];
+        total_requests += requests[i];
+        total_syscalls += syscalls[i];
+        total_connects += connects[i];
+        total_connect_failures += connect_failures[i];
+        frame_counts_add(&total_integrity, &integrity[i]);
+        udp_rx_counts_add(&total_udp, &udp[i]);
+    }
+    avg_latency /= num_conns;
+
+    printf("Throughput: %.6f Gbps\n", total_throughput);
+    printf("Latency: %.6f us\n", avg_latency);
+    printf("Total bytes: %lld\n", total_bytes);
+    if (opts.churn) {
+        printf("Churn: %lld connections (%.0f conn/s), %d %s each, %lld failed%s\n",
+               total_connects, (double)total_connects / opts.duration, opts.churn,
+               opts.rpc ? "replies" : "messages", total_connect_failures,
+               opts.fastopen ? ", fast open" : "");
+        hist_print_summary(stdout, "Connect-to-first-byte percentiles", &merged);
+        hist_print_summary(stdout, "Connect percentiles", &connect_merged);
+    } else {
+        hist_print_summary(stdout, "Latency percentiles", &merged);
+    }
+    fairness_print(stdout, throughput, num_conns);
+    if (series.bytes) {
+        series_print_summary(stdout, &series);
+        if (opts.series_out && series_write_csv(opts.series_out, &series) < 0)
+            perror("Failed to write time series");
+    }
+    if (opts.rpc) {
+        double achieved = (double)total_requests / opts.duration;
+        if (opts.rate > 0)
+            printf("Requests: %lld (%.0f req/s, target %.0f req/s %s)\n", total_requests,
+                   achieved, opts.rate, opts.poisson ? "poisson" : "constant");
+        else
+            printf("Requests: %lld (%.0f req/s, closed loop)\n", total_requests, achieved);
+    }
+    if (total_syscalls > 0)
+        printf("Syscalls: %lld (%.3f per %s)\n", total_syscalls,
+               merged.total ? (double)total_syscalls / merged.total : 0,
+               opts.churn ? "connection" : "message");
+    if (opts.zerocopy_rx) {
+        long long rx_total = total_zerocopy + total_copied;
+        printf("RX zero-copy bytes: %lld (%.1f%%)\n", total_zerocopy,
+               rx_total > 0 ? 100.0 * total_zerocopy / rx_total : 0);
+        printf("RX copied bytes: %lld\n", total_copied);
+    }
+    if (opts.udp) udp_rx_counts_print(stdout, &total_udp, opts.frame);
+    else if (pipe) pipe_client_print(stdout, pipe, opts.duration * 1000000000LL);
+    else if (opts.frame) frame_counts_print(stdout, &total_integrity);
+    if (opts.rx_timestamps) hist_print_summary(stdout, "RX timestamps: wire-to-app", &rx_merged);
+    perf_counters_print(stdout, "Perf counters:", &perf_total, total_bytes);
+    if (opts.hist_out && hist_dump(opts.hist_out, &merged) < 0) {
+        perror("Failed to write histogram");
+    }
+    if (opts.json_out) {
+        RunRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        if (opts.label) snprintf(rec.impl, sizeof(rec.impl), "%s", opts.label);
+        else snprintf(rec.impl, sizeof(rec.impl), "%s:%d", opts.server_ip, opts.port);
+        snprintf(rec.transport, sizeof(rec.transport), "%s%s",
+                 opts.udp ? (opts.gro ? "udp-gro" : "udp")
+                 : opts.rpc ? (opts.ktls ? "tcp-rpc-ktls" : "tcp-rpc")
+                 : opts.ktls ? "tcp-ktls" : "tcp",
+                 opts.churn ? "-churn" : "");
+        rec.msg_size = opts.message_size;
+        rec.threads = num_conns;
+        rec.rep = opts.rep;
+        rec.duration_s = opts.duration;
+        rec.throughput_gbps = total_throughput;
+        rec.latency_us = avg_latency;
+        rec.total_bytes = total_bytes;
+        run_record_set_latency(&rec, &merged);
+        FILE *f = fopen(opts.json_out, "a");
+        if (f) {
+            run_record_write(f, &rec);
+            fclose(f);
+        } else {
+            perror("Failed to write run record");
+        }
+    }
+
+    if (pipe) pipe_client_free(pipe);
+    series_free(&series);
+    free(perf);
+    free(connect_hists);
+    free(rx_hists);
+    free(hists);
+    free(udp);
+    free(integrity);
+    free(connect_failures);
+    free(connects);
+    free(syscalls);
+    free(requests);
+    free(rx_copied);
+    free(rx_zerocopy);
+    free(bytes_sent);
+    free(latency);
+    free(throughput);
+    free(args);
+    free(threads);
+
+    return 0;
+}
+
+#endif
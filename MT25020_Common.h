@@ -1,6 +1,10 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE   // accept4, CPU affinity and other Linux extensions
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,11 +16,47 @@
 #include <time.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <getopt.h>
+#include <stdint.h>
 
-#define MAX_CLIENTS 100
+#define MAX_CLIENTS 4096        // listen() backlog; absorbs a client's connect burst
 #define DEFAULT_PORT 8080
 #define DURATION_SEC 10
 #define NUM_FIELDS 8
+#define MAX_BATCH 128           // messages per send call; 8 iovecs each stays within IOV_MAX
+#define FRAME_MAX_BATCH (NUM_FIELDS * MAX_BATCH / (NUM_FIELDS + 1))  // 9 iovecs each with --frame
+#define UDP_DEFAULT_DATAGRAM 1472   // --udp: Ethernet MTU minus IPv4 and UDP headers
+#define UDP_MIN_DATAGRAM 64
+#define UDP_MAX_PAYLOAD 65507       // largest UDP payload, and largest GSO super-buffer
+#define PIPE_DEFAULT_DEPTH 32       // --pipeline: blocks per stage queue
+#define PIPE_MAX_DEPTH 4096
+#define PIPE_DEFAULT_ENTROPY 50     // --pipeline: percent of fresh random bytes
+#define DEFAULT_FASTOPEN_QUEUE 256  // --fastopen: pending fast-open requests per listener
+#define MAX_ACCEPTORS 256
+
+// Request/response mode: the client sends one fixed-size request and the
+// server answers with a Message of `size` bytes (no response header).
+#define RPC_MAGIC 0x4D543235u   // "MT25"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;              // requested message size, multiple of NUM_FIELDS
+    uint64_t id;
+} RpcRequest;
+
+// Framed streaming (--frame): every message is preceded by this header, so
+// the receiver can find message boundaries, detect loss or reordering from
+// the sequence number, and verify the payload against its CRC-32C.
+#define FRAME_MAGIC 0x4D544652u // "MTFR"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length;            // payload bytes that follow the header
+    uint64_t seq;               // per connection, counting from 0
+    int64_t send_ns;            // CLOCK_MONOTONIC when the message was queued
+    uint32_t crc32c;            // CRC-32C (Castagnoli) of the payload
+    uint32_t reserved;
+} FrameHeader;
 
 typedef struct {
     char *field1;
@@ -29,33 +69,456 @@ typedef struct {
     char *field8;
 } Message;
 
+// Command-line configuration shared by every server variant.
+// The two positional arguments are mandatory; everything else is an
+// optional flag so the original "<message_size> <port>" invocation still works.
 typedef struct {
-    int thread_id;
-    char *server_ip;
-    int port;
     int message_size;
-    int duration;
-    double *throughput;
-    double *latency;
-    long long *bytes_sent;
-} ClientThreadArgs;
+    int port;
+    int reactor_threads;    // 0 = thread-per-connection (original model)
+    int queue_depth;        // A4: messages in flight per connection
+    long zc_max_inflight;   // A3: zero-copy bytes allowed in flight per connection
+    int zc_adaptive;        // A3: choose zero-copy vs scatter-gather per connection
+    long zc_adaptive_threshold; // A3: smallest message sent zero-copy in adaptive mode
+    int payload_cache;      // share one read-only payload across connections
+    int hugepages;          // back the shared payload with huge pages
+    int splice_mode;        // A5: vmsplice + splice instead of sendfile
+    int rpc;                // answer RpcRequests instead of streaming
+    int perf_counters;      // per-thread perf_event_open counters
+    const char *cpus;       // pin workers to these CPUs (list, ranges allowed)
+    int steer;              // place connections on their SO_INCOMING_CPU
+    int batch;              // streaming: whole messages handed to each send call
+    int msg_more;           // streaming: MSG_MORE / TCP_CORK, let TCP fill segments
+    const char *gather;     // A1: marshalling kernel name, "auto" picks by CPU
+    long nt_threshold;      // A1: smallest unit marshalled with streaming stores; 0 = never
+    int frame;              // streaming: prefix each message with a FrameHeader
+    int tx_timestamps;      // report kernel TX timestamps per connection (not A4)
+    int pool_threads;       // >0: fixed worker pool with work stealing
+    long quantum;           // --pool: bytes written to a connection before yielding
+    int max_conns;          // open connections admitted at once; 0 = no limit
+    int live_stats;         // publish counters in shared memory for MT25020_Part_C_LiveTop
+    int udp;                // >0: stream UDP datagrams of at most this many bytes (A1-A3)
+    int gso;                // --udp: hand the kernel UDP_SEGMENT super-buffers
+    int ktls;               // encrypt with kernel TLS, fixed test keys (A1, A2, A5)
+    int pipeline;           // >0: producer threads feeding per-connection senders (A1-A3)
+    int compress;           // --pipeline: LZ compressor threads between the two
+    int entropy;            // --pipeline: percent of each block that is fresh random bytes
+    int pipe_depth;         // --pipeline: blocks each stage queue holds
+    int accept4;            // accept4() without the peer address (thread-per-connection)
+    int acceptors;          // accept threads, each with its own SO_REUSEPORT listener
+    int fastopen;           // >0: TCP_FASTOPEN queue length on the listener
+    int defer_accept;       // >0: TCP_DEFER_ACCEPT seconds on the listener
+} ServerOptions;
+
+static inline void server_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s <message_size> <port> [options]\n"
+            "  --reactor[=N]   serve with N epoll reactor threads (default: one per core)\n"
+            "  --queue-depth=N messages kept in flight per connection (A4 only, default 4)\n"
+            "  --zc-inflight=BYTES  zero-copy bytes in flight before blocking (A3, default 4 MB)\n"
+            "  --zc-adaptive[=BYTES] switch between zero-copy and sendmsg per connection;\n"
+            "                  messages below BYTES (default 32768) never use zero-copy (A3)\n"
+            "  --payload-cache share one payload per message size across connections\n"
+            "  --hugepages     back the shared payload with huge pages (implies --payload-cache)\n"
+            "  --splice        send via vmsplice into a pipe + splice (A5, default sendfile)\n"
+            "  --rpc           request/response mode: send one message per client request\n"
+            "  --perf          report per-thread hardware/software counters (perf_event_open)\n"
+            "  --cpus=LIST     start worker threads pinned to these CPUs, e.g. 0-3,8\n"
+            "  --steer         serve each connection on the CPU that receives its packets\n"
+            "  --batch=K       send K messages per syscall (1-%d, default 1; not with --rpc)\n"
+            "  --msg-more      send with MSG_MORE (TCP_CORK for sendfile) so partial\n"
+            "                  segments are held until full\n"
+            "  --gather=KIND   A1 marshalling kernel: auto (default), avx512, avx2, sse2, memcpy\n"
+            "  --nt-threshold=BYTES  A1: marshal units of at least BYTES with non-temporal\n"
+            "                  stores (default 4194304, 0 = never)\n"
+            "  --frame         prefix every message with a header carrying its length,\n"
+            "                  sequence number, send time and CRC-32C (A1-A3 streaming)\n"
+            "  --tx-timestamps break each send's latency down with kernel software\n"
+            "                  timestamps: app->qdisc, qdisc->driver, driver->ACK (not A4)\n"
+            "  --pool[=N]      serve from a pool of N workers that steal runnable\n"
+            "                  connections from each other (default: one per core)\n"
+            "  --quantum=BYTES --pool: bytes written to one connection before the worker\n"
+            "                  moves on (default 262144)\n"
+            "  --max-conns=N   admit at most N connections at once; later ones wait in the\n"
+            "                  listen backlog (reactors and A4 reject them; --pool default 4096)\n"
+            "  --live-stats    publish per-connection and per-thread counters in\n"
+            "                  /dev/shm/MT25020_live_<impl>_<port> for MT25020_Part_C_LiveTop\n"
+            "  --udp[=BYTES]   stream UDP datagrams of at most BYTES (%d-%d, default %d)\n"
+            "                  to each client that says hello (A1-A3; --batch: per sendmmsg)\n"
+            "  --gso           --udp: send super-buffers the kernel segments (UDP_SEGMENT)\n"
+            "  --ktls          encrypt in the kernel: TLS 1.3 AES-GCM with fixed test keys,\n"
+            "                  no handshake (A1, A2, A5; the client needs --ktls too)\n"
+            "  --pipeline[=P]  P producer threads generate fresh data for per-connection\n"
+            "                  sender threads (A1-A3; default 1; --batch: messages per block)\n"
+            "  --compress[=C]  --pipeline: C threads LZ-compress blocks before sending (default 1)\n"
+            "  --entropy=PCT   --pipeline: share of fresh random bytes per block (0-100, default %d)\n"
+            "  --pipe-depth=N  --pipeline: blocks each stage queue holds (default %d)\n"
+            "  --accept4       accept with accept4(), no peer address (default accept())\n"
+            "  --acceptors=N   N accept threads, each on its own SO_REUSEPORT listener\n"
+            "                  (thread-per-connection servers, default 1)\n"
+            "  --fastopen[=Q]  TCP Fast Open: take requests in the SYN (Q pending, default %d)\n"
+            "  --defer-accept[=S]  accept only once the client has sent data, waiting up to\n"
+            "                  S seconds (default 1; both useful with --rpc)\n",
+            prog, MAX_BATCH, UDP_MIN_DATAGRAM, UDP_MAX_PAYLOAD, UDP_DEFAULT_DATAGRAM,
+            PIPE_DEFAULT_ENTROPY, PIPE_DEFAULT_DEPTH, DEFAULT_FASTOPEN_QUEUE);
+}
+
+// Defaults for every option; also used by the in-process bench harness.
+static inline void server_options_init(ServerOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->queue_depth = 4;
+    opts->zc_max_inflight = 4 << 20;
+    opts->zc_adaptive_threshold = 32768;
+    opts->batch = 1;
+    opts->gather = "auto";
+    opts->nt_threshold = 4 << 20;
+    opts->quantum = 256 << 10;
+    opts->entropy = PIPE_DEFAULT_ENTROPY;
+    opts->pipe_depth = PIPE_DEFAULT_DEPTH;
+    opts->acceptors = 1;
+}
+
+// Returns 0 on success, -1 on bad arguments (usage already printed).
+static inline int parse_server_options(int argc, char *argv[], ServerOptions *opts) {
+    static const struct option long_opts[] = {
+        {"reactor", optional_argument, NULL, 'r'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"zc-inflight", required_argument, NULL, 'z'},
+        {"zc-adaptive", optional_argument, NULL, 'a'},
+        {"payload-cache", no_argument, NULL, 'p'},
+        {"hugepages", no_argument, NULL, 'H'},
+        {"splice", no_argument, NULL, 's'},
+        {"rpc", no_argument, NULL, 'R'},
+        {"perf", no_argument, NULL, 'P'},
+        {"cpus", required_argument, NULL, 'c'},
+        {"steer", no_argument, NULL, 'S'},
+        {"batch", required_argument, NULL, 'b'},
+        {"msg-more", no_argument, NULL, 'm'},
+        {"gather", required_argument, NULL, 'g'},
+        {"nt-threshold", required_argument, NULL, 'n'},
+        {"frame", no_argument, NULL, 'f'},
+        {"tx-timestamps", no_argument, NULL, 't'},
+        {"pool", optional_argument, NULL, 'o'},
+        {"quantum", required_argument, NULL, 'Q'},
+        {"max-conns", required_argument, NULL, 'M'},
+        {"live-stats", no_argument, NULL, 'L'},
+        {"udp", optional_argument, NULL, 'u'},
+        {"gso", no_argument, NULL, 'G'},
+        {"ktls", no_argument, NULL, 'k'},
+        {"pipeline", optional_argument, NULL, 'i'},
+        {"compress", optional_argument, NULL, 'C'},
+        {"entropy", required_argument, NULL, 'e'},
+        {"pipe-depth", required_argument, NULL, 'D'},
+        {"accept4", no_argument, NULL, 'A'},
+        {"acceptors", required_argument, NULL, 'N'},
+        {"fastopen", optional_argument, NULL, 'F'},
+        {"defer-accept", optional_argument, NULL, 'd'},
+        {NULL, 0, NULL, 0}
+    };
+
+    server_options_init(opts);
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'r':
+            opts->reactor_threads = optarg ? atoi(optarg) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (opts->reactor_threads <= 0) opts->reactor_threads = 1;
+            break;
+        case 'q':
+            opts->queue_depth = atoi(optarg);
+            if (opts->queue_depth <= 0) opts->queue_depth = 1;
+            break;
+        case 'z':
+            opts->zc_max_inflight = atol(optarg);
+            if (opts->zc_max_inflight <= 0) opts->zc_max_inflight = 1;
+            break;
+        case 'a':
+            opts->zc_adaptive = 1;
+            if (optarg) opts->zc_adaptive_threshold = atol(optarg);
+            break;
+        case 'p':
+            opts->payload_cache = 1;
+            break;
+        case 'H':
+            opts->payload_cache = 1;
+            opts->hugepages = 1;
+            break;
+        case 's':
+            opts->splice_mode = 1;
+            break;
+        case 'R':
+            opts->rpc = 1;
+            break;
+        case 'P':
+            opts->perf_counters = 1;
+            break;
+        case 'c':
+            opts->cpus = optarg;
+            break;
+        case 'S':
+            opts->steer = 1;
+            break;
+        case 'b':
+            opts->batch = atoi(optarg);
+            if (opts->batch < 1 || opts->batch > MAX_BATCH) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'm':
+            opts->msg_more = 1;
+            break;
+        case 'g':
+            opts->gather = optarg;
+            break;
+        case 'n':
+            opts->nt_threshold = atol(optarg);
+            if (opts->nt_threshold < 0) opts->nt_threshold = 0;
+            break;
+        case 'f':
+            opts->frame = 1;
+            break;
+        case 't':
+            opts->tx_timestamps = 1;
+            break;
+        case 'o':
+            opts->pool_threads = optarg ? atoi(optarg) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (opts->pool_threads <= 0) opts->pool_threads = 1;
+            break;
+        case 'Q':
+            opts->quantum = atol(optarg);
+            if (opts->quantum <= 0) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'M':
+            opts->max_conns = atoi(optarg);
+            if (opts->max_conns < 0) opts->max_conns = 0;
+            break;
+        case 'L':
+            opts->live_stats = 1;
+            break;
+        case 'u':
+            opts->udp = optarg ? atoi(optarg) : UDP_DEFAULT_DATAGRAM;
+            if (opts->udp < UDP_MIN_DATAGRAM || opts->udp > UDP_MAX_PAYLOAD) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'G':
+            opts->gso = 1;
+            break;
+        case 'k':
+            opts->ktls = 1;
+            break;
+        case 'i':
+            opts->pipeline = optarg ? atoi(optarg) : 1;
+            if (opts->pipeline <= 0) opts->pipeline = 1;
+            break;
+        case 'C':
+            opts->compress = optarg ? atoi(optarg) : 1;
+            if (opts->compress <= 0) opts->compress = 1;
+            break;
+        case 'e':
+            opts->entropy = atoi(optarg);
+            if (opts->entropy < 0 || opts->entropy > 100) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'D':
+            opts->pipe_depth = atoi(optarg);
+            if (opts->pipe_depth < 1 || opts->pipe_depth > PIPE_MAX_DEPTH) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'A':
+            opts->accept4 = 1;
+            break;
+        case 'N':
+            opts->acceptors = atoi(optarg);
+            if (opts->acceptors < 1 || opts->acceptors > MAX_ACCEPTORS) {
+                server_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'F':
+            opts->fastopen = optarg ? atoi(optarg) : DEFAULT_FASTOPEN_QUEUE;
+            if (opts->fastopen <= 0) opts->fastopen = DEFAULT_FASTOPEN_QUEUE;
+            break;
+        case 'd':
+            opts->defer_accept = optarg ? atoi(optarg) : 1;
+            if (opts->defer_accept <= 0) opts->defer_accept = 1;
+            break;
+        default:
+            server_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        server_usage(argv[0]);
+        return -1;
+    }
+    opts->message_size = atoi(argv[optind]);
+    opts->port = atoi(argv[optind + 1]);
+    if (opts->message_size < NUM_FIELDS) {
+        fprintf(stderr, "message_size must be at least %d bytes\n", NUM_FIELDS);
+        return -1;
+    }
+    if (opts->rpc && (opts->batch > 1 || opts->msg_more)) {
+        // A reply is exactly one message, and holding its tail back would
+        // only add latency.
+        fprintf(stderr, "--batch/--msg-more only apply to streaming; ignored with --rpc\n");
+        opts->batch = 1;
+        opts->msg_more = 0;
+    }
+    if (opts->rpc && opts->frame) {
+        fprintf(stderr, "--frame only applies to streaming; ignored with --rpc\n");
+        opts->frame = 0;
+    }
+    if (opts->frame && opts->message_size % NUM_FIELDS != 0) {
+        fprintf(stderr, "--frame needs a message size that is a multiple of %d\n", NUM_FIELDS);
+        return -1;
+    }
+    if (opts->pool_threads > 0 && opts->reactor_threads > 0) {
+        fprintf(stderr, "--pool and --reactor are alternative server modes\n");
+        return -1;
+    }
+    if (opts->udp && (opts->reactor_threads > 0 || opts->pool_threads > 0 || opts->rpc)) {
+        fprintf(stderr, "--udp streams from a thread per flow; not with --reactor/--pool/--rpc\n");
+        return -1;
+    }
+    if (opts->udp && (opts->msg_more || opts->tx_timestamps)) {
+        fprintf(stderr, "--msg-more/--tx-timestamps are TCP-only; ignored with --udp\n");
+        opts->msg_more = 0;
+        opts->tx_timestamps = 0;
+    }
+    if (opts->ktls && opts->udp) {
+        fprintf(stderr, "--ktls encrypts TCP streams; not with --udp\n");
+        return -1;
+    }
+    if (opts->ktls && opts->tx_timestamps) {
+        // Timestamps are keyed by byte offsets, which record headers and
+        // tags shift.
+        fprintf(stderr, "--tx-timestamps cannot follow TLS records; ignored with --ktls\n");
+        opts->tx_timestamps = 0;
+    }
+    if (opts->gso && !opts->udp) {
+        fprintf(stderr, "--gso only applies to --udp; ignored\n");
+        opts->gso = 0;
+    }
+    if (opts->compress > 0 && !opts->pipeline) {
+        fprintf(stderr, "--compress is a --pipeline stage\n");
+        return -1;
+    }
+    if (opts->pipeline && (opts->reactor_threads > 0 || opts->pool_threads > 0 || opts->rpc ||
+                           opts->udp)) {
+        fprintf(stderr, "--pipeline sends from a thread per connection; not with "
+                        "--reactor/--pool/--rpc/--udp\n");
+        return -1;
+    }
+    if (opts->pipeline && opts->tx_timestamps) {
+        fprintf(stderr, "--tx-timestamps does not follow pipelined blocks; ignored\n");
+        opts->tx_timestamps = 0;
+    }
+    if (opts->udp && (opts->accept4 || opts->acceptors > 1 || opts->fastopen || opts->defer_accept)) {
+        fprintf(stderr, "--accept4/--acceptors/--fastopen/--defer-accept are TCP-only; not with "
+                        "--udp\n");
+        return -1;
+    }
+    if (opts->acceptors > 1 && (opts->reactor_threads > 0 || opts->pool_threads > 0)) {
+        // Every reactor already has its own SO_REUSEPORT listener, and the
+        // pool's single acceptor only hands sockets over.
+        fprintf(stderr, "--acceptors is for thread-per-connection servers; ignored with "
+                        "--reactor/--pool\n");
+        opts->acceptors = 1;
+    }
+    if ((opts->fastopen || opts->defer_accept) && !opts->rpc) {
+        // A streaming client never sends: nothing rides in its SYN, and a
+        // deferred accept waits out the whole timeout.
+        fprintf(stderr, "--fastopen/--defer-accept need a client that sends first (--rpc)\n");
+    }
+    if (opts->frame && !opts->udp && !opts->pipeline && opts->batch > FRAME_MAX_BATCH) {
+        // The header is one more iovec per message.
+        fprintf(stderr, "--frame allows at most --batch=%d\n", FRAME_MAX_BATCH);
+        return -1;
+    }
+    return 0;
+}
+
+// Streaming: bytes one message occupies on the wire.
+static inline int stream_record_size(const ServerOptions *opts) {
+    return opts->message_size + (opts->frame ? (int)sizeof(FrameHeader) : 0);
+}
+
+// Streaming: bytes handed to one send call, --batch back-to-back messages.
+static inline int stream_unit_size(const ServerOptions *opts) {
+    return stream_record_size(opts) * opts->batch;
+}
+
+// Extra send() flags for streaming writes.
+static inline int stream_send_flags(const ServerOptions *opts) {
+    return opts->msg_more ? MSG_MORE : 0;
+}
+
+struct SendStrategy;
 
 typedef struct {
     int client_socket;
     int thread_id;
     int message_size;
+    const ServerOptions *opts;
+    const struct SendStrategy *strategy;    // used by the --rpc handler
 } ServerThreadArgs;
 
+// A request is served only if it asks for a whole number of fields and no
+// more than the payload the server was started with.
+static inline int rpc_request_valid(const RpcRequest *req, int max_size) {
+    return req->magic == RPC_MAGIC && req->size >= NUM_FIELDS &&
+           req->size % NUM_FIELDS == 0 && req->size <= (uint32_t)max_size;
+}
+
+// All timing uses CLOCK_MONOTONIC: served from the vDSO without a syscall,
+// nanosecond resolution, and immune to wall-clock steps during a run.
+static inline long long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 static inline double get_time_in_seconds() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+    return get_time_ns() / 1e9;
 }
 
 static inline long long get_time_in_microseconds() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+    return get_time_ns() / 1000;
+}
+
+// Busy-wait hint for spin loops that poll another thread's writes.
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// After a sendmsg() that moved `n` bytes: drop the iovecs it finished and
+// trim the one it stopped in, so the next call sends the rest.
+static inline void msghdr_advance(struct msghdr *mh, size_t n) {
+    while (n > 0 && n >= mh->msg_iov->iov_len) {
+        n -= mh->msg_iov->iov_len;
+        mh->msg_iov++;
+        mh->msg_iovlen--;
+    }
+    if (n > 0) {
+        mh->msg_iov->iov_base = (char*)mh->msg_iov->iov_base + n;
+        mh->msg_iov->iov_len -= n;
+    }
 }
 
 static inline Message* allocate_message(int field_size) {
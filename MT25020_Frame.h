@@ -0,0 +1,421 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+// Framed wire protocol (--frame) and its CRC-32C.
+//
+// Servers: FrameWriter fills the FrameHeaders of each write unit. A1
+// marshals them into its linear buffer with the payload. A2 and A3 send
+// each header as one more iovec in front of the message's eight fields, so
+// the payload is still never copied in user space and A3 still sends it
+// zero-copy. The payload never changes, so its CRC is computed once per
+// connection and each message only costs a sequence number and a clock read.
+//
+// A header sent with MSG_ZEROCOPY stays pinned until its completion
+// arrives, so it must not be rewritten before then. Zero-copy units
+// therefore take their headers from a ring of ZC_RING_SIZE + 1 slots. At
+// most ZC_RING_SIZE sends are ever in flight, so by the time a slot comes
+// round again every send that used it has completed. For the same reason
+// the ring is only freed once the connection's sends have completed: A3
+// calls frame_writer_free() after zc_drain_all(), or from conn_free() once
+// conn_busy() has cleared (MT25020_Reactor.h).
+//
+// Client: FrameParser follows the stream across arbitrary recv() boundaries,
+// checks each header's magic, length and sequence number, and runs CRC-32C
+// over the payload while it is still hot in L1 from the recv() copy. The
+// CRC picks the fastest kernel this CPU has:
+//   vpclmulqdq  AVX-512 carry-less multiplies fold 256 bytes per iteration,
+//               four 128-bit lanes per instruction (~4x the crc32 instruction)
+//   sse4.2      the crc32 instruction on three independent lanes, merged with
+//               precomputed tables to hide its 3-cycle latency
+//   table       bytewise software fallback
+// All fold and merge constants are derived from the polynomial at startup.
+
+#include "MT25020_Common.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FRAME_X86 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u     // Castagnoli, bit-reflected
+#define CRC32C_LANE 512             // bytes per lane in the 3-lane hardware loop
+#define CRC32C_CLMUL_MIN 256        // shortest buffer worth the vector setup
+#define FRAME_MAX_LENGTH (1u << 30) // larger lengths mean the framing is lost
+
+// Fold distances in bits, CRC32C_FOLD_* index Crc32cTables.fold.
+enum { CRC32C_FOLD_128, CRC32C_FOLD_256, CRC32C_FOLD_384, CRC32C_FOLD_512, CRC32C_FOLD_2048,
+       CRC32C_NUM_FOLDS };
+static const int crc32c_fold_bits[CRC32C_NUM_FOLDS] = { 128, 256, 384, 512, 2048 };
+
+// --- CRC-32C ---
+
+typedef struct {
+    uint32_t table[256];            // bytewise software update
+    uint32_t shift1[4][256];        // register advanced over CRC32C_LANE zero bytes
+    uint32_t shift2[4][256];        // ... over 2 * CRC32C_LANE zero bytes
+    uint64_t fold[CRC32C_NUM_FOLDS][2];  // carry-less fold constants, see crc32c_fold_const
+    int hw;                         // SSE4.2 crc32 instruction available
+    int clmul;                      // ... and AVX-512 VPCLMULQDQ
+} Crc32cTables;
+
+static inline Crc32cTables* crc32c_storage(void) {
+    static Crc32cTables t;
+    return &t;
+}
+
+// The register update is linear over GF(2), so running it over n zero bytes
+// is a fixed 32x32 bit matrix. Tabulate it per byte of the register.
+static inline void crc32c_build_shift(const Crc32cTables *t, uint32_t out[4][256], size_t zeros) {
+    uint32_t basis[32];
+    for (int b = 0; b < 32; b++) {
+        uint32_t c = 1u << b;
+        for (size_t i = 0; i < zeros; i++) c = t->table[c & 0xff] ^ (c >> 8);
+        basis[b] = c;
+    }
+    for (int k = 0; k < 4; k++) {
+        for (int x = 0; x < 256; x++) {
+            uint32_t v = 0;
+            for (int j = 0; j < 8; j++)
+                if (x >> j & 1) v ^= basis[8 * k + j];
+            out[k][x] = v;
+        }
+    }
+}
+
+// x^e mod P as a bit-reflected register (bit i is the coefficient of x^(31-i)).
+static inline uint32_t crc32c_xpow(int e) {
+    uint32_t r = 0x80000000u;       // the polynomial 1
+    for (int i = 0; i < e; i++) r = r & 1 ? (r >> 1) ^ CRC32C_POLY : r >> 1;
+    return r;
+}
+
+// Moving a 128-bit block H*x^64 + L forward by d bits multiplies it by x^d:
+//   H*x^(d+64) + L*x^d  ==  H*(x^(d+32) mod P)*x^32 + L*(x^(d-32) mod P)*x^32
+// With bit-reflected operands a 64x33-bit carry-less multiply supplies the
+// extra x^32, so the block is folded by two multiplies and stays 128 bits
+// wide. H is the low (first) quadword and pairs with element 0.
+static inline void crc32c_fold_const(uint64_t out[2], int d) {
+    out[0] = (uint64_t)crc32c_xpow(d + 32) << 1;
+    out[1] = (uint64_t)crc32c_xpow(d - 32) << 1;
+}
+
+static inline void crc32c_build(void) {
+    Crc32cTables *t = crc32c_storage();
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        t->table[i] = c;
+    }
+    crc32c_build_shift(t, t->shift1, CRC32C_LANE);
+    crc32c_build_shift(t, t->shift2, 2 * CRC32C_LANE);
+    for (int i = 0; i < CRC32C_NUM_FOLDS; i++) crc32c_fold_const(t->fold[i], crc32c_fold_bits[i]);
+#ifdef FRAME_X86
+    t->hw = __builtin_cpu_supports("sse4.2");
+    t->clmul = t->hw && __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("pclmul");
+#endif
+}
+
+static inline const Crc32cTables* crc32c_tables(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, crc32c_build);
+    return crc32c_storage();
+}
+
+static inline uint32_t crc32c_shift(const uint32_t shift[4][256], uint32_t crc) {
+    return shift[0][crc & 0xff] ^ shift[1][(crc >> 8) & 0xff] ^
+           shift[2][(crc >> 16) & 0xff] ^ shift[3][crc >> 24];
+}
+
+// Raw register updates: no pre/post inversion.
+static inline uint32_t crc32c_sw(const Crc32cTables *t, uint32_t crc,
+                                 const unsigned char *p, size_t len) {
+    for (; len > 0; p++, len--) crc = t->table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef FRAME_X86
+// Three lanes of CRC32C_LANE bytes run side by side. Lane a continues from
+// crc, lanes b and c start from zero, and linearity gives
+//   crc(a|b|c) = shift_2L(a) ^ shift_L(b) ^ c.
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_hw(const Crc32cTables *t, uint32_t crc,
+                                 const unsigned char *p, size_t len) {
+    for (; len >= 3 * CRC32C_LANE; p += 3 * CRC32C_LANE, len -= 3 * CRC32C_LANE) {
+        uint64_t a = crc, b = 0, c = 0;
+        for (size_t i = 0; i < CRC32C_LANE; i += 8) {
+            uint64_t x, y, z;
+            memcpy(&x, p + i, 8);
+            memcpy(&y, p + CRC32C_LANE + i, 8);
+            memcpy(&z, p + 2 * CRC32C_LANE + i, 8);
+            a = _mm_crc32_u64(a, x);
+            b = _mm_crc32_u64(b, y);
+            c = _mm_crc32_u64(c, z);
+        }
+        crc = crc32c_shift(t->shift2, (uint32_t)a) ^ crc32c_shift(t->shift1, (uint32_t)b) ^
+              (uint32_t)c;
+    }
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        c = _mm_crc32_u64(c, x);
+    }
+    crc = (uint32_t)c;
+    for (; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+#define CRC32C_CLMUL_TARGET __attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.2")))
+
+CRC32C_CLMUL_TARGET
+static inline __m128i crc32c_fold128(__m128i x, const uint64_t k[2], __m128i next) {
+    __m128i kk = _mm_loadu_si128((const __m128i*)k);
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, kk, 0x00),
+                                       _mm_clmulepi64_si128(x, kk, 0x11)), next);
+}
+
+CRC32C_CLMUL_TARGET
+static inline __m512i crc32c_fold512(__m512i x, __m512i k, __m512i next) {
+    return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00),
+                                     _mm512_clmulepi64_epi128(x, k, 0x11), next, 0x96);
+}
+
+// len >= CRC32C_CLMUL_MIN. Four 512-bit accumulators each hold four
+// 128-bit blocks and fold forward 256 bytes per iteration. They are then
+// folded into one register, its four blocks into one, and that last block
+// plus the tail go through the crc32 instruction.
+CRC32C_CLMUL_TARGET
+static inline uint32_t crc32c_clmul(const Crc32cTables *t, uint32_t crc,
+                                    const unsigned char *p, size_t len) {
+    __m512i k2048 = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)t->fold[CRC32C_FOLD_2048]));
+    __m512i k512 = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)t->fold[CRC32C_FOLD_512]));
+    // The register only ever XORs into the first four bytes of the stream.
+    __m512i z0 = _mm512_xor_si512(_mm512_loadu_si512((const void*)p),
+                                  _mm512_inserti32x4(_mm512_setzero_si512(),
+                                                     _mm_cvtsi32_si128((int)crc), 0));
+    __m512i z1 = _mm512_loadu_si512((const void*)(p + 64));
+    __m512i z2 = _mm512_loadu_si512((const void*)(p + 128));
+    __m512i z3 = _mm512_loadu_si512((const void*)(p + 192));
+    p += 256, len -= 256;
+    for (; len >= 256; p += 256, len -= 256) {
+        z0 = crc32c_fold512(z0, k2048, _mm512_loadu_si512((const void*)p));
+        z1 = crc32c_fold512(z1, k2048, _mm512_loadu_si512((const void*)(p + 64)));
+        z2 = crc32c_fold512(z2, k2048, _mm512_loadu_si512((const void*)(p + 128)));
+        z3 = crc32c_fold512(z3, k2048, _mm512_loadu_si512((const void*)(p + 192)));
+    }
+    __m512i z = crc32c_fold512(z0, k512, z1);
+    z = crc32c_fold512(z, k512, z2);
+    z = crc32c_fold512(z, k512, z3);
+    for (; len >= 64; p += 64, len -= 64)
+        z = crc32c_fold512(z, k512, _mm512_loadu_si512((const void*)p));
+
+    __m128i x = crc32c_fold128(_mm512_extracti32x4_epi32(z, 0), t->fold[CRC32C_FOLD_384],
+                               _mm512_extracti32x4_epi32(z, 3));
+    x = _mm_xor_si128(x, crc32c_fold128(_mm512_extracti32x4_epi32(z, 1),
+                                        t->fold[CRC32C_FOLD_256], _mm_setzero_si128()));
+    x = _mm_xor_si128(x, crc32c_fold128(_mm512_extracti32x4_epi32(z, 2),
+                                        t->fold[CRC32C_FOLD_128], _mm_setzero_si128()));
+    for (; len >= 16; p += 16, len -= 16)
+        x = crc32c_fold128(x, t->fold[CRC32C_FOLD_128], _mm_loadu_si128((const __m128i*)p));
+
+    uint64_t c = _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(x));
+    c = _mm_crc32_u64(c, (uint64_t)_mm_extract_epi64(x, 1));
+    return crc32c_hw(t, (uint32_t)c, p, len);
+}
+#endif
+
+// CRC-32C of len bytes continuing from `crc` (0 to start), like zlib's crc32().
+static inline uint32_t crc32c_extend(uint32_t crc, const void *buf, size_t len) {
+    const Crc32cTables *t = crc32c_tables();
+#ifdef FRAME_X86
+    if (t->clmul && len >= CRC32C_CLMUL_MIN)
+        return ~crc32c_clmul(t, ~crc, (const unsigned char*)buf, len);
+    if (t->hw) return ~crc32c_hw(t, ~crc, (const unsigned char*)buf, len);
+#endif
+    return ~crc32c_sw(t, ~crc, (const unsigned char*)buf, len);
+}
+
+static inline const char* crc32c_impl(void) {
+    const Crc32cTables *t = crc32c_tables();
+    return t->clmul ? "vpclmulqdq" : t->hw ? "sse4.2" : "table";
+}
+
+// --- Sender ---
+
+typedef struct {
+    FrameHeader *headers;       // NULL: --frame off
+    int batch;                  // headers per write unit
+    int ring;                   // zero-copy slots after the scratch slot 0
+    int slot;                   // last zero-copy slot used
+    FrameHeader *cur;           // headers of the unit being sent; NULL unframed
+    uint64_t next_seq;
+    uint32_t length;            // payload bytes per message
+    uint32_t crc;               // CRC-32C of the payload
+} FrameWriter;
+
+static inline uint32_t frame_payload_crc(const Message *msg, int field_size) {
+    const char *fields[NUM_FIELDS] = {
+        msg->field1, msg->field2, msg->field3, msg->field4,
+        msg->field5, msg->field6, msg->field7, msg->field8
+    };
+    uint32_t crc = 0;
+    for (int i = 0; i < NUM_FIELDS; i++) crc = crc32c_extend(crc, fields[i], field_size);
+    return crc;
+}
+
+// `ring`: slots for zero-copy units (ZC_RING_SIZE + 1), 0 if the sender
+// never pins its headers. Returns 0 on success, -1 if out of memory.
+static inline int frame_writer_init(FrameWriter *w, const ServerOptions *opts,
+                                    const Message *msg, int field_size, int ring) {
+    memset(w, 0, sizeof(*w));
+    if (!opts->frame) return 0;
+    w->batch = opts->batch;
+    w->ring = ring;
+    w->headers = (FrameHeader*)calloc((size_t)(ring + 1) * w->batch, sizeof(FrameHeader));
+    if (!w->headers) return -1;
+    w->length = field_size * NUM_FIELDS;
+    w->crc = frame_payload_crc(msg, field_size);
+    return 0;
+}
+
+// Number the next unit's messages. `pinned`: the unit goes out with
+// MSG_ZEROCOPY and its headers must survive until completion. Returns the
+// headers, NULL when unframed.
+static inline FrameHeader* frame_begin_unit(FrameWriter *w, int pinned) {
+    if (!w->headers) return NULL;
+    FrameHeader *h = w->headers;
+    if (pinned && w->ring > 0) {
+        w->slot = w->slot % w->ring + 1;
+        h += (size_t)w->slot * w->batch;
+    }
+    int64_t now = get_time_ns();
+    for (int i = 0; i < w->batch; i++) {
+        h[i].magic = FRAME_MAGIC;
+        h[i].length = w->length;
+        h[i].seq = w->next_seq++;
+        h[i].send_ns = now;
+        h[i].crc32c = w->crc;
+        h[i].reserved = 0;
+    }
+    w->cur = h;
+    return h;
+}
+
+// Zero-copy writers: only once no send still references the headers.
+static inline void frame_writer_free(FrameWriter *w) {
+    free(w->headers);
+    w->headers = w->cur = NULL;
+}
+
+// --- Receiver ---
+
+typedef struct {
+    long long frames;           // headers and payloads fully received
+    long long seq_errors;       // sequence number other than the one expected
+    long long crc_errors;
+    long long length_errors;    // length other than the requested message size
+    long long lost_sync;        // connections whose stream stopped parsing
+    long long delay_ns;         // sum of one-way delays (receipt - send_ns)
+} FrameCounts;
+
+typedef struct {
+    FrameHeader hdr;            // header being assembled
+    size_t hdr_have;
+    size_t payload_left;
+    uint32_t crc;               // running CRC-32C of the payload
+    uint64_t next_seq;
+    uint32_t expect_length;
+    long long unsettled;        // frames completed since frame_settle()
+    long long unsettled_send_ns;
+    FrameCounts counts;
+} FrameParser;
+
+static inline void frame_parser_init(FrameParser *p, int message_size) {
+    memset(p, 0, sizeof(*p));
+    p->expect_length = message_size;
+    crc32c_tables();
+}
+
+// Bytes until the current frame ends, if the header not yet seen announces
+// the requested size. Lets the caller stop each recv() at a frame boundary.
+static inline size_t frame_remaining(const FrameParser *p) {
+    if (p->hdr_have < sizeof(FrameHeader))
+        return sizeof(FrameHeader) - p->hdr_have + p->expect_length;
+    return p->payload_left;
+}
+
+// Verify n received bytes. Returns the number of frames they completed, or
+// -1 once a header is corrupt and the stream cannot be followed further.
+static inline long frame_parse(FrameParser *p, const char *buf, size_t n) {
+    long done = 0;
+    while (n > 0) {
+        if (p->hdr_have < sizeof(FrameHeader)) {
+            size_t k = sizeof(FrameHeader) - p->hdr_have;
+            if (k > n) k = n;
+            memcpy((char*)&p->hdr + p->hdr_have, buf, k);
+            p->hdr_have += k;
+            buf += k;
+            n -= k;
+            if (p->hdr_have < sizeof(FrameHeader)) break;
+            if (p->hdr.magic != FRAME_MAGIC || p->hdr.length > FRAME_MAX_LENGTH) {
+                p->counts.lost_sync++;
+                return -1;
+            }
+            if (p->hdr.length != p->expect_length) p->counts.length_errors++;
+            if (p->hdr.seq != p->next_seq) p->counts.seq_errors++;
+            p->next_seq = p->hdr.seq + 1;   // count each gap once, then follow the sender
+            p->payload_left = p->hdr.length;
+            p->crc = 0;
+        } else {
+            size_t k = p->payload_left < n ? p->payload_left : n;
+            p->crc = crc32c_extend(p->crc, buf, k);
+            p->payload_left -= k;
+            buf += k;
+            n -= k;
+        }
+        if (p->payload_left == 0) {
+            if (p->crc != p->hdr.crc32c) p->counts.crc_errors++;
+            p->counts.frames++;
+            p->unsettled++;
+            p->unsettled_send_ns += p->hdr.send_ns;
+            p->hdr_have = 0;
+            done++;
+        }
+    }
+    return done;
+}
+
+// Charge the frames completed since the last call with their one-way delay
+// up to `now`, so the parser itself never reads the clock. Only meaningful
+// when sender and receiver share CLOCK_MONOTONIC, i.e. the same host.
+static inline void frame_settle(FrameParser *p, long long now) {
+    p->counts.delay_ns += p->unsettled * now - p->unsettled_send_ns;
+    p->unsettled = 0;
+    p->unsettled_send_ns = 0;
+}
+
+static inline void frame_counts_add(FrameCounts *sum, const FrameCounts *c) {
+    sum->frames += c->frames;
+    sum->seq_errors += c->seq_errors;
+    sum->crc_errors += c->crc_errors;
+    sum->length_errors += c->length_errors;
+    sum->lost_sync += c->lost_sync;
+    sum->delay_ns += c->delay_ns;
+}
+
+static inline long long frame_counts_errors(const FrameCounts *c) {
+    return c->seq_errors + c->crc_errors + c->length_errors + c->lost_sync;
+}
+
+static inline void frame_counts_print(FILE *out, const FrameCounts *c) {
+    fprintf(out, "Integrity: %lld frames verified (crc32c %s), %lld sequence errors, "
+            "%lld checksum errors, %lld length errors, %lld connections lost framing\n",
+            c->frames, crc32c_impl(), c->seq_errors, c->crc_errors, c->length_errors,
+            c->lost_sync);
+    if (c->frames > 0)
+        fprintf(out, "One-way delay: %.3f us mean (same-host clocks only)\n",
+                c->delay_ns / 1000.0 / c->frames);
+}
+
+#endif
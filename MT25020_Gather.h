@@ -0,0 +1,240 @@
+#ifndef GATHER_H
+#define GATHER_H
+
+// Gather-copy kernels for A1's user-space marshalling copy.
+//
+// A1 assembles the eight scattered fields into one contiguous buffer before
+// send(). gather_message() does that with a kernel chosen at startup from
+// the CPU's features: AVX-512, AVX2, SSE2, or plain memcpy(). Units of at
+// least --nt-threshold bytes are written with non-temporal (streaming)
+// stores. Those bypass the cache, so a large marshalled buffer, which is read
+// only once more by the kernel's copy into the socket, does not evict the
+// source fields the next message reads again. Smaller units use regular
+// stores and stay cache-hot for that copy.
+
+#include "MT25020_Common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GATHER_X86 1
+#endif
+
+typedef void (*GatherCopyFn)(char *dst, const char *src, size_t len);
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    GatherCopyFn copy;          // cached stores
+    GatherCopyFn copy_nt;       // non-temporal stores; NULL: never streams
+} GatherKernel;
+
+static inline int gather_always(void) { return 1; }
+
+static inline void gather_copy_memcpy(char *dst, const char *src, size_t len) {
+    memcpy(dst, src, len);
+}
+
+#ifdef GATHER_X86
+
+// Bytes to copy with ordinary stores before dst reaches `align`.
+static inline size_t gather_head(const char *dst, size_t align, size_t len) {
+    size_t head = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+    return head < len ? head : len;
+}
+
+static inline int gather_has_sse2(void) { return __builtin_cpu_supports("sse2"); }
+static inline int gather_has_avx2(void) { return __builtin_cpu_supports("avx2"); }
+static inline int gather_has_avx512(void) { return __builtin_cpu_supports("avx512f"); }
+
+// Each kernel moves four vectors per iteration, then single vectors. The
+// cached variants finish with one overlapping vector over the last bytes,
+// the _nt variants leave the sub-vector tail to memcpy(). Loads are
+// unaligned: fields come straight from malloc(). Streaming stores need an
+// aligned destination, so the _nt variants first copy up to the alignment
+// boundary.
+
+__attribute__((target("sse2")))
+static inline void gather_copy_sse2(char *dst, const char *src, size_t len) {
+    if (len < 16) {
+        memcpy(dst, src, len);
+        return;
+    }
+    __m128i tail = _mm_loadu_si128((const __m128i*)(src + len - 16));
+    char *tail_dst = dst + len - 16;
+    for (; len >= 64; dst += 64, src += 64, len -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)src);
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+        _mm_storeu_si128((__m128i*)dst, a);
+        _mm_storeu_si128((__m128i*)(dst + 16), b);
+        _mm_storeu_si128((__m128i*)(dst + 32), c);
+        _mm_storeu_si128((__m128i*)(dst + 48), d);
+    }
+    for (; len >= 16; dst += 16, src += 16, len -= 16)
+        _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+    _mm_storeu_si128((__m128i*)tail_dst, tail);
+}
+
+__attribute__((target("sse2")))
+static inline void gather_copy_sse2_nt(char *dst, const char *src, size_t len) {
+    size_t head = gather_head(dst, 16, len);
+    memcpy(dst, src, head);
+    dst += head, src += head, len -= head;
+    for (; len >= 64; dst += 64, src += 64, len -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)src);
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+        _mm_stream_si128((__m128i*)dst, a);
+        _mm_stream_si128((__m128i*)(dst + 16), b);
+        _mm_stream_si128((__m128i*)(dst + 32), c);
+        _mm_stream_si128((__m128i*)(dst + 48), d);
+    }
+    for (; len >= 16; dst += 16, src += 16, len -= 16)
+        _mm_stream_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+    memcpy(dst, src, len);
+}
+
+__attribute__((target("avx2")))
+static inline void gather_copy_avx2(char *dst, const char *src, size_t len) {
+    if (len < 32) {
+        memcpy(dst, src, len);
+        return;
+    }
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(src + len - 32));
+    char *tail_dst = dst + len - 32;
+    for (; len >= 128; dst += 128, src += 128, len -= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)src);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src + 96));
+        _mm256_storeu_si256((__m256i*)dst, a);
+        _mm256_storeu_si256((__m256i*)(dst + 32), b);
+        _mm256_storeu_si256((__m256i*)(dst + 64), c);
+        _mm256_storeu_si256((__m256i*)(dst + 96), d);
+    }
+    for (; len >= 32; dst += 32, src += 32, len -= 32)
+        _mm256_storeu_si256((__m256i*)dst, _mm256_loadu_si256((const __m256i*)src));
+    _mm256_storeu_si256((__m256i*)tail_dst, tail);
+}
+
+__attribute__((target("avx2")))
+static inline void gather_copy_avx2_nt(char *dst, const char *src, size_t len) {
+    size_t head = gather_head(dst, 32, len);
+    memcpy(dst, src, head);
+    dst += head, src += head, len -= head;
+    for (; len >= 128; dst += 128, src += 128, len -= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)src);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src + 96));
+        _mm256_stream_si256((__m256i*)dst, a);
+        _mm256_stream_si256((__m256i*)(dst + 32), b);
+        _mm256_stream_si256((__m256i*)(dst + 64), c);
+        _mm256_stream_si256((__m256i*)(dst + 96), d);
+    }
+    for (; len >= 32; dst += 32, src += 32, len -= 32)
+        _mm256_stream_si256((__m256i*)dst, _mm256_loadu_si256((const __m256i*)src));
+    memcpy(dst, src, len);
+}
+
+__attribute__((target("avx512f")))
+static inline void gather_copy_avx512(char *dst, const char *src, size_t len) {
+    if (len < 64) {
+        memcpy(dst, src, len);
+        return;
+    }
+    __m512i tail = _mm512_loadu_si512((const void*)(src + len - 64));
+    char *tail_dst = dst + len - 64;
+    for (; len >= 256; dst += 256, src += 256, len -= 256) {
+        __m512i a = _mm512_loadu_si512((const void*)src);
+        __m512i b = _mm512_loadu_si512((const void*)(src + 64));
+        __m512i c = _mm512_loadu_si512((const void*)(src + 128));
+        __m512i d = _mm512_loadu_si512((const void*)(src + 192));
+        _mm512_storeu_si512((void*)dst, a);
+        _mm512_storeu_si512((void*)(dst + 64), b);
+        _mm512_storeu_si512((void*)(dst + 128), c);
+        _mm512_storeu_si512((void*)(dst + 192), d);
+    }
+    for (; len >= 64; dst += 64, src += 64, len -= 64)
+        _mm512_storeu_si512((void*)dst, _mm512_loadu_si512((const void*)src));
+    _mm512_storeu_si512((void*)tail_dst, tail);
+}
+
+__attribute__((target("avx512f")))
+static inline void gather_copy_avx512_nt(char *dst, const char *src, size_t len) {
+    size_t head = gather_head(dst, 64, len);
+    memcpy(dst, src, head);
+    dst += head, src += head, len -= head;
+    for (; len >= 256; dst += 256, src += 256, len -= 256) {
+        __m512i a = _mm512_loadu_si512((const void*)src);
+        __m512i b = _mm512_loadu_si512((const void*)(src + 64));
+        __m512i c = _mm512_loadu_si512((const void*)(src + 128));
+        __m512i d = _mm512_loadu_si512((const void*)(src + 192));
+        _mm512_stream_si512((void*)dst, a);
+        _mm512_stream_si512((void*)(dst + 64), b);
+        _mm512_stream_si512((void*)(dst + 128), c);
+        _mm512_stream_si512((void*)(dst + 192), d);
+    }
+    for (; len >= 64; dst += 64, src += 64, len -= 64)
+        _mm512_stream_si512((void*)dst, _mm512_loadu_si512((const void*)src));
+    memcpy(dst, src, len);
+}
+
+#endif
+
+// Best first: "auto" takes the first one the CPU supports.
+static const GatherKernel gather_kernels[] = {
+#ifdef GATHER_X86
+    { "avx512", gather_has_avx512, gather_copy_avx512, gather_copy_avx512_nt },
+    { "avx2", gather_has_avx2, gather_copy_avx2, gather_copy_avx2_nt },
+    { "sse2", gather_has_sse2, gather_copy_sse2, gather_copy_sse2_nt },
+#endif
+    { "memcpy", gather_always, gather_copy_memcpy, NULL },
+};
+#define GATHER_NUM_KERNELS ((int)(sizeof(gather_kernels) / sizeof(gather_kernels[0])))
+
+// Kernel by name ("auto" or NULL: best supported). NULL if the name is
+// unknown or this CPU cannot run it.
+static inline const GatherKernel* gather_kernel_find(const char *name) {
+    int any = !name || strcmp(name, "auto") == 0;
+    for (int i = 0; i < GATHER_NUM_KERNELS; i++) {
+        const GatherKernel *k = &gather_kernels[i];
+        if ((any || strcmp(name, k->name) == 0) && k->supported()) return k;
+    }
+    return NULL;
+}
+
+// Whether a unit of `total` bytes is written with streaming stores.
+static inline int gather_streams(const GatherKernel *k, long nt_threshold, size_t total) {
+    return k->copy_nt && nt_threshold > 0 && total >= (size_t)nt_threshold;
+}
+
+// Write `copies` back-to-back serializations of msg to dst, each preceded
+// by its --frame header when `hdrs` is non-NULL.
+static inline void gather_message(const GatherKernel *k, long nt_threshold, char *dst,
+                                  const FrameHeader *hdrs, const Message *msg, int field_size,
+                                  int copies) {
+    const char *fields[NUM_FIELDS] = {
+        msg->field1, msg->field2, msg->field3, msg->field4,
+        msg->field5, msg->field6, msg->field7, msg->field8
+    };
+    size_t total = (size_t)field_size * NUM_FIELDS * copies;
+    int nt = gather_streams(k, nt_threshold, total);
+    GatherCopyFn copy = nt ? k->copy_nt : k->copy;
+    for (int m = 0; m < copies; m++) {
+        if (hdrs) {
+            memcpy(dst, &hdrs[m], sizeof(FrameHeader));
+            dst += sizeof(FrameHeader);
+        }
+        for (int i = 0; i < NUM_FIELDS; i++, dst += field_size)
+            copy(dst, fields[i], field_size);
+    }
+#ifdef GATHER_X86
+    // Order the weakly-ordered streaming stores before send() reads them.
+    if (nt) _mm_sfence();
+#endif
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Fixed-size log-linear latency histogram (HDR-style).
+//
+// Values below 2^HIST_SUB_BITS ns are counted exactly; above that every
+// power-of-two range is split into 2^(HIST_SUB_BITS-1) equal sub-buckets, so
+// the relative error stays below 1/64 (~1.6%) from nanoseconds up to
+// HIST_MAX_NS. Recording is a shift, a count-leading-zeros and one
+// increment: no allocation, no locks. Each thread owns its histogram and the
+// main thread merges them after join, so no atomics are needed either.
+
+#include "MT25020_Common.h"
+#include <stdint.h>
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)             // exact range [0, 128)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)            // sub-buckets per octave
+#define HIST_MAX_SHIFT 34                               // covers up to ~2^41 ns (~36 min)
+#define HIST_BUCKETS (HIST_SUB_COUNT + HIST_MAX_SHIFT * HIST_HALF_COUNT)
+#define HIST_MAX_NS ((((uint64_t)HIST_SUB_COUNT) << HIST_MAX_SHIFT) - 1)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} LatencyHistogram;
+
+static inline void hist_init(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static inline int hist_index(uint64_t v) {
+    if (v < HIST_SUB_COUNT) return (int)v;
+    if (v > HIST_MAX_NS) v = HIST_MAX_NS;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - (HIST_SUB_BITS - 1);              // v >> shift in [64, 128)
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT +
+           (int)((v >> shift) - HIST_HALF_COUNT);
+}
+
+// Highest value that maps to bucket `idx`.
+static inline uint64_t hist_bucket_upper(int idx) {
+    if (idx < HIST_SUB_COUNT) return idx;
+    int k = idx - HIST_SUB_COUNT;
+    int shift = k / HIST_HALF_COUNT + 1;
+    uint64_t sub = k % HIST_HALF_COUNT + HIST_HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void hist_record(LatencyHistogram *h, uint64_t ns) {
+    h->counts[hist_index(ns)]++;
+    h->total++;
+    h->sum += ns;
+    if (ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+}
+
+// `count` samples of the same value (e.g. messages completed by one read).
+static inline void hist_record_n(LatencyHistogram *h, uint64_t ns, uint64_t count) {
+    h->counts[hist_index(ns)] += count;
+    h->total += count;
+    h->sum += (double)ns * count;
+    if (ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+}
+
+static inline void hist_merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+// Value at percentile p (0..100), reported as the bucket's upper bound and
+// clamped to the exact observed min/max.
+static inline uint64_t hist_percentile(const LatencyHistogram *h, double p) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * h->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = hist_bucket_upper(i);
+            if (v > h->max) v = h->max;
+            if (v < h->min) v = h->min;
+            return v;
+        }
+    }
+    return h->max;
+}
+
+static inline double hist_mean(const LatencyHistogram *h) {
+    return h->total ? h->sum / h->total : 0;
+}
+
+// One line, in microseconds, for the client summary.
+static inline void hist_print_summary(FILE *out, const char *label, const LatencyHistogram *h) {
+    fprintf(out, "%s: min=%.3f p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f max=%.3f us (n=%llu)\n",
+            label,
+            h->total ? h->min / 1000.0 : 0,
+            hist_percentile(h, 50) / 1000.0,
+            hist_percentile(h, 90) / 1000.0,
+            hist_percentile(h, 99) / 1000.0,
+            hist_percentile(h, 99.9) / 1000.0,
+            h->max / 1000.0,
+            (unsigned long long)h->total);
+}
+
+// Mergeable text dump: a header, then "bucket_index upper_bound_ns count"
+// for every non-empty bucket. Histograms from several runs or hosts merge
+// by summing counts per bucket index.
+static inline int hist_dump(const char *path, const LatencyHistogram *h) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "# mt25020-histogram v1 sub_bits=%d unit=ns total=%llu min=%llu max=%llu sum=%.0f\n",
+            HIST_SUB_BITS, (unsigned long long)h->total,
+            (unsigned long long)(h->total ? h->min : 0), (unsigned long long)h->max, h->sum);
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->counts[i])
+            fprintf(f, "%d %llu %llu\n", i, (unsigned long long)hist_bucket_upper(i),
+                    (unsigned long long)h->counts[i]);
+    }
+    fclose(f);
+    return 0;
+}
+
+#endif
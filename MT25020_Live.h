@@ -0,0 +1,311 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+// Live statistics in shared memory (--live-stats).
+//
+// A running server otherwise prints nothing between its banner and the end
+// of a run. With --live-stats it maps /dev/shm/MT25020_live_<impl>_<port>
+// and publishes counters into it: bytes, send calls, partial sends, EAGAINs,
+// and zero-copy completions and copy fallbacks. There is one slot per
+// connection, and one per reactor, pool worker or io_uring loop.
+// MT25020_Part_C_LiveTop samples the region and prints rates.
+//
+// Every slot has exactly one writer at a time: the thread driving the
+// connection, or the thread the slot describes. So the hot path never needs
+// an atomic read-modify-write. The writer makes the slot's sequence number
+// odd, updates the counters with plain stores, and makes it even again. A
+// reader copies the slot and retries if the sequence number was odd or
+// changed meanwhile (a seqlock). On x86 both fences compile to nothing, so
+// an update costs a few stores and no system call.
+//
+// Slots are taken and returned under a mutex when connections open and
+// close. A reader tells a reused slot apart by its `since_ns`.
+
+#include "MT25020_Common.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define LIVE_MAGIC 0x4D544C56u      // "MTLV"
+#define LIVE_VERSION 1
+#define LIVE_MAX_SLOTS 8192         // further connections are counted, not tracked
+
+enum {
+    LIVE_BYTES,
+    LIVE_SENDS,                 // send-path calls (io_uring: send completions)
+    LIVE_PARTIAL,               // calls that moved less than asked for
+    LIVE_EAGAIN,                // calls that found the socket buffer full
+    LIVE_ZC_DONE,               // zero-copy sends completed
+    LIVE_ZC_COPIED,             // ... of which the kernel copied after all
+    LIVE_NUM_COUNTERS
+};
+
+enum { LIVE_FREE, LIVE_THREAD, LIVE_CONN };
+
+typedef struct {
+    uint32_t seq;               // odd while the writer is updating
+    uint32_t kind;              // LIVE_FREE, LIVE_THREAD or LIVE_CONN
+    int32_t id;                 // thread index, or connection id as in the reports
+    int32_t owner;              // LIVE_CONN: id of the thread driving it; -1: its own thread
+    int64_t since_ns;           // CLOCK_MONOTONIC when the slot was taken
+    uint64_t v[LIVE_NUM_COUNTERS];
+} __attribute__((aligned(64))) LiveSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    int32_t port;
+    char impl[8];
+    char mode[16];              // threads, reactor, pool or io_uring
+    int32_t message_size;
+    int32_t num_slots;
+    int64_t start_ns;           // CLOCK_MONOTONIC at startup
+    uint32_t untracked;         // connections that found no free slot
+} __attribute__((aligned(64))) LiveHeader;
+
+// A connection's view: its own slot, and the slot of the thread driving it
+// (NULL in thread-per-connection mode). Both NULL: not published.
+typedef struct {
+    LiveSlot *conn;
+    LiveSlot *thread;
+    long long zc_done;          // ZcTracker totals already published
+    long long zc_copied;
+} LiveConn;
+
+// The writer side, per server process.
+typedef struct {
+    LiveHeader *hdr;
+    LiveSlot *slots;
+    int *free_slots;            // stack of free indices
+    int num_free;
+    pthread_mutex_t lock;
+} LiveRegion;
+
+static LiveRegion live_region = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline size_t live_region_size(int num_slots) {
+    return sizeof(LiveHeader) + (size_t)num_slots * sizeof(LiveSlot);
+}
+
+static inline void live_region_name(char *buf, size_t len, const char *impl, int port) {
+    snprintf(buf, len, "/MT25020_live_%s_%d", impl, port);
+}
+
+static inline const char* live_server_mode(const ServerOptions *opts) {
+    if (opts->reactor_threads > 0) return "reactor";
+    if (opts->pool_threads > 0) return "pool";
+    if (opts->udp > 0) return "udp";
+    return "threads";
+}
+
+// --- Writer ---
+
+static inline void live_write_begin(LiveSlot *s) {
+    __atomic_store_n(&s->seq, __atomic_load_n(&s->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void live_write_end(LiveSlot *s) {
+    __atomic_store_n(&s->seq, __atomic_load_n(&s->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+// Only the slot's writer calls this, so load + store is enough.
+static inline void live_add(LiveSlot *s, int counter, uint64_t delta) {
+    __atomic_store_n(&s->v[counter], __atomic_load_n(&s->v[counter], __ATOMIC_RELAXED) + delta,
+                     __ATOMIC_RELAXED);
+}
+
+static inline void live_slot_add_send(LiveSlot *s, uint64_t bytes, int partial, int eagain) {
+    live_write_begin(s);
+    live_add(s, LIVE_BYTES, bytes);
+    live_add(s, LIVE_SENDS, 1);
+    if (partial) live_add(s, LIVE_PARTIAL, 1);
+    if (eagain) live_add(s, LIVE_EAGAIN, 1);
+    live_write_end(s);
+}
+
+static inline void live_slot_add_zc(LiveSlot *s, uint64_t done, uint64_t copied) {
+    live_write_begin(s);
+    live_add(s, LIVE_ZC_DONE, done);
+    live_add(s, LIVE_ZC_COPIED, copied);
+    live_write_end(s);
+}
+
+// Create the region for this server. Without --live-stats nothing is
+// mapped and every slot request returns NULL. Returns -1 on failure.
+static inline int live_stats_open(const ServerOptions *opts, const char *impl, const char *mode) {
+    if (!opts->live_stats) return 0;
+    char name[64];
+    live_region_name(name, sizeof(name), impl, opts->port);
+    size_t size = live_region_size(LIVE_MAX_SLOTS);
+
+    // A region left by an earlier server on this port is replaced.
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open failed");
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        perror("ftruncate failed");
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    live_region.free_slots = (int*)malloc(LIVE_MAX_SLOTS * sizeof(int));
+    if (base == MAP_FAILED || !live_region.free_slots) {
+        fprintf(stderr, "Failed to map live statistics\n");
+        if (base != MAP_FAILED) munmap(base, size);
+        free(live_region.free_slots);
+        shm_unlink(name);
+        return -1;
+    }
+
+    // ftruncate() zero-filled the slots: all LIVE_FREE.
+    LiveHeader *hdr = (LiveHeader*)base;
+    hdr->version = LIVE_VERSION;
+    hdr->pid = getpid();
+    hdr->port = opts->port;
+    snprintf(hdr->impl, sizeof(hdr->impl), "%s", impl);
+    snprintf(hdr->mode, sizeof(hdr->mode), "%s", mode);
+    hdr->message_size = opts->message_size;
+    hdr->num_slots = LIVE_MAX_SLOTS;
+    hdr->start_ns = get_time_ns();
+    for (int i = 0; i < LIVE_MAX_SLOTS; i++)
+        live_region.free_slots[i] = LIVE_MAX_SLOTS - 1 - i;
+    live_region.num_free = LIVE_MAX_SLOTS;
+    live_region.slots = (LiveSlot*)((char*)base + sizeof(LiveHeader));
+    // Readers check the magic last.
+    __atomic_store_n(&hdr->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    live_region.hdr = hdr;
+
+    printf("[%s] live statistics in /dev/shm%s\n", impl, name);
+    fflush(stdout);
+    return 0;
+}
+
+// Take a slot; the calling thread becomes its writer. NULL without
+// --live-stats or when every slot is in use.
+static inline LiveSlot* live_slot_acquire(int kind, int id, int owner) {
+    if (!live_region.hdr) return NULL;
+    LiveSlot *s = NULL;
+    pthread_mutex_lock(&live_region.lock);
+    if (live_region.num_free > 0)
+        s = &live_region.slots[live_region.free_slots[--live_region.num_free]];
+    else
+        live_region.hdr->untracked++;
+    pthread_mutex_unlock(&live_region.lock);
+    if (!s) return NULL;
+
+    live_write_begin(s);
+    s->kind = kind;
+    s->id = id;
+    s->owner = owner;
+    s->since_ns = get_time_ns();
+    for (int i = 0; i < LIVE_NUM_COUNTERS; i++) __atomic_store_n(&s->v[i], 0, __ATOMIC_RELAXED);
+    live_write_end(s);
+    return s;
+}
+
+static inline void live_slot_release(LiveSlot *s) {
+    if (!s) return;
+    live_write_begin(s);
+    s->kind = LIVE_FREE;
+    live_write_end(s);
+    pthread_mutex_lock(&live_region.lock);
+    live_region.free_slots[live_region.num_free++] = (int)(s - live_region.slots);
+    pthread_mutex_unlock(&live_region.lock);
+}
+
+// Publish a connection, driven by `thread` (NULL: by its own thread).
+static inline void live_conn_open(LiveConn *l, int id, LiveSlot *thread) {
+    l->thread = thread;
+    l->conn = live_slot_acquire(LIVE_CONN, id, thread ? thread->id : -1);
+    l->zc_done = l->zc_copied = 0;
+}
+
+static inline void live_conn_close(LiveConn *l) {
+    live_slot_release(l->conn);
+    l->conn = NULL;
+    l->thread = NULL;
+}
+
+// --pool: `thread` now drives the connection. Called by the new driver.
+static inline void live_conn_move(LiveConn *l, LiveSlot *thread) {
+    if (!l->conn || l->thread == thread) return;
+    l->thread = thread;
+    live_write_begin(l->conn);
+    l->conn->owner = thread ? thread->id : -1;
+    live_write_end(l->conn);
+}
+
+// One send call that was asked to move `want` bytes and returned n (errno
+// set when n < 0). Leaves errno alone.
+static inline void live_note_send(LiveConn *l, size_t want, ssize_t n) {
+    if (!l || !l->conn) return;
+    uint64_t bytes = n > 0 ? (uint64_t)n : 0;
+    int partial = n > 0 && (size_t)n < want;
+    int eagain = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    live_slot_add_send(l->conn, bytes, partial, eagain);
+    if (l->thread) live_slot_add_send(l->thread, bytes, partial, eagain);
+}
+
+// Zero-copy totals so far; publishes what is new since the last call.
+static inline void live_note_zc(LiveConn *l, long long done, long long copied) {
+    if (!l || !l->conn) return;
+    uint64_t d = done - l->zc_done, c = copied - l->zc_copied;
+    if (d == 0 && c == 0) return;
+    l->zc_done = done;
+    l->zc_copied = copied;
+    live_slot_add_zc(l->conn, d, c);
+    if (l->thread) live_slot_add_zc(l->thread, d, c);
+}
+
+// --- Reader ---
+
+// Map an existing region read-only. Returns the header or NULL.
+static inline const LiveHeader* live_stats_attach(const char *impl, int port, size_t *size) {
+    char name[64];
+    live_region_name(name, sizeof(name), impl, port);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    *size = live_region_size(LIVE_MAX_SLOTS);
+    void *base = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    const LiveHeader *hdr = (const LiveHeader*)base;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC ||
+        hdr->version != LIVE_VERSION || hdr->num_slots != LIVE_MAX_SLOTS) {
+        munmap(base, *size);
+        return NULL;
+    }
+    return hdr;
+}
+
+static inline const LiveSlot* live_stats_slots(const LiveHeader *hdr) {
+    return (const LiveSlot*)((const char*)hdr + sizeof(LiveHeader));
+}
+
+// Consistent copy of *s. Returns -1 if the writer kept it busy.
+static inline int live_slot_read(const LiveSlot *s, LiveSlot *out) {
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        out->kind = __atomic_load_n(&s->kind, __ATOMIC_RELAXED);
+        out->id = __atomic_load_n(&s->id, __ATOMIC_RELAXED);
+        out->owner = __atomic_load_n(&s->owner, __ATOMIC_RELAXED);
+        out->since_ns = __atomic_load_n(&s->since_ns, __ATOMIC_RELAXED);
+        for (int i = 0; i < LIVE_NUM_COUNTERS; i++)
+            out->v[i] = __atomic_load_n(&s->v[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+            out->seq = seq;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
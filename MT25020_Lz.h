@@ -0,0 +1,188 @@
+#ifndef LZ_H
+#define LZ_H
+
+// Fast LZ77 block codec for the --pipeline compression stage.
+//
+// The output is the LZ4 block format, so any LZ4 decoder can read it, but
+// the codec is self-contained like the rest of the tree. A block is a run
+// of sequences:
+//
+//   token       high nibble: literal count, low nibble: match length - 4
+//               (15 = more length bytes follow, each adding up to 255)
+//   literals    copied verbatim
+//   offset      2 bytes little-endian, distance back to the match
+//
+// The last sequence holds literals only. Matches must end 5 bytes before
+// the end of the block and start at least 12 bytes before it. The
+// compressor is greedy with a single-entry hash table of 4-byte prefixes.
+// Its search step grows in stretches that do not match, so incompressible
+// data costs little more than a copy. The decoder checks every length and
+// offset against both buffers, so corrupt input fails cleanly.
+
+#include "MT25020_Common.h"
+
+#define LZ_HASH_LOG 14
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5          // the block always ends in this many literals
+#define LZ_MFLIMIT 12               // no match starts within this many bytes of the end
+#define LZ_MAX_OFFSET 65535
+#define LZ_SKIP_TRIGGER 6           // step grows by one every 2^6 misses
+
+// Per-thread compressor state.
+typedef struct {
+    uint32_t table[1 << LZ_HASH_LOG];   // last position seen for each hashed prefix
+} LzState;
+
+// Largest output lz_compress() can produce for `n` input bytes.
+static inline size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static inline uint32_t lz_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t lz_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static inline uint8_t* lz_put_length(uint8_t *op, size_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// One sequence: `lit` literals from `anchor`, then a match of `mlen` + 4
+// bytes at `offset` (mlen < 0: literals only, the block's last sequence).
+static inline uint8_t* lz_put_sequence(uint8_t *op, const uint8_t *anchor, size_t lit,
+                                       size_t offset, long mlen) {
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) op = lz_put_length(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+    if (mlen < 0) return op;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    *token |= (uint8_t)(mlen >= 15 ? 15 : mlen);
+    if (mlen >= 15) op = lz_put_length(op, mlen - 15);
+    return op;
+}
+
+// Bytes `a` and `b` have in common, stopping at `limit` (a's end).
+static inline size_t lz_common(const uint8_t *a, const uint8_t *b, const uint8_t *limit) {
+    const uint8_t *start = a;
+    while (a + 8 <= limit) {
+        uint64_t diff = lz_read64(a) ^ lz_read64(b);
+        if (diff) return a - start + (__builtin_ctzll(diff) >> 3);   // little-endian
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return a - start;
+}
+
+// Compress `n` bytes into `dst` (at least lz_bound(n) bytes). Returns the
+// compressed size.
+static inline size_t lz_compress(LzState *s, const void *src_, size_t n, void *dst_) {
+    const uint8_t *src = (const uint8_t*)src_;
+    const uint8_t *end = src + n;
+    const uint8_t *anchor = src;
+    uint8_t *op = (uint8_t*)dst_;
+
+    if (n > LZ_MFLIMIT) {
+        const uint8_t *mflimit = end - LZ_MFLIMIT;
+        const uint8_t *matchlimit = end - LZ_LAST_LITERALS;
+        memset(s->table, 0, sizeof(s->table));
+        const uint8_t *ip = src + 1;
+        unsigned misses = 1 << LZ_SKIP_TRIGGER;
+        while (ip < mflimit) {
+            uint32_t seq = lz_read32(ip);
+            uint32_t h = lz_hash(seq);
+            const uint8_t *match = src + s->table[h];
+            s->table[h] = (uint32_t)(ip - src);
+            if (match >= ip || ip - match > LZ_MAX_OFFSET || lz_read32(match) != seq) {
+                ip += misses++ >> LZ_SKIP_TRIGGER;
+                continue;
+            }
+            misses = 1 << LZ_SKIP_TRIGGER;
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            size_t len = LZ_MIN_MATCH + lz_common(ip + LZ_MIN_MATCH, match + LZ_MIN_MATCH,
+                                                  matchlimit);
+            op = lz_put_sequence(op, anchor, ip - anchor, ip - match, (long)(len - LZ_MIN_MATCH));
+            ip += len;
+            anchor = ip;
+            // Seed the table inside the match so the next one is found sooner.
+            if (ip < mflimit) s->table[lz_hash(lz_read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+        }
+    }
+    op = lz_put_sequence(op, anchor, end - anchor, 0, -1);
+    return op - (uint8_t*)dst_;
+}
+
+static inline int lz_get_length(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+    unsigned b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+// Decode `n` bytes of `src` into `dst` (`cap` bytes). Returns the decoded
+// size, or -1 if `src` is not a valid block or does not fit.
+static inline long lz_decompress(const void *src_, size_t n, void *dst_, size_t cap) {
+    const uint8_t *ip = (const uint8_t*)src_;
+    const uint8_t *iend = ip + n;
+    uint8_t *dst = (uint8_t*)dst_;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + cap;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && lz_get_length(&ip, iend, &lit) < 0) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break;                  // last sequence: literals only
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+        size_t len = token & 15;
+        if (len == 15 && lz_get_length(&ip, iend, &len) < 0) return -1;
+        len += LZ_MIN_MATCH;
+        if (len > (size_t)(oend - op)) return -1;
+
+        const uint8_t *match = op - offset;
+        if (offset >= 8 && (size_t)(oend - op) >= len + 8) {
+            // Non-overlapping 8-byte steps; may write up to 7 bytes past
+            // the match, which the next sequence overwrites.
+            for (size_t i = 0; i < len; i += 8) memcpy(op + i, match + i, 8);
+        } else {
+            for (size_t i = 0; i < len; i++) op[i] = match[i];
+        }
+        op += len;
+    }
+    return op - dst;
+}
+
+#endif
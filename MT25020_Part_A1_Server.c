@@ -1,113 +1,157 @@
 #include "MT25020_Common.h"
+#include "MT25020_Strategies.h"
+#include "MT25020_Pool.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Udp.h"
+#include "MT25020_Accept.h"
+#include "MT25020_Pipeline.h"
 
 void* handle_client(void* arg) {
     ServerThreadArgs *args = (ServerThreadArgs*)arg;
+    const ServerOptions *opts = args->opts;
     int client_socket = args->client_socket;
     int message_size = args->message_size;
     int field_size = message_size / NUM_FIELDS;
+    // --batch: every send() carries `batch` back-to-back messages
+    int unit_size = stream_unit_size(opts);
+    int flags = stream_send_flags(opts);
+    const GatherKernel *gather = gather_kernel_find(opts->gather);   // checked in main
     
-    Message *msg = allocate_message(field_size);
+    Message *msg = acquire_message(opts, field_size);
     // CHANGE 1: Allocate a single linear buffer for the "User Copy"
-    char *linear_buffer = (char*)malloc(message_size);
+    // (not needed with --payload-cache: the shared payload is prelinearized)
+    char *linear_buffer = opts->payload_cache ? NULL : (char*)malloc(unit_size);
+    // --frame: headers are marshalled into linear_buffer along with the fields
+    FrameWriter frame;
 
-    if (!msg || !linear_buffer) {
+    if (!msg || (!opts->payload_cache && !linear_buffer) ||
+        frame_writer_init(&frame, opts, msg, field_size, 0) < 0) {
         fprintf(stderr, "Failed to allocate memory\n");
-        if (msg) free_message(msg);
-        if (linear_buffer) free(linear_buffer);
+        release_message(opts, msg);
+        free(linear_buffer);
         close(client_socket);
+        connection_closed();
         free(args);
         return NULL;
     }
     
+    // --tx-timestamps: the app->sched interval starts before copy #1
+    TxStamps *stamps = opts->tx_timestamps ? tx_stamps_create(client_socket) : NULL;
+    PerfCounters pc;
+    perf_counters_open(&pc, opts->perf_counters);
+    long long bytes_sent = 0;
+    long long syscalls = 0;
+    LiveConn live;
+    live_conn_open(&live, args->thread_id, NULL);
+    
     while (1) {
+        if (stamps && tx_stamps_due(stamps) &&
+            tx_stamps_process_errqueue(client_socket, stamps) < 0)
+            break;
+        long long app_ns = stamps ? ts_realtime_ns() : 0;
+        frame_begin_unit(&frame, 0);
+        if (opts->payload_cache) {
+            // Shared payload: one kernel copy from the prelinearized buffer.
+            struct iovec iov[2 * MAX_BATCH];
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = linear_iov_from_offset(frame.cur, payload_linear(msg), message_size,
+                                                    unit_size, 0, iov);
+            ssize_t sent = sendmsg(client_socket, &hdr, flags);
+            syscalls++;
+            live_note_send(&live, unit_size, sent);
+            if (sent <= 0) break;
+            if (stamps) tx_stamps_note_send(stamps, app_ns, sent);
+            bytes_sent += sent;
+            continue;
+        }
+        
         // CHANGE 2: "Two-Copy" Implementation
         
         // Copy #1: User-Space Copy
         // We manually assemble the 8 scattered fields into one contiguous buffer.
-        // This represents the cost of "marshalling" data in real applications.
-        memcpy(linear_buffer + (0 * field_size), msg->field1, field_size);
-        memcpy(linear_buffer + (1 * field_size), msg->field2, field_size);
-        memcpy(linear_buffer + (2 * field_size), msg->field3, field_size);
-        memcpy(linear_buffer + (3 * field_size), msg->field4, field_size);
-        memcpy(linear_buffer + (4 * field_size), msg->field5, field_size);
-        memcpy(linear_buffer + (5 * field_size), msg->field6, field_size);
-        memcpy(linear_buffer + (6 * field_size), msg->field7, field_size);
-        memcpy(linear_buffer + (7 * field_size), msg->field8, field_size);
+        // This represents the cost of "marshalling" data in real applications,
+        // so it runs through the fastest gather kernel this CPU has.
+        gather_message(gather, opts->nt_threshold, linear_buffer, frame.cur, msg, field_size,
+                       opts->batch);
 
         // Copy #2: Kernel-Space Copy
         // We call send() once. The kernel copies data from linear_buffer to the socket buffer.
-        ssize_t sent = send(client_socket, linear_buffer, message_size, 0);
+        ssize_t sent = send(client_socket, linear_buffer, unit_size, flags);
+        syscalls++;
+        live_note_send(&live, unit_size, sent);
         
         if (sent <= 0) break;
+        if (stamps) tx_stamps_note_send(stamps, app_ns, sent);
+        bytes_sent += sent;
     }
     
+    char label[128];
+    placement_conn_label(label, sizeof(label), "A1", args->thread_id, client_socket, syscalls);
+    perf_counters_finish(&pc, label, bytes_sent);
+    if (stamps) {
+        tx_stamps_process_errqueue(client_socket, stamps);
+        tx_stamps_report("A1", args->thread_id, stamps);
+        free(stamps);
+    }
+    live_conn_close(&live);
+    
     // Cleanup
+    frame_writer_free(&frame);
     free(linear_buffer);
-    free_message(msg);
+    release_message(opts, msg);
     close(client_socket);
+    connection_closed();
     free(args);
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <message_size> <port>\n", argv[0]);
+    ServerOptions opts;
+    if (parse_server_options(argc, argv, &opts) < 0) {
         exit(EXIT_FAILURE);
     }
-    
-    int message_size = atoi(argv[1]);
-    int port = atoi(argv[2]);
-    
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket < 0) {
-        perror("Socket creation failed");
+    if (opts.ktls && !ktls_available()) {
         exit(EXIT_FAILURE);
     }
-    
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed");
-        close(server_socket);
+    const GatherKernel *gather = gather_kernel_find(opts.gather);
+    if (!gather) {
+        fprintf(stderr, "Gather kernel '%s' is unknown or not supported by this CPU\n", opts.gather);
         exit(EXIT_FAILURE);
     }
+    if (!opts.payload_cache) {
+        printf("A1 marshalling with the %s kernel", gather->name);
+        if (gather->copy_nt && opts.nt_threshold > 0)
+            printf(", non-temporal stores from %ld bytes", opts.nt_threshold);
+        printf("\n");
+    }
     
-    if (listen(server_socket, MAX_CLIENTS) < 0) {
-        perror("Listen failed");
-        close(server_socket);
+    if (live_stats_open(&opts, "A1", live_server_mode(&opts)) < 0) {
         exit(EXIT_FAILURE);
     }
     
-    printf("A1 Server listening on 0.0.0.0:%d\n", port);
-    
-    int thread_count = 0;
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-        if (client_socket < 0) {
-            perror("Accept failed");
-            continue;
-        }
-        
-        ServerThreadArgs *args = (ServerThreadArgs*)malloc(sizeof(ServerThreadArgs));
-        args->client_socket = client_socket;
-        args->thread_id = thread_count++;
-        args->message_size = message_size;
-        
-        pthread_t thread;
-        pthread_create(&thread, NULL, handle_client, args);
-        pthread_detach(thread);
+    if (opts.udp) {
+        return run_udp_server("A1", UDP_SEND_LINEAR, &opts) == 0 ? 0 : EXIT_FAILURE;
+    }
+    if (opts.pipeline) {
+        return run_pipeline_server("A1", PIPE_SEND_LINEAR, &opts) == 0 ? 0 : EXIT_FAILURE;
+    }
+    if (opts.reactor_threads > 0) {
+        return run_reactor_server(&a1_strategy, &opts) == 0 ? 0 : EXIT_FAILURE;
+    }
+    if (opts.pool_threads > 0) {
+        return run_pool_server(&a1_strategy, &opts) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    Placement placement;
+    if (placement_init(&placement, &opts) < 0) {
+        exit(EXIT_FAILURE);
     }
     
-    close(server_socket);
-    return 0;
+    AcceptLoop loop = { .name = "A1", .opts = &opts, .placement = &placement,
+                        .handler = opts.rpc ? rpc_handle_client : handle_client,
+                        .strategy = &a1_strategy };
+    return run_accept_loop(&loop) == 0 ? 0 : EXIT_FAILURE;
 }
\ No newline at end of file
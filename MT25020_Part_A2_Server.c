@@ -1,8 +1,18 @@
 #include "MT25020_Common.h"
+#include "MT25020_Strategies.h"
+#include "MT25020_Pool.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Udp.h"
+#include "MT25020_Accept.h"
+#include "MT25020_Pipeline.h"
 #include <sys/uio.h>
 
-// Helper to send entire iovec via sendmsg handling partial writes
-static ssize_t send_iov_all(int sock, struct iovec *iov, int iovcnt, int flags) {
+// Helper to send entire iovec via sendmsg handling partial writes;
+// counts the sendmsg() calls it makes in *calls, notes each one in
+// `stamps` (--tx-timestamps) when non-NULL and publishes it to `live`.
+static ssize_t send_iov_all(int sock, struct iovec *iov, int iovcnt, int flags,
+                            long long *calls, TxStamps *stamps, LiveConn *live) {
     struct msghdr hdr;
     memset(&hdr, 0, sizeof(hdr));
     hdr.msg_iov = iov;
@@ -14,107 +24,93 @@ static ssize_t send_iov_all(int sock, struct iovec *iov, int iovcnt, int flags)
 
     size_t sent_total = 0;
     while (sent_total < total) {
+        long long app_ns = stamps ? ts_realtime_ns() : 0;
         ssize_t n = sendmsg(sock, &hdr, flags);
+        (*calls)++;
+        live_note_send(live, total - sent_total, n);
         if (n <= 0) return n;
+        if (stamps) tx_stamps_note_send(stamps, app_ns, n);
         sent_total += n;
-
-        // Advance iovecs by n bytes (handling partial sends)
-        size_t rem = n;
-        int idx = 0;
-        while (rem > 0 && idx < hdr.msg_iovlen) {
-            if (rem >= (size_t)hdr.msg_iov[idx].iov_len) {
-                rem -= hdr.msg_iov[idx].iov_len;
-                hdr.msg_iov[idx].iov_base = (char*)hdr.msg_iov[idx].iov_base + hdr.msg_iov[idx].iov_len;
-                hdr.msg_iov[idx].iov_len = 0;
-                idx++;
-            } else {
-                hdr.msg_iov[idx].iov_base = (char*)hdr.msg_iov[idx].iov_base + rem;
-                hdr.msg_iov[idx].iov_len -= rem;
-                rem = 0;
-            }
-        }
-        
-        // Compact iov array
-        int new_cnt = 0;
-        for (int i = 0; i < iovcnt; i++) {
-            if (hdr.msg_iov[i].iov_len > 0) {
-                if (i != new_cnt) hdr.msg_iov[new_cnt] = hdr.msg_iov[i];
-                new_cnt++;
-            }
-        }
-        hdr.msg_iovlen = new_cnt;
+        // Partial send: continue from the first unsent byte
+        msghdr_advance(&hdr, n);
     }
     return (ssize_t)sent_total;
 }
 
 void* handle_client(void* arg) {
     ServerThreadArgs *args = (ServerThreadArgs*)arg;
+    const ServerOptions *opts = args->opts;
     int client_socket = args->client_socket;
     int message_size = args->message_size;
     int field_size = message_size / NUM_FIELDS;
+    // --batch: one iovec per field of every message in the unit
+    int unit_size = stream_unit_size(opts);
+    int flags = stream_send_flags(opts);
     
-    Message *msg = allocate_message(field_size);
-    if (!msg) {
+    Message *msg = acquire_message(opts, field_size);
+    // --frame: each header is one more iovec ahead of its message's fields
+    FrameWriter frame;
+    if (!msg || frame_writer_init(&frame, opts, msg, field_size, 0) < 0) {
+        release_message(opts, msg);
         close(client_socket);
+        connection_closed();
         free(args);
         return NULL;
     }
     
-    struct iovec iov[NUM_FIELDS];
+    struct iovec iov[NUM_FIELDS * MAX_BATCH];
+    TxStamps *stamps = opts->tx_timestamps ? tx_stamps_create(client_socket) : NULL;
+    PerfCounters pc;
+    perf_counters_open(&pc, opts->perf_counters);
+    long long bytes_sent = 0;
+    long long syscalls = 0;
+    LiveConn live;
+    live_conn_open(&live, args->thread_id, NULL);
     
     while (1) {
+        if (stamps && tx_stamps_due(stamps) &&
+            tx_stamps_process_errqueue(client_socket, stamps) < 0)
+            break;
         // ONE-COPY: Reset iovec pointers every loop
-        iov[0].iov_base = msg->field1; iov[0].iov_len = field_size;
-        iov[1].iov_base = msg->field2; iov[1].iov_len = field_size;
-        iov[2].iov_base = msg->field3; iov[2].iov_len = field_size;
-        iov[3].iov_base = msg->field4; iov[3].iov_len = field_size;
-        iov[4].iov_base = msg->field5; iov[4].iov_len = field_size;
-        iov[5].iov_base = msg->field6; iov[5].iov_len = field_size;
-        iov[6].iov_base = msg->field7; iov[6].iov_len = field_size;
-        iov[7].iov_base = msg->field8; iov[7].iov_len = field_size;
+        frame_begin_unit(&frame, 0);
+        int iovcnt = message_iov_from_offset(msg, field_size, frame.cur, unit_size, 0, iov);
         
-        ssize_t sent = send_iov_all(client_socket, iov, NUM_FIELDS, 0);
+        ssize_t sent = send_iov_all(client_socket, iov, iovcnt, flags, &syscalls, stamps, &live);
         if (sent <= 0) break;
+        bytes_sent += sent;
+    }
+    
+    char label[128];
+    placement_conn_label(label, sizeof(label), "A2", args->thread_id, client_socket, syscalls);
+    perf_counters_finish(&pc, label, bytes_sent);
+    if (stamps) {
+        tx_stamps_process_errqueue(client_socket, stamps);
+        tx_stamps_report("A2", args->thread_id, stamps);
+        free(stamps);
     }
+    live_conn_close(&live);
     
-    free_message(msg);
+    frame_writer_free(&frame);
+    release_message(opts, msg);
     close(client_socket);
+    connection_closed();
     free(args);
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) { fprintf(stderr, "Usage: %s <size> <port>\n", argv[0]); exit(1); }
-    int message_size = atoi(argv[1]);
-    int port = atoi(argv[2]);
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY); // <--- CRITICAL FIX
-    server_addr.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed"); exit(1);
-    }
-    listen(server_socket, MAX_CLIENTS);
-    
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t len = sizeof(client_addr);
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &len);
-        if (client_socket < 0) continue;
-        
-        ServerThreadArgs *args = malloc(sizeof(ServerThreadArgs));
-        args->client_socket = client_socket;
-        args->message_size = message_size;
-        pthread_t t;
-        pthread_create(&t, NULL, handle_client, args);
-        pthread_detach(t);
-    }
-    return 0;
+    ServerOptions opts;
+    if (parse_server_options(argc, argv, &opts) < 0) exit(1);
+    if (opts.ktls && !ktls_available()) exit(1);
+    if (live_stats_open(&opts, "A2", live_server_mode(&opts)) < 0) exit(1);
+    if (opts.udp) return run_udp_server("A2", UDP_SEND_IOV, &opts) == 0 ? 0 : 1;
+    if (opts.pipeline) return run_pipeline_server("A2", PIPE_SEND_IOV, &opts) == 0 ? 0 : 1;
+    if (opts.reactor_threads > 0) return run_reactor_server(&a2_strategy, &opts) == 0 ? 0 : 1;
+    if (opts.pool_threads > 0) return run_pool_server(&a2_strategy, &opts) == 0 ? 0 : 1;
+    Placement placement;
+    if (placement_init(&placement, &opts) < 0) exit(1);
+    AcceptLoop loop = { .name = "A2", .opts = &opts, .placement = &placement,
+                        .handler = opts.rpc ? rpc_handle_client : handle_client,
+                        .strategy = &a2_strategy };
+    return run_accept_loop(&loop) == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -1,100 +1,137 @@
 #include "MT25020_Common.h"
+#include "MT25020_Strategies.h"
+#include "MT25020_Pool.h"
+#include "MT25020_Payload.h"
+#include "MT25020_ZeroCopy.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Udp.h"
+#include "MT25020_Accept.h"
+#include "MT25020_Pipeline.h"
 #include <sys/uio.h>
-#include <linux/errqueue.h>
-
-#ifndef SO_ZEROCOPY
-#define SO_ZEROCOPY 60
-#endif
-#ifndef MSG_ZEROCOPY
-#define MSG_ZEROCOPY 0x4000000
-#endif
 
 void* handle_client(void* arg) {
     ServerThreadArgs *args = (ServerThreadArgs*)arg;
+    const ServerOptions *opts = args->opts;
     int client_socket = args->client_socket;
     int message_size = args->message_size;
     int field_size = message_size / NUM_FIELDS;
+    int unit_size = stream_unit_size(opts);
+    int flags = stream_send_flags(opts);
     
-    // Try enabling Zero-Copy, but don't crash if it fails
-    int optval = 1;
-    if (setsockopt(client_socket, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) < 0) {
-        // Just continue, it will fall back to normal copy
+    // Enables SO_ZEROCOPY; if the kernel refuses, every message takes the
+    // plain sendmsg path instead of silently copying under MSG_ZEROCOPY.
+    ZcTracker *zc = (ZcTracker*)malloc(sizeof(ZcTracker));
+    Message *msg = acquire_message(opts, field_size);
+    // --frame: zero-copy units take their headers from a ring whose slots
+    // are only reused once the sends that pinned them have completed.
+    FrameWriter frame;
+    if (!zc || !msg || frame_writer_init(&frame, opts, msg, field_size, ZC_RING_SIZE + 1) < 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        free(zc);
+        release_message(opts, msg);
+        close(client_socket);
+        connection_closed();
+        free(args);
+        return NULL;
     }
+    zc_tracker_init(zc, client_socket, opts);
+    // --tx-timestamps: reports share the error queue with the completions
+    zc->stamps = opts->tx_timestamps ? tx_stamps_create(client_socket) : NULL;
+    LiveConn live;
+    live_conn_open(&live, args->thread_id, NULL);
+    zc->live = &live;
     
-    Message *msg = allocate_message(field_size);
-    struct iovec iov[NUM_FIELDS];
+    struct iovec iov[NUM_FIELDS * MAX_BATCH];
+    PerfCounters pc;
+    perf_counters_open(&pc, opts->perf_counters);
+    long long bytes_sent = 0;
+    long long syscalls = 0;
     
     while (1) {
-        // Reset iov
-        iov[0].iov_base = msg->field1; iov[0].iov_len = field_size;
-        iov[1].iov_base = msg->field2; iov[1].iov_len = field_size;
-        iov[2].iov_base = msg->field3; iov[2].iov_len = field_size;
-        iov[3].iov_base = msg->field4; iov[3].iov_len = field_size;
-        iov[4].iov_base = msg->field5; iov[4].iov_len = field_size;
-        iov[5].iov_base = msg->field6; iov[5].iov_len = field_size;
-        iov[6].iov_base = msg->field7; iov[6].iov_len = field_size;
-        iov[7].iov_base = msg->field8; iov[7].iov_len = field_size;
-        
-        struct msghdr mh = {0};
-        mh.msg_iov = iov;
-        mh.msg_iovlen = NUM_FIELDS;
-        
-        // Send with MSG_ZEROCOPY
-        if (sendmsg(client_socket, &mh, MSG_ZEROCOPY) <= 0) break;
+        int zerocopy = zc_begin_message(zc);
+        frame_begin_unit(&frame, zerocopy);
         
-        // Essential: Clean the error queue to prevent memory leaks in kernel
-        char buf[1024];
-        struct msghdr err_msg = {0};
-        struct iovec err_iov = { .iov_base = buf, .iov_len = sizeof(buf) };
-        char control[1024];
+        // Partial sends are resumed from `offset`; each sendmsg that moves
+        // data under MSG_ZEROCOPY consumes one completion id. With --batch
+        // the unit is `batch` messages and the decision covers all of them.
+        size_t offset = 0;
+        while (offset < (size_t)unit_size) {
+            size_t remaining = unit_size - offset;
+            
+            // Backpressure: too much payload still pinned by the kernel.
+            while (zerocopy && zc_must_wait(zc, remaining)) {
+                if (zc_wait(client_socket, zc, -1) < 0) goto done;
+            }
+            
+            struct msghdr mh = {0};
+            mh.msg_iov = iov;
+            mh.msg_iovlen = message_iov_from_offset(msg, field_size, frame.cur, unit_size,
+                                                  offset, iov);
+            
+            long long app_ns = zc->stamps ? ts_realtime_ns() : 0;
+            ssize_t n = sendmsg(client_socket, &mh, flags | (zerocopy ? MSG_ZEROCOPY : 0));
+            syscalls++;
+            live_note_send(&live, remaining, n);
+            if (n < 0 && errno == ENOBUFS && zerocopy) {
+                // optmem limit reached: wait for completions, then retry.
+                if (zc_wait(client_socket, zc, -1) < 0) goto done;
+                continue;
+            }
+            if (n <= 0) goto done;
+            if (zerocopy) zc_record_send(zc, n);
+            if (zc->stamps) tx_stamps_note_send(zc->stamps, app_ns, n);
+            offset += n;
+            bytes_sent += n;
+        }
         
-        err_msg.msg_iov = &err_iov;
-        err_msg.msg_iovlen = 1;
-        err_msg.msg_control = control;
-        err_msg.msg_controllen = sizeof(control);
-        
-        // Non-blocking check for completion notifications
-        recvmsg(client_socket, &err_msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        // Batch completion handling: only touch the error queue once half
+        // the in-flight budget is used, so notifications arrive coalesced
+        // (timestamp reports do not coalesce and are read more often).
+        if (zc->inflight_bytes > zc->max_inflight_bytes / 2 ||
+            (zc->stamps && tx_stamps_due(zc->stamps))) {
+            if (zc_process_errqueue(client_socket, zc) < 0) break;
+        }
     }
     
-    free_message(msg);
+done:
+    // The kernel may still reference msg's pages; wait before freeing.
+    zc_drain_all(client_socket, zc, 1000);
+    zc_report("A3", args->thread_id, zc);
+    if (zc->stamps) {
+        tx_stamps_report("A3", args->thread_id, zc->stamps);
+        free(zc->stamps);
+    }
+    live_conn_close(&live);
+    char label[128];
+    placement_conn_label(label, sizeof(label), "A3", args->thread_id, client_socket, syscalls);
+    perf_counters_finish(&pc, label, bytes_sent);
+    free(zc);
+    frame_writer_free(&frame);
+    release_message(opts, msg);
     close(client_socket);
+    connection_closed();
     free(args);
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) { fprintf(stderr, "Usage: %s <size> <port>\n", argv[0]); exit(1); }
-    int message_size = atoi(argv[1]);
-    int port = atoi(argv[2]);
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY); // <--- CRITICAL FIX
-    server_addr.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed"); exit(1);
-    }
-    listen(server_socket, MAX_CLIENTS);
-    
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t len = sizeof(client_addr);
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &len);
-        if (client_socket < 0) continue;
-        
-        ServerThreadArgs *args = malloc(sizeof(ServerThreadArgs));
-        args->client_socket = client_socket;
-        args->message_size = message_size;
-        pthread_t t;
-        pthread_create(&t, NULL, handle_client, args);
-        pthread_detach(t);
+    ServerOptions opts;
+    if (parse_server_options(argc, argv, &opts) < 0) exit(1);
+    if (opts.ktls) {
+        // The TLS layer rejects MSG_ZEROCOPY; without it A3 is just A2.
+        fprintf(stderr, "A3 sends with MSG_ZEROCOPY, which kernel TLS does not support; "
+                        "--ktls is served by A1, A2 and A5\n");
+        exit(1);
     }
-    return 0;
+    if (live_stats_open(&opts, "A3", live_server_mode(&opts)) < 0) exit(1);
+    if (opts.udp) return run_udp_server("A3", UDP_SEND_ZEROCOPY, &opts) == 0 ? 0 : 1;
+    if (opts.pipeline) return run_pipeline_server("A3", PIPE_SEND_ZEROCOPY, &opts) == 0 ? 0 : 1;
+    if (opts.reactor_threads > 0) return run_reactor_server(&a3_strategy, &opts) == 0 ? 0 : 1;
+    if (opts.pool_threads > 0) return run_pool_server(&a3_strategy, &opts) == 0 ? 0 : 1;
+    Placement placement;
+    if (placement_init(&placement, &opts) < 0) exit(1);
+    AcceptLoop loop = { .name = "A3", .opts = &opts, .placement = &placement,
+                        .handler = opts.rpc ? rpc_handle_client : handle_client,
+                        .strategy = &a3_strategy };
+    return run_accept_loop(&loop) == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,385 @@
+#include "MT25020_Common.h"
+#include "MT25020_Uring.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Placement.h"
+#include "MT25020_Live.h"
+#include "MT25020_Accept.h"
+#include <signal.h>
+#include <sys/eventfd.h>
+
+// A4: io_uring transmit engine.
+//
+// The eight Message fields are registered once as fixed buffers and every
+// field goes out as an IORING_OP_SEND_ZC referencing its buffer index, so the
+// kernel neither copies the payload nor has to pin the pages on each send.
+// Completion notifications arrive on the CQ (IORING_CQE_F_NOTIF) instead of
+// the socket error queue. Each connection keeps two linked SQE chains of
+// `queue_depth` messages queued, so the kernel already holds the next chain
+// while the current one is sending. Links only order sends within a chain;
+// between chains a per-connection eventfd does it: every chain ends with a
+// linked WRITE of 1 and every later chain starts with a linked READ of it, so
+// chain n+1 cannot send until chain n's last send has completed. The main
+// loop queues a fresh chain whenever one finishes, and chains for every
+// connection are submitted together in one io_uring_enter.
+
+#define A4_RING_ENTRIES 4096
+#define A4_CQ_ENTRIES (4 * A4_RING_ENTRIES)
+#define A4_ACCEPT_TAG 0ULL
+#define A4_CHAINS 2                 // chains queued per connection
+
+// The low bits of a connection's user_data say which SQE of a chain the CQE
+// belongs to (A4Conn comes from calloc, so its low bits are free).
+#define A4_TAG_SEND 0UL
+#define A4_TAG_GATE_WAIT 1UL        // READ of the gate opening a chain
+#define A4_TAG_GATE_POST 2UL        // WRITE of the gate closing a chain
+#define A4_TAG_MASK 3UL
+
+typedef struct {
+    int fd;
+    int gate_fd;                // eventfd ordering this connection's chains
+    uint64_t gate_in;           // READ target of the pending gate wait
+    long long chain_seq;        // chains queued so far
+    int pending;                // CQEs (sends and gate ops) still outstanding
+    int notif_pending;          // zero-copy notifications not yet received
+    int closing;
+    long long bytes_sent;
+    LiveConn live;              // --live-stats slots
+} A4Conn;
+
+static const uint64_t a4_gate_post = 1;
+
+typedef struct {
+    Uring ring;
+    Message *msg;
+    char *fields[NUM_FIELDS];
+    int field_size;
+    int queue_depth;
+    int max_conns;              // --max-conns; 0 = no limit
+    int listen_fd;
+    int active_conns;
+    int run_conns;
+    long long run_bytes;
+    long long run_start_us;
+    long long run_syscalls;     // io_uring_enter calls this run
+    long long zc_notifs;
+    long long zc_copied;
+    PerfCounters perf;          // --perf: the single submission thread, per run
+    LiveSlot *live;             // --live-stats: the submission thread
+} A4Server;
+
+static void a4_report(A4Server *s) {
+    double elapsed = (get_time_in_microseconds() - s->run_start_us) / 1000000.0;
+    double gbps = elapsed > 0 ? (s->run_bytes * 8.0) / (elapsed * 1e9) : 0;
+    double copied = s->zc_notifs > 0 ? 100.0 * s->zc_copied / s->zc_notifs : 0;
+    printf("[A4] conns=%d bytes=%lld elapsed=%.3f s throughput=%.6f Gbps zc_copied=%.1f%%\n",
+           s->run_conns, s->run_bytes, elapsed, gbps, copied);
+    fflush(stdout);
+
+    if (s->perf.enabled) {
+        char label[96];
+        snprintf(label, sizeof(label), "[A4 perf run] cpu=%d syscalls=%lld",
+                 sched_getcpu(), s->run_syscalls);
+        perf_counters_delta(&s->perf);
+        perf_counters_print(stdout, label, &s->perf, s->run_bytes);
+    }
+}
+
+// Every io_uring_enter goes through here, so --perf can report them per run.
+static int a4_enter(A4Server *s, unsigned wait_nr) {
+    s->run_syscalls++;
+    return uring_submit_and_wait(&s->ring, wait_nr);
+}
+
+static int a4_queue_accept(A4Server *s) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&s->ring);
+    if (!sqe) {
+        a4_enter(s, 0);
+        sqe = uring_get_sqe(&s->ring);
+        if (!sqe) return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = s->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = A4_ACCEPT_TAG;
+    return 0;
+}
+
+// Queue one chain for a connection: a gate wait (all but the first chain),
+// queue_depth messages of 8 linked SEND_ZC, then the gate post. Nothing is
+// submitted here; the main loop flushes all chains at once.
+static int a4_queue_chain(A4Server *s, A4Conn *c) {
+    int gated = c->chain_seq > 0;
+    unsigned needed = s->queue_depth * NUM_FIELDS + 1 + gated;
+    if (uring_sq_space(&s->ring) < needed) a4_enter(s, 0);
+    if (uring_sq_space(&s->ring) < needed) return -1;
+
+    struct io_uring_sqe *sqe;
+    if (gated) {
+        // EFD_SEMAPHORE: each READ consumes exactly one earlier chain's post.
+        sqe = uring_get_sqe(&s->ring);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = c->gate_fd;
+        sqe->addr = (unsigned long)&c->gate_in;
+        sqe->len = sizeof(c->gate_in);
+        sqe->off = (uint64_t)-1;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = (unsigned long)c | A4_TAG_GATE_WAIT;
+    }
+    for (int m = 0; m < s->queue_depth; m++) {
+        for (int f = 0; f < NUM_FIELDS; f++) {
+            sqe = uring_get_sqe(&s->ring);
+            sqe->opcode = IORING_OP_SEND_ZC;
+            sqe->fd = c->fd;
+            sqe->addr = (unsigned long)s->fields[f];
+            sqe->len = s->field_size;
+            // MSG_WAITALL makes io_uring retry short sends, so a link only
+            // breaks on a real error.
+            sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+            sqe->ioprio = IORING_RECVSEND_FIXED_BUF | IORING_SEND_ZC_REPORT_USAGE;
+            sqe->buf_index = f;
+            sqe->user_data = (unsigned long)c | A4_TAG_SEND;
+            sqe->flags = IOSQE_IO_LINK;
+        }
+    }
+    // Cancelled along with the chain if a send fails; a4_abort() then
+    // opens the gate for the chain behind it.
+    sqe = uring_get_sqe(&s->ring);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = c->gate_fd;
+    sqe->addr = (unsigned long)&a4_gate_post;
+    sqe->len = sizeof(a4_gate_post);
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = (unsigned long)c | A4_TAG_GATE_POST;
+
+    c->chain_seq++;
+    c->pending += needed;
+    // Every SEND_ZC gets its notification at prep, and a send cancelled by a
+    // broken link still posts it even though its CQE lacks F_MORE.
+    c->notif_pending += s->queue_depth * NUM_FIELDS;
+    return 0;
+}
+
+// Stop a connection: shut the socket so queued sends fail fast, and open the
+// gate so a chain waiting behind a cancelled one completes too.
+static void a4_abort(A4Conn *c) {
+    if (c->closing) return;
+    c->closing = 1;
+    shutdown(c->fd, SHUT_RDWR);
+    eventfd_write(c->gate_fd, 1);
+}
+
+static void a4_handle_accept(A4Server *s, struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        // Multishot accept was terminated (e.g. error); re-arm it.
+        if (a4_queue_accept(s) < 0) fprintf(stderr, "Failed to re-arm accept\n");
+    }
+    if (cqe->res < 0) {
+        fprintf(stderr, "Accept failed: %s\n", strerror(-cqe->res));
+        return;
+    }
+
+    // Multishot accept keeps accepting, so --max-conns rejects.
+    if (connection_limit_reached(s->max_conns)) {
+        close(cqe->res);
+        connection_rejected("A4");
+        return;
+    }
+
+    A4Conn *c = (A4Conn*)calloc(1, sizeof(A4Conn));
+    if (!c) {
+        close(cqe->res);
+        return;
+    }
+    c->fd = cqe->res;
+    c->gate_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    if (c->gate_fd < 0) {
+        perror("eventfd failed");
+        close(c->fd);
+        free(c);
+        return;
+    }
+    if (s->active_conns++ == 0) {
+        s->run_start_us = get_time_in_microseconds();
+        s->run_conns = 0;
+        s->run_bytes = 0;
+        s->run_syscalls = 0;
+        s->zc_notifs = 0;
+        s->zc_copied = 0;
+        perf_counters_snapshot(&s->perf);
+    }
+    s->run_conns++;
+    connection_opened("A4");
+
+    if (a4_queue_chain(s, c) < 0) {
+        fprintf(stderr, "Submission queue full, dropping connection\n");
+        close(c->gate_fd);
+        close(c->fd);
+        free(c);
+        connection_closed();
+        if (--s->active_conns == 0) a4_report(s);
+        return;
+    }
+    live_conn_open(&c->live, c->fd, s->live);
+    for (int i = 1; i < A4_CHAINS && !c->closing; i++)
+        if (a4_queue_chain(s, c) < 0) a4_abort(c);
+}
+
+static void a4_handle_send(A4Server *s, struct io_uring_cqe *cqe) {
+    A4Conn *c = (A4Conn*)(unsigned long)(cqe->user_data & ~A4_TAG_MASK);
+    unsigned long tag = cqe->user_data & A4_TAG_MASK;
+
+    if (cqe->flags & IORING_CQE_F_NOTIF) {
+        // The kernel has released the pages of one earlier send.
+        c->notif_pending--;
+        int copied = ((unsigned)cqe->res & IORING_NOTIF_USAGE_ZC_COPIED) != 0;
+        s->zc_notifs++;
+        s->zc_copied += copied;
+        live_note_zc(&c->live, c->live.zc_done + 1, c->live.zc_copied + copied);
+    } else if (tag != A4_TAG_SEND) {
+        c->pending--;
+        // A failed gate op ends the connection like a failed send.
+        if (cqe->res != sizeof(uint64_t)) a4_abort(c);
+        // A posted (or cancelled) gate is the last CQE of its chain.
+        if (tag == A4_TAG_GATE_POST && !c->closing) {
+            if (a4_queue_chain(s, c) < 0) a4_abort(c);
+        }
+    } else {
+        c->pending--;
+        // Each completion is one field's send; io_uring retries EAGAIN itself.
+        live_note_send(&c->live, s->field_size, cqe->res > 0 ? cqe->res : 0);
+        if (cqe->res > 0) {
+            c->bytes_sent += cqe->res;
+            s->run_bytes += cqe->res;
+        }
+        // Errors (and the -ECANCELED tail of a broken chain) end the connection.
+        if (cqe->res < s->field_size) a4_abort(c);
+    }
+
+    // Only free the connection once the kernel holds no references to it.
+    if (c->closing && c->pending == 0 && c->notif_pending == 0) {
+        live_conn_close(&c->live);
+        close(c->gate_fd);
+        close(c->fd);
+        free(c);
+        connection_closed();
+        if (--s->active_conns == 0) a4_report(s);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    ServerOptions opts;
+    if (parse_server_options(argc, argv, &opts) < 0) exit(1);
+    if (opts.ktls) {
+        // IORING_OP_SEND_ZC is MSG_ZEROCOPY, which the TLS layer rejects.
+        fprintf(stderr, "A4 sends zero-copy, which kernel TLS does not support; "
+                        "--ktls is served by A1, A2 and A5\n");
+        exit(1);
+    }
+    if (opts.udp) {
+        // Completions arrive per connection; a datagram flow has none.
+        fprintf(stderr, "A4 serves TCP only; --udp is served by A1-A3\n");
+        exit(1);
+    }
+    if (opts.pipeline) {
+        // Its ring slots all point at one prebuilt payload.
+        fprintf(stderr, "A4 sends a fixed payload; --pipeline is served by A1-A3\n");
+        exit(1);
+    }
+    if (opts.reactor_threads > 0)
+        fprintf(stderr, "A4 is already event-driven; --reactor ignored\n");
+    if (opts.acceptors > 1 || opts.accept4)
+        fprintf(stderr, "A4 accepts through its ring (multishot); --acceptors/--accept4 ignored\n");
+    if (opts.rpc)
+        fprintf(stderr, "A4 has no request/response mode; --rpc ignored\n");
+    if (opts.steer)
+        fprintf(stderr, "A4 serves every connection from one loop; --steer ignored\n");
+    if (opts.batch > 1 || opts.msg_more)
+        fprintf(stderr, "A4 already batches through --queue-depth; --batch/--msg-more ignored\n");
+    if (opts.frame) {
+        // Every ring slot would need its own header buffer; A4 stays unframed.
+        fprintf(stderr, "A4 sends raw messages; --frame ignored\n");
+        opts.frame = 0;
+    }
+    if (opts.tx_timestamps) {
+        // Sends complete through the ring, which has no error queue reader.
+        fprintf(stderr, "A4 does not read TX timestamps; --tx-timestamps ignored\n");
+        opts.tx_timestamps = 0;
+    }
+    if (opts.pool_threads > 0)
+        fprintf(stderr, "A4 serves every connection from one loop; --pool ignored\n");
+    if (live_stats_open(&opts, "A4", "io_uring") < 0) exit(1);
+
+    // Pin before the payload and rings are allocated so they are node-local.
+    Placement placement;
+    if (placement_init(&placement, &opts) < 0) exit(1);
+    if (opts.cpus) placement_pin_self(placement.cpus[0]);
+
+    A4Server s;
+    memset(&s, 0, sizeof(s));
+    s.field_size = opts.message_size / NUM_FIELDS;
+    s.queue_depth = opts.queue_depth;
+    s.max_conns = opts.max_conns;
+    s.live = live_slot_acquire(LIVE_THREAD, 0, -1);
+    if (s.queue_depth * NUM_FIELDS > A4_RING_ENTRIES / 2) {
+        s.queue_depth = A4_RING_ENTRIES / 2 / NUM_FIELDS;
+        fprintf(stderr, "Queue depth capped at %d\n", s.queue_depth);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    s.msg = acquire_message(&opts, s.field_size);
+    if (!s.msg) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(1);
+    }
+    s.fields[0] = s.msg->field1; s.fields[1] = s.msg->field2;
+    s.fields[2] = s.msg->field3; s.fields[3] = s.msg->field4;
+    s.fields[4] = s.msg->field5; s.fields[5] = s.msg->field6;
+    s.fields[6] = s.msg->field7; s.fields[7] = s.msg->field8;
+
+    if (uring_init(&s.ring, A4_RING_ENTRIES, A4_CQ_ENTRIES) < 0) {
+        perror("io_uring_setup failed");
+        exit(1);
+    }
+
+    // The payload is read-only and shared by every connection, so one set
+    // of registered buffers serves them all.
+    struct iovec bufs[NUM_FIELDS];
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        bufs[i].iov_base = s.fields[i];
+        bufs[i].iov_len = s.field_size;
+    }
+    if (uring_register_buffers(&s.ring, bufs, NUM_FIELDS) < 0) {
+        perror("io_uring buffer registration failed");
+        exit(1);
+    }
+
+    s.listen_fd = server_listen(&opts, 0);
+    if (s.listen_fd < 0) exit(1);
+    printf("A4 Server listening on 0.0.0.0:%d (queue depth %d)\n", opts.port, s.queue_depth);
+    fflush(stdout);
+
+    a4_queue_accept(&s);
+    perf_counters_open(&s.perf, opts.perf_counters);
+
+    while (1) {
+        if (a4_enter(&s, 1) < 0) {
+            perror("io_uring_enter failed");
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&s.ring)) != NULL) {
+            struct io_uring_cqe local = *cqe;
+            uring_cqe_seen(&s.ring);
+            if (local.user_data == A4_ACCEPT_TAG) a4_handle_accept(&s, &local);
+            else a4_handle_send(&s, &local);
+        }
+    }
+
+    perf_counters_close(&s.perf);
+    close(s.listen_fd);
+    release_message(&opts, s.msg);
+    return 0;
+}
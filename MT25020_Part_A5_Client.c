@@ -0,0 +1,8 @@
+#include "MT25020_Common.h"
+#include "MT25020_Client.h"
+
+// Receiver for the memfd/splice (A5) server. The receive loop and its modes are shared
+// by every Part client and live in MT25020_Client.h.
+int main(int argc, char *argv[]) {
+    return client_main(argc, argv);
+}
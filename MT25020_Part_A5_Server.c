@@ -0,0 +1,259 @@
+#include "MT25020_Common.h"
+#include "MT25020_Reactor.h"
+#include "MT25020_Pool.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Accept.h"
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+// A5: file/pipe-backed zero-copy.
+//
+// The eight fields are written back to back into one memfd_create() region
+// shared by every connection. The default mode transmits it with sendfile(),
+// so the kernel feeds page-cache pages of the memfd straight to the socket.
+// With --splice, each connection instead vmsplice()s the mapped memfd into
+// its own pipe and splice()s the pipe into the socket, which is how static
+// payloads held in user memory are usually sent without a copy.
+//
+// With --batch the memfd holds that many copies of the message, so one
+// sendfile()/vmsplice() covers the whole batch. sendfile() has no MSG_MORE,
+// so --msg-more corks the socket (TCP_CORK) instead.
+
+static int payload_fd = -1;         // memfd holding the serialized message(s)
+static char *payload_mem = NULL;    // read-only mapping of payload_fd (splice mode)
+
+static int setup_payload(int message_size, int copies) {
+    int field_size = message_size / NUM_FIELDS;
+    size_t unit_size = (size_t)message_size * copies;
+
+    payload_fd = memfd_create("mt25020_payload", 0);
+    if (payload_fd < 0) return -1;
+    if (ftruncate(payload_fd, unit_size) < 0) return -1;
+
+    Message *msg = allocate_message(field_size);
+    if (!msg) return -1;
+    char *fields[NUM_FIELDS] = {
+        msg->field1, msg->field2, msg->field3, msg->field4,
+        msg->field5, msg->field6, msg->field7, msg->field8
+    };
+    for (int i = 0; i < NUM_FIELDS * copies; i++) {
+        if (pwrite(payload_fd, fields[i % NUM_FIELDS], field_size, (off_t)i * field_size) !=
+            field_size) {
+            free_message(msg);
+            return -1;
+        }
+    }
+    free_message(msg);
+
+    payload_mem = mmap(NULL, unit_size, PROT_READ, MAP_SHARED, payload_fd, 0);
+    return payload_mem == MAP_FAILED ? -1 : 0;
+}
+
+// Pipe sized to hold a whole message (or batch), so one vmsplice covers
+// it. Units above /proc/sys/fs/pipe-max-size just take several rounds.
+static int open_payload_pipe(int pipefd[2], int message_size) {
+    if (pipe(pipefd) < 0) return -1;
+    fcntl(pipefd[1], F_SETPIPE_SZ, message_size);
+    return 0;
+}
+
+// splice already passes SPLICE_F_MORE; sendfile needs the socket corked.
+static void cork_socket(int fd, const ServerOptions *opts) {
+    int one = 1;
+    if (opts->msg_more && !opts->splice_mode)
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one));
+}
+
+void* handle_client(void* arg) {
+    ServerThreadArgs *args = (ServerThreadArgs*)arg;
+    const ServerOptions *opts = args->opts;
+    int client_socket = args->client_socket;
+    int message_size = stream_unit_size(opts);
+
+    int pipefd[2] = { -1, -1 };
+    if (opts->splice_mode && open_payload_pipe(pipefd, message_size) < 0) {
+        perror("Pipe creation failed");
+        close(client_socket);
+        connection_closed();
+        free(args);
+        return NULL;
+    }
+
+    TxStamps *stamps = opts->tx_timestamps ? tx_stamps_create(client_socket) : NULL;
+    PerfCounters pc;
+    perf_counters_open(&pc, opts->perf_counters);
+    long long bytes_sent = 0;
+    long long syscalls = 0;
+    char label[128];
+    LiveConn live;
+    live_conn_open(&live, args->thread_id, NULL);
+    cork_socket(client_socket, opts);
+
+    while (1) {
+        if (stamps && tx_stamps_due(stamps) &&
+            tx_stamps_process_errqueue(client_socket, stamps) < 0)
+            break;
+        long long app_ns = 0;
+        if (!opts->splice_mode) {
+            // sendfile: page cache -> socket, no user-space buffer at all.
+            off_t off = 0;
+            while (off < message_size) {
+                if (stamps) app_ns = ts_realtime_ns();
+                size_t want = message_size - off;
+                ssize_t n = sendfile(client_socket, payload_fd, &off, want);
+                syscalls++;
+                live_note_send(&live, want, n);
+                if (n <= 0) goto done;
+                if (stamps) tx_stamps_note_send(stamps, app_ns, n);
+                bytes_sent += n;
+            }
+            continue;
+        }
+
+        // vmsplice maps the payload pages into the pipe, splice moves them on.
+        size_t queued = 0;
+        while (queued < (size_t)message_size) {
+            struct iovec iov = { payload_mem + queued, message_size - queued };
+            if (stamps) app_ns = ts_realtime_ns();
+            ssize_t in = vmsplice(pipefd[1], &iov, 1, 0);
+            syscalls++;
+            if (in <= 0) goto done;
+            queued += in;
+
+            while (in > 0) {
+                ssize_t out = splice(pipefd[0], NULL, client_socket, NULL, in,
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+                syscalls++;
+                live_note_send(&live, in, out);
+                if (out <= 0) goto done;
+                // The interval starts at the vmsplice() that queued the pages.
+                if (stamps) tx_stamps_note_send(stamps, app_ns, out);
+                in -= out;
+                bytes_sent += out;
+            }
+        }
+    }
+
+done:
+    placement_conn_label(label, sizeof(label), "A5", args->thread_id, client_socket, syscalls);
+    perf_counters_finish(&pc, label, bytes_sent);
+    if (stamps) {
+        tx_stamps_process_errqueue(client_socket, stamps);
+        tx_stamps_report("A5", args->thread_id, stamps);
+        free(stamps);
+    }
+    live_conn_close(&live);
+    if (pipefd[0] >= 0) close(pipefd[0]);
+    if (pipefd[1] >= 0) close(pipefd[1]);
+    close(client_socket);
+    connection_closed();
+    free(args);
+    return NULL;
+}
+
+// --- Reactor mode ---
+
+typedef struct {
+    int pipefd[2];
+    size_t in_pipe;             // bytes vmspliced but not yet spliced out
+} A5SpliceState;
+
+static int a5_conn_init(ReactorConn *c) {
+    cork_socket(c->fd, c->opts);
+    if (!c->opts->splice_mode) return 0;
+    A5SpliceState *st = (A5SpliceState*)calloc(1, sizeof(A5SpliceState));
+    if (!st) return -1;
+    if (open_payload_pipe(st->pipefd, c->message_size) < 0) {
+        free(st);
+        return -1;
+    }
+    fcntl(st->pipefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(st->pipefd[1], F_SETFL, O_NONBLOCK);
+    c->priv = st;
+    return 0;
+}
+
+static ssize_t a5_send_step(ReactorConn *c) {
+    if (!c->opts->splice_mode) {
+        off_t off = c->offset;
+        return sendfile(c->fd, payload_fd, &off, c->message_size - c->offset);
+    }
+
+    // The pipe holds message bytes [offset, offset + in_pipe); top it up
+    // with the rest of the message, then push as much as the socket takes.
+    A5SpliceState *st = (A5SpliceState*)c->priv;
+    size_t next = c->offset + st->in_pipe;
+    if (next < (size_t)c->message_size) {
+        struct iovec iov = { payload_mem + next, c->message_size - next };
+        ssize_t in = vmsplice(st->pipefd[1], &iov, 1, SPLICE_F_NONBLOCK);
+        if (in > 0) st->in_pipe += in;
+        else if (in < 0 && errno != EAGAIN) return -1;
+    }
+
+    ssize_t out = splice(st->pipefd[0], NULL, c->fd, NULL, st->in_pipe,
+                         SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+    if (out > 0) st->in_pipe -= out;
+    return out;
+}
+
+static void a5_conn_free(ReactorConn *c) {
+    A5SpliceState *st = (A5SpliceState*)c->priv;
+    if (!st) return;
+    close(st->pipefd[0]);
+    close(st->pipefd[1]);
+    free(st);
+}
+
+static const SendStrategy a5_strategy = {
+    .name = "A5",
+    .conn_init = a5_conn_init,
+    .send_step = a5_send_step,
+    .on_error_queue = NULL,
+    .conn_busy = NULL,
+    .conn_free = a5_conn_free,
+};
+
+int main(int argc, char *argv[]) {
+    ServerOptions opts;
+    if (parse_server_options(argc, argv, &opts) < 0) exit(1);
+    if (opts.ktls && !ktls_available()) exit(1);
+    if (opts.udp) {
+        // sendfile() needs a stream socket.
+        fprintf(stderr, "A5 serves TCP only; --udp is served by A1-A3\n");
+        exit(1);
+    }
+    if (opts.pipeline) {
+        // sendfile() sends the memfd; there is no user buffer to produce into.
+        fprintf(stderr, "A5 sends a fixed file; --pipeline is served by A1-A3\n");
+        exit(1);
+    }
+    if (opts.frame) {
+        // sendfile()/splice() send straight from the memfd, which cannot
+        // carry a per-message sequence number.
+        fprintf(stderr, "A5 sends the file unmodified; --frame ignored\n");
+        opts.frame = 0;
+    }
+
+    if (live_stats_open(&opts, "A5", live_server_mode(&opts)) < 0) exit(1);
+
+    if (setup_payload(opts.message_size, opts.batch) < 0) {
+        perror("memfd payload setup failed");
+        exit(1);
+    }
+
+    if (opts.reactor_threads > 0) return run_reactor_server(&a5_strategy, &opts) == 0 ? 0 : 1;
+    if (opts.pool_threads > 0) return run_pool_server(&a5_strategy, &opts) == 0 ? 0 : 1;
+
+    Placement placement;
+    if (placement_init(&placement, &opts) < 0) exit(1);
+
+    printf("A5 sending with %s\n", opts.splice_mode ? "vmsplice+splice" : "sendfile");
+    AcceptLoop loop = { .name = "A5", .opts = &opts, .placement = &placement,
+                        .handler = opts.rpc ? rpc_handle_client : handle_client,
+                        .strategy = &a5_strategy };
+    return run_accept_loop(&loop) == 0 ? 0 : 1;
+}
@@ -0,0 +1,835 @@
+#include "MT25020_Common.h"
+#include "MT25020_Strategies.h"
+#include "MT25020_Client.h"
+#include "MT25020_Stats.h"
+#include "MT25020_ShmRing.h"
+#include <sched.h>
+#include <signal.h>
+
+// In-process benchmark harness.
+//
+// Runs the A1/A2/A3 send strategies and the shared client receive loop as
+// threads of one process, connected over loopback TCP, an AF_UNIX
+// socketpair or a shared-memory ring, and sweeps implementations, message
+// sizes and connection counts with warm-up and repetitions. Needs no root, network namespaces,
+// separate processes or readiness polling: every connection is accepted
+// before its client thread starts, so each data point measures only the
+// transfer itself.
+//
+// Every repetition is also appended to a JSON-lines record file. At the end
+// each cell is summarized by its median and bootstrap confidence interval,
+// and with --baseline compared against an earlier record file; significant
+// throughput or latency regressions are flagged and make the exit status 2.
+// --analyze runs only that summary/comparison on an existing record file,
+// e.g. one written by the Part clients' --json.
+//
+// --transport=shm replaces the socket with a lock-free SPSC ring in shared
+// memory (MT25020_ShmRing.h), the ceiling any kernel transport is measured
+// against. Each implementation keeps its user-space copy count: A1 gathers
+// into its linear buffer and copies that into the slot, A2 gathers straight
+// into the slot, and A3 builds each slot's message in place once and then
+// only writes headers. The receiver copies every message out of its slot,
+// as recv() would, so latency and throughput mean the same as over TCP.
+
+#define BENCH_MAX_LIST 32
+
+typedef struct {
+    const char *name;
+    const SendStrategy *strategy;
+    int shm_copies;                 // --transport=shm: copies into the slot, 0: built in place
+} BenchImpl;
+
+static const BenchImpl bench_impls[] = {
+    { "A1", &a1_strategy, 2 },
+    { "A2", &a2_strategy, 1 },
+    { "A3", &a3_strategy, 0 },
+};
+#define BENCH_NUM_IMPLS ((int)(sizeof(bench_impls) / sizeof(bench_impls[0])))
+
+typedef enum { BENCH_TCP, BENCH_UNIX, BENCH_SHM, BENCH_NUM_TRANSPORTS } BenchTransport;
+static const char *bench_transports[BENCH_NUM_TRANSPORTS] = { "tcp", "unix", "shm" };
+
+typedef struct {
+    int impls[BENCH_NUM_IMPLS];     // indices into bench_impls
+    int num_impls;
+    int sizes[BENCH_MAX_LIST];
+    int num_sizes;
+    int threads[BENCH_MAX_LIST];
+    int num_threads;
+    int server_cpus[BENCH_MAX_LIST];
+    int num_server_cpus;
+    int client_cpus[BENCH_MAX_LIST];
+    int num_client_cpus;
+    int duration;                   // seconds per repetition
+    int warmup;                     // seconds, discarded, before the repetitions
+    int reps;
+    int batch;                      // messages per sender syscall
+    int frame;                      // framed messages, verified by the receiver
+    int transport;                  // BenchTransport
+    const char *csv;
+    const char *json;               // per-repetition records
+    const char *baseline;           // records to compare against
+    const char *analyze;            // summarize this record file instead of running
+    double min_effect;              // smallest relative change worth flagging
+} BenchOptions;
+
+typedef struct {
+    int fd;
+    int cpu;                        // -1: not pinned
+    int message_size;
+    const SendStrategy *strategy;
+    const ServerOptions *opts;
+} BenchServerArgs;
+
+typedef struct {
+    ClientThreadArgs args;
+    int cpu;
+} BenchClientArgs;
+
+// --transport=shm: one ring and the two threads' private ends of it.
+typedef struct {
+    ShmRing ring;
+    ShmRingEnd tx;
+    ShmRingEnd rx;
+    BenchServerArgs *send;
+    BenchClientArgs *recv;
+    int copies;                     // BenchImpl.shm_copies
+} BenchShmPair;
+
+// --transport=shm: how often the ring ends slept, summed over a point's rings.
+typedef struct {
+    long long messages;
+    long long tx_sleeps;
+    long long rx_sleeps;
+    long long wakeups;
+} BenchShmStats;
+
+static void bench_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --impls=LIST        implementations to run (default A1,A2,A3)\n"
+            "  --sizes=LIST        message sizes in bytes (default 1024,4096,16384,65536)\n"
+            "  --threads=LIST      connection counts (default 1,2,4,8)\n"
+            "  --duration=S        seconds per repetition (default 2)\n"
+            "  --warmup=S          discarded warm-up seconds per point (default 1)\n"
+            "  --reps=N            repetitions per point (default 3)\n"
+            "  --batch=K           messages per sender syscall (default 1; impl recorded as A1/bK)\n"
+            "  --frame             framed messages with sequence numbers and CRC-32C, verified\n"
+            "                      by the receiver (impl recorded as A1/f)\n"
+            "  --transport=KIND    tcp (loopback, default), unix (socketpair) or shm\n"
+            "                      (shared-memory ring, no kernel on the data path)\n"
+            "  --server-cpus=LIST  pin sender threads round-robin to these CPUs\n"
+            "  --client-cpus=LIST  pin receiver threads round-robin to these CPUs\n"
+            "  --csv=FILE          results file (default MT25020_Part_C_Bench.csv)\n"
+            "  --json=FILE         per-repetition records (default MT25020_Part_C_Bench.jsonl)\n"
+            "  --baseline=FILE     compare each cell against records from an earlier run\n"
+            "  --min-effect=PCT    smallest median change flagged as significant (default 2)\n"
+            "  --analyze=FILE      summarize/compare an existing record file, run nothing\n"
+            "LISTs are comma separated; CPU lists also accept ranges like 0-3.\n",
+            prog);
+}
+
+static int parse_bench_options(int argc, char *argv[], BenchOptions *b) {
+    static const struct option long_opts[] = {
+        {"impls", required_argument, NULL, 'i'},
+        {"sizes", required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 't'},
+        {"duration", required_argument, NULL, 'd'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"reps", required_argument, NULL, 'r'},
+        {"batch", required_argument, NULL, 'B'},
+        {"frame", no_argument, NULL, 'F'},
+        {"transport", required_argument, NULL, 'T'},
+        {"server-cpus", required_argument, NULL, 'S'},
+        {"client-cpus", required_argument, NULL, 'C'},
+        {"csv", required_argument, NULL, 'o'},
+        {"json", required_argument, NULL, 'j'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"min-effect", required_argument, NULL, 'm'},
+        {"analyze", required_argument, NULL, 'a'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(b, 0, sizeof(*b));
+    b->num_impls = BENCH_NUM_IMPLS;
+    for (int i = 0; i < BENCH_NUM_IMPLS; i++) b->impls[i] = i;
+    b->num_sizes = parse_int_list("1024,4096,16384,65536", b->sizes, BENCH_MAX_LIST, 0);
+    b->num_threads = parse_int_list("1,2,4,8", b->threads, BENCH_MAX_LIST, 0);
+    b->duration = 2;
+    b->warmup = 1;
+    b->reps = 3;
+    b->batch = 1;
+    b->csv = "MT25020_Part_C_Bench.csv";
+    b->json = "MT25020_Part_C_Bench.jsonl";
+    b->min_effect = 0.02;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'i': {
+            b->num_impls = 0;
+            char *list = strdup(optarg), *save = NULL;
+            for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                int found = -1;
+                for (int i = 0; i < BENCH_NUM_IMPLS; i++)
+                    if (strcmp(tok, bench_impls[i].name) == 0) found = i;
+                if (found < 0 || b->num_impls == BENCH_NUM_IMPLS) {
+                    fprintf(stderr, "Unknown or repeated implementation: %s\n", tok);
+                    free(list);
+                    return -1;
+                }
+                b->impls[b->num_impls++] = found;
+            }
+            free(list);
+            break;
+        }
+        case 's':
+            b->num_sizes = parse_int_list(optarg, b->sizes, BENCH_MAX_LIST, 0);
+            break;
+        case 't':
+            b->num_threads = parse_int_list(optarg, b->threads, BENCH_MAX_LIST, 0);
+            break;
+        case 'd':
+            b->duration = atoi(optarg);
+            break;
+        case 'w':
+            b->warmup = atoi(optarg);
+            break;
+        case 'r':
+            b->reps = atoi(optarg);
+            break;
+        case 'B':
+            b->batch = atoi(optarg);
+            break;
+        case 'F':
+            b->frame = 1;
+            break;
+        case 'T':
+            b->transport = -1;
+            for (int i = 0; i < BENCH_NUM_TRANSPORTS; i++)
+                if (strcmp(optarg, bench_transports[i]) == 0) b->transport = i;
+            if (b->transport < 0) {
+                bench_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'S':
+            b->num_server_cpus = parse_int_list(optarg, b->server_cpus, BENCH_MAX_LIST, 1);
+            break;
+        case 'C':
+            b->num_client_cpus = parse_int_list(optarg, b->client_cpus, BENCH_MAX_LIST, 1);
+            break;
+        case 'o':
+            b->csv = optarg;
+            break;
+        case 'j':
+            b->json = optarg;
+            break;
+        case 'b':
+            b->baseline = optarg;
+            break;
+        case 'm':
+            b->min_effect = atof(optarg) / 100.0;
+            break;
+        case 'a':
+            b->analyze = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (optind != argc || b->num_impls <= 0 || b->num_sizes <= 0 || b->num_threads <= 0 ||
+        b->num_server_cpus < 0 || b->num_client_cpus < 0 ||
+        b->duration <= 0 || b->warmup < 0 || b->reps <= 0 || b->min_effect < 0 ||
+        b->batch < 1 || b->batch > (b->frame ? FRAME_MAX_BATCH : MAX_BATCH)) {
+        bench_usage(argv[0]);
+        return -1;
+    }
+    // Reject CPUs outside our affinity mask up front rather than letting
+    // every thread fail to pin.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    for (int i = 0; i < b->num_server_cpus + b->num_client_cpus; i++) {
+        int cpu = i < b->num_server_cpus ? b->server_cpus[i]
+                                         : b->client_cpus[i - b->num_server_cpus];
+        if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+            fprintf(stderr, "CPU %d is not available to this process\n", cpu);
+            return -1;
+        }
+    }
+    for (int i = 0; i < b->num_sizes; i++) {
+        if (b->sizes[i] < NUM_FIELDS) {
+            fprintf(stderr, "Message size %d is below %d bytes\n", b->sizes[i], NUM_FIELDS);
+            return -1;
+        }
+        if (b->frame && b->sizes[i] % NUM_FIELDS != 0) {
+            fprintf(stderr, "--frame needs message sizes that are multiples of %d\n", NUM_FIELDS);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Sender: stream whole messages until the receiver closes its end.
+static void* bench_server_thread(void *arg) {
+    BenchServerArgs *a = (BenchServerArgs*)arg;
+    placement_pin_self(a->cpu);
+
+    ReactorConn c;
+    memset(&c, 0, sizeof(c));
+    c.fd = a->fd;
+    c.opts = a->opts;
+    c.message_size = stream_unit_size(a->opts);
+    c.field_size = a->message_size / NUM_FIELDS;
+    if (a->strategy->conn_init(&c) != 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        close(c.fd);
+        return NULL;
+    }
+    while (strategy_send_message(a->strategy, &c) == 0) {
+        c.offset = 0;
+        c.messages_sent += a->opts->batch;
+    }
+    conn_quiesce(a->strategy, &c);
+    conn_release(a->strategy, &c);
+    return NULL;
+}
+
+static void* bench_client_thread(void *arg) {
+    BenchClientArgs *a = (BenchClientArgs*)arg;
+    placement_pin_self(a->cpu);
+    return client_thread(&a->args);
+}
+
+// Point msg's fields at consecutive runs of `base` and fill them the way
+// allocate_message() does, so the receiver sees the same bytes.
+static void bench_shm_build_in_place(Message *msg, char *base, int field_size) {
+    char **fields[NUM_FIELDS] = {
+        &msg->field1, &msg->field2, &msg->field3, &msg->field4,
+        &msg->field5, &msg->field6, &msg->field7, &msg->field8
+    };
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        *fields[i] = base + (size_t)i * field_size;
+        memset(*fields[i], 'A' + i, field_size);
+    }
+}
+
+// Sender over a shared-memory ring: fill slots until the receiver closes
+// it. Headers go straight into each slot; the payload is copied there per
+// BenchShmPair.copies, and batches are published with one index store.
+static void* bench_shm_sender_thread(void *arg) {
+    BenchShmPair *p = (BenchShmPair*)arg;
+    const ServerOptions *opts = p->send->opts;
+    placement_pin_self(p->send->cpu);
+
+    int field_size = p->send->message_size / NUM_FIELDS;
+    size_t payload = (size_t)field_size * NUM_FIELDS;
+    const GatherKernel *kernel = gather_kernel_find(opts->gather);
+    Message *msg = allocate_message(field_size);
+    char *linear = p->copies == 2 ? (char*)malloc(payload) : NULL;
+    FrameWriter fw;
+    if (!msg || (p->copies == 2 && !linear) || frame_writer_init(&fw, opts, msg, field_size, 0) < 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        shm_ring_close(&p->ring);
+        free(linear);
+        free_message(msg);
+        return NULL;
+    }
+
+    while (1) {
+        FrameHeader *hdrs = frame_begin_unit(&fw, 0);
+        for (int i = 0; i < opts->batch; i++) {
+            char *slot = shm_ring_reserve(&p->tx);
+            if (!slot) goto out;
+            char *dst = slot + sizeof(FrameHeader);
+            if (hdrs) memcpy(slot, &hdrs[i], sizeof(FrameHeader));
+            if (p->copies == 2) {
+                gather_message(kernel, opts->nt_threshold, linear, NULL, msg, field_size, 1);
+                memcpy(dst, linear, payload);
+            } else if (p->copies == 1) {
+                gather_message(kernel, opts->nt_threshold, dst, NULL, msg, field_size, 1);
+            } else if (p->tx.pos < p->ring.num_slots) {
+                // The payload never changes: after the first lap round the
+                // ring every slot already holds it.
+                Message view;
+                bench_shm_build_in_place(&view, dst, field_size);
+            }
+            shm_ring_commit(&p->tx);
+        }
+        shm_ring_publish(&p->tx);
+    }
+out:
+    frame_writer_free(&fw);
+    free(linear);
+    free_message(msg);
+    return NULL;
+}
+
+// Receiver over a shared-memory ring: client_thread()'s message loop with
+// a copy out of the slot in place of recv().
+static void* bench_shm_receiver_thread(void *arg) {
+    BenchShmPair *p = (BenchShmPair*)arg;
+    ClientThreadArgs *a = &p->recv->args;
+    placement_pin_self(p->recv->cpu);
+
+    int framed = a->opts->frame;
+    size_t skip = framed ? 0 : sizeof(FrameHeader);
+    size_t record = sizeof(FrameHeader) + (size_t)(a->message_size / NUM_FIELDS) * NUM_FIELDS - skip;
+    char *buffer = (char*)malloc(record);
+    if (!buffer) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        shm_ring_close(&p->ring);
+        return NULL;
+    }
+    LatencyHistogram *hist = a->hist;
+    FrameParser fp;
+    frame_parser_init(&fp, a->message_size);
+    perf_counters_open(a->perf, a->opts->perf_counters);
+
+    long long bytes_received = 0;
+    long long now = get_time_ns();
+    long long start_ns = now;
+    long long end_ns = now + (long long)a->duration * 1000000000LL;
+    while (now < end_ns) {
+        long long msg_start = now;
+        const char *slot = shm_ring_peek(&p->rx);
+        if (!slot) break;
+        memcpy(buffer, slot + skip, record);
+        shm_ring_release(&p->rx);
+        bytes_received += record;
+        if (framed && frame_parse(&fp, buffer, record) < 0) {
+            now = get_time_ns();
+            break;
+        }
+        now = get_time_ns();
+        hist_record(hist, now - msg_start);
+        frame_settle(&fp, now);
+    }
+    shm_ring_close(&p->ring);
+
+    double elapsed = (now - start_ns) / 1e9;
+    a->throughput[a->thread_id] = (bytes_received * 8.0) / (elapsed * 1e9);
+    a->latency[a->thread_id] = hist_mean(hist) / 1000.0;
+    a->bytes_sent[a->thread_id] = bytes_received;
+    if (framed) a->integrity[a->thread_id] = fp.counts;
+    perf_counters_delta(a->perf);
+    perf_counters_close(a->perf);
+    free(buffer);
+    return NULL;
+}
+
+// Loopback listener on an ephemeral port, shared by every data point.
+static int bench_listen(int *port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, MAX_CLIENTS) < 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// One connected pair: fds[0] for the receiver, fds[1] for the sender.
+static int bench_connect_pair(const BenchOptions *b, int listen_fd, int port, int fds[2]) {
+    if (b->transport == BENCH_UNIX) return socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fds[0], (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    // The handshake has completed, so this accept() returns immediately.
+    fds[1] = accept(listen_fd, NULL, NULL);
+    if (fds[1] < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    return 0;
+}
+
+// Run `conns` sender/receiver pairs for `duration` seconds. `shm` is
+// filled for --transport=shm.
+static int bench_point(const BenchOptions *b, const BenchImpl *impl, int listen_fd, int port,
+                       int message_size, int conns, int duration, RunRecord *res,
+                       BenchShmStats *shm) {
+    ServerOptions sopts;
+    server_options_init(&sopts);
+    sopts.message_size = message_size;
+    sopts.batch = b->batch;
+    sopts.frame = b->frame;
+
+    ClientOptions copts;
+    memset(&copts, 0, sizeof(copts));
+    copts.message_size = message_size;
+    copts.num_threads = conns;
+    copts.duration = duration;
+    copts.frame = b->frame;
+
+    BenchServerArgs *sargs = (BenchServerArgs*)calloc(conns, sizeof(BenchServerArgs));
+    BenchClientArgs *cargs = (BenchClientArgs*)calloc(conns, sizeof(BenchClientArgs));
+    pthread_t *sthreads = (pthread_t*)calloc(conns, sizeof(pthread_t));
+    pthread_t *cthreads = (pthread_t*)calloc(conns, sizeof(pthread_t));
+    double *throughput = (double*)calloc(conns, sizeof(double));
+    double *latency = (double*)calloc(conns, sizeof(double));
+    long long *bytes = (long long*)calloc(conns, sizeof(long long));
+    long long *unused = (long long*)calloc(conns, sizeof(long long));
+    LatencyHistogram *hists = (LatencyHistogram*)malloc(conns * sizeof(LatencyHistogram));
+    PerfCounters *perf = (PerfCounters*)calloc(conns, sizeof(PerfCounters));
+    FrameCounts *integrity = (FrameCounts*)calloc(conns, sizeof(FrameCounts));
+    BenchShmPair *pairs = NULL;
+    if (b->transport == BENCH_SHM) pairs = (BenchShmPair*)calloc(conns, sizeof(BenchShmPair));
+    int ok = sargs && cargs && sthreads && cthreads && throughput && latency &&
+             bytes && unused && hists && perf && integrity && (pairs || b->transport != BENCH_SHM);
+
+    int started = 0;
+    for (int i = 0; ok && i < conns; i++) {
+        int fds[2] = { -1, -1 };
+        if (pairs) {
+            if (shm_ring_create(&pairs[i].ring, message_size) < 0) {
+                perror("Shared-memory ring setup failed");
+                ok = 0;
+                break;
+            }
+            shm_ring_end_init(&pairs[i].tx, &pairs[i].ring, 1);
+            shm_ring_end_init(&pairs[i].rx, &pairs[i].ring, 0);
+            pairs[i].send = &sargs[i];
+            pairs[i].recv = &cargs[i];
+            pairs[i].copies = impl->shm_copies;
+        } else if (bench_connect_pair(b, listen_fd, port, fds) < 0) {
+            perror("Connection setup failed");
+            ok = 0;
+            break;
+        }
+
+        sargs[i].fd = fds[1];
+        sargs[i].cpu = b->num_server_cpus ? b->server_cpus[i % b->num_server_cpus] : -1;
+        sargs[i].message_size = message_size;
+        sargs[i].strategy = impl->strategy;
+        sargs[i].opts = &sopts;
+
+        hist_init(&hists[i]);
+        ClientThreadArgs *ca = &cargs[i].args;
+        ca->thread_id = i;
+        ca->fd = fds[0];
+        ca->message_size = message_size;
+        ca->duration = duration;
+        ca->throughput = throughput;
+        ca->latency = latency;
+        ca->bytes_sent = bytes;
+        ca->rx_zerocopy = unused;
+        ca->rx_copied = unused;
+        ca->requests = unused;
+        ca->syscalls = unused;
+        ca->integrity = integrity;
+        ca->hist = &hists[i];
+        ca->perf = &perf[i];
+        ca->opts = &copts;
+        cargs[i].cpu = b->num_client_cpus ? b->client_cpus[i % b->num_client_cpus] : -1;
+
+        if (pairs) {
+            if (pthread_create(&sthreads[i], NULL, bench_shm_sender_thread, &pairs[i]) != 0) {
+                shm_ring_destroy(&pairs[i].ring);
+                ok = 0;
+                break;
+            }
+            if (pthread_create(&cthreads[i], NULL, bench_shm_receiver_thread, &pairs[i]) != 0) {
+                shm_ring_close(&pairs[i].ring);
+                pthread_join(sthreads[i], NULL);
+                shm_ring_destroy(&pairs[i].ring);
+                ok = 0;
+                break;
+            }
+            started++;
+            continue;
+        }
+        if (pthread_create(&sthreads[i], NULL, bench_server_thread, &sargs[i]) != 0) {
+            close(fds[0]);
+            close(fds[1]);
+            ok = 0;
+            break;
+        }
+        if (pthread_create(&cthreads[i], NULL, bench_client_thread, &cargs[i]) != 0) {
+            // Closing the receiver end lets the sender thread exit.
+            close(fds[0]);
+            pthread_join(sthreads[i], NULL);
+            ok = 0;
+            break;
+        }
+        started++;
+    }
+
+    // Receivers stop after `duration` and close; senders then see EPIPE
+    // (or the closed ring).
+    for (int i = 0; i < started; i++) pthread_join(cthreads[i], NULL);
+    for (int i = 0; i < started; i++) pthread_join(sthreads[i], NULL);
+    if (pairs && shm) {
+        memset(shm, 0, sizeof(*shm));
+        for (int i = 0; i < started; i++) {
+            shm->messages += pairs[i].rx.pos;
+            shm->tx_sleeps += pairs[i].tx.sleeps;
+            shm->rx_sleeps += pairs[i].rx.sleeps;
+            shm->wakeups += pairs[i].tx.wakeups + pairs[i].rx.wakeups;
+        }
+    }
+    for (int i = 0; pairs && i < started; i++) shm_ring_destroy(&pairs[i].ring);
+
+    if (ok) {
+        LatencyHistogram merged;
+        hist_init(&merged);
+        memset(res, 0, sizeof(*res));
+        for (int i = 0; i < conns; i++) {
+            hist_merge(&merged, &hists[i]);
+            res->throughput_gbps += throughput[i];
+            res->latency_us += latency[i];
+            res->total_bytes += bytes[i];
+        }
+        res->latency_us /= conns;
+        if (b->frame) {
+            FrameCounts total;
+            memset(&total, 0, sizeof(total));
+            for (int i = 0; i < conns; i++) frame_counts_add(&total, &integrity[i]);
+            if (frame_counts_errors(&total) > 0) frame_counts_print(stderr, &total);
+        }
+        res->msg_size = message_size;
+        res->threads = conns;
+        res->duration_s = duration;
+        run_record_set_latency(res, &merged);
+    }
+
+    free(pairs);
+    free(integrity);
+    free(perf);
+    free(hists);
+    free(unused);
+    free(bytes);
+    free(latency);
+    free(throughput);
+    free(cthreads);
+    free(sthreads);
+    free(cargs);
+    free(sargs);
+    return ok ? 0 : -1;
+}
+
+// --- Summary and baseline comparison ---
+
+typedef enum { METRIC_THROUGHPUT, METRIC_P50, METRIC_P99, NUM_METRICS } BenchMetric;
+
+static const struct {
+    const char *name;
+    int higher_is_better;
+} bench_metrics[NUM_METRICS] = {
+    { "throughput", 1 },
+    { "p50", 0 },
+    { "p99", 0 },
+};
+
+static double record_metric(const RunRecord *r, BenchMetric m) {
+    switch (m) {
+    case METRIC_THROUGHPUT: return r->throughput_gbps;
+    case METRIC_P50: return r->p50_us;
+    default: return r->p99_us;
+    }
+}
+
+// Values of metric `m` for every record in `cell`'s cell. Returns the count.
+static int cell_values(const RunRecord *recs, int n, const RunRecord *cell, BenchMetric m,
+                       double *out) {
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        if (run_record_same_cell(&recs[i], cell)) out[count++] = record_metric(&recs[i], m);
+    return count;
+}
+
+// Print one metric's change against the baseline. Returns 1 on a
+// significant regression.
+static int bench_compare_metric(const BenchOptions *b, BenchMetric m, const double *base, int nb,
+                                const double *cur, int nc, double *scratch) {
+    double mb = stats_median(base, nb, scratch);
+    double mc = stats_median(cur, nc, scratch);
+    if (mb == 0) {
+        printf(" %s n/a", bench_metrics[m].name);
+        return 0;
+    }
+    double change = mc / mb - 1;
+    double lo, hi;
+    stats_relative_change_ci(base, nb, cur, nc, &lo, &hi);
+
+    const char *verdict = "~";
+    int regression = 0;
+    if (nb < STATS_MIN_REPS || nc < STATS_MIN_REPS) {
+        verdict = "(too few reps)";
+    } else if ((lo > 0 || hi < 0) && fabs(change) >= b->min_effect) {
+        int better = (change > 0) == bench_metrics[m].higher_is_better;
+        verdict = better ? "improved" : "REGRESSION";
+        regression = !better;
+    }
+    printf(" %s %+.1f%% [%+.1f, %+.1f] %s", bench_metrics[m].name, 100 * change,
+           100 * lo, 100 * hi, verdict);
+    return regression;
+}
+
+// Median and confidence interval per cell of `path`, then the comparison
+// against --baseline. Returns the exit status: 2 if anything regressed.
+static int bench_analyze(const BenchOptions *b, const char *path) {
+    RunRecord *recs = NULL, *base = NULL;
+    int n = run_records_load(path, &recs);
+    if (n < 0) {
+        perror("Failed to read records");
+        return 1;
+    }
+    int nb = 0;
+    if (b->baseline && (nb = run_records_load(b->baseline, &base)) < 0) {
+        perror("Failed to read baseline");
+        free(recs);
+        return 1;
+    }
+
+    int max = n > nb ? n : nb;
+    double *cur = (double*)malloc((max + 1) * sizeof(double));
+    double *ref = (double*)malloc((max + 1) * sizeof(double));
+    double *scratch = (double*)malloc((max + 1) * sizeof(double));
+    int regressions = 0;
+    printf("\nSummary: median [%.0f%% bootstrap CI] over repetitions\n", 100 * STATS_CONFIDENCE);
+    for (int i = 0; cur && ref && scratch && i < n; i++) {
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) seen = run_record_same_cell(&recs[j], &recs[i]);
+        if (seen) continue;
+
+        const RunRecord *cell = &recs[i];
+        printf("%s %s size=%d threads=%d", cell->impl, cell->transport, cell->msg_size,
+               cell->threads);
+        int nc = 0;
+        for (int m = 0; m < NUM_METRICS; m++) {
+            double lo, hi;
+            nc = cell_values(recs, n, cell, (BenchMetric)m, cur);
+            stats_median_ci(cur, nc, &lo, &hi);
+            printf(" %s %.3f [%.3f, %.3f]%s", bench_metrics[m].name,
+                   stats_median(cur, nc, scratch), lo, hi, m == METRIC_THROUGHPUT ? " Gbps" : " us");
+        }
+        printf(" (n=%d)\n", nc);
+
+        if (!b->baseline) continue;
+        printf("  vs baseline:");
+        if (cell_values(base, nb, cell, METRIC_THROUGHPUT, ref) == 0) {
+            printf(" no baseline records for this cell\n");
+            continue;
+        }
+        for (int m = 0; m < NUM_METRICS; m++) {
+            int cnt = cell_values(recs, n, cell, (BenchMetric)m, cur);
+            int bcnt = cell_values(base, nb, cell, (BenchMetric)m, ref);
+            regressions += bench_compare_metric(b, (BenchMetric)m, ref, bcnt, cur, cnt, scratch);
+        }
+        printf("\n");
+    }
+    if (b->baseline)
+        printf("%d significant regression(s) against %s (min effect %.1f%%)\n", regressions,
+               b->baseline, 100 * b->min_effect);
+
+    free(scratch);
+    free(ref);
+    free(cur);
+    free(base);
+    free(recs);
+    return regressions ? 2 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions b;
+    if (parse_bench_options(argc, argv, &b) < 0) exit(1);
+
+    // --analyze only reads records; it needs no sockets.
+    if (b.analyze) return bench_analyze(&b, b.analyze);
+
+    signal(SIGPIPE, SIG_IGN);
+    int max_conns = 0;
+    for (int i = 0; i < b.num_threads; i++)
+        if (b.threads[i] > max_conns) max_conns = b.threads[i];
+    raise_fd_limit(3 * max_conns + 64);
+
+    int port = 0;
+    int listen_fd = -1;
+    if (b.transport == BENCH_TCP) {
+        listen_fd = bench_listen(&port);
+        if (listen_fd < 0) {
+            perror("Loopback listener setup failed");
+            exit(1);
+        }
+    }
+
+    FILE *csv = fopen(b.csv, "w");
+    FILE *json = fopen(b.json, "w");
+    if (!csv || !json) {
+        perror(csv ? "Failed to open record file" : "Failed to open CSV");
+        exit(1);
+    }
+    fprintf(csv, "Impl,Transport,MsgSize,Threads,Rep,ThroughputGbps,LatencyUs,P50Us,P99Us,P999Us\n");
+    const char *transport = bench_transports[b.transport];
+
+    for (int ii = 0; ii < b.num_impls; ii++) {
+        const BenchImpl *impl = &bench_impls[b.impls[ii]];
+        for (int si = 0; si < b.num_sizes; si++) {
+            for (int ti = 0; ti < b.num_threads; ti++) {
+                int size = b.sizes[si];
+                int conns = b.threads[ti];
+                RunRecord r;
+                BenchShmStats shm;
+
+                if (b.warmup > 0 &&
+                    bench_point(&b, impl, listen_fd, port, size, conns, b.warmup, &r, &shm) < 0)
+                    continue;
+
+                for (int rep = 1; rep <= b.reps; rep++) {
+                    if (bench_point(&b, impl, listen_fd, port, size, conns, b.duration, &r,
+                                    &shm) < 0)
+                        break;
+                    // Batched and framed runs are their own cells.
+                    if (b.batch > 1)
+                        snprintf(r.impl, sizeof(r.impl), "%s/b%d%s", impl->name, b.batch,
+                                 b.frame ? "/f" : "");
+                    else
+                        snprintf(r.impl, sizeof(r.impl), "%s%s", impl->name,
+                                 b.frame ? "/f" : "");
+                    snprintf(r.transport, sizeof(r.transport), "%s", transport);
+                    r.rep = rep;
+                    printf("%s %s size=%d threads=%d rep=%d: %.3f Gbps, latency %.3f us "
+                           "(p50=%.3f p99=%.3f p99.9=%.3f us)\n",
+                           r.impl, transport, size, conns, rep, r.throughput_gbps,
+                           r.latency_us, r.p50_us, r.p99_us, r.p999_us);
+                    if (b.transport == BENCH_SHM && shm.messages > 0)
+                        printf("  ring: %.2f wake-ups per 1000 messages (sender slept %lld, "
+                               "receiver slept %lld times)\n", 1000.0 * shm.wakeups / shm.messages,
+                               shm.tx_sleeps, shm.rx_sleeps);
+                    fflush(stdout);
+                    fprintf(csv, "%s,%s,%d,%d,%d,%.6f,%.6f,%.3f,%.3f,%.3f\n",
+                            r.impl, transport, size, conns, rep, r.throughput_gbps,
+                            r.latency_us, r.p50_us, r.p99_us, r.p999_us);
+                    fflush(csv);
+                    run_record_write(json, &r);
+                }
+            }
+        }
+    }
+
+    fclose(json);
+    fclose(csv);
+    if (listen_fd >= 0) close(listen_fd);
+    printf("Results saved to %s and %s\n", b.csv, b.json);
+    return bench_analyze(&b, b.json);
+}
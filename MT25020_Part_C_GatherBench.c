@@ -0,0 +1,256 @@
+#include "MT25020_Common.h"
+#include "MT25020_Gather.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Placement.h"
+
+// Marshalling microbenchmark.
+//
+// Times A1's copy #1 alone: gather_message() from the eight fields of one
+// Message into a linear buffer, with no socket involved. It sweeps gather
+// kernels, message sizes and store types: cached stores, or streaming stores
+// (forced on, whatever the server's --nt-threshold). --consume also reads
+// the marshalled buffer back into a sink, as send() would, so the cost that
+// streaming stores push onto that copy is included. With --perf each point
+// also reports LLC misses per KB, which shows whether the destination is
+// evicting the source fields.
+
+#define GATHER_BENCH_MAX_LIST 32
+#define GATHER_BENCH_CHUNK 64           // iterations between clock reads
+
+enum { STORES_CACHED = 1, STORES_NT = 2 };
+
+typedef struct {
+    int kernels[GATHER_BENCH_MAX_LIST];     // indices into gather_kernels
+    int num_kernels;
+    int sizes[GATHER_BENCH_MAX_LIST];
+    int num_sizes;
+    int batch;                      // messages per marshalled unit
+    int stores;                     // STORES_* mask
+    int consume;                    // read the unit back, like send() does
+    int duration_ms;                // per point, after a warm-up of a tenth of it
+    int cpu;                        // -1: not pinned
+    int perf;
+    const char *csv;
+} GatherBenchOptions;
+
+static void gather_bench_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --kernels=LIST    gather kernels (default: every one this CPU supports)\n"
+            "  --sizes=LIST      message sizes in bytes (default 1024,4096,16384,65536,262144,1048576)\n"
+            "  --batch=K         messages per marshalled unit (1-%d, default 1)\n"
+            "  --stores=KIND     cached, nt or both (default both)\n"
+            "  --consume         read each unit back into a sink, as send() would\n"
+            "  --duration-ms=MS  measuring time per point (default 200)\n"
+            "  --cpu=N           pin the benchmark thread to CPU N\n"
+            "  --perf            count cycles, cache misses, ... per point\n"
+            "  --csv=FILE        results file (default MT25020_Part_C_GatherBench.csv)\n",
+            prog, MAX_BATCH);
+}
+
+static int parse_gather_bench_options(int argc, char *argv[], GatherBenchOptions *b) {
+    static const struct option long_opts[] = {
+        {"kernels", required_argument, NULL, 'k'},
+        {"sizes", required_argument, NULL, 's'},
+        {"batch", required_argument, NULL, 'b'},
+        {"stores", required_argument, NULL, 'S'},
+        {"consume", no_argument, NULL, 'c'},
+        {"duration-ms", required_argument, NULL, 'd'},
+        {"cpu", required_argument, NULL, 'C'},
+        {"perf", no_argument, NULL, 'P'},
+        {"csv", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < GATHER_NUM_KERNELS; i++)
+        if (gather_kernels[i].supported()) b->kernels[b->num_kernels++] = i;
+    b->num_sizes = parse_int_list("1024,4096,16384,65536,262144,1048576", b->sizes,
+                                  GATHER_BENCH_MAX_LIST, 0);
+    b->batch = 1;
+    b->stores = STORES_CACHED | STORES_NT;
+    b->duration_ms = 200;
+    b->cpu = -1;
+    b->csv = "MT25020_Part_C_GatherBench.csv";
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'k': {
+            b->num_kernels = 0;
+            char *list = strdup(optarg), *save = NULL;
+            for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                const GatherKernel *k = gather_kernel_find(tok);
+                if (!k || strcmp(tok, "auto") == 0 || b->num_kernels == GATHER_BENCH_MAX_LIST) {
+                    fprintf(stderr, "Unknown or unsupported kernel: %s\n", tok);
+                    free(list);
+                    return -1;
+                }
+                b->kernels[b->num_kernels++] = (int)(k - gather_kernels);
+            }
+            free(list);
+            break;
+        }
+        case 's':
+            b->num_sizes = parse_int_list(optarg, b->sizes, GATHER_BENCH_MAX_LIST, 0);
+            break;
+        case 'b':
+            b->batch = atoi(optarg);
+            break;
+        case 'S':
+            if (strcmp(optarg, "cached") == 0) b->stores = STORES_CACHED;
+            else if (strcmp(optarg, "nt") == 0) b->stores = STORES_NT;
+            else if (strcmp(optarg, "both") == 0) b->stores = STORES_CACHED | STORES_NT;
+            else {
+                gather_bench_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'c':
+            b->consume = 1;
+            break;
+        case 'd':
+            b->duration_ms = atoi(optarg);
+            break;
+        case 'C':
+            b->cpu = atoi(optarg);
+            break;
+        case 'P':
+            b->perf = 1;
+            break;
+        case 'o':
+            b->csv = optarg;
+            break;
+        default:
+            gather_bench_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (optind != argc || b->num_kernels <= 0 || b->num_sizes <= 0 ||
+        b->batch < 1 || b->batch > MAX_BATCH || b->duration_ms <= 0) {
+        gather_bench_usage(argv[0]);
+        return -1;
+    }
+    for (int i = 0; i < b->num_sizes; i++) {
+        if (b->sizes[i] < NUM_FIELDS) {
+            fprintf(stderr, "Message sizes must be at least %d bytes\n", NUM_FIELDS);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    double gbps;
+    double ns_per_msg;
+    long long bytes;                // marshalled while measuring
+    PerfCounters perf;
+} GatherResult;
+
+// Marshal for `duration_ns`; returns messages marshalled.
+static long long gather_run(const GatherKernel *k, long nt_threshold, char *dst, char *sink,
+                            const Message *msg, int field_size, int batch, long long duration_ns,
+                            volatile char *keep) {
+    size_t unit = (size_t)field_size * NUM_FIELDS * batch;
+    long long messages = 0;
+    long long end = get_time_ns() + duration_ns;
+    do {
+        for (int i = 0; i < GATHER_BENCH_CHUNK; i++) {
+            gather_message(k, nt_threshold, dst, NULL, msg, field_size, batch);
+            if (sink) memcpy(sink, dst, unit);
+            *keep ^= dst[(messages + i) % unit];
+        }
+        messages += (long long)GATHER_BENCH_CHUNK * batch;
+    } while (get_time_ns() < end);
+    return messages;
+}
+
+static int gather_point(const GatherBenchOptions *b, const GatherKernel *k, int nt,
+                        int message_size, GatherResult *res) {
+    int field_size = message_size / NUM_FIELDS;
+    size_t unit = (size_t)field_size * NUM_FIELDS * b->batch;
+    Message *msg = allocate_message(field_size);
+    char *dst = (char*)aligned_alloc(64, (unit + 63) & ~(size_t)63);
+    char *sink = b->consume ? (char*)malloc(unit) : NULL;
+    if (!msg || !dst || (b->consume && !sink)) {
+        if (msg) free_message(msg);
+        free(dst);
+        free(sink);
+        return -1;
+    }
+    memset(dst, 0, unit);
+    if (sink) memset(sink, 0, unit);
+
+    // nt_threshold 1 streams every unit, 0 none.
+    long nt_threshold = nt ? 1 : 0;
+    static volatile char keep;
+    gather_run(k, nt_threshold, dst, sink, msg, field_size, b->batch,
+               b->duration_ms * 100000LL, &keep);
+
+    perf_counters_open(&res->perf, b->perf);
+    long long start = get_time_ns();
+    long long messages = gather_run(k, nt_threshold, dst, sink, msg, field_size, b->batch,
+                                    b->duration_ms * 1000000LL, &keep);
+    long long elapsed = get_time_ns() - start;
+    perf_counters_delta(&res->perf);
+    perf_counters_close(&res->perf);
+
+    res->bytes = messages * field_size * NUM_FIELDS;
+    res->gbps = (double)res->bytes * 8 / elapsed;
+    res->ns_per_msg = (double)elapsed / messages;
+
+    free(sink);
+    free(dst);
+    free_message(msg);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    GatherBenchOptions b;
+    if (parse_gather_bench_options(argc, argv, &b) < 0) exit(1);
+    placement_pin_self(b.cpu);
+
+    FILE *csv = fopen(b.csv, "w");
+    if (!csv) {
+        perror("Failed to open results file");
+        exit(1);
+    }
+    fprintf(csv, "Kernel,Stores,MsgSize,Batch,Consume,ThroughputGbps,NsPerMsg,LLCMissesPerKB\n");
+
+    for (int ki = 0; ki < b.num_kernels; ki++) {
+        const GatherKernel *k = &gather_kernels[b.kernels[ki]];
+        for (int si = 0; si < b.num_sizes; si++) {
+            for (int nt = 0; nt <= 1; nt++) {
+                if (!(b.stores & (nt ? STORES_NT : STORES_CACHED))) continue;
+                if (nt && !k->copy_nt) continue;
+                int size = b.sizes[si];
+                GatherResult r;
+                if (gather_point(&b, k, nt, size, &r) < 0) {
+                    fprintf(stderr, "Failed to allocate memory\n");
+                    continue;
+                }
+
+                const char *stores = nt ? "nt" : "cached";
+                printf("%s %s size=%d batch=%d%s: %.3f Gbps, %.1f ns/msg\n", k->name, stores,
+                       size, b.batch, b.consume ? " consume" : "", r.gbps, r.ns_per_msg);
+                char label[64];
+                snprintf(label, sizeof(label), "  [%s %s perf]", k->name, stores);
+                perf_counters_print(stdout, label, &r.perf, r.bytes);
+                fflush(stdout);
+
+                fprintf(csv, "%s,%s,%d,%d,%d,%.6f,%.3f,", k->name, stores, size, b.batch,
+                        b.consume, r.gbps, r.ns_per_msg);
+                if (r.perf.enabled && r.perf.valid[PERF_LLC_MISSES])
+                    fprintf(csv, "%.4f\n", r.perf.delta[PERF_LLC_MISSES] / (r.bytes / 1024.0));
+                else
+                    fprintf(csv, "NA\n");
+                fflush(csv);
+            }
+        }
+    }
+
+    fclose(csv);
+    printf("Results saved to %s\n", b.csv);
+    return 0;
+}
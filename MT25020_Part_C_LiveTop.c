@@ -0,0 +1,225 @@
+#include "MT25020_Common.h"
+#include "MT25020_Live.h"
+#include <signal.h>
+
+// Live view of a running server, like top.
+//
+// Attaches read-only to the region a server started with --live-stats
+// publishes under /dev/shm. It samples every slot at a fixed interval and
+// prints rates per thread and for the busiest connections. The server never
+// learns it is being watched: sampling is plain loads from shared memory.
+// A connection that closed during an interval drops out of the connection
+// lines, but its bytes still count in the thread lines.
+
+#define LIVE_TOP_MAX_CONNS 32
+
+typedef struct {
+    const char *impl;
+    int port;
+    int interval_ms;
+    int count;                      // samples to print; 0: until the server exits
+    int top;                        // connections listed per sample
+    int plain;                      // append samples instead of redrawing the screen
+} LiveTopOptions;
+
+static void live_top_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s <impl> <port> [options]\n"
+            "  <impl> <port>     the server to watch, e.g. A2 8080 (started with --live-stats)\n"
+            "  --interval-ms=MS  sampling interval (default 1000)\n"
+            "  --count=N         stop after N samples (default: until the server exits)\n"
+            "  --top=N           connections listed, busiest first (0-%d, default 10)\n"
+            "  --plain           append samples instead of redrawing (default when not a tty)\n",
+            prog, LIVE_TOP_MAX_CONNS);
+}
+
+static int parse_live_top_options(int argc, char *argv[], LiveTopOptions *o) {
+    static const struct option long_opts[] = {
+        {"interval-ms", required_argument, NULL, 'i'},
+        {"count", required_argument, NULL, 'n'},
+        {"top", required_argument, NULL, 't'},
+        {"plain", no_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(o, 0, sizeof(*o));
+    o->interval_ms = 1000;
+    o->top = 10;
+    o->plain = !isatty(STDOUT_FILENO);
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'i':
+            o->interval_ms = atoi(optarg);
+            break;
+        case 'n':
+            o->count = atoi(optarg);
+            break;
+        case 't':
+            o->top = atoi(optarg);
+            break;
+        case 'p':
+            o->plain = 1;
+            break;
+        default:
+            live_top_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - optind != 2 || o->interval_ms <= 0 || o->count < 0 ||
+        o->top < 0 || o->top > LIVE_TOP_MAX_CONNS) {
+        live_top_usage(argv[0]);
+        return -1;
+    }
+    o->impl = argv[optind];
+    o->port = atoi(argv[optind + 1]);
+    return 0;
+}
+
+// Per-second rates of one slot over the last interval.
+typedef struct {
+    int kind;
+    int id;
+    int owner;
+    double r[LIVE_NUM_COUNTERS];
+} LiveRate;
+
+// `prev` is the slot's previous sample; a different since_ns means the slot
+// was reused, so the new connection's counters all fall in this interval.
+static void live_rate(const LiveSlot *cur, const LiveSlot *prev, long long now, double interval_s,
+                      LiveRate *out) {
+    int same = prev->kind == cur->kind && prev->since_ns == cur->since_ns;
+    double age = (now - cur->since_ns) / 1e9;
+    double secs = same || age > interval_s ? interval_s : age;
+    out->kind = cur->kind;
+    out->id = cur->id;
+    out->owner = cur->owner;
+    for (int i = 0; i < LIVE_NUM_COUNTERS; i++) {
+        uint64_t d = cur->v[i] - (same ? prev->v[i] : 0);
+        out->r[i] = secs > 0 ? d / secs : 0;
+    }
+}
+
+static void live_rate_add(LiveRate *sum, const LiveRate *r) {
+    for (int i = 0; i < LIVE_NUM_COUNTERS; i++) sum->r[i] += r->r[i];
+}
+
+static int live_rate_cmp_bytes(const void *a, const void *b) {
+    double x = ((const LiveRate*)a)->r[LIVE_BYTES], y = ((const LiveRate*)b)->r[LIVE_BYTES];
+    return (x < y) - (x > y);
+}
+
+static void live_print_columns(void) {
+    printf("%-6s %6s %6s %6s %10s %10s %8s %10s %10s %7s\n", "", "id", "thread", "conns",
+           "Gbps", "sends/s", "partial", "eagain/s", "zc_done/s", "copied");
+}
+
+// `thread` and `conns` are preformatted; "-" where they do not apply.
+static void live_print_rate(const char *label, const LiveRate *r, const char *thread,
+                            const char *conns) {
+    double sends = r->r[LIVE_SENDS];
+    double zc = r->r[LIVE_ZC_DONE];
+    char id[16];
+    if (r->id >= 0) snprintf(id, sizeof(id), "%d", r->id);
+    else snprintf(id, sizeof(id), "-");
+    printf("%-6s %6s %6s %6s %10.3f %10.0f %7.1f%% %10.0f %10.0f %6.1f%%\n", label, id, thread,
+           conns, r->r[LIVE_BYTES] * 8 / 1e9, sends,
+           sends > 0 ? 100 * r->r[LIVE_PARTIAL] / sends : 0, r->r[LIVE_EAGAIN], zc,
+           zc > 0 ? 100 * r->r[LIVE_ZC_COPIED] / zc : 0);
+}
+
+static volatile sig_atomic_t live_top_stop;
+
+static void live_top_on_signal(int sig) {
+    (void)sig;
+    live_top_stop = 1;
+}
+
+int main(int argc, char *argv[]) {
+    LiveTopOptions o;
+    if (parse_live_top_options(argc, argv, &o) < 0) exit(1);
+
+    size_t size;
+    const LiveHeader *hdr = live_stats_attach(o.impl, o.port, &size);
+    if (!hdr) {
+        fprintf(stderr, "No live statistics for %s on port %d; start the server with "
+                        "--live-stats\n", o.impl, o.port);
+        exit(1);
+    }
+    const LiveSlot *slots = live_stats_slots(hdr);
+    int n = hdr->num_slots;
+    LiveSlot *prev = (LiveSlot*)calloc(n, sizeof(LiveSlot));
+    LiveRate *threads = (LiveRate*)malloc(n * sizeof(LiveRate));
+    LiveRate *conns = (LiveRate*)malloc(n * sizeof(LiveRate));
+    if (!prev || !threads || !conns) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(1);
+    }
+    signal(SIGINT, live_top_on_signal);
+    signal(SIGTERM, live_top_on_signal);
+
+    // The first pass only records a baseline.
+    long long last = get_time_ns();
+    for (int i = 0; i < n; i++) live_slot_read(&slots[i], &prev[i]);
+
+    for (int sample = 0; !live_top_stop && (o.count == 0 || sample < o.count); sample++) {
+        usleep(o.interval_ms * 1000);
+        if (kill(hdr->pid, 0) < 0 && errno == ESRCH) {
+            printf("Server %s pid %d has exited\n", hdr->impl, hdr->pid);
+            break;
+        }
+        long long now = get_time_ns();
+        double interval = (now - last) / 1e9;
+        last = now;
+
+        int num_threads = 0, num_conns = 0;
+        LiveRate total;
+        memset(&total, 0, sizeof(total));
+        total.id = -1;
+        for (int i = 0; i < n; i++) {
+            LiveSlot cur;
+            if (live_slot_read(&slots[i], &cur) < 0) continue;   // keep the old baseline
+            if (cur.kind == LIVE_THREAD)
+                live_rate(&cur, &prev[i], now, interval, &threads[num_threads++]);
+            else if (cur.kind == LIVE_CONN)
+                live_rate(&cur, &prev[i], now, interval, &conns[num_conns++]);
+            prev[i] = cur;
+        }
+        // Thread slots cover connections that closed meanwhile; without
+        // them (thread-per-connection) the open connections are the total.
+        for (int i = 0; i < (num_threads ? num_threads : num_conns); i++)
+            live_rate_add(&total, num_threads ? &threads[i] : &conns[i]);
+        qsort(conns, num_conns, sizeof(LiveRate), live_rate_cmp_bytes);
+
+        if (!o.plain) printf("\033[H\033[2J");
+        printf("%s pid %d port %d (%s), %d B messages, up %.1f s, untracked conns=%u\n",
+               hdr->impl, hdr->pid, hdr->port, hdr->mode, hdr->message_size,
+               (now - hdr->start_ns) / 1e9, hdr->untracked);
+        live_print_columns();
+        char count[16];
+        snprintf(count, sizeof(count), "%d", num_conns);
+        live_print_rate("total", &total, "-", count);
+        for (int i = 0; i < num_threads; i++) {
+            int owned = 0;
+            for (int k = 0; k < num_conns; k++) owned += conns[k].owner == threads[i].id;
+            snprintf(count, sizeof(count), "%d", owned);
+            live_print_rate("thread", &threads[i], "-", count);
+        }
+        for (int i = 0; i < num_conns && i < o.top; i++) {
+            char owner[16];
+            if (conns[i].owner >= 0) snprintf(owner, sizeof(owner), "%d", conns[i].owner);
+            else snprintf(owner, sizeof(owner), "own");
+            live_print_rate("conn", &conns[i], owner, "-");
+        }
+        if (o.plain) printf("\n");
+        fflush(stdout);
+    }
+
+    free(conns);
+    free(threads);
+    free(prev);
+    munmap((void*)hdr, size);
+    return 0;
+}
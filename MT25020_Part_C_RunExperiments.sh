@@ -8,8 +8,52 @@ MESSAGE_SIZES=(1024 4096 16384 65536)
 THREAD_COUNTS=(1 2 4 8)
 OUTPUT_CSV="MT25020_Part_C_Results.csv"
 PLOT_SCRIPT="MT25020_Part_D_Plots.py"
+# Extra server flags, e.g. SERVER_FLAGS="--reactor=4" for the epoll reactor model,
+# or SERVER_FLAGS="--cpus=2-5 --steer" to place connections on their RX CPUs,
+# or SERVER_FLAGS="--batch=16 --msg-more" to coalesce 16 messages per syscall
+SERVER_FLAGS="${SERVER_FLAGS:-}"
+# CPUs the server process may use (taskset); widen this together with --cpus
+SERVER_CPUS="${SERVER_CPUS:-2}"
+# Extra client flags, e.g. CLIENT_FLAGS="--zerocopy-rx" for TCP_ZEROCOPY_RECEIVE,
+# or CLIENT_FLAGS="--recv-batch=16" to drain many messages per recv()
+CLIENT_FLAGS="${CLIENT_FLAGS:-}"
+# Open-loop RPC sweep: space-separated total request rates, e.g.
+# RPC_RATES="1000 5000 20000 50000". Empty skips the sweep.
+RPC_RATES="${RPC_RATES:-}"
+RPC_MSG_SIZE="${RPC_MSG_SIZE:-4096}"
+RPC_THREADS="${RPC_THREADS:-4}"
+RPC_CSV="MT25020_Part_C_RPC_Results.csv"
+# Kernel TLS tax: KTLS=1 runs A1, A2, A5 and A5S at KTLS_SIZES twice, plain
+# and with --ktls on both sides, and records throughput and server cycles
+# per payload byte. Needs the tls module (modprobe tls).
+KTLS="${KTLS:-}"
+KTLS_SIZES="${KTLS_SIZES:-4096 65536}"
+KTLS_THREADS="${KTLS_THREADS:-1}"
+KTLS_CSV="MT25020_Part_C_KTLS_Results.csv"
+# Connection churn: CHURN=1 runs A1, A2 and A5 as RPC servers against
+# clients that reconnect after every CHURN_REPLIES replies, once per accept
+# setup in CHURN_SETUPS, and records connections/s and connect-to-first-byte
+# percentiles. Each setup turns on one server flag over plain accept()
+# (accept4, acceptors, fastopen, defer); "all" turns them all on.
+CHURN="${CHURN:-}"
+CHURN_SETUPS="${CHURN_SETUPS:-plain accept4 acceptors fastopen defer all}"
+CHURN_REPLIES="${CHURN_REPLIES:-1}"
+CHURN_MSG_SIZE="${CHURN_MSG_SIZE:-1024}"
+CHURN_THREADS="${CHURN_THREADS:-4}"
+CHURN_ACCEPTORS="${CHURN_ACCEPTORS:-2}"
+CHURN_CSV="MT25020_Part_C_Churn_Results.csv"
+# Repetitions per configuration, each preceded by a discarded warm-up run of
+# WARMUP_SEC seconds. Every measured run is also appended to RECORDS as a
+# JSON record; set BASELINE to an earlier RECORDS file to flag significant
+# regressions per impl/size/thread cell.
+REPS="${REPS:-3}"
+WARMUP_SEC="${WARMUP_SEC:-2}"
+RECORDS="MT25020_Part_C_Runs.jsonl"
+BASELINE="${BASELINE:-}"
 
 # --- FORCE PERF PERMISSIONS ---
+# The servers open their own per-thread counters (--perf); allow kernel-mode
+# counting so the in-kernel copy and TCP work is included.
 sysctl -w kernel.perf_event_paranoid=-1 2>/dev/null
 
 # --- NETWORK NAMESPACE SETUP ---
@@ -51,18 +95,55 @@ make all
 setup_namespaces
 
 # Initialize CSV
-echo "Impl,MsgSize,Threads,ThroughputGbps,LatencyUs,CPUCycles,L1Misses,LLCMisses,ContextSwitches" > $OUTPUT_CSV
+echo "Impl,MsgSize,Threads,ThroughputGbps,LatencyUs,CPUCycles,L1Misses,LLCMisses,ContextSwitches,P50Us,P99Us,P999Us,Instructions,TaskClockNs,Rep,JainIndex,CrossCoreConns,LLCMissesCrossCore,SyscallsPerMsg,ClientSyscallsPerMsg" > $OUTPUT_CSV
+: > $RECORDS
+
+# Map an impl label to its binary suffix and any label-specific server flags.
+# A5 = memfd + sendfile, A5S = memfd + vmsplice/splice (same binary).
+impl_binary() {
+    case $1 in
+        A5S) echo "A5" ;;
+        *)   echo "$1" ;;
+    esac
+}
+
+impl_flags() {
+    case $1 in
+        A5S) echo "--splice" ;;
+        *)   echo "" ;;
+    esac
+}
+
+# Sum one counter over every "[... perf ...]" line the server printed (one
+# per connection thread, reactor or A4 run). NA if any thread could not
+# count it, so missing hardware events never masquerade as zero. With
+# "cross" as second argument only connections whose handler ran on another
+# CPU than their packets (cpu != rx_cpu) are counted.
+sum_counter() {
+    awk -v key="$1" -v only="$2" '/^\[.* perf / {
+        delete f
+        for (i = 1; i <= NF; i++) { split($i, kv, "="); f[kv[1]] = kv[2] }
+        if (only == "cross" && !("rx_cpu" in f && f["rx_cpu"] >= 0 && f["cpu"] != f["rx_cpu"])) next
+        if (key == "conns") sum++
+        else if (f[key] == "n/a") na = 1
+        else sum += f[key]
+    } END { if (na) print "NA"; else printf "%.0f\n", sum }' server_output.log
+}
 
 run_experiment() {
     local impl=$1
     local msg_size=$2
     local num_threads=$3
+    local rep=$4
+    local bin=$(impl_binary $impl)
+    local flags=$(impl_flags $impl)
     
-    echo "Running $impl with message_size=$msg_size, threads=$num_threads"
+    echo "Running $impl with message_size=$msg_size, threads=$num_threads (rep $rep/$REPS)"
     
-    # --- 1. START SERVER (Background, Pinned to Core 2) ---
-    # We do NOT wrap with perf here. We just start the process.
-    ip netns exec ns_server taskset -c 2 ./MT25020_Part_${impl}_Server $msg_size $PORT &
+    # --- 1. START SERVER (Background, Pinned to SERVER_CPUS) ---
+    # --perf makes every worker thread count its own cycles, cache misses,
+    # context switches, ... and print them when its connection/run ends.
+    ip netns exec ns_server taskset -c $SERVER_CPUS ./MT25020_Part_${bin}_Server $msg_size $PORT --perf $flags $SERVER_FLAGS >> server_output.log &
     SERVER_PID=$!
     
     # --- 2. WAIT FOR SERVER READY ---
@@ -73,29 +154,23 @@ run_experiment() {
         sleep 0.1
     done
     
-    # --- 3. START PERF ATTACHED TO SERVER PID ---
-    # We run perf inside the namespace and attach to the specific PID (-p).
-    # We output to a file (-o) and run it in background (&).
-    ip netns exec ns_server perf stat \
-        -p $SERVER_PID \
-        -e cpu_core/cycles/,cpu_core/L1-dcache-load-misses/,cpu_core/LLC-load-misses/,context-switches \
-        -o server_perf.log 2>&1 &
-    
-    PERF_PID=$!
-    
-    # Give perf a moment to attach
-    sleep 0.5
-    
+    # --- 3. WARM UP (Discarded) ---
+    # Fault in buffers, grow socket windows and settle CPU frequency, then
+    # drop the server's counter lines for those connections.
+    if [ "$WARMUP_SEC" -gt 0 ]; then
+        ip netns exec ns_client taskset -c 0 ./MT25020_Part_${bin}_Client $SERVER_IP $PORT $msg_size $num_threads --duration=$WARMUP_SEC $CLIENT_FLAGS > /dev/null 2>&1
+        sleep 1
+        : > server_output.log
+    fi
+
     # --- 4. RUN CLIENT (Foreground) ---
     # Client (Receiver) runs on P-Core 0.
-    CLIENT_OUTPUT=$(ip netns exec ns_client taskset -c 0 ./MT25020_Part_${impl}_Client $SERVER_IP $PORT $msg_size $num_threads 2>&1)
-    
-    # --- 5. STOP PERF & SERVER ---
-    # Send SIGINT to Perf to ensure it flushes stats to the file
-    kill -2 $PERF_PID 2>/dev/null
-    wait $PERF_PID 2>/dev/null
+    CLIENT_OUTPUT=$(ip netns exec ns_client taskset -c 0 ./MT25020_Part_${bin}_Client $SERVER_IP $PORT $msg_size $num_threads --json=$RECORDS --label=$impl --rep=$rep $CLIENT_FLAGS 2>&1)
     
-    # Now kill the server
+    # --- 5. STOP SERVER ---
+    # Give the server threads a moment to notice the disconnect and print
+    # their counters, then kill it.
+    sleep 1
     kill -9 $SERVER_PID 2>/dev/null
     wait $SERVER_PID 2>/dev/null
     
@@ -104,12 +179,27 @@ run_experiment() {
     # Parse App Metrics (From Client Output)
     THROUGHPUT=$(echo "$CLIENT_OUTPUT" | grep "Throughput:" | awk '{print $2}')
     LATENCY=$(echo "$CLIENT_OUTPUT" | grep "Latency:" | awk '{print $2}')
+    PERCENTILES=$(echo "$CLIENT_OUTPUT" | grep "Latency percentiles:")
+    P50=$(echo "$PERCENTILES" | grep -o 'p50=[0-9.]*' | cut -d= -f2)
+    P99=$(echo "$PERCENTILES" | grep -o 'p99=[0-9.]*' | cut -d= -f2)
+    P999=$(echo "$PERCENTILES" | grep -o 'p99\.9=[0-9.]*' | cut -d= -f2)
+    JAIN=$(echo "$CLIENT_OUTPUT" | grep "Fairness:" | grep -o 'jain=[0-9.]*' | cut -d= -f2)
     
-    # Parse Perf Metrics (From server_perf.log)
-    CPU_CYCLES=$(grep "cpu_core/cycles/" server_perf.log | head -n 1 | sed 's/,//g' | awk '{print $1}')
-    L1_MISSES=$(grep "cpu_core/L1-dcache-load-misses/" server_perf.log | head -n 1 | sed 's/,//g' | awk '{print $1}')
-    LLC_MISSES=$(grep "cpu_core/LLC-load-misses/" server_perf.log | head -n 1 | sed 's/,//g' | awk '{print $1}')
-    CTX_SWITCHES=$(grep "context-switches" server_perf.log | head -n 1 | sed 's/,//g' | awk '{print $1}')
+    # Parse Perf Metrics (From the server's own counter lines)
+    CPU_CYCLES=$(sum_counter cycles)
+    L1_MISSES=$(sum_counter l1d_misses)
+    LLC_MISSES=$(sum_counter llc_misses)
+    CTX_SWITCHES=$(sum_counter ctx_switches)
+    INSTRUCTIONS=$(sum_counter instructions)
+    TASK_CLOCK=$(sum_counter task_clock_ns)
+    CROSS_CONNS=$(sum_counter conns cross)
+    CROSS_LLC=$(sum_counter llc_misses cross)
+    # Server send-path syscalls per message actually delivered
+    SERVER_SYSCALLS=$(sum_counter syscalls)
+    SERVER_BYTES=$(sum_counter bytes)
+    SYSCALLS_PER_MSG=$(awk -v s="${SERVER_SYSCALLS:-0}" -v b="${SERVER_BYTES:-0}" -v m="$msg_size" \
+        'BEGIN { if (b > 0) printf "%.4f\n", s / (b / m); else print "0" }')
+    CLIENT_SYSCALLS_PER_MSG=$(echo "$CLIENT_OUTPUT" | grep "^Syscalls:" | sed 's/.*(\([0-9.]*\) per message.*/\1/')
     
     # Sanitize
     THROUGHPUT=${THROUGHPUT:-0.0}
@@ -118,29 +208,177 @@ run_experiment() {
     L1_MISSES=${L1_MISSES:-0}
     LLC_MISSES=${LLC_MISSES:-0}
     CTX_SWITCHES=${CTX_SWITCHES:-0}
+    INSTRUCTIONS=${INSTRUCTIONS:-0}
+    TASK_CLOCK=${TASK_CLOCK:-0}
+    P50=${P50:-0.0}
+    P99=${P99:-0.0}
+    P999=${P999:-0.0}
+    JAIN=${JAIN:-0.0}
 
-    # Handle <not supported> by setting to 0
-    if [[ "$CPU_CYCLES" == *"<"* ]]; then CPU_CYCLES="0"; fi
-    if [[ "$L1_MISSES" == *"<"* ]]; then L1_MISSES="0"; fi
-    if [[ "$LLC_MISSES" == *"<"* ]]; then LLC_MISSES="0"; fi
-    
-    echo "$impl,$msg_size,$num_threads,$THROUGHPUT,$LATENCY,$CPU_CYCLES,$L1_MISSES,$LLC_MISSES,$CTX_SWITCHES" >> $OUTPUT_CSV
+    echo "$impl,$msg_size,$num_threads,$THROUGHPUT,$LATENCY,$CPU_CYCLES,$L1_MISSES,$LLC_MISSES,$CTX_SWITCHES,$P50,$P99,$P999,$INSTRUCTIONS,$TASK_CLOCK,$rep,$JAIN,${CROSS_CONNS:-0},${CROSS_LLC:-0},$SYSCALLS_PER_MSG,${CLIENT_SYSCALLS_PER_MSG:-0}" >> $OUTPUT_CSV
     
     # Clean temp file
-    rm -f server_perf.log
+    rm -f server_output.log
 }
 
 # Run all experiments
-for impl in "A1" "A2" "A3"; do
+for impl in "A1" "A2" "A3" "A4" "A5" "A5S"; do
     for msg_size in "${MESSAGE_SIZES[@]}"; do
         for num_threads in "${THREAD_COUNTS[@]}"; do
-            run_experiment $impl $msg_size $num_threads
+            for rep in $(seq 1 $REPS); do
+                run_experiment $impl $msg_size $num_threads $rep
+            done
         done
     done
 done
 
+# One open-loop point: fixed offered load, latency from intended send times.
+# Achieved rate falling behind the target marks the saturation point.
+run_rpc_point() {
+    local impl=$1
+    local rate=$2
+    local bin=$(impl_binary $impl)
+    local flags=$(impl_flags $impl)
+
+    echo "Running $impl RPC at $rate req/s (message_size=$RPC_MSG_SIZE, threads=$RPC_THREADS)"
+    ip netns exec ns_server taskset -c $SERVER_CPUS ./MT25020_Part_${bin}_Server $RPC_MSG_SIZE $PORT --rpc $flags $SERVER_FLAGS &
+    SERVER_PID=$!
+    while ! ip netns exec ns_server ss -lnt | grep -q ":$PORT"; do
+        sleep 0.1
+    done
+
+    CLIENT_OUTPUT=$(ip netns exec ns_client taskset -c 0 ./MT25020_Part_${bin}_Client $SERVER_IP $PORT $RPC_MSG_SIZE $RPC_THREADS --rate=$rate $CLIENT_FLAGS 2>&1)
+
+    kill -9 $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    THROUGHPUT=$(echo "$CLIENT_OUTPUT" | grep "Throughput:" | awk '{print $2}')
+    ACHIEVED=$(echo "$CLIENT_OUTPUT" | grep "Requests:" | sed 's/.*(\([0-9.]*\) req\/s.*/\1/')
+    PERCENTILES=$(echo "$CLIENT_OUTPUT" | grep "Latency percentiles:")
+    P50=$(echo "$PERCENTILES" | grep -o 'p50=[0-9.]*' | cut -d= -f2)
+    P99=$(echo "$PERCENTILES" | grep -o 'p99=[0-9.]*' | cut -d= -f2)
+    P999=$(echo "$PERCENTILES" | grep -o 'p99\.9=[0-9.]*' | cut -d= -f2)
+
+    echo "$impl,$RPC_MSG_SIZE,$RPC_THREADS,$rate,${ACHIEVED:-0},${THROUGHPUT:-0.0},${P50:-0.0},${P99:-0.0},${P999:-0.0}" >> $RPC_CSV
+}
+
+if [ -n "$RPC_RATES" ]; then
+    echo "Impl,MsgSize,Threads,TargetRate,AchievedRate,ThroughputGbps,P50Us,P99Us,P999Us" > $RPC_CSV
+    for impl in "A1" "A2" "A3" "A5" "A5S"; do
+        for rate in $RPC_RATES; do
+            run_rpc_point $impl $rate
+        done
+    done
+    echo "RPC sweep saved to $RPC_CSV"
+fi
+
+# One plain or kernel-TLS point. Cycles come from the server's --perf lines,
+# per plaintext byte, so the difference is what encryption costs.
+run_ktls_point() {
+    local impl=$1
+    local msg_size=$2
+    local tls=$3
+    local bin=$(impl_binary $impl)
+    local flags=$(impl_flags $impl)
+    local tls_flag=""
+    [ "$tls" = 1 ] && tls_flag="--ktls"
+
+    echo "Running $impl with message_size=$msg_size, threads=$KTLS_THREADS, ktls=$tls"
+    ip netns exec ns_server taskset -c $SERVER_CPUS ./MT25020_Part_${bin}_Server $msg_size $PORT --perf $flags $tls_flag $SERVER_FLAGS >> server_output.log &
+    SERVER_PID=$!
+    while ! ip netns exec ns_server ss -lnt | grep -q ":$PORT"; do
+        sleep 0.1
+    done
+
+    CLIENT_OUTPUT=$(ip netns exec ns_client taskset -c 0 ./MT25020_Part_${bin}_Client $SERVER_IP $PORT $msg_size $KTLS_THREADS $tls_flag $CLIENT_FLAGS 2>&1)
+
+    sleep 1
+    kill -9 $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    THROUGHPUT=$(echo "$CLIENT_OUTPUT" | grep "Throughput:" | awk '{print $2}')
+    CYCLES_PER_BYTE=$(awk -v c="$(sum_counter cycles)" -v b="$(sum_counter bytes)" \
+        'BEGIN { if (c != "NA" && b > 0) printf "%.4f\n", c / b; else print "NA" }')
+    echo "$impl,$msg_size,$KTLS_THREADS,$tls,${THROUGHPUT:-0.0},$CYCLES_PER_BYTE" >> $KTLS_CSV
+    rm -f server_output.log
+}
+
+if [ -n "$KTLS" ]; then
+    echo "Impl,MsgSize,Threads,KTLS,ThroughputGbps,ServerCyclesPerByte" > $KTLS_CSV
+    for impl in "A1" "A2" "A5" "A5S"; do
+        for msg_size in $KTLS_SIZES; do
+            run_ktls_point $impl $msg_size 0
+            run_ktls_point $impl $msg_size 1
+        done
+    done
+    echo "Kernel TLS sweep saved to $KTLS_CSV"
+fi
+
+# One churn point. Fast open needs net.ipv4.tcp_fastopen=3 in both
+# namespaces, which the setup below turns on. The client closes first, so
+# every connection leaves a TIME_WAIT socket on its side; the setup also
+# turns on net.ipv4.tcp_tw_reuse=1 (the default 2 only covers loopback) and
+# widens the port range, or the rate would be that of the client's search
+# for a free port rather than of the server's accept path.
+run_churn_point() {
+    local impl=$1
+    local setup=$2
+    local bin=$(impl_binary $impl)
+    local flags=$(impl_flags $impl)
+    local server_setup=""
+    local client_setup=""
+    case $setup in
+        accept4)   server_setup="--accept4" ;;
+        acceptors) server_setup="--acceptors=$CHURN_ACCEPTORS" ;;
+        fastopen)  server_setup="--fastopen"; client_setup="--fastopen" ;;
+        defer)     server_setup="--defer-accept" ;;
+        all)       server_setup="--accept4 --acceptors=$CHURN_ACCEPTORS --fastopen --defer-accept"
+                   client_setup="--fastopen" ;;
+    esac
+
+    echo "Running $impl churn with setup=$setup, threads=$CHURN_THREADS"
+    ip netns exec ns_server taskset -c $SERVER_CPUS ./MT25020_Part_${bin}_Server $CHURN_MSG_SIZE $PORT --rpc $flags $server_setup $SERVER_FLAGS > /dev/null 2>&1 &
+    SERVER_PID=$!
+    while ! ip netns exec ns_server ss -lnt | grep -q ":$PORT"; do
+        sleep 0.1
+    done
+
+    CLIENT_OUTPUT=$(ip netns exec ns_client taskset -c 0 ./MT25020_Part_${bin}_Client $SERVER_IP $PORT $CHURN_MSG_SIZE $CHURN_THREADS --rpc --churn=$CHURN_REPLIES $client_setup $CLIENT_FLAGS 2>&1)
+
+    kill -9 $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+
+    RATE=$(echo "$CLIENT_OUTPUT" | grep "^Churn:" | sed 's/.*(\([0-9.]*\) conn\/s).*/\1/')
+    FAILED=$(echo "$CLIENT_OUTPUT" | grep "^Churn:" | sed 's/.* \([0-9]*\) failed.*/\1/')
+    P50=$(echo "$CLIENT_OUTPUT" | grep "Connect-to-first-byte" | sed 's/.* p50=\([0-9.]*\).*/\1/')
+    P99=$(echo "$CLIENT_OUTPUT" | grep "Connect-to-first-byte" | sed 's/.* p99=\([0-9.]*\).*/\1/')
+    echo "$impl,$setup,$CHURN_THREADS,${RATE:-0},${P50:-NA},${P99:-NA},${FAILED:-NA}" >> $CHURN_CSV
+}
+
+if [ -n "$CHURN" ]; then
+    echo "Impl,Setup,Threads,ConnPerSec,FirstByteP50us,FirstByteP99us,Failed" > $CHURN_CSV
+    ip netns exec ns_server sysctl -qw net.ipv4.tcp_fastopen=3
+    ip netns exec ns_client sysctl -qw net.ipv4.tcp_fastopen=3
+    ip netns exec ns_client sysctl -qw net.ipv4.tcp_tw_reuse=1
+    ip netns exec ns_client sysctl -qw net.ipv4.ip_local_port_range="1024 65535"
+    for impl in "A1" "A2" "A5"; do
+        for setup in $CHURN_SETUPS; do
+            run_churn_point $impl $setup
+        done
+    done
+    echo "Connection churn sweep saved to $CHURN_CSV"
+fi
+
 cleanup_namespaces
-echo "Results saved to $OUTPUT_CSV"
+echo "Results saved to $OUTPUT_CSV (records in $RECORDS)"
+
+# Median and bootstrap confidence interval per cell, and the comparison
+# against BASELINE when given (exit status 2 there means a regression).
+if [ -n "$BASELINE" ]; then
+    ./MT25020_Part_C_Bench --analyze=$RECORDS --baseline=$BASELINE
+else
+    ./MT25020_Part_C_Bench --analyze=$RECORDS
+fi
 
 # Run plotting script
 echo "Generating plots..."
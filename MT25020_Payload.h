@@ -0,0 +1,230 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+// Process-wide payload cache and per-connection memory accounting.
+//
+// Every connection sends identical content, so with --payload-cache the
+// servers share one read-only payload per message size instead of calling
+// allocate_message() (nine mallocs) per connection. The cached payload is a
+// single page-aligned mapping laid out as
+//
+//     [field1 .. field8][pad to page][linear copy of all eight fields]
+//
+// where the linear copy lets A1 send without a per-connection marshalling
+// buffer. With --hugepages the mapping is backed by explicit huge pages
+// (MAP_HUGETLB) if any are reserved, otherwise by transparent huge pages,
+// which cuts TLB misses and the number of pages pinned per zero-copy send.
+//
+// The mapping is read-only by convention only: it is not mprotect()ed
+// because io_uring refuses to register read-only fixed buffers (A4).
+
+#include "MT25020_Common.h"
+#include <sys/mman.h>
+
+#define PAYLOAD_HUGE_PAGE_SIZE (2UL << 20)
+
+typedef enum {
+    PAYLOAD_PAGES_NORMAL,
+    PAYLOAD_PAGES_HUGETLB,
+    PAYLOAD_PAGES_THP
+} PayloadPageKind;
+
+typedef struct PayloadEntry {
+    Message msg;                // must stay first: Message* <-> PayloadEntry*
+    int message_size;
+    int refcount;
+    char *linear;               // prelinearized copy for A1
+    void *base;
+    size_t map_len;
+    PayloadPageKind kind;
+    struct PayloadEntry *next;
+} PayloadEntry;
+
+static PayloadEntry *payload_cache_head;
+static pthread_mutex_t payload_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int active_connections;
+static int rejected_connections;
+static int connection_ids;         // handed out by connection_next_id()
+static pthread_mutex_t connection_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connection_slot_free = PTHREAD_COND_INITIALIZER;
+
+static inline size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+static inline void* payload_map(size_t len, int hugepages, size_t *map_len, PayloadPageKind *kind) {
+    void *p;
+    if (hugepages) {
+        *map_len = round_up(len, PAYLOAD_HUGE_PAGE_SIZE);
+        p = mmap(NULL, *map_len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *kind = PAYLOAD_PAGES_HUGETLB;
+            return p;
+        }
+        // No reserved huge pages: over-allocate to get a 2 MB aligned
+        // region and ask for transparent huge pages instead.
+        size_t raw_len = *map_len + PAYLOAD_HUGE_PAGE_SIZE;
+        char *raw = mmap(NULL, raw_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return NULL;
+        char *aligned = (char*)round_up((size_t)raw, PAYLOAD_HUGE_PAGE_SIZE);
+        if (aligned > raw) munmap(raw, aligned - raw);
+        size_t tail = (raw + raw_len) - (aligned + *map_len);
+        if (tail) munmap(aligned + *map_len, tail);
+        madvise(aligned, *map_len, MADV_HUGEPAGE);
+        *kind = PAYLOAD_PAGES_THP;
+        return aligned;
+    }
+
+    *map_len = round_up(len, sysconf(_SC_PAGESIZE));
+    p = mmap(NULL, *map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    *kind = PAYLOAD_PAGES_NORMAL;
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static inline PayloadEntry* payload_create(int message_size, int hugepages) {
+    int field_size = message_size / NUM_FIELDS;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t fields_len = round_up((size_t)field_size * NUM_FIELDS, page);
+
+    PayloadEntry *e = (PayloadEntry*)calloc(1, sizeof(PayloadEntry));
+    if (!e) return NULL;
+    e->base = payload_map(2 * fields_len, hugepages, &e->map_len, &e->kind);
+    if (!e->base) {
+        free(e);
+        return NULL;
+    }
+
+    char *base = (char*)e->base;
+    char **fields[NUM_FIELDS] = {
+        &e->msg.field1, &e->msg.field2, &e->msg.field3, &e->msg.field4,
+        &e->msg.field5, &e->msg.field6, &e->msg.field7, &e->msg.field8
+    };
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        *fields[i] = base + (size_t)i * field_size;
+        memset(*fields[i], 'A' + i, field_size);
+    }
+    e->linear = base + fields_len;
+    memcpy(e->linear, base, (size_t)field_size * NUM_FIELDS);
+
+    e->message_size = message_size;
+
+    static const char *kind_names[] = { "4K pages", "hugetlb", "THP" };
+    printf("[payload] shared %d B payload in %zu KB mapping (%s)\n",
+           message_size, e->map_len / 1024, kind_names[e->kind]);
+    fflush(stdout);
+    return e;
+}
+
+// Take a reference on the shared payload for message_size, creating it on
+// first use. Returns NULL on allocation failure.
+static inline Message* payload_acquire(int message_size, int hugepages) {
+    pthread_mutex_lock(&payload_cache_lock);
+    PayloadEntry *e = payload_cache_head;
+    while (e && e->message_size != message_size) e = e->next;
+    if (!e) {
+        e = payload_create(message_size, hugepages);
+        if (e) {
+            e->next = payload_cache_head;
+            payload_cache_head = e;
+        }
+    }
+    if (e) e->refcount++;
+    pthread_mutex_unlock(&payload_cache_lock);
+    return e ? &e->msg : NULL;
+}
+
+static inline void payload_release(Message *msg) {
+    PayloadEntry *e = (PayloadEntry*)msg;
+    pthread_mutex_lock(&payload_cache_lock);
+    if (--e->refcount == 0) {
+        PayloadEntry **pp = &payload_cache_head;
+        while (*pp != e) pp = &(*pp)->next;
+        *pp = e->next;
+        munmap(e->base, e->map_len);
+        free(e);
+    }
+    pthread_mutex_unlock(&payload_cache_lock);
+}
+
+// The prelinearized message, for A1 in cache mode.
+static inline const char* payload_linear(const Message *msg) {
+    return ((const PayloadEntry*)msg)->linear;
+}
+
+// Per-connection payload: shared when --payload-cache is set, otherwise a
+// private allocate_message() copy as in the original servers.
+static inline Message* acquire_message(const ServerOptions *opts, int field_size) {
+    if (opts->payload_cache) return payload_acquire(field_size * NUM_FIELDS, opts->hugepages);
+    return allocate_message(field_size);
+}
+
+static inline void release_message(const ServerOptions *opts, Message *msg) {
+    if (!msg) return;
+    if (opts->payload_cache) payload_release(msg);
+    else free_message(msg);
+}
+
+static inline long resident_bytes(void) {
+    long pages_total, pages_resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+    int ok = fscanf(f, "%ld %ld", &pages_total, &pages_resident) == 2;
+    fclose(f);
+    return ok ? pages_resident * sysconf(_SC_PAGESIZE) : -1;
+}
+
+// Call on every accepted connection. Prints resident memory per connection
+// at powers of two and every 1000 connections, so growth with fan-in is
+// visible without sampling on the hot path.
+static inline void connection_opened(const char *name) {
+    int n = __atomic_add_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+    if ((n & (n - 1)) == 0 || n % 1000 == 0) {
+        long rss = resident_bytes();
+        printf("[%s] conns=%d rss=%.1f MB (%.1f KB/conn)\n",
+               name, n, rss / 1048576.0, rss / 1024.0 / n);
+        fflush(stdout);
+    }
+}
+
+// Connection number for the report lines of the event-loop servers, which
+// have no accept loop counting for them.
+static inline int connection_next_id(void) {
+    return __atomic_fetch_add(&connection_ids, 1, __ATOMIC_RELAXED);
+}
+
+static inline void connection_closed(void) {
+    __atomic_sub_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&connection_lock);
+    pthread_cond_signal(&connection_slot_free);
+    pthread_mutex_unlock(&connection_lock);
+}
+
+// --max-conns for blocking accept loops: wait while `max` connections are
+// open (0: no limit). Later clients queue in the listen backlog, and the
+// kernel refuses them once that is full, instead of each costing a thread.
+static inline void connection_wait_slot(int max) {
+    if (max <= 0) return;
+    pthread_mutex_lock(&connection_lock);
+    while (__atomic_load_n(&active_connections, __ATOMIC_RELAXED) >= max)
+        pthread_cond_wait(&connection_slot_free, &connection_lock);
+    pthread_mutex_unlock(&connection_lock);
+}
+
+// --max-conns for event loops, which cannot block in accept: true if a new
+// connection must be rejected (closed right away).
+static inline int connection_limit_reached(int max) {
+    return max > 0 && __atomic_load_n(&active_connections, __ATOMIC_RELAXED) >= max;
+}
+
+// Count a connection turned away by --max-conns; reported at powers of two.
+static inline void connection_rejected(const char *name) {
+    int n = __atomic_add_fetch(&rejected_connections, 1, __ATOMIC_RELAXED);
+    if ((n & (n - 1)) == 0) {
+        printf("[%s] rejected=%d connections over --max-conns\n", name, n);
+        fflush(stdout);
+    }
+}
+
+#endif
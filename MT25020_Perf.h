@@ -0,0 +1,167 @@
+#ifndef PERF_H
+#define PERF_H
+
+// In-process hardware/software counters via perf_event_open.
+//
+// Each worker thread (thread-per-connection handler, reactor, A4 loop or
+// client thread) opens its own counters with pid=0/cpu=-1, so they follow
+// that thread only and the accept loop is never mixed in. Generic
+// PERF_TYPE_HARDWARE/HW_CACHE events are used instead of PMU-specific names,
+// so the same binary works on hybrid and non-hybrid CPUs. Events the machine
+// cannot count (VMs without a PMU, unprivileged kernel counting) are
+// reported as n/a rather than 0, and cycles fall back to the task clock.
+
+#include "MT25020_Common.h"
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_CTX_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_TASK_CLOCK,            // ns on CPU; always available, cycles fallback
+    PERF_NUM_COUNTERS
+} PerfCounterId;
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} perf_counter_defs[PERF_NUM_COUNTERS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "l1d_misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+          (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "ctx_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+typedef struct {
+    int enabled;
+    int fd[PERF_NUM_COUNTERS];      // -1: not countable here
+    int user_only;                  // kernel counting refused (perf_event_paranoid)
+    uint64_t base[PERF_NUM_COUNTERS];
+    uint64_t delta[PERF_NUM_COUNTERS];
+    int valid[PERF_NUM_COUNTERS];   // delta holds a real count
+} PerfCounters;
+
+static inline int perf_open_counter(PerfCounterId id, int *user_only) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_counter_defs[id].type;
+    attr.config = perf_counter_defs[id].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = *user_only;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && (errno == EACCES || errno == EPERM) && !attr.exclude_kernel) {
+        // Most send/receive cost is in the kernel, so only settle for
+        // user-space counts when the system forbids anything else.
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd >= 0) *user_only = 1;
+    }
+    return fd;
+}
+
+// Count, scaled for multiplexing. Returns -1 if the event never ran.
+static inline int perf_read_counter(int fd, uint64_t *value) {
+    uint64_t buf[3];    // value, time_enabled, time_running
+    if (fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) return -1;
+    *value = buf[2] < buf[1] ? (uint64_t)((double)buf[0] * buf[1] / buf[2]) : buf[0];
+    return 0;
+}
+
+static inline void perf_counters_snapshot(PerfCounters *pc) {
+    if (!pc->enabled) return;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (perf_read_counter(pc->fd[i], &pc->base[i]) < 0) pc->base[i] = 0;
+    }
+}
+
+// Open counters for the calling thread and start measuring from now.
+static inline void perf_counters_open(PerfCounters *pc, int enabled) {
+    memset(pc, 0, sizeof(*pc));
+    pc->enabled = enabled;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        pc->fd[i] = enabled ? perf_open_counter((PerfCounterId)i, &pc->user_only) : -1;
+    }
+    perf_counters_snapshot(pc);
+}
+
+// Counts since the last snapshot.
+static inline void perf_counters_delta(PerfCounters *pc) {
+    if (!pc->enabled) return;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        uint64_t now;
+        pc->valid[i] = perf_read_counter(pc->fd[i], &now) == 0;
+        pc->delta[i] = pc->valid[i] && now > pc->base[i] ? now - pc->base[i] : 0;
+    }
+}
+
+static inline void perf_counters_close(PerfCounters *pc) {
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (pc->enabled && pc->fd[i] >= 0) close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+}
+
+// Accumulate deltas, e.g. over client threads. A counter stays valid only
+// if every contributor could count it.
+static inline void perf_counters_add(PerfCounters *dst, const PerfCounters *src) {
+    if (!src->enabled) return;
+    int first = !dst->enabled;
+    dst->enabled = 1;
+    dst->user_only |= src->user_only;
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        dst->valid[i] = (first || dst->valid[i]) && src->valid[i];
+        dst->delta[i] += src->delta[i];
+    }
+}
+
+// One line: raw counts, then cycles/byte (task-clock ns/byte without a
+// cycle counter), IPC and misses per KB of payload moved.
+static inline void perf_counters_print(FILE *out, const char *label, const PerfCounters *pc,
+                                       long long bytes) {
+    if (!pc->enabled) return;
+    fprintf(out, "%s bytes=%lld", label, bytes);
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (pc->valid[i]) fprintf(out, " %s=%llu", perf_counter_defs[i].name,
+                                  (unsigned long long)pc->delta[i]);
+        else fprintf(out, " %s=n/a", perf_counter_defs[i].name);
+    }
+
+    double kb = bytes / 1024.0;
+    const uint64_t *d = pc->delta;
+    if (bytes > 0 && pc->valid[PERF_CYCLES])
+        fprintf(out, " cycles/byte=%.3f", (double)d[PERF_CYCLES] / bytes);
+    else if (bytes > 0 && pc->valid[PERF_TASK_CLOCK])
+        fprintf(out, " task_ns/byte=%.3f", (double)d[PERF_TASK_CLOCK] / bytes);
+    if (pc->valid[PERF_CYCLES] && pc->valid[PERF_INSTRUCTIONS] && d[PERF_CYCLES] > 0)
+        fprintf(out, " ipc=%.2f", (double)d[PERF_INSTRUCTIONS] / d[PERF_CYCLES]);
+    if (kb > 0 && pc->valid[PERF_L1D_MISSES])
+        fprintf(out, " l1d_miss/KB=%.2f", d[PERF_L1D_MISSES] / kb);
+    if (kb > 0 && pc->valid[PERF_LLC_MISSES])
+        fprintf(out, " llc_miss/KB=%.2f", d[PERF_LLC_MISSES] / kb);
+    if (pc->user_only) fprintf(out, " (user only)");
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+// End a per-connection or per-run measurement: report and release.
+static inline void perf_counters_finish(PerfCounters *pc, const char *label, long long bytes) {
+    if (!pc->enabled) return;
+    perf_counters_delta(pc);
+    perf_counters_print(stdout, label, pc, bytes);
+    perf_counters_close(pc);
+}
+
+#endif
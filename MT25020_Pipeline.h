@@ -0,0 +1,924 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Staged pipeline (--pipeline): produce -> compress -> send, and on the
+// client receive -> decompress.
+//
+// The plain servers resend the same constant fields, so they never pay for
+// producing data. With --pipeline, producer threads generate every block
+// afresh. A block is --batch messages, fields back to back. --entropy sets
+// how much of a block is fresh random bytes; the rest repeats bytes seen a
+// little earlier, which is what an LZ codec can find. With --compress,
+// compressor threads run the block through MT25020_Lz.h, and a block that
+// does not shrink goes out raw. One sender thread per connection takes
+// finished blocks and sends each one framed: a FrameHeader whose length
+// is the bytes on the wire, reserved the raw size, send_ns the time the
+// block was produced and, with --frame, crc32c the CRC-32C of the raw bytes.
+//
+//   A1  copy header and block into one buffer, send()
+//   A2  sendmsg(): header iovec, then one per field (one for LZ output)
+//   A3  the same iovecs under MSG_ZEROCOPY; a block goes back to the free
+//       list only once its sends have completed
+//
+// The stages hand blocks over through bounded lock-free MPMC queues (one
+// sequence number per cell), and a fixed set of blocks circulates through
+// a free queue, so a slow stage fills the queue in front of it and stalls
+// the stages upstream instead of growing memory. A thread that finds its
+// queue empty or full spins briefly, then sleeps on a futex that the other
+// side only wakes when someone sleeps (same handshake as MT25020_ShmRing.h).
+//
+// At the end of a run (the last connection closing) the server prints,
+// per stage, blocks, throughput, and the share of time its threads were
+// busy or blocked on a queue. Per queue it prints mean depth and how often
+// a push found it full or a pop found it empty. The busy stage in front of
+// a full queue is the one that saturates. The client's --pipeline stage
+// mirrors this: receivers hand blocks to decompressor threads, which verify
+// length (and CRC with --frame) and record the one-way delay.
+
+#include "MT25020_Accept.h"
+#include "MT25020_Common.h"
+#include "MT25020_Frame.h"
+#include "MT25020_Histogram.h"
+#include "MT25020_Live.h"
+#include "MT25020_Lz.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Placement.h"
+#include "MT25020_ZeroCopy.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define PIPE_SPARE_BLOCKS 8         // blocks beyond the queues, for senders in flight
+#define PIPE_MAX_MEMORY (1L << 30)  // block memory a server may allocate
+#define PIPE_MAX_BLOCK (256 << 20)  // client: largest block it accepts
+#define PIPE_MAX_IOV 1024           // UIO_MAXIOV
+#define PIPE_SPIN 256               // polls before sleeping on a queue
+#define PIPE_SLEEP_MS 100           // futex timeout; a safety net, not a poll
+#define PIPE_RX_TIMEOUT_MS 100      // client: recv() wait between duration checks
+#define PIPE_RUN_MIN 8              // entropy generator: shortest run, bytes
+#define PIPE_WINDOW 4096            // repeats copy from this far back at most
+
+enum { PIPE_SEND_LINEAR, PIPE_SEND_IOV, PIPE_SEND_ZEROCOPY };
+
+// --- Data generation ---
+
+static inline uint64_t pipe_rand(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+// Fill `len` bytes in runs of 8-71 bytes. A run is fresh random bytes with
+// probability `entropy`%, otherwise a copy from up to PIPE_WINDOW bytes back.
+static inline void pipe_fill(char *dst, size_t len, int entropy, uint64_t *rng) {
+    size_t i = 0;
+    while (i < len) {
+        uint64_t r = pipe_rand(rng);
+        size_t run = PIPE_RUN_MIN + (r & 63);
+        if (run > len - i) run = len - i;
+        if (i >= PIPE_RUN_MIN && (int)((r >> 8) % 100) >= entropy) {
+            size_t window = i < PIPE_WINDOW ? i : PIPE_WINDOW;
+            size_t back = PIPE_RUN_MIN + (r >> 20) % (window - PIPE_RUN_MIN + 1);
+            for (size_t k = 0; k < run; k++) dst[i + k] = dst[i + k - back];
+        } else {
+            for (size_t k = 0; k < run; k += 8) {
+                uint64_t v = pipe_rand(rng);
+                memcpy(dst + i + k, &v, run - k < 8 ? run - k : 8);
+            }
+        }
+        i += run;
+    }
+}
+
+// --- Blocks and queues ---
+
+typedef struct {
+    FrameHeader hdr;                // wire header; A3 pins it with the block
+    char *raw;                      // server: produced bytes; client: decoded bytes
+    size_t raw_cap;
+    char *wire;                     // server: LZ output; client: bytes received
+    size_t wire_cap;
+    size_t raw_len;
+    const char *data;               // server: what goes out, raw or wire
+    size_t data_len;
+    uint32_t crc;                   // --frame: CRC-32C of raw
+    int64_t produced_ns;
+    unsigned zc_done;               // A3: completion id that releases the block
+    int conn;                       // client: receiving connection
+} PipeBlock;
+
+typedef struct {
+    uint64_t seq;
+    PipeBlock *block;
+} PipeCell;
+
+typedef struct {
+    const char *name;
+    PipeCell *cells;
+    unsigned capacity;              // power of two
+    int closed;
+    uint64_t enq __attribute__((aligned(64)));
+    uint64_t deq __attribute__((aligned(64)));
+    uint32_t not_empty __attribute__((aligned(64)));   // futex eventcounts
+    uint32_t empty_waiters;
+    uint32_t not_full;
+    uint32_t full_waiters;
+    long long pushes __attribute__((aligned(64)));
+    long long push_blocked;         // pushes that found the queue full
+    long long pops;
+    long long pop_blocked;          // pops that found it empty
+    long long depth_sum;            // depth seen by each pop
+} PipeQueue;
+
+static inline int pipe_queue_init(PipeQueue *q, const char *name, unsigned capacity) {
+    memset(q, 0, sizeof(*q));
+    q->name = name;
+    q->capacity = 2;
+    while (q->capacity < capacity) q->capacity *= 2;
+    q->cells = (PipeCell*)calloc(q->capacity, sizeof(PipeCell));
+    if (!q->cells) return -1;
+    for (unsigned i = 0; i < q->capacity; i++) q->cells[i].seq = i;
+    return 0;
+}
+
+static inline int pipe_try_push(PipeQueue *q, PipeBlock *b) {
+    uint64_t pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+    PipeCell *c;
+    while (1) {
+        c = &q->cells[pos & (q->capacity - 1)];
+        int64_t dif = (int64_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif < 0) return 0;
+        if (dif == 0 && __atomic_compare_exchange_n(&q->enq, &pos, pos + 1, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (dif > 0) pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED);
+    }
+    c->block = b;
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline PipeBlock* pipe_try_pop(PipeQueue *q) {
+    uint64_t pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED);
+    PipeCell *c;
+    while (1) {
+        c = &q->cells[pos & (q->capacity - 1)];
+        int64_t dif = (int64_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (dif < 0) return NULL;
+        if (dif == 0 && __atomic_compare_exchange_n(&q->deq, &pos, pos + 1, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (dif > 0) pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED);
+    }
+    PipeBlock *b = c->block;
+    __atomic_store_n(&c->seq, pos + q->capacity, __ATOMIC_RELEASE);
+    return b;
+}
+
+static inline void pipe_futex(uint32_t *addr, int op, uint32_t val) {
+    struct timespec ts = { 0, PIPE_SLEEP_MS * 1000000L };
+    syscall(SYS_futex, addr, op, val, op == FUTEX_WAIT_PRIVATE ? &ts : NULL, NULL, 0);
+}
+
+// After changing the queue: wake one sleeper on `event`, if there is one.
+static inline void pipe_wake(uint32_t *event, uint32_t *waiters) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(waiters, __ATOMIC_RELAXED)) return;
+    __atomic_fetch_add(event, 1, __ATOMIC_RELAXED);
+    pipe_futex(event, FUTEX_WAKE_PRIVATE, 1);
+}
+
+// Spin, then sleep on `event` until `attempt` succeeds. The sleeper
+// registers, then retries once more before sleeping; a waker changes the
+// queue, then checks for sleepers (full fences between, on both sides).
+#define PIPE_WAIT(q, attempt, event, waiters)                                    \
+    do {                                                                         \
+        int ok_ = 0;                                                             \
+        for (int spin_ = 0; spin_ < PIPE_SPIN && !(ok_ = !!(attempt)); spin_++)  \
+            cpu_relax();                                                         \
+        while (!ok_) {                                                           \
+            uint32_t ev_ = __atomic_load_n(event, __ATOMIC_RELAXED);             \
+            __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);                    \
+            ok_ = !!(attempt);                                                   \
+            int closed_ = __atomic_load_n(&(q)->closed, __ATOMIC_ACQUIRE);       \
+            if (!ok_ && !closed_) pipe_futex(event, FUTEX_WAIT_PRIVATE, ev_);    \
+            __atomic_fetch_sub(waiters, 1, __ATOMIC_RELAXED);                    \
+            if (closed_) break;                                                  \
+        }                                                                        \
+    } while (0)
+
+// Blocking push; adds the time spent waiting to *wait_ns.
+static inline void pipe_push(PipeQueue *q, PipeBlock *b, long long *wait_ns) {
+    __atomic_fetch_add(&q->pushes, 1, __ATOMIC_RELAXED);
+    if (!pipe_try_push(q, b)) {
+        __atomic_fetch_add(&q->push_blocked, 1, __ATOMIC_RELAXED);
+        long long t0 = get_time_ns();
+        int pushed = 0;
+        PIPE_WAIT(q, (pushed = pipe_try_push(q, b)), &q->not_full, &q->full_waiters);
+        *wait_ns += get_time_ns() - t0;
+        if (!pushed) return;
+    }
+    pipe_wake(&q->not_empty, &q->empty_waiters);
+}
+
+// Account for a block taken off `q` and wake a pusher waiting for room.
+static inline PipeBlock* pipe_popped(PipeQueue *q, PipeBlock *b) {
+    uint64_t depth = __atomic_load_n(&q->enq, __ATOMIC_RELAXED) -
+                     __atomic_load_n(&q->deq, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&q->pops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&q->depth_sum, (long long)depth, __ATOMIC_RELAXED);
+    pipe_wake(&q->not_full, &q->full_waiters);
+    return b;
+}
+
+// Blocking pop; NULL once the queue is closed and empty.
+static inline PipeBlock* pipe_pop(PipeQueue *q, long long *wait_ns) {
+    PipeBlock *b = pipe_try_pop(q);
+    if (!b) {
+        __atomic_fetch_add(&q->pop_blocked, 1, __ATOMIC_RELAXED);
+        long long t0 = get_time_ns();
+        PIPE_WAIT(q, (b = pipe_try_pop(q)), &q->not_empty, &q->empty_waiters);
+        *wait_ns += get_time_ns() - t0;
+        if (!b) return NULL;
+    }
+    return pipe_popped(q, b);
+}
+
+// Wake every sleeper; pops return NULL once the queue is empty.
+static inline void pipe_queue_close(PipeQueue *q) {
+    __atomic_store_n(&q->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&q->not_empty, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&q->not_full, 1, __ATOMIC_RELAXED);
+    pipe_futex(&q->not_empty, FUTEX_WAKE_PRIVATE, INT_MAX);
+    pipe_futex(&q->not_full, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
+
+static inline void pipe_queue_reset_stats(PipeQueue *q) {
+    __atomic_store_n(&q->pushes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->push_blocked, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->pops, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->pop_blocked, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->depth_sum, 0, __ATOMIC_RELAXED);
+}
+
+static inline void pipe_queue_print(FILE *out, const char *prefix, const PipeQueue *q) {
+    fprintf(out, "%s queue %s] capacity=%u depth=%.1f push_full=%.1f%% pop_empty=%.1f%%\n",
+            prefix, q->name, q->capacity, q->pops ? (double)q->depth_sum / q->pops : 0,
+            q->pushes ? 100.0 * q->push_blocked / q->pushes : 0,
+            q->pops ? 100.0 * q->pop_blocked / q->pops : 0);
+}
+
+// --- Stage accounting ---
+
+typedef struct {
+    const char *name;
+    int threads;
+    long long blocks;
+    long long bytes_in;
+    long long bytes_out;
+    long long busy_ns;              // working on blocks
+    long long wait_ns;              // blocked on a queue
+    long long stored;               // compress: blocks sent raw (did not shrink)
+} PipeStage;
+
+static inline void pipe_stage_add(PipeStage *s, long long in, long long out, long long busy_ns,
+                                  long long wait_ns) {
+    __atomic_fetch_add(&s->blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->bytes_in, in, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->bytes_out, out, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->busy_ns, busy_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->wait_ns, wait_ns, __ATOMIC_RELAXED);
+}
+
+static inline void pipe_stage_reset(PipeStage *s) {
+    __atomic_store_n(&s->blocks, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->bytes_in, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->bytes_out, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->busy_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->wait_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->stored, 0, __ATOMIC_RELAXED);
+}
+
+static inline double pipe_stage_share(const PipeStage *s, long long ns, long long elapsed_ns) {
+    return s->threads > 0 && elapsed_ns > 0 ? 100.0 * ns / ((double)s->threads * elapsed_ns) : 0;
+}
+
+static inline void pipe_stage_print(FILE *out, const char *prefix, const PipeStage *s,
+                                    long long elapsed_ns) {
+    double secs = elapsed_ns / 1e9;
+    fprintf(out, "%s %s] threads=%d blocks=%lld in=%.3f Gbps out=%.3f Gbps busy=%.1f%% "
+                 "blocked=%.1f%%", prefix, s->name, s->threads, s->blocks,
+            secs > 0 ? s->bytes_in * 8.0 / (secs * 1e9) : 0,
+            secs > 0 ? s->bytes_out * 8.0 / (secs * 1e9) : 0,
+            pipe_stage_share(s, s->busy_ns, elapsed_ns), pipe_stage_share(s, s->wait_ns, elapsed_ns));
+    if (s->stored) fprintf(out, " stored_raw=%lld", s->stored);
+    fprintf(out, "\n");
+}
+
+// The stage whose threads were busy the largest share of the run.
+static inline const PipeStage* pipe_busiest(const PipeStage *const *stages, int n,
+                                            long long elapsed_ns) {
+    const PipeStage *best = NULL;
+    for (int i = 0; i < n; i++) {
+        if (stages[i]->threads == 0) continue;
+        if (!best || pipe_stage_share(stages[i], stages[i]->busy_ns, elapsed_ns) >
+                     pipe_stage_share(best, best->busy_ns, elapsed_ns))
+            best = stages[i];
+    }
+    return best;
+}
+
+static inline PipeBlock* pipe_blocks_alloc(int count, size_t raw_cap, size_t wire_cap) {
+    PipeBlock *blocks = (PipeBlock*)calloc(count, sizeof(PipeBlock));
+    if (!blocks) return NULL;
+    for (int i = 0; i < count; i++) {
+        blocks[i].raw_cap = raw_cap;
+        blocks[i].wire_cap = wire_cap;
+        blocks[i].raw = raw_cap ? (char*)malloc(raw_cap) : NULL;
+        blocks[i].wire = wire_cap ? (char*)malloc(wire_cap) : NULL;
+        if ((raw_cap && !blocks[i].raw) || (wire_cap && !blocks[i].wire)) {
+            for (int j = 0; j <= i; j++) {
+                free(blocks[j].raw);
+                free(blocks[j].wire);
+            }
+            free(blocks);
+            return NULL;
+        }
+    }
+    return blocks;
+}
+
+// --- Server ---
+
+typedef struct {
+    const char *name;
+    int mode;                       // PIPE_SEND_*
+    const ServerOptions *opts;
+    size_t raw_len;                 // bytes per block
+    PipeBlock *blocks;
+    int num_blocks;
+    PipeQueue free;                 // empty blocks
+    PipeQueue filled;               // producer -> compressor (--compress)
+    PipeQueue ready;                // -> senders
+    PipeStage produce;
+    PipeStage compress;
+    PipeStage send;
+    pthread_mutex_t lock;           // run boundaries
+    pthread_cond_t running;         // producers idle between runs
+    int active;                     // open connections
+    int run_conns;
+    long long run_start_ns;
+} PipeServer;
+
+typedef struct {
+    PipeServer *srv;
+    int id;
+} PipeWorker;
+
+typedef struct {
+    PipeServer *srv;
+    int fd;
+    int id;
+} PipeConnArgs;
+
+// Producers make nothing while no client is connected, so queued blocks
+// do not carry stale timestamps into the next run.
+static inline void pipe_wait_running(PipeServer *srv) {
+    if (__atomic_load_n(&srv->active, __ATOMIC_ACQUIRE) > 0) return;
+    pthread_mutex_lock(&srv->lock);
+    while (srv->active == 0) pthread_cond_wait(&srv->running, &srv->lock);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+static inline void* pipe_producer_thread(void *arg) {
+    PipeWorker *w = (PipeWorker*)arg;
+    PipeServer *srv = w->srv;
+    const ServerOptions *opts = srv->opts;
+    PipeQueue *out = opts->compress > 0 ? &srv->filled : &srv->ready;
+    uint64_t rng = 0x9E3779B97F4A7C15ull * (w->id + 1);
+
+    while (1) {
+        pipe_wait_running(srv);
+        long long wait_ns = 0;
+        PipeBlock *b = pipe_pop(&srv->free, &wait_ns);
+        long long t0 = get_time_ns();
+        pipe_fill(b->raw, srv->raw_len, opts->entropy, &rng);
+        b->raw_len = srv->raw_len;
+        b->data = b->raw;
+        b->data_len = b->raw_len;
+        b->crc = opts->frame ? crc32c_extend(0, b->raw, b->raw_len) : 0;
+        b->produced_ns = get_time_ns();
+        long long busy_ns = b->produced_ns - t0;
+        pipe_push(out, b, &wait_ns);
+        pipe_stage_add(&srv->produce, 0, b->raw_len, busy_ns, wait_ns);
+    }
+    return NULL;
+}
+
+static inline void* pipe_compressor_thread(void *arg) {
+    PipeWorker *w = (PipeWorker*)arg;
+    PipeServer *srv = w->srv;
+    LzState *lz = (LzState*)malloc(sizeof(LzState));
+    if (!lz) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return NULL;
+    }
+
+    while (1) {
+        long long wait_ns = 0;
+        PipeBlock *b = pipe_pop(&srv->filled, &wait_ns);
+        long long t0 = get_time_ns();
+        size_t n = lz_compress(lz, b->raw, b->raw_len, b->wire);
+        if (n < b->raw_len) {
+            b->data = b->wire;
+            b->data_len = n;
+        } else {
+            __atomic_fetch_add(&srv->compress.stored, 1, __ATOMIC_RELAXED);
+        }
+        long long busy_ns = get_time_ns() - t0;
+        pipe_push(&srv->ready, b, &wait_ns);
+        pipe_stage_add(&srv->compress, b->raw_len, b->data_len, busy_ns, wait_ns);
+    }
+    return NULL;
+}
+
+static inline void pipe_run_begin(PipeServer *srv) {
+    pthread_mutex_lock(&srv->lock);
+    if (srv->active++ == 0) {
+        pipe_stage_reset(&srv->produce);
+        pipe_stage_reset(&srv->compress);
+        pipe_stage_reset(&srv->send);
+        pipe_queue_reset_stats(&srv->free);
+        pipe_queue_reset_stats(&srv->filled);
+        pipe_queue_reset_stats(&srv->ready);
+        srv->run_conns = 0;
+        srv->run_start_ns = get_time_ns();
+        pthread_cond_broadcast(&srv->running);
+    }
+    srv->run_conns++;
+    pthread_mutex_unlock(&srv->lock);
+}
+
+static inline void pipe_report(PipeServer *srv) {
+    long long elapsed_ns = get_time_ns() - srv->run_start_ns;
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "[%s pipeline", srv->name);
+    srv->send.threads = srv->run_conns;
+    const PipeStage *stages[] = { &srv->produce, &srv->compress, &srv->send };
+    long long raw = srv->produce.bytes_out;
+    long long wire = srv->send.bytes_out;
+    printf("%s] conns=%d elapsed=%.3f s entropy=%d%% produced=%lld B sent=%lld B "
+           "ratio=%.2f\n", prefix, srv->run_conns, elapsed_ns / 1e9, srv->opts->entropy,
+           raw, wire, wire > 0 ? (double)srv->send.bytes_in / wire : 0);
+    for (int i = 0; i < 3; i++)
+        if (stages[i]->threads > 0) pipe_stage_print(stdout, prefix, stages[i], elapsed_ns);
+    if (srv->opts->compress > 0) pipe_queue_print(stdout, prefix, &srv->filled);
+    pipe_queue_print(stdout, prefix, &srv->ready);
+    pipe_queue_print(stdout, prefix, &srv->free);
+    const PipeStage *busiest = pipe_busiest(stages, 3, elapsed_ns);
+    if (busiest)
+        printf("%s] busiest stage: %s (%.1f%% busy)\n", prefix, busiest->name,
+               pipe_stage_share(busiest, busiest->busy_ns, elapsed_ns));
+    fflush(stdout);
+}
+
+// Last connection gone: report, and return queued blocks to the free list
+// so the next run starts with fresh ones. The drain pops like a stage
+// does, so producers and compressors parked on a full queue wake at once
+// instead of after PIPE_SLEEP_MS; the stats it adds are reset next run.
+static inline void pipe_run_end(PipeServer *srv) {
+    pthread_mutex_lock(&srv->lock);
+    if (--srv->active == 0) {
+        pipe_report(srv);
+        PipeQueue *drain[] = { &srv->ready, &srv->filled };
+        long long wait_ns = 0;
+        for (int i = 0; i < 2; i++) {
+            PipeBlock *b;
+            while ((b = pipe_try_pop(drain[i])))
+                pipe_push(&srv->free, pipe_popped(drain[i], b), &wait_ns);
+        }
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+// Header iovec, then the block: one iovec per field while raw, capped at
+// PIPE_MAX_IOV (the last one takes the rest), or one for LZ output.
+static inline int pipe_block_iov(const PipeBlock *b, int field_size, struct iovec *iov) {
+    iov[0].iov_base = (void*)&b->hdr;
+    iov[0].iov_len = sizeof(FrameHeader);
+    int n = 1;
+    size_t off = 0;
+    size_t piece = b->data == b->raw ? (size_t)field_size : b->data_len;
+    while (off < b->data_len) {
+        size_t len = n == PIPE_MAX_IOV - 1 || b->data_len - off < piece ? b->data_len - off : piece;
+        iov[n].iov_base = (char*)b->data + off;
+        iov[n].iov_len = len;
+        off += len;
+        n++;
+    }
+    return n;
+}
+
+// Send `iov` completely. Under MSG_ZEROCOPY every call that moves data is
+// recorded in `zc`, after waiting out its pinned-memory budget. Returns 0,
+// or -1 once the connection is gone.
+static inline int pipe_send_iov(int fd, struct iovec *iov, int iovcnt, int flags, ZcTracker *zc,
+                                long long *syscalls, LiveConn *live) {
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = iovcnt;
+    size_t remaining = 0;
+    for (int i = 0; i < iovcnt; i++) remaining += iov[i].iov_len;
+
+    while (remaining > 0) {
+        while (zc && zc_must_wait(zc, remaining)) {
+            if (zc_wait(fd, zc, -1) < 0) return -1;
+        }
+        ssize_t n = sendmsg(fd, &mh, flags);
+        (*syscalls)++;
+        live_note_send(live, remaining, n);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == ENOBUFS && zc) {
+            // optmem limit reached: wait for completions, then retry.
+            if (zc_wait(fd, zc, -1) < 0) return -1;
+            continue;
+        }
+        if (n <= 0) return -1;
+        if (zc) zc_record_send(zc, n);
+        remaining -= n;
+        msghdr_advance(&mh, n);
+    }
+    return 0;
+}
+
+// A3: blocks whose sends the kernel has released.
+typedef struct {
+    PipeBlock *blocks[ZC_RING_SIZE];    // every block holds at least one id
+    unsigned head;
+    unsigned tail;
+} PipeInflight;
+
+static inline void pipe_release_done(PipeServer *srv, PipeInflight *f, const ZcTracker *zc) {
+    long long wait_ns = 0;
+    while (f->head != f->tail &&
+           (int)(f->blocks[f->head % ZC_RING_SIZE]->zc_done - zc->head_id) <= 0)
+        pipe_push(&srv->free, f->blocks[f->head++ % ZC_RING_SIZE], &wait_ns);
+}
+
+// Next block to send. A3 keeps collecting completions while the queue is
+// empty: the blocks it holds may be the ones the producers are waiting for.
+static inline PipeBlock* pipe_next_block(PipeServer *srv, int fd, ZcTracker *zc,
+                                         PipeInflight *f, long long *wait_ns) {
+    PipeBlock *b = NULL;
+    if (zc) {
+        long long t0 = get_time_ns();
+        while (f->head != f->tail && !(b = pipe_try_pop(&srv->ready))) {
+            if (zc_wait(fd, zc, 1) < 0) return NULL;
+            pipe_release_done(srv, f, zc);
+        }
+        *wait_ns += get_time_ns() - t0;
+    }
+    return b ? pipe_popped(&srv->ready, b) : pipe_pop(&srv->ready, wait_ns);
+}
+
+static inline void* pipe_sender_thread(void *arg) {
+    PipeConnArgs *a = (PipeConnArgs*)arg;
+    PipeServer *srv = a->srv;
+    const ServerOptions *opts = srv->opts;
+    int fd = a->fd;
+    int field_size = opts->message_size / NUM_FIELDS;
+    int flags = stream_send_flags(opts) | MSG_NOSIGNAL;
+
+    size_t max_wire = opts->compress > 0 ? lz_bound(srv->raw_len) : srv->raw_len;
+    char *linear = srv->mode == PIPE_SEND_LINEAR
+                   ? (char*)malloc(sizeof(FrameHeader) + max_wire) : NULL;
+    struct iovec *iov = (struct iovec*)malloc(PIPE_MAX_IOV * sizeof(struct iovec));
+    ZcTracker *zc = srv->mode == PIPE_SEND_ZEROCOPY ? (ZcTracker*)malloc(sizeof(ZcTracker)) : NULL;
+    PipeInflight *inflight = zc ? (PipeInflight*)calloc(1, sizeof(PipeInflight)) : NULL;
+    if ((srv->mode == PIPE_SEND_LINEAR && !linear) || !iov ||
+        (srv->mode == PIPE_SEND_ZEROCOPY && (!zc || !inflight))) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        free(linear);
+        free(iov);
+        free(zc);
+        free(inflight);
+        close(fd);
+        connection_closed();
+        free(a);
+        return NULL;
+    }
+    LiveConn live;
+    live_conn_open(&live, a->id, NULL);
+    if (zc) {
+        zc_tracker_init(zc, fd, opts);
+        zc->live = &live;
+    }
+    PerfCounters pc;
+    perf_counters_open(&pc, opts->perf_counters);
+    long long bytes_sent = 0;
+    long long syscalls = 0;
+    uint64_t seq = 0;
+    pipe_run_begin(srv);
+
+    while (1) {
+        long long wait_ns = 0;
+        PipeBlock *b = pipe_next_block(srv, fd, zc, inflight, &wait_ns);
+        if (!b) break;
+        long long t0 = get_time_ns();
+        b->hdr.magic = FRAME_MAGIC;
+        b->hdr.length = b->data_len;
+        b->hdr.seq = seq++;
+        b->hdr.send_ns = b->produced_ns;
+        b->hdr.crc32c = b->crc;
+        b->hdr.reserved = b->raw_len;
+        size_t wire = sizeof(FrameHeader) + b->data_len;
+        long long raw_len = b->raw_len;
+
+        int rc;
+        int pinned = 0;
+        if (srv->mode == PIPE_SEND_LINEAR) {
+            // Copy #1: header and block into the connection's buffer; the
+            // block is free again before the send.
+            memcpy(linear, &b->hdr, sizeof(FrameHeader));
+            memcpy(linear + sizeof(FrameHeader), b->data, b->data_len);
+            long long push_wait = 0;
+            pipe_push(&srv->free, b, &push_wait);
+            b = NULL;
+            iov[0].iov_base = linear;
+            iov[0].iov_len = wire;
+            rc = pipe_send_iov(fd, iov, 1, flags, NULL, &syscalls, &live);
+        } else {
+            int iovcnt = pipe_block_iov(b, field_size, iov);
+            pinned = zc && zc_begin_message(zc);
+            rc = pipe_send_iov(fd, iov, iovcnt, flags | (pinned ? MSG_ZEROCOPY : 0),
+                               pinned ? zc : NULL, &syscalls, &live);
+        }
+        if (b && pinned) {
+            b->zc_done = zc->next_id;
+            inflight->blocks[inflight->tail++ % ZC_RING_SIZE] = b;
+        } else if (b) {
+            pipe_push(&srv->free, b, &wait_ns);
+        }
+        if (rc < 0) break;
+        bytes_sent += wire;
+        pipe_stage_add(&srv->send, raw_len, wire, get_time_ns() - t0, wait_ns);
+
+        if (zc) {
+            if (zc->inflight_bytes > zc->max_inflight_bytes / 2 && zc_process_errqueue(fd, zc) < 0)
+                break;
+            pipe_release_done(srv, inflight, zc);
+        }
+    }
+
+    if (zc) {
+        // Blocks still pinned go back only after the kernel lets go of them
+        // (or gives up on the dead connection).
+        zc_drain_all(fd, zc, 1000);
+        long long wait_ns = 0;
+        while (inflight->head != inflight->tail)
+            pipe_push(&srv->free, inflight->blocks[inflight->head++ % ZC_RING_SIZE], &wait_ns);
+        zc_report(srv->name, a->id, zc);
+    }
+    live_conn_close(&live);
+    char label[128];
+    placement_conn_label(label, sizeof(label), srv->name, a->id, fd, syscalls);
+    perf_counters_finish(&pc, label, bytes_sent);
+    pipe_run_end(srv);
+
+    free(linear);
+    free(iov);
+    free(zc);
+    free(inflight);
+    close(fd);
+    connection_closed();
+    free(a);
+    return NULL;
+}
+
+static inline int pipe_spawn_sender(AcceptLoop *loop, int fd, int id) {
+    PipeConnArgs *a = (PipeConnArgs*)malloc(sizeof(PipeConnArgs));
+    if (!a) return -1;
+    a->srv = (PipeServer*)loop->ctx;
+    a->fd = fd;
+    a->id = id;
+    pthread_t t;
+    if (placement_spawn(loop->placement, fd, &t, pipe_sender_thread, a) != 0) {
+        free(a);
+        return -1;
+    }
+    pthread_detach(t);
+    return 0;
+}
+
+static inline int pipe_start_workers(PipeServer *srv, int count, void *(*fn)(void*)) {
+    for (int i = 0; i < count; i++) {
+        PipeWorker *w = (PipeWorker*)malloc(sizeof(PipeWorker));
+        pthread_t t;
+        if (!w) return -1;
+        w->srv = srv;
+        w->id = i;
+        if (pthread_create(&t, NULL, fn, w) != 0) {
+            free(w);
+            return -1;
+        }
+        pthread_detach(t);
+    }
+    return 0;
+}
+
+// Serve --pipeline: start the producer and compressor stages, then give
+// every connection a sender thread that drains the ready queue.
+static inline int run_pipeline_server(const char *name, int mode, const ServerOptions *opts) {
+    Placement placement;
+    if (placement_init(&placement, opts) < 0) return -1;
+    PipeServer *srv = (PipeServer*)calloc(1, sizeof(PipeServer));
+    if (!srv) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+    srv->name = name;
+    srv->mode = mode;
+    srv->opts = opts;
+    srv->raw_len = (size_t)(opts->message_size / NUM_FIELDS) * NUM_FIELDS * opts->batch;
+    srv->num_blocks = 2 * opts->pipe_depth + opts->pipeline + opts->compress + PIPE_SPARE_BLOCKS;
+    size_t wire_cap = opts->compress > 0 ? lz_bound(srv->raw_len) : 0;
+    if ((double)srv->num_blocks * (srv->raw_len + wire_cap) > PIPE_MAX_MEMORY) {
+        fprintf(stderr, "%d blocks of %zu bytes exceed %ld MB; lower --pipe-depth or --batch\n",
+                srv->num_blocks, srv->raw_len, PIPE_MAX_MEMORY >> 20);
+        free(srv);
+        return -1;
+    }
+    srv->produce.name = "produce";
+    srv->produce.threads = opts->pipeline;
+    srv->compress.name = "compress";
+    srv->compress.threads = opts->compress;
+    srv->send.name = "send";
+    pthread_mutex_init(&srv->lock, NULL);
+    pthread_cond_init(&srv->running, NULL);
+    srv->blocks = pipe_blocks_alloc(srv->num_blocks, srv->raw_len, wire_cap);
+    if (!srv->blocks || pipe_queue_init(&srv->free, "free", srv->num_blocks) < 0 ||
+        pipe_queue_init(&srv->filled, "filled", opts->pipe_depth) < 0 ||
+        pipe_queue_init(&srv->ready, "ready", opts->pipe_depth) < 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+    for (int i = 0; i < srv->num_blocks; i++) pipe_try_push(&srv->free, &srv->blocks[i]);
+    if (opts->frame) crc32c_tables();
+
+    if (pipe_start_workers(srv, opts->pipeline, pipe_producer_thread) < 0 ||
+        pipe_start_workers(srv, opts->compress, pipe_compressor_thread) < 0) {
+        fprintf(stderr, "Failed to start the pipeline stages\n");
+        return -1;
+    }
+    printf("[%s pipeline] producers=%d compressors=%d depth=%u blocks=%d of %zu bytes "
+           "entropy=%d%% send=%s\n", name, opts->pipeline, opts->compress,
+           srv->ready.capacity, srv->num_blocks, srv->raw_len, opts->entropy,
+           mode == PIPE_SEND_LINEAR ? "copy" : mode == PIPE_SEND_IOV ? "sendmsg" : "zerocopy");
+    AcceptLoop loop = { .name = name, .opts = opts, .placement = &placement,
+                        .spawn = pipe_spawn_sender, .ctx = srv };
+    return run_accept_loop(&loop);
+}
+
+// --- Client ---
+
+typedef struct {
+    pthread_mutex_t lock;           // hist, shared with the decompressors
+    LatencyHistogram *hist;
+    long long pending;              // blocks handed to the decompressors
+} PipeClientConn;
+
+typedef struct {
+    int verify;                     // --frame: check the raw CRC-32C
+    PipeBlock *blocks;
+    int num_blocks;
+    PipeQueue free;
+    PipeQueue decode;
+    PipeStage receive;
+    PipeStage decompress;
+    PipeClientConn *conns;
+    int num_conns;
+    pthread_t *threads;
+    long long decode_errors;        // bad LZ data or wrong decoded length
+    long long crc_errors;
+    long long seq_errors;
+    long long framing_errors;       // connections whose stream stopped parsing
+} PipeClient;
+
+// Grow `b` to hold a block of `wire` bytes that decodes to `raw`.
+static inline int pipe_block_reserve(PipeBlock *b, size_t wire, size_t raw) {
+    if (wire > b->wire_cap) {
+        char *p = (char*)realloc(b->wire, wire);
+        if (!p) return -1;
+        b->wire = p;
+        b->wire_cap = wire;
+    }
+    if (raw > b->raw_cap) {
+        char *p = (char*)realloc(b->raw, raw);
+        if (!p) return -1;
+        b->raw = p;
+        b->raw_cap = raw;
+    }
+    return 0;
+}
+
+static inline void* pipe_decompressor_thread(void *arg) {
+    PipeClient *pc = (PipeClient*)arg;
+    while (1) {
+        long long wait_ns = 0;
+        PipeBlock *b = pipe_pop(&pc->decode, &wait_ns);
+        if (!b) break;
+        long long t0 = get_time_ns();
+        const FrameHeader *h = &b->hdr;
+        const char *raw = b->wire;
+        if (h->length < h->reserved) {
+            long n = lz_decompress(b->wire, h->length, b->raw, h->reserved);
+            raw = b->raw;
+            if (n != (long)h->reserved) {
+                __atomic_fetch_add(&pc->decode_errors, 1, __ATOMIC_RELAXED);
+                raw = NULL;
+            }
+        }
+        if (raw && pc->verify && crc32c_extend(0, raw, h->reserved) != h->crc32c)
+            __atomic_fetch_add(&pc->crc_errors, 1, __ATOMIC_RELAXED);
+        long long now = get_time_ns();
+        PipeClientConn *c = &pc->conns[b->conn];
+        pthread_mutex_lock(&c->lock);
+        hist_record(c->hist, now - h->send_ns);
+        pthread_mutex_unlock(&c->lock);
+        pipe_stage_add(&pc->decompress, h->length, h->reserved, now - t0, wait_ns);
+        pipe_push(&pc->free, b, &wait_ns);
+        __atomic_fetch_sub(&c->pending, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// Decompressor threads and blocks for `num_conns` receivers. NULL on failure.
+static inline PipeClient* pipe_client_start(int decompressors, int num_conns, int verify) {
+    PipeClient *pc = (PipeClient*)calloc(1, sizeof(PipeClient));
+    if (!pc) return NULL;
+    pc->verify = verify;
+    if (verify) crc32c_tables();
+    pc->num_conns = num_conns;
+    pc->num_blocks = 2 * PIPE_DEFAULT_DEPTH + num_conns + decompressors;
+    pc->receive.name = "receive";
+    pc->receive.threads = num_conns;
+    pc->decompress.name = "decompress";
+    pc->decompress.threads = decompressors;
+    pc->conns = (PipeClientConn*)calloc(num_conns, sizeof(PipeClientConn));
+    pc->threads = (pthread_t*)calloc(decompressors, sizeof(pthread_t));
+    pc->blocks = pipe_blocks_alloc(pc->num_blocks, 0, 0);
+    if (!pc->conns || !pc->threads || !pc->blocks ||
+        pipe_queue_init(&pc->free, "free", pc->num_blocks) < 0 ||
+        pipe_queue_init(&pc->decode, "decode", 2 * PIPE_DEFAULT_DEPTH) < 0)
+        return NULL;
+    for (int i = 0; i < pc->num_blocks; i++) pipe_try_push(&pc->free, &pc->blocks[i]);
+    for (int i = 0; i < num_conns; i++) pthread_mutex_init(&pc->conns[i].lock, NULL);
+    for (int i = 0; i < decompressors; i++) {
+        if (pthread_create(&pc->threads[i], NULL, pipe_decompressor_thread, pc) != 0) {
+            pc->decompress.threads = i;
+            break;
+        }
+    }
+    return pc->decompress.threads > 0 ? pc : NULL;
+}
+
+// Receivers are done: let the decompressors finish the queue and exit.
+static inline void pipe_client_stop(PipeClient *pc) {
+    pipe_queue_close(&pc->decode);
+    for (int i = 0; i < pc->decompress.threads; i++) pthread_join(pc->threads[i], NULL);
+}
+
+static inline void pipe_client_print(FILE *out, const PipeClient *pc, long long elapsed_ns) {
+    const PipeStage *stages[] = { &pc->receive, &pc->decompress };
+    long long wire = pc->receive.bytes_in;
+    fprintf(out, "Pipeline: received=%lld B decoded=%lld B ratio=%.2f\n", wire,
+            pc->decompress.bytes_out, wire > 0 ? (double)pc->receive.bytes_out / wire : 0);
+    for (int i = 0; i < 2; i++) pipe_stage_print(out, "[pipeline", stages[i], elapsed_ns);
+    pipe_queue_print(out, "[pipeline", &pc->decode);
+    pipe_queue_print(out, "[pipeline", &pc->free);
+    fprintf(out, "Pipeline errors: %lld decode, %lld sequence, %lld framing", pc->decode_errors,
+            pc->seq_errors, pc->framing_errors);
+    if (pc->verify) fprintf(out, ", %lld checksum (crc32c %s)", pc->crc_errors, crc32c_impl());
+    fprintf(out, "\n");
+}
+
+static inline void pipe_client_free(PipeClient *pc) {
+    for (int i = 0; i < pc->num_blocks; i++) {
+        free(pc->blocks[i].raw);
+        free(pc->blocks[i].wire);
+    }
+    free(pc->blocks);
+    free(pc->free.cells);
+    free(pc->decode.cells);
+    free(pc->conns);
+    free(pc->threads);
+    free(pc);
+}
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Topology-aware placement of server worker threads.
+//
+// --cpus=LIST restricts the workers (connection threads, reactors, the A4
+// loop) to those CPUs. Every thread is created already pinned, so the
+// Message buffers it allocates and first touches are placed on its own NUMA
+// node by the kernel's default local-allocation policy. There is no
+// migration after the memory has been touched.
+//
+// --steer additionally puts each connection on the worker whose CPU already
+// processes its packets. In thread-per-connection mode the accept loop reads
+// SO_INCOMING_CPU from the new socket (the CPU that ran its receive
+// softirq) and pins the handler there. If that CPU is not a worker, it uses
+// a worker sharing the LLC, then one on the same node, then round-robin.
+// In reactor mode a classic BPF program attached to the SO_REUSEPORT group
+// sends each connection to the listener of the reactor on the receiving
+// CPU. Connections from other CPUs fall back to the kernel's hash.
+//
+// Every per-connection perf line is tagged with the CPU the handler ran on
+// and the connection's SO_INCOMING_CPU. Cache misses can then be split into
+// connections served where their packets landed and cross-core ones.
+
+#include "MT25020_Common.h"
+#include <sched.h>
+#include <linux/filter.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+#define PLACEMENT_MAX_CPUS 1024
+
+typedef struct {
+    int enabled;                    // --cpus or --steer given
+    int steer;
+    int cpus[PLACEMENT_MAX_CPUS];   // worker CPUs, in --cpus order
+    int num_cpus;
+    short node[PLACEMENT_MAX_CPUS]; // by CPU id; -1 unknown
+    short llc[PLACEMENT_MAX_CPUS];  // lowest CPU sharing the last-level cache
+    int next;                       // round-robin cursor (accept loop only)
+} Placement;
+
+// Parse "1,2,8-11" into out[]. Returns the count, or -1 on a bad list.
+static inline int parse_int_list(const char *arg, int *out, int max, int allow_ranges) {
+    int n = 0;
+    const char *p = arg;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0) return -1;
+        long hi = lo;
+        if (allow_ranges && *end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        for (long v = lo; v <= hi; v++) {
+            if (n == max) return -1;
+            out[n++] = (int)v;
+        }
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return n;
+}
+
+// First number in a sysfs file such as a cpulist, or -1.
+static inline int placement_read_first(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int v = -1;
+    if (fscanf(f, "%d", &v) != 1) v = -1;
+    fclose(f);
+    return v;
+}
+
+static inline void placement_read_topology(Placement *p) {
+    char path[128];
+    for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) p->node[cpu] = p->llc[cpu] = -1;
+    int ncpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < ncpus && cpu < PLACEMENT_MAX_CPUS; cpu++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list",
+                 cpu);
+        p->llc[cpu] = (short)placement_read_first(path);
+    }
+    for (int node = 0; node < PLACEMENT_MAX_CPUS; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            if (node > 0) break;    // nodes are numbered densely in practice
+            continue;
+        }
+        char list[4096];
+        int cpus[PLACEMENT_MAX_CPUS];
+        if (fgets(list, sizeof(list), f)) {
+            list[strcspn(list, "\n")] = '\0';
+            int n = parse_int_list(list, cpus, PLACEMENT_MAX_CPUS, 1);
+            for (int i = 0; i < n; i++)
+                if (cpus[i] < PLACEMENT_MAX_CPUS) p->node[cpus[i]] = (short)node;
+        }
+        fclose(f);
+    }
+}
+
+// Returns 0 on success, -1 if --cpus names a CPU this process cannot use.
+static inline int placement_init(Placement *p, const ServerOptions *opts) {
+    memset(p, 0, sizeof(*p));
+    p->steer = opts->steer;
+    p->enabled = opts->cpus || opts->steer;
+    if (!p->enabled) return 0;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    if (opts->cpus) {
+        p->num_cpus = parse_int_list(opts->cpus, p->cpus, PLACEMENT_MAX_CPUS, 1);
+        if (p->num_cpus <= 0) {
+            fprintf(stderr, "Bad CPU list: %s\n", opts->cpus);
+            return -1;
+        }
+        for (int i = 0; i < p->num_cpus; i++) {
+            if (p->cpus[i] >= CPU_SETSIZE || !CPU_ISSET(p->cpus[i], &allowed)) {
+                fprintf(stderr, "CPU %d is not available to this process\n", p->cpus[i]);
+                return -1;
+            }
+        }
+    } else {
+        for (int cpu = 0; cpu < CPU_SETSIZE && cpu < PLACEMENT_MAX_CPUS; cpu++)
+            if (CPU_ISSET(cpu, &allowed)) p->cpus[p->num_cpus++] = cpu;
+    }
+    placement_read_topology(p);
+    return 0;
+}
+
+static inline int placement_is_worker(const Placement *p, int cpu) {
+    for (int i = 0; i < p->num_cpus; i++)
+        if (p->cpus[i] == cpu) return 1;
+    return 0;
+}
+
+// Worker CPU for a freshly accepted socket. Called from the accept loop.
+static inline int placement_choose_cpu(Placement *p, int fd) {
+    int rx = -1;
+    socklen_t len = sizeof(rx);
+    if (p->steer && getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &rx, &len) == 0 &&
+        rx >= 0 && rx < PLACEMENT_MAX_CPUS) {
+        if (placement_is_worker(p, rx)) return rx;
+        // Nearest worker: same LLC, then same node; rotate among equals.
+        for (int level = 1; level <= 2; level++) {
+            for (int k = 0; k < p->num_cpus; k++) {
+                int cpu = p->cpus[(p->next + k) % p->num_cpus];
+                short mine = level == 1 ? p->llc[cpu] : p->node[cpu];
+                short theirs = level == 1 ? p->llc[rx] : p->node[rx];
+                if (mine >= 0 && mine == theirs) {
+                    p->next = (p->next + k + 1) % p->num_cpus;
+                    return cpu;
+                }
+            }
+        }
+    }
+    int cpu = p->cpus[p->next];
+    p->next = (p->next + 1) % p->num_cpus;
+    return cpu;
+}
+
+// pthread_create() that starts the thread already pinned to `cpu` (no
+// placement: default attributes). Returns pthread_create's result.
+static inline int placement_create_thread(const Placement *p, int cpu, pthread_t *thread,
+                                          void *(*fn)(void*), void *arg) {
+    if (!p->enabled || cpu < 0) return pthread_create(thread, NULL, fn, arg);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    int err = pthread_create(thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return err;
+}
+
+// Thread-per-connection servers: pick the CPU for `fd` and start its handler.
+static inline int placement_spawn(Placement *p, int fd, pthread_t *thread,
+                                  void *(*fn)(void*), void *arg) {
+    int cpu = p->enabled ? placement_choose_cpu(p, fd) : -1;
+    return placement_create_thread(p, cpu, thread, fn, arg);
+}
+
+static inline void placement_pin_self(int cpu) {
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) fprintf(stderr, "Pinning to CPU %d failed: %s\n", cpu, strerror(err));
+}
+
+// Reactor mode: listener i of the SO_REUSEPORT group belongs to the reactor
+// on cpus[i]. The program returns that index for connections whose packets
+// arrive on cpus[i]; any other value makes the kernel fall back to its hash.
+static inline int placement_attach_reuseport(const Placement *p, int listen_fd, int reactors) {
+    int n = reactors < p->num_cpus ? reactors : p->num_cpus;
+    struct sock_filter *code = (struct sock_filter*)calloc(2 * n + 2, sizeof(struct sock_filter));
+    if (!code) return -1;
+    int k = 0;
+    code[k++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int i = 0; i < n; i++) {
+        code[k++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, p->cpus[i], 0, 1);
+        code[k++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    code[k++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffffu);
+    struct sock_fprog prog = { .len = (unsigned short)k, .filter = code };
+    int rc = setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    free(code);
+    return rc;
+}
+
+// "[A1 perf conn 3] cpu=2 rx_cpu=2 syscalls=N": where the handler ran,
+// where the connection's packets were processed, and how many send-path
+// calls it made. Call before closing `fd`.
+static inline void placement_conn_label(char *buf, size_t len, const char *name, int id, int fd,
+                                        long long syscalls) {
+    int rx = -1;
+    socklen_t optlen = sizeof(rx);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &rx, &optlen) < 0) rx = -1;
+    snprintf(buf, len, "[%s perf conn %d] cpu=%d rx_cpu=%d syscalls=%lld", name, id,
+             sched_getcpu(), rx, syscalls);
+}
+
+static inline void placement_print(const Placement *p, const char *name) {
+    if (!p->enabled) return;
+    printf("%s placement:%s", name, p->steer ? " steering by SO_INCOMING_CPU," : "");
+    for (int i = 0; i < p->num_cpus; i++)
+        printf(" cpu%d(node %d)", p->cpus[i], p->node[p->cpus[i]]);
+    printf("\n");
+    fflush(stdout);
+}
+
+#endif
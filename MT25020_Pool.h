@@ -0,0 +1,418 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Bounded worker pool with a work-stealing connection scheduler (--pool).
+//
+// Thread-per-connection mode costs one thread per socket, and the reactors
+// never move a connection once the kernel's SO_REUSEPORT hash has placed it.
+// A fixed pool of workers avoids both. It uses the same non-blocking
+// SendStrategy as the reactors.
+//
+// Every worker owns a deque of runnable connections and an epoll instance
+// for the ones that are waiting. The worker takes a connection from the
+// head of its deque and writes at most --quantum bytes. If the socket can
+// still take more, the connection goes back to the tail, so one fast peer
+// cannot monopolise a worker. If it would block, it is armed EPOLLONESHOT
+// in the worker's epoll set. A connection is always in exactly one place:
+// a deque, a running worker, or armed in one epoll set.
+//
+// A worker whose deque is empty steals half of another worker's deque,
+// taking from the tail: those connections would otherwise wait longest.
+// Only when nothing can be stolen does it sleep in epoll_wait(), and then
+// only for POOL_IDLE_MS so it can retry. The acceptor spreads new sockets
+// round-robin by arming them in a worker's epoll set. A fresh socket is
+// writable, so the worker picks it up on its next poll.
+//
+// Admission is bounded. The acceptor stops accepting while --max-conns
+// connections are open (default POOL_DEFAULT_MAX_CONNS). Connection storms
+// therefore queue in the listen backlog, and the memory per connection
+// stays bounded. When the last connection of a run closes, the pool
+// prints per-worker throughput, quanta, yields and steals. It also prints
+// the Jain index across workers and the fairness across connections.
+
+#include "MT25020_Reactor.h"
+#include "MT25020_Series.h"
+
+#define POOL_DEFAULT_MAX_CONNS 4096
+#define POOL_MAX_EVENTS 64
+#define POOL_IDLE_MS 1              // idle worker: epoll_wait timeout between steal attempts
+#define POOL_POLL_EVERY 16          // busy worker: check its epoll set every N quanta
+#define POOL_STEAL_MAX 64           // connections moved by one steal
+
+typedef struct {
+    ReactorConn c;                  // what the strategy sees; first, so a
+                                    // lingering conn is freed as its PoolConn
+    int epoll_owner;                // worker whose epoll set holds the registration
+    long long opened_ns;
+} PoolConn;
+
+// Mutex-protected ring; the owner runs from the head and requeues at the
+// tail, thieves take from the tail.
+typedef struct {
+    pthread_mutex_t lock;
+    PoolConn **slots;
+    unsigned mask;
+    unsigned head, tail;
+} PoolDeque;
+
+struct Pool;
+
+typedef struct {
+    int id;
+    int epfd;
+    struct Pool *pool;
+    PoolDeque deque;
+    ConnLinger linger;              // closed connections this worker still holds
+    // This run; added with relaxed atomics, read by whichever worker reports.
+    long long bytes;
+    long long syscalls;
+    long long quanta;               // turns a connection got on this worker
+    long long yields;               // turns that ended on the quantum, still writable
+    long long steals;               // successful steal operations
+    long long stolen;               // connections taken by them
+    LiveSlot *live;                 // --live-stats: this worker
+} PoolWorker;
+
+typedef struct Pool {
+    const SendStrategy *strategy;
+    const ServerOptions *opts;
+    PoolWorker *workers;
+    int count;
+    int max_conns;
+    int active;                     // open connections
+    // Reset by the acceptor and read by whichever worker reports: __atomic only.
+    long long run_start_ns;
+    long long run_conns;
+    pthread_mutex_t report_lock;    // guards rates
+    double *rates;                  // Gbps of each connection closed this run
+    int num_rates;
+    int cap_rates;
+} Pool;
+
+static inline int pool_deque_init(PoolDeque *d, int capacity) {
+    unsigned size = 1;
+    while (size < (unsigned)capacity) size <<= 1;
+    d->slots = (PoolConn**)calloc(size, sizeof(PoolConn*));
+    d->mask = size - 1;
+    d->head = d->tail = 0;
+    pthread_mutex_init(&d->lock, NULL);
+    return d->slots ? 0 : -1;
+}
+
+// Capacity is max_conns, and a connection is in at most one deque, so a
+// push always fits.
+static inline void pool_deque_push(PoolDeque *d, PoolConn *pc) {
+    pthread_mutex_lock(&d->lock);
+    d->slots[d->tail++ & d->mask] = pc;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static inline PoolConn* pool_deque_pop(PoolDeque *d) {
+    PoolConn *pc = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->head != d->tail) pc = d->slots[d->head++ & d->mask];
+    pthread_mutex_unlock(&d->lock);
+    return pc;
+}
+
+// Take up to half (rounded up) of d, from the tail. Returns the count.
+static inline int pool_deque_steal(PoolDeque *d, PoolConn **out) {
+    pthread_mutex_lock(&d->lock);
+    unsigned len = d->tail - d->head;
+    unsigned n = (len + 1) / 2;
+    if (n > POOL_STEAL_MAX) n = POOL_STEAL_MAX;
+    for (unsigned i = 0; i < n; i++) out[i] = d->slots[--d->tail & d->mask];
+    pthread_mutex_unlock(&d->lock);
+    return (int)n;
+}
+
+// Empty deque: try the other workers in turn. The first connection taken
+// is returned to run now, the rest join w's deque.
+static inline PoolConn* pool_steal(PoolWorker *w) {
+    Pool *p = w->pool;
+    PoolConn *got[POOL_STEAL_MAX];
+    for (int k = 1; k < p->count; k++) {
+        PoolWorker *victim = &p->workers[(w->id + k) % p->count];
+        int n = pool_deque_steal(&victim->deque, got);
+        if (n == 0) continue;
+        for (int i = 1; i < n; i++) pool_deque_push(&w->deque, got[i]);
+        __atomic_fetch_add(&w->steals, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&w->stolen, n, __ATOMIC_RELAXED);
+        return got[0];
+    }
+    return NULL;
+}
+
+// Park pc in w's epoll set until `events` (plus EPOLLERR/EPOLLHUP) fire.
+// A stolen connection is still registered with its previous worker, where
+// EPOLLONESHOT has disarmed it; it moves to w.
+static inline int pool_arm(PoolWorker *w, PoolConn *pc, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = pc;
+    if (pc->epoll_owner == w->id) return epoll_ctl(w->epfd, EPOLL_CTL_MOD, pc->c.fd, &ev);
+    epoll_ctl(w->pool->workers[pc->epoll_owner].epfd, EPOLL_CTL_DEL, pc->c.fd, NULL);
+    pc->epoll_owner = w->id;
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, pc->c.fd, &ev);
+}
+
+static inline void pool_report(Pool *p) {
+    long long run_conns = __atomic_load_n(&p->run_conns, __ATOMIC_RELAXED);
+    double elapsed = (get_time_ns() - __atomic_load_n(&p->run_start_ns, __ATOMIC_RELAXED)) / 1e9;
+    const char *name = p->strategy->name;
+    double *gbps = (double*)calloc(p->count, sizeof(double));
+    long long total = 0;
+    for (int i = 0; i < p->count; i++) {
+        PoolWorker *w = &p->workers[i];
+        long long bytes = __atomic_exchange_n(&w->bytes, 0, __ATOMIC_RELAXED);
+        long long syscalls = __atomic_exchange_n(&w->syscalls, 0, __ATOMIC_RELAXED);
+        long long quanta = __atomic_exchange_n(&w->quanta, 0, __ATOMIC_RELAXED);
+        long long yields = __atomic_exchange_n(&w->yields, 0, __ATOMIC_RELAXED);
+        long long steals = __atomic_exchange_n(&w->steals, 0, __ATOMIC_RELAXED);
+        long long stolen = __atomic_exchange_n(&w->stolen, 0, __ATOMIC_RELAXED);
+        double rate = elapsed > 0 ? bytes * 8.0 / (elapsed * 1e9) : 0;
+        if (gbps) gbps[i] = rate;
+        total += bytes;
+        printf("[%s pool worker %d] bytes=%lld throughput=%.6f Gbps syscalls=%lld quanta=%lld "
+               "yields=%lld steals=%lld stolen_conns=%lld\n",
+               name, i, bytes, rate, syscalls, quanta, yields, steals, stolen);
+    }
+    double jain = 0;
+    if (gbps) {
+        double sum = 0, sum_sq = 0;
+        for (int i = 0; i < p->count; i++) {
+            sum += gbps[i];
+            sum_sq += gbps[i] * gbps[i];
+        }
+        jain = sum_sq > 0 ? sum * sum / (p->count * sum_sq) : 0;
+        free(gbps);
+    }
+    printf("[%s pool] workers=%d conns=%lld bytes=%lld elapsed=%.3f s throughput=%.6f Gbps "
+           "worker_jain=%.4f\n",
+           name, p->count, run_conns, total, elapsed,
+           elapsed > 0 ? total * 8.0 / (elapsed * 1e9) : 0, jain);
+    pthread_mutex_lock(&p->report_lock);
+    fairness_print(stdout, p->rates, p->num_rates);
+    p->num_rates = 0;
+    pthread_mutex_unlock(&p->report_lock);
+    fflush(stdout);
+}
+
+static inline void pool_close(PoolWorker *w, PoolConn *pc) {
+    Pool *p = w->pool;
+    ReactorConn *c = &pc->c;
+    // A lingering A3 socket moves to w's epoll set for EPOLLERR alone:
+    // edge-triggered, not one-shot, since EPOLLHUP would fire on every re-arm.
+    struct epoll_event ev = { .events = EPOLLET, .data.ptr = pc };
+    if (pc->epoll_owner == w->id) {
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    } else {
+        epoll_ctl(p->workers[pc->epoll_owner].epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        pc->epoll_owner = w->id;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+    live_conn_close(&c->live);
+
+    double secs = (get_time_ns() - pc->opened_ns) / 1e9;
+    pthread_mutex_lock(&p->report_lock);
+    if (p->num_rates == p->cap_rates) {
+        int cap = p->cap_rates ? 2 * p->cap_rates : 64;
+        double *grown = (double*)realloc(p->rates, cap * sizeof(double));
+        if (grown) {
+            p->rates = grown;
+            p->cap_rates = cap;
+        }
+    }
+    if (p->num_rates < p->cap_rates)
+        p->rates[p->num_rates++] = secs > 0 ? c->bytes_sent * 8.0 / (secs * 1e9) : 0;
+    pthread_mutex_unlock(&p->report_lock);
+    if (!conn_retire(p->strategy, c, &w->linger)) free(pc);
+
+    // A run ends when the last client disconnects; report and reset.
+    if (__atomic_sub_fetch(&p->active, 1, __ATOMIC_ACQ_REL) == 0) pool_report(p);
+    connection_closed();
+}
+
+// One turn: up to --quantum bytes, then requeue, park or close.
+static inline void pool_run(PoolWorker *w, PoolConn *pc) {
+    Pool *p = w->pool;
+    ReactorConn *c = &pc->c;
+    long long written = 0;
+    long long calls = c->syscalls;
+    live_conn_move(&c->live, w->live);
+    int state = conn_drive(p->strategy, c, p->opts->quantum, &written);
+    __atomic_fetch_add(&w->bytes, written, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->syscalls, c->syscalls - calls, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&w->quanta, 1, __ATOMIC_RELAXED);
+
+    int rc = 0;
+    switch (state) {
+    case CONN_WRITABLE:
+        // Parked connections get no EPOLLERR, so collect reports here.
+        if (c->stamps && tx_stamps_due(c->stamps)) conn_error_queue(p->strategy, c);
+        __atomic_fetch_add(&w->yields, 1, __ATOMIC_RELAXED);
+        pool_deque_push(&w->deque, pc);
+        return;
+    case CONN_WAIT_OUT:
+        rc = pool_arm(w, pc, EPOLLOUT);
+        break;
+    case CONN_WAIT_IN:
+        rc = pool_arm(w, pc, EPOLLIN);
+        break;
+    case CONN_WAIT_ERRQUEUE:
+        rc = pool_arm(w, pc, 0);
+        break;
+    default:
+        rc = -1;
+        break;
+    }
+    if (rc < 0) pool_close(w, pc);
+}
+
+static inline void* pool_worker(void *arg) {
+    PoolWorker *w = (PoolWorker*)arg;
+    Pool *p = w->pool;
+    struct epoll_event events[POOL_MAX_EVENTS];
+    unsigned turn = 0;
+
+    while (1) {
+        PoolConn *pc = pool_deque_pop(&w->deque);
+        if (!pc) pc = pool_steal(w);
+
+        // Busy workers look for newly ready connections every few quanta.
+        if (!pc || ++turn % POOL_POLL_EVERY == 0) {
+            int n = epoll_wait(w->epfd, events, POOL_MAX_EVENTS, pc ? 0 : POOL_IDLE_MS);
+            if (n < 0 && errno != EINTR) {
+                perror("epoll_wait failed");
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                PoolConn *ready = (PoolConn*)events[i].data.ptr;
+                if (events[i].events & EPOLLERR) conn_error_queue(p->strategy, &ready->c);
+                if (ready->c.lingering) continue;
+                if (events[i].events & EPOLLHUP) pool_close(w, ready);
+                else pool_deque_push(&w->deque, ready);
+            }
+            if (w->linger.head) conn_linger_sweep(p->strategy, &w->linger);
+        }
+        if (pc) pool_run(w, pc);
+    }
+    return NULL;
+}
+
+// Start opts->pool_threads workers, then accept forever on this thread.
+static inline int run_pool_server(const SendStrategy *strategy, const ServerOptions *opts) {
+    Pool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.strategy = strategy;
+    pool.opts = opts;
+    pool.count = opts->pool_threads;
+    pool.max_conns = opts->max_conns > 0 ? opts->max_conns : POOL_DEFAULT_MAX_CONNS;
+    pthread_mutex_init(&pool.report_lock, NULL);
+
+    Placement placement;
+    if (placement_init(&placement, opts) < 0) return -1;
+    if (placement.steer)
+        fprintf(stderr, "--pool moves connections between workers; --steer ignored\n");
+    pool.workers = (PoolWorker*)calloc(pool.count, sizeof(PoolWorker));
+    pthread_t *threads = (pthread_t*)calloc(pool.count, sizeof(pthread_t));
+    if (!pool.workers || !threads) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+    for (int i = 0; i < pool.count; i++) {
+        PoolWorker *w = &pool.workers[i];
+        w->id = i;
+        w->pool = &pool;
+        w->epfd = epoll_create1(0);
+        if (w->epfd < 0 || pool_deque_init(&w->deque, pool.max_conns) < 0) {
+            perror("Worker setup failed");
+            return -1;
+        }
+        w->live = live_slot_acquire(LIVE_THREAD, i, -1);
+    }
+
+    int listen_fd = reactor_open_listener(opts);
+    if (listen_fd < 0) {
+        perror("Listener setup failed");
+        return -1;
+    }
+    // Writes to a closed peer must surface as EPIPE, not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < pool.count; i++) {
+        int cpu = placement.enabled ? placement.cpus[i % placement.num_cpus] : -1;
+        if (placement_create_thread(&placement, cpu, &threads[i], pool_worker,
+                                    &pool.workers[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            return -1;
+        }
+    }
+    printf("%s Server listening on 0.0.0.0:%d (pool of %d workers, quantum %ld bytes, "
+           "max %d connections)\n",
+           strategy->name, opts->port, pool.count, opts->quantum, pool.max_conns);
+    fflush(stdout);
+    placement_print(&placement, strategy->name);
+
+    int next = 0;
+    while (1) {
+        connection_wait_slot(pool.max_conns);
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) < 0) continue;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("Accept failed");
+            continue;
+        }
+        if (ktls_server_setup(opts, fd) < 0) {
+            close(fd);
+            continue;
+        }
+
+        PoolConn *pc = (PoolConn*)calloc(1, sizeof(PoolConn));
+        if (!pc) {
+            close(fd);
+            continue;
+        }
+        ReactorConn *c = &pc->c;
+        c->fd = fd;
+        c->id = connection_next_id();
+        c->opts = opts;
+        c->message_size = stream_unit_size(opts);
+        c->field_size = opts->message_size / NUM_FIELDS;
+        c->awaiting_request = opts->rpc;
+        if (opts->rpc) rpc_socket_setup(fd);
+        if (opts->tx_timestamps) c->stamps = tx_stamps_create(fd);
+        if (strategy->conn_init(c) != 0) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            close(fd);
+            free(c->stamps);
+            free(pc);
+            continue;
+        }
+        pc->opened_ns = get_time_ns();
+
+        if (__atomic_fetch_add(&pool.active, 1, __ATOMIC_ACQ_REL) == 0) {
+            __atomic_store_n(&pool.run_start_ns, pc->opened_ns, __ATOMIC_RELAXED);
+            __atomic_store_n(&pool.run_conns, 0, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&pool.run_conns, 1, __ATOMIC_RELAXED);
+        connection_opened(strategy->name);
+
+        PoolWorker *w = &pool.workers[next];
+        next = (next + 1) % pool.count;
+        pc->epoll_owner = w->id;
+        live_conn_open(&c->live, c->id, w->live);
+        struct epoll_event ev;
+        ev.events = (opts->rpc ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+        ev.data.ptr = pc;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            pool_close(w, pc);
+        }
+    }
+    return 0;
+}
+
+#endif
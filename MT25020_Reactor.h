@@ -0,0 +1,644 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+// Multi-reactor server mode.
+//
+// Instead of one blocking thread per accepted socket, a fixed number of
+// reactor threads each own an epoll instance and an SO_REUSEPORT listener on
+// the same port. The kernel spreads incoming connections across listeners,
+// and each reactor drives its connections with non-blocking writes whenever
+// the socket becomes writable. The A1/A2/A3 send strategies plug in through
+// SendStrategy, so the three servers share the event loop and differ only in
+// how one write is issued.
+//
+// With --rpc the same strategies answer requests instead of streaming: each
+// connection reads an RpcRequest, sends a message of the requested size, and
+// goes back to reading. rpc_handle_client() does the same for the
+// thread-per-connection servers.
+
+#include "MT25020_Common.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Placement.h"
+#include "MT25020_Frame.h"
+#include "MT25020_Timestamp.h"
+#include "MT25020_Live.h"
+#include "MT25020_Tls.h"
+#include "MT25020_Accept.h"
+#include <signal.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+
+#define REACTOR_MAX_EVENTS 256
+// Upper bound on bytes written to one connection per wake-up, so a single
+// fast peer cannot starve the other sockets owned by the same reactor.
+#define REACTOR_WRITE_BUDGET (1 << 20)
+// A closed connection whose buffers the kernel may still read (A3's
+// zero-copy sends) keeps them until its completions arrive, or this long.
+#define CONN_LINGER_MS 1000
+#define CONN_LINGER_TICK_MS 10      // epoll_wait timeout while any connection lingers
+
+typedef struct ReactorConn {
+    int fd;
+    int id;                     // connection number in report lines
+    int message_size;           // bytes per write unit: --batch messages when streaming
+    int field_size;
+    size_t offset;              // bytes of the current unit already written
+    int unit_started;           // per-unit work (marshalling, headers) done for it
+    const ServerOptions *opts;
+    Message *msg;
+    char *linear_buffer;        // A1 only: marshalled copy of msg
+    void *priv;                 // strategy-specific state (A3: ZcTracker)
+    FrameWriter frame;          // --frame headers
+    TxStamps *stamps;           // --tx-timestamps, or NULL
+    LiveConn live;              // --live-stats slots
+    long long bytes_sent;
+    long long messages_sent;
+    long long syscalls;         // send-path system calls issued
+    int ready;                  // on the reactor's ready list (budget exhausted)
+    struct ReactorConn *next_ready;
+    int awaiting_request;       // --rpc: reading the next RpcRequest
+    size_t req_have;            // bytes of `req` received so far
+    RpcRequest req;
+    int lingering;              // closed; buffers freed once the kernel is done
+    long long linger_until_ns;
+    struct ReactorConn *next_linger;
+} ReactorConn;
+
+typedef struct SendStrategy {
+    const char *name;
+    // Allocate per-connection buffers. Returns 0 on success.
+    int (*conn_init)(ReactorConn *c);
+    // Issue one non-blocking write of the current message starting at
+    // c->offset. Returns bytes written, or -1 with errno set.
+    ssize_t (*send_step)(ReactorConn *c);
+    // Called on EPOLLERR before the connection is checked for real errors
+    // (A3 drains zero-copy completions, and any timestamp reports, here).
+    // May be NULL.
+    void (*on_error_queue)(ReactorConn *c);
+    // Nonzero while the kernel may still read the connection's buffers
+    // (A3: zero-copy sends not completed yet); conn_free() must wait until
+    // it returns 0. May be NULL.
+    int (*conn_busy)(const ReactorConn *c);
+    void (*conn_free)(ReactorConn *c);
+} SendStrategy;
+
+// Closed connections still waiting for conn_busy() to clear; one list per
+// reactor or pool worker.
+typedef struct {
+    ReactorConn *head;
+} ConnLinger;
+
+typedef struct {
+    int id;
+    int epfd;
+    int listen_fd;
+    const SendStrategy *strategy;
+    const ServerOptions *opts;
+    ReactorConn *ready_head;
+    ConnLinger linger;
+    int active_conns;
+    int run_conns;              // connections seen during the current run
+    long long run_bytes;
+    long long run_syscalls;
+    long long run_start_us;
+    PerfCounters perf;          // --perf: this reactor thread, per run
+    LiveSlot *live;             // --live-stats: this reactor thread
+} Reactor;
+
+// Fill iov with the part of a `total`-byte run of back-to-back copies of
+// msg (one message, or a --batch of them) that starts at byte `offset`.
+// With `hdrs` (--frame) message i is preceded by hdrs[i]. Returns the number
+// of iovecs used, at most NUM_FIELDS * MAX_BATCH.
+static inline int message_iov_from_offset(const Message *msg, int field_size,
+                                          const FrameHeader *hdrs, size_t total,
+                                          size_t offset, struct iovec *iov) {
+    char *fields[NUM_FIELDS] = {
+        msg->field1, msg->field2, msg->field3, msg->field4,
+        msg->field5, msg->field6, msg->field7, msg->field8
+    };
+    if (hdrs) {
+        size_t record = sizeof(FrameHeader) + (size_t)field_size * NUM_FIELDS;
+        int cnt = 0;
+        for (size_t pos = offset; pos < total; cnt++) {
+            size_t in = pos % record;
+            if (in < sizeof(FrameHeader)) {
+                iov[cnt].iov_base = (char*)&hdrs[pos / record] + in;
+                iov[cnt].iov_len = sizeof(FrameHeader) - in;
+            } else {
+                in -= sizeof(FrameHeader);
+                iov[cnt].iov_base = fields[in / field_size] + in % field_size;
+                iov[cnt].iov_len = field_size - in % field_size;
+            }
+            pos += iov[cnt].iov_len;
+        }
+        return cnt;
+    }
+    int first = offset / field_size;
+    size_t skip = offset % field_size;
+    int cnt = 0;
+    int count = total / field_size;
+    for (int i = first; i < count; i++) {
+        iov[cnt].iov_base = fields[i % NUM_FIELDS] + skip;
+        iov[cnt].iov_len = field_size - skip;
+        skip = 0;
+        cnt++;
+    }
+    return cnt;
+}
+
+// EPOLLERR/POLLERR: the strategy's error queue handler, or, without one,
+// the --tx-timestamps reports that would otherwise fill the queue.
+static inline void conn_error_queue(const SendStrategy *strategy, ReactorConn *c) {
+    if (strategy->on_error_queue) strategy->on_error_queue(c);
+    else if (c->stamps) tx_stamps_process_errqueue(c->fd, c->stamps);
+}
+
+// One send_step(), noted for --tx-timestamps when it moved data and
+// published for --live-stats.
+static inline ssize_t conn_send_step(const SendStrategy *strategy, ReactorConn *c) {
+    long long app_ns = c->stamps ? ts_realtime_ns() : 0;
+    size_t want = c->message_size - c->offset;
+    ssize_t n = strategy->send_step(c);
+    c->syscalls++;
+    live_note_send(&c->live, want, n);
+    if (n > 0 && c->stamps) tx_stamps_note_send(c->stamps, app_ns, n);
+    return n;
+}
+
+// After conn_free(): collect the reports still queued, print, release.
+static inline void conn_stamps_finish(const SendStrategy *strategy, ReactorConn *c, int conn_id) {
+    if (!c->stamps) return;
+    if (!strategy->on_error_queue) tx_stamps_process_errqueue(c->fd, c->stamps);
+    tx_stamps_report(strategy->name, conn_id, c->stamps);
+    free(c->stamps);
+    c->stamps = NULL;
+}
+
+// Free the strategy's buffers, report, and close the socket. The caller
+// frees c.
+static inline void conn_release(const SendStrategy *strategy, ReactorConn *c) {
+    strategy->conn_free(c);
+    conn_stamps_finish(strategy, c, c->id);
+    close(c->fd);
+}
+
+// Blocking callers: wait until the kernel has let go of the connection's
+// buffers, at most CONN_LINGER_MS, collecting completions as they arrive.
+// Like zc_drain_all(), give up early once the peer is gone and nothing more
+// is queued.
+static inline void conn_quiesce(const SendStrategy *strategy, ReactorConn *c) {
+    long long deadline = get_time_ns() + CONN_LINGER_MS * 1000000LL;
+    while (strategy->conn_busy && strategy->conn_busy(c)) {
+        int left = (int)((deadline - get_time_ns()) / 1000000);
+        if (left <= 0) break;
+        struct pollfd pfd = { c->fd, 0, 0 };   // POLLERR is always reported
+        int n = poll(&pfd, 1, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || !(pfd.revents & POLLERR)) break;
+        conn_error_queue(strategy, c);
+    }
+}
+
+// Event loops: a closed connection the kernel still reads from keeps its
+// socket, so its error queue keeps delivering completions (the caller
+// leaves it registered for EPOLLERR), and waits on `l`. Returns 1 if it
+// lingers, 0 if it was released (the caller frees c).
+static inline int conn_retire(const SendStrategy *strategy, ReactorConn *c, ConnLinger *l) {
+    if (!strategy->conn_busy || !strategy->conn_busy(c)) {
+        conn_release(strategy, c);
+        return 0;
+    }
+    c->lingering = 1;
+    c->linger_until_ns = get_time_ns() + CONN_LINGER_MS * 1000000LL;
+    c->next_linger = l->head;
+    l->head = c;
+    return 1;
+}
+
+// Release, and free, the lingering connections that are idle or out of
+// time. Their completions are collected on EPOLLERR, as for open ones.
+static inline void conn_linger_sweep(const SendStrategy *strategy, ConnLinger *l) {
+    long long now = get_time_ns();
+    ReactorConn **pp = &l->head;
+    while (*pp) {
+        ReactorConn *c = *pp;
+        if (strategy->conn_busy(c) && now < c->linger_until_ns) {
+            pp = &c->next_linger;
+            continue;
+        }
+        *pp = c->next_linger;
+        conn_release(strategy, c);
+        free(c);
+    }
+}
+
+static inline int reactor_open_listener(const ServerOptions *opts) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts->port);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, MAX_CLIENTS) < 0 || listener_tune(fd, opts) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static inline void reactor_report(Reactor *r) {
+    double elapsed = (get_time_in_microseconds() - r->run_start_us) / 1000000.0;
+    double gbps = elapsed > 0 ? (r->run_bytes * 8.0) / (elapsed * 1e9) : 0;
+    printf("[%s reactor %d] conns=%d bytes=%lld elapsed=%.3f s throughput=%.6f Gbps\n",
+           r->strategy->name, r->id, r->run_conns, r->run_bytes, elapsed, gbps);
+    fflush(stdout);
+
+    if (r->perf.enabled) {
+        char label[128];
+        snprintf(label, sizeof(label), "[%s perf reactor %d] cpu=%d syscalls=%lld",
+                 r->strategy->name, r->id, sched_getcpu(), r->run_syscalls);
+        perf_counters_delta(&r->perf);
+        perf_counters_print(stdout, label, &r->perf, r->run_bytes);
+    }
+}
+
+static inline void reactor_close_conn(Reactor *r, ReactorConn *c) {
+    // Only EPOLLERR (and EPOLLHUP) from now on, for a lingering A3 socket.
+    struct epoll_event ev = { .events = EPOLLET, .data.ptr = c };
+    epoll_ctl(r->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    live_conn_close(&c->live);
+    if (!conn_retire(r->strategy, c, &r->linger)) free(c);
+    connection_closed();
+
+    // A run ends when the last client disconnects; report and reset.
+    if (--r->active_conns == 0) {
+        reactor_report(r);
+        r->run_conns = 0;
+        r->run_bytes = 0;
+        r->run_syscalls = 0;
+    }
+}
+
+// Replies end in a short segment that Nagle would hold until the client's
+// delayed ACK (~40 ms on Linux), which matters once every reply is waited on.
+static inline void rpc_socket_setup(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static inline void reactor_accept(Reactor *r) {
+    while (1) {
+        int fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("Accept failed");
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        // Reactors cannot hold back accept(), so --max-conns rejects.
+        if (connection_limit_reached(r->opts->max_conns)) {
+            close(fd);
+            connection_rejected(r->strategy->name);
+            continue;
+        }
+        if (ktls_server_setup(r->opts, fd) < 0) {
+            close(fd);
+            continue;
+        }
+
+        ReactorConn *c = (ReactorConn*)calloc(1, sizeof(ReactorConn));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->id = connection_next_id();
+        c->opts = r->opts;
+        c->message_size = stream_unit_size(r->opts);
+        c->field_size = r->opts->message_size / NUM_FIELDS;
+        c->awaiting_request = r->opts->rpc;
+        if (r->opts->rpc) rpc_socket_setup(fd);
+        // Before conn_init, so A3 can hand its error queue reports on.
+        if (r->opts->tx_timestamps) c->stamps = tx_stamps_create(fd);
+        if (r->strategy->conn_init(c) != 0) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            close(fd);
+            free(c->stamps);
+            free(c);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLOUT | EPOLLET | (r->opts->rpc ? EPOLLIN : 0);
+        ev.data.ptr = c;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            close(fd);
+            r->strategy->conn_free(c);
+            free(c->stamps);
+            free(c);
+            continue;
+        }
+
+        if (r->active_conns++ == 0) {
+            r->run_start_us = get_time_in_microseconds();
+            perf_counters_snapshot(&r->perf);
+        }
+        r->run_conns++;
+        live_conn_open(&c->live, c->id, r->live);
+        connection_opened(r->strategy->name);
+    }
+}
+
+// Answer the request just read: the next message is the first req.size
+// bytes, i.e. a prefix of every field. Returns -1 on a malformed request.
+static inline int rpc_start_response(ReactorConn *c) {
+    if (!rpc_request_valid(&c->req, c->opts->message_size)) return -1;
+    c->message_size = c->req.size;
+    c->field_size = c->req.size / NUM_FIELDS;
+    c->offset = 0;
+    c->unit_started = 0;
+    c->req_have = 0;
+    c->awaiting_request = 0;
+    return 0;
+}
+
+// Non-blocking read of the rest of an RpcRequest. Returns 1 once a request
+// is ready to answer, 0 if more bytes are needed, -1 on EOF or error.
+static inline int rpc_read_request(ReactorConn *c) {
+    while (c->req_have < sizeof(RpcRequest)) {
+        ssize_t n = recv(c->fd, (char*)&c->req + c->req_have,
+                         sizeof(RpcRequest) - c->req_have, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (n == 0) return -1;
+        c->req_have += n;
+    }
+    return rpc_start_response(c) < 0 ? -1 : 1;
+}
+
+// What a connection waits for after conn_drive().
+enum {
+    CONN_WRITABLE,              // budget used up, the socket can take more
+    CONN_WAIT_OUT,              // send buffer full
+    CONN_WAIT_IN,               // --rpc: the rest of the next request
+    CONN_WAIT_ERRQUEUE,         // A3: zero-copy completions (ENOBUFS)
+    CONN_CLOSE,                 // peer gone or error
+};
+
+// Write until the socket would block, `budget` bytes are out, or the peer
+// goes away. Adds the bytes written to *written; returns a CONN_* state.
+static inline int conn_drive(const SendStrategy *strategy, ReactorConn *c, long long budget,
+                             long long *written) {
+    while (budget > 0) {
+        if (c->awaiting_request) {
+            int got = rpc_read_request(c);
+            if (got == 0) return CONN_WAIT_IN;
+            if (got < 0) return CONN_CLOSE;
+        }
+        ssize_t n = conn_send_step(strategy, c);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return CONN_WAIT_OUT;
+            // Zero-copy optmem limit hit; retry once completions arrive.
+            if (errno == ENOBUFS) return CONN_WAIT_ERRQUEUE;
+            return CONN_CLOSE;
+        }
+        if (n == 0) return CONN_CLOSE;
+
+        c->offset += n;
+        c->bytes_sent += n;
+        *written += n;
+        budget -= n;
+        if (c->offset == (size_t)c->message_size) {
+            c->offset = 0;
+            c->unit_started = 0;
+            c->messages_sent += c->opts->batch;
+            c->awaiting_request = c->opts->rpc;
+        }
+    }
+    return CONN_WRITABLE;
+}
+
+// Edge-triggered: a connection that blocked is resumed by its next event.
+// Returns 0 if the connection is still usable, -1 if it must be closed.
+static inline int reactor_drive_conn(Reactor *r, ReactorConn *c) {
+    long long calls = c->syscalls;
+    int state = conn_drive(r->strategy, c, REACTOR_WRITE_BUDGET, &r->run_bytes);
+    r->run_syscalls += c->syscalls - calls;
+    if (state == CONN_CLOSE) return -1;
+
+    // Still writable: revisit after other sockets have had their turn.
+    if (state == CONN_WRITABLE && !c->ready) {
+        c->ready = 1;
+        c->next_ready = r->ready_head;
+        r->ready_head = c;
+    }
+    return 0;
+}
+
+static inline void* reactor_thread(void *arg) {
+    Reactor *r = (Reactor*)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    perf_counters_open(&r->perf, r->opts->perf_counters);
+
+    while (1) {
+        int timeout = r->ready_head ? 0 : r->linger.head ? CONN_LINGER_TICK_MS : -1;
+        int n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            ReactorConn *c = (ReactorConn*)events[i].data.ptr;
+            if (!c) {
+                reactor_accept(r);
+                continue;
+            }
+            if (events[i].events & EPOLLERR) conn_error_queue(r->strategy, c);
+            if (c->lingering) continue;
+            if (c->ready) continue;   // driven (or closed) from the ready list below
+
+            if (events[i].events & EPOLLHUP) {
+                reactor_close_conn(r, c);
+                continue;
+            }
+            if (reactor_drive_conn(r, c) < 0) reactor_close_conn(r, c);
+        }
+
+        // Round-robin over connections that exhausted their write budget.
+        ReactorConn *list = r->ready_head;
+        r->ready_head = NULL;
+        while (list) {
+            ReactorConn *c = list;
+            list = c->next_ready;
+            c->ready = 0;
+            if (reactor_drive_conn(r, c) < 0) reactor_close_conn(r, c);
+        }
+        if (r->linger.head) conn_linger_sweep(r->strategy, &r->linger);
+    }
+    perf_counters_close(&r->perf);
+    return NULL;
+}
+
+// Finish the current message from a blocking thread with the strategy's
+// non-blocking send_step: when it would block, poll() waits for writability
+// (or, for A3's ENOBUFS backpressure, only for zero-copy completions on the
+// error queue). Returns 0 once the message is out, -1 if the peer is gone.
+static inline int strategy_send_message(const SendStrategy *strategy, ReactorConn *c) {
+    while (c->offset < (size_t)c->message_size) {
+        ssize_t n = conn_send_step(strategy, c);
+        if (n > 0) {
+            c->offset += n;
+            c->bytes_sent += n;
+            continue;
+        }
+        if (n == 0) return -1;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) return -1;
+
+        struct pollfd pfd = { c->fd, errno == ENOBUFS ? 0 : POLLOUT, 0 };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return -1;
+        if (pfd.revents & POLLERR) conn_error_queue(strategy, c);
+        if (pfd.revents & POLLHUP) return -1;
+    }
+    c->unit_started = 0;
+    // No EPOLLERR here: collect --tx-timestamps reports every few messages
+    // before they fill the error queue.
+    if (c->stamps && tx_stamps_due(c->stamps)) conn_error_queue(strategy, c);
+    return 0;
+}
+
+// Thread-per-connection request/response loop shared by the --rpc servers.
+static inline void* rpc_handle_client(void *arg) {
+    ServerThreadArgs *args = (ServerThreadArgs*)arg;
+    const SendStrategy *strategy = args->strategy;
+
+    ReactorConn c;
+    memset(&c, 0, sizeof(c));
+    c.fd = args->client_socket;
+    c.id = args->thread_id;
+    c.opts = args->opts;
+    c.message_size = args->message_size;
+    c.field_size = c.message_size / NUM_FIELDS;
+    rpc_socket_setup(c.fd);
+    if (c.opts->tx_timestamps) c.stamps = tx_stamps_create(c.fd);
+    if (strategy->conn_init(&c) != 0) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        free(c.stamps);
+        close(c.fd);
+        connection_closed();
+        free(args);
+        return NULL;
+    }
+
+    PerfCounters pc;
+    perf_counters_open(&pc, c.opts->perf_counters);
+    char label[128];
+    live_conn_open(&c.live, args->thread_id, NULL);
+
+    while (1) {
+        c.req_have = 0;
+        while (c.req_have < sizeof(RpcRequest)) {
+            ssize_t n = recv(c.fd, (char*)&c.req + c.req_have,
+                             sizeof(RpcRequest) - c.req_have, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto done;
+            c.req_have += n;
+        }
+        if (rpc_start_response(&c) < 0) goto done;
+        if (strategy_send_message(strategy, &c) < 0) goto done;
+        c.messages_sent++;
+    }
+
+done:
+    placement_conn_label(label, sizeof(label), strategy->name, args->thread_id, c.fd, c.syscalls);
+    perf_counters_finish(&pc, label, c.bytes_sent);
+    live_conn_close(&c.live);
+    conn_quiesce(strategy, &c);
+    conn_release(strategy, &c);
+    connection_closed();
+    free(args);
+    return NULL;
+}
+
+// Start opts->reactor_threads reactors and serve forever.
+static inline int run_reactor_server(const SendStrategy *strategy, const ServerOptions *opts) {
+    int count = opts->reactor_threads;
+    Placement placement;
+    if (placement_init(&placement, opts) < 0) return -1;
+    Reactor *reactors = (Reactor*)calloc(count, sizeof(Reactor));
+    pthread_t *threads = (pthread_t*)calloc(count, sizeof(pthread_t));
+    if (!reactors || !threads) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+
+    // Writes to a closed peer must surface as EPIPE, not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < count; i++) {
+        Reactor *r = &reactors[i];
+        r->id = i;
+        r->strategy = strategy;
+        r->opts = opts;
+        r->listen_fd = reactor_open_listener(opts);
+        if (r->listen_fd < 0) {
+            perror("Listener setup failed");
+            return -1;
+        }
+        r->epfd = epoll_create1(0);
+        if (r->epfd < 0) {
+            perror("epoll_create1 failed");
+            return -1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listen_fd, &ev);
+        r->live = live_slot_acquire(LIVE_THREAD, i, -1);
+    }
+    // Listener i joined the SO_REUSEPORT group i-th, so the program can
+    // address it by index; the group is shared, so any member can attach.
+    if (placement.steer && placement_attach_reuseport(&placement, reactors[0].listen_fd, count) < 0)
+        perror("SO_ATTACH_REUSEPORT_CBPF failed; using the kernel's hash");
+
+    printf("%s Server listening on 0.0.0.0:%d (%d reactors)\n",
+           strategy->name, opts->port, count);
+    fflush(stdout);
+    placement_print(&placement, strategy->name);
+
+    for (int i = 0; i < count; i++) {
+        int cpu = placement.enabled ? placement.cpus[i % placement.num_cpus] : -1;
+        if (placement_create_thread(&placement, cpu, &threads[i], reactor_thread, &reactors[i]) != 0) {
+            fprintf(stderr, "Failed to start reactor %d\n", i);
+            return -1;
+        }
+    }
+    for (int i = 0; i < count; i++) pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(reactors);
+    return 0;
+}
+
+#endif
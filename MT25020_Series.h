@@ -0,0 +1,157 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+// Per-connection throughput time series and fairness statistics.
+//
+// With --interval the client counts the bytes every connection receives in
+// fixed intervals measured from one common epoch, the moment the first
+// connection starts its run (after its connect), so slow start, stalls and
+// completion backlogs show up as dips instead of vanishing into the run
+// total. All slots are allocated up front (one row per connection); each
+// receive thread only writes its own connections' rows, so recording is a
+// division and an add, with no locks. Bytes past the last slot are counted
+// in it, so a run that overshoots its duration slightly is not lost.
+
+#include "MT25020_Common.h"
+#include "MT25020_Stats.h"
+#include <math.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t *bytes;            // conns x slots, row per connection; NULL: off
+    int conns;
+    int slots;
+    long long interval_ns;
+    long long epoch_ns;         // 0 until series_start
+} ThroughputSeries;
+
+// Returns 0 on success; leaves the series disabled on interval_ms == 0.
+static inline int series_init(ThroughputSeries *s, int conns, int duration_s, int interval_ms) {
+    memset(s, 0, sizeof(*s));
+    if (interval_ms <= 0) return 0;
+    s->conns = conns;
+    s->interval_ns = interval_ms * 1000000LL;
+    // One extra slot for connect skew between the threads.
+    s->slots = (int)(((long long)duration_s * 1000 + interval_ms - 1) / interval_ms) + 1;
+    s->bytes = (uint64_t*)calloc((size_t)conns * s->slots, sizeof(uint64_t));
+    return s->bytes ? 0 : -1;
+}
+
+// A connection's run starts at `now`; the first call sets the epoch.
+static inline void series_start(ThroughputSeries *s, long long now) {
+    long long unset = 0;
+    if (!s || !s->bytes) return;
+    __atomic_compare_exchange_n(&s->epoch_ns, &unset, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline void series_free(ThroughputSeries *s) {
+    free(s->bytes);
+    s->bytes = NULL;
+}
+
+static inline void series_record(ThroughputSeries *s, int conn, long long now, long long bytes) {
+    if (!s || !s->bytes) return;
+    long long slot = (now - __atomic_load_n(&s->epoch_ns, __ATOMIC_RELAXED)) / s->interval_ns;
+    if (slot < 0) slot = 0;
+    if (slot >= s->slots) slot = s->slots - 1;
+    s->bytes[(size_t)conn * s->slots + slot] += bytes;
+}
+
+static inline double series_gbps(const ThroughputSeries *s, uint64_t bytes) {
+    return bytes * 8.0 / s->interval_ns;
+}
+
+static inline uint64_t series_total(const ThroughputSeries *s, int slot) {
+    uint64_t total = 0;
+    for (int c = 0; c < s->conns; c++) total += s->bytes[(size_t)c * s->slots + slot];
+    return total;
+}
+
+// Long format, one row per interval for the aggregate ("all") and one per
+// connection: TimeMs,Conn,Bytes,Gbps.
+static inline int series_write_csv(const char *path, const ThroughputSeries *s) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "TimeMs,Conn,Bytes,Gbps\n");
+    for (int t = 0; t < s->slots; t++) {
+        long long ms = t * s->interval_ns / 1000000;
+        uint64_t total = series_total(s, t);
+        fprintf(f, "%lld,all,%llu,%.6f\n", ms, (unsigned long long)total, series_gbps(s, total));
+        for (int c = 0; c < s->conns; c++) {
+            uint64_t b = s->bytes[(size_t)c * s->slots + t];
+            fprintf(f, "%lld,%d,%llu,%.6f\n", ms, c, (unsigned long long)b, series_gbps(s, b));
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// Aggregate min/median/max over the intervals between the first and last
+// non-empty one, when the aggregate first reached 90% of its median (the
+// end of the ramp), and how many connection-intervals in that range got no
+// data at all (stalls or starvation).
+static inline void series_print_summary(FILE *out, const ThroughputSeries *s) {
+    int first = -1, last = -1;
+    for (int t = 0; t < s->slots; t++) {
+        if (series_total(s, t) == 0) continue;
+        if (first < 0) first = t;
+        last = t;
+    }
+    if (first < 0) {
+        fprintf(out, "Time series: no data received\n");
+        return;
+    }
+    // The first and last intervals are partial; leave them out when there
+    // is anything else to look at.
+    int lo = first, hi = last;
+    if (hi - lo >= 2) {
+        lo++;
+        hi--;
+    }
+
+    int n = hi - lo + 1;
+    double *gbps = (double*)malloc(2 * n * sizeof(double));
+    if (!gbps) return;
+    double *sorted = gbps + n;
+    for (int t = lo; t <= hi; t++) gbps[t - lo] = series_gbps(s, series_total(s, t));
+    double median = stats_median(gbps, n, sorted);
+    fprintf(out, "Time series: %lld ms x %d intervals, min=%.3f p50=%.3f max=%.3f Gbps",
+            s->interval_ns / 1000000, n, sorted[0], median, sorted[n - 1]);
+
+    int ramp = first;
+    for (int t = first; t <= last; t++) {
+        if (series_gbps(s, series_total(s, t)) >= 0.9 * median) {
+            ramp = t;
+            break;
+        }
+    }
+    long long idle = 0;
+    for (int c = 0; c < s->conns; c++)
+        for (int t = lo; t <= hi; t++)
+            if (s->bytes[(size_t)c * s->slots + t] == 0) idle++;
+    fprintf(out, ", 90%% of p50 by %lld ms, idle conn-intervals=%lld/%lld\n",
+            (ramp + 1) * s->interval_ns / 1000000, idle, (long long)n * s->conns);
+    free(gbps);
+}
+
+// Spread of per-connection throughput: min/max, coefficient of variation
+// and Jain's fairness index (1 = perfectly fair, 1/n = one connection got
+// everything).
+static inline void fairness_print(FILE *out, const double *gbps, int n) {
+    if (n <= 0) return;
+    double min = gbps[0], max = gbps[0], sum = 0, sum_sq = 0;
+    for (int i = 0; i < n; i++) {
+        if (gbps[i] < min) min = gbps[i];
+        if (gbps[i] > max) max = gbps[i];
+        sum += gbps[i];
+        sum_sq += gbps[i] * gbps[i];
+    }
+    double mean = sum / n;
+    double var = sum_sq / n - mean * mean;
+    double cv = mean > 0 && var > 0 ? sqrt(var) / mean : 0;
+    double jain = sum_sq > 0 ? sum * sum / (n * sum_sq) : 0;
+    fprintf(out, "Fairness: conns=%d min=%.3f max=%.3f mean=%.3f Gbps cv=%.3f jain=%.4f\n",
+            n, min, max, mean, cv, jain);
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+// Shared-memory transport: a lock-free single-producer/single-consumer ring.
+//
+// The ring lives in a memfd_create() mapping. The memfd and the two
+// eventfds are ordinary descriptors, so a co-located peer process can map
+// the same ring after receiving them over an AF_UNIX socket (SCM_RIGHTS).
+// The mapping holds four cache lines of shared state followed by
+// fixed-size slots. Each slot holds one message: a FrameHeader, then the
+// payload.
+//
+//   producer line   head: slots published
+//   consumer line   tail: slots consumed
+//   sleep line      the two sleep flags, written only around a sleep
+//   control line    closed, geometry
+//
+// Each index has exactly one writer and is published with a release store.
+// Each side keeps a private copy of the other side's index. It reloads
+// that copy only when the copy says the ring is full or empty, so in steady
+// state the two index lines do not bounce on every message. Every publish
+// does read the peer's sleep flag, but that line stays cached on both
+// sides until someone actually goes to sleep.
+//
+// A side that finds the ring full or empty spins for a while, then sleeps
+// on an eventfd. The spin budget adapts. It doubles when spinning found
+// work and halves when the side had to sleep, so a peer on another core
+// is caught by spinning, and a peer sharing the core is not starved by it.
+// Before sleeping a side sets its flag and checks the index once more.
+// The other side publishes its index and then checks the flag (a full fence
+// between, on both sides). So a write() to the eventfd is only issued when
+// the peer is really idle, and no wake-up is lost.
+
+#include "MT25020_Common.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#define SHM_RING_BYTES (4 << 20)    // slot memory per ring, like a large socket buffer
+#define SHM_RING_MIN_SLOTS 4
+#define SHM_SPIN_MIN 16             // polls before sleeping, adapted between these
+#define SHM_SPIN_MAX 16384
+
+typedef struct {
+    struct {
+        uint64_t head;              // slots published
+    } __attribute__((aligned(64))) prod;
+    struct {
+        uint64_t tail;              // slots consumed
+    } __attribute__((aligned(64))) cons;
+    struct {
+        uint32_t producer;          // producer asleep on space_efd
+        uint32_t consumer;          // consumer asleep on data_efd
+    } __attribute__((aligned(64))) waiting;
+    struct {
+        uint32_t closed;            // either side has gone
+        uint32_t num_slots;
+        uint64_t slot_size;
+    } __attribute__((aligned(64))) ctl;
+} ShmRingShared;
+
+typedef struct {
+    ShmRingShared *sh;
+    char *slots;
+    size_t slot_size;
+    unsigned num_slots;             // power of two
+    int memfd;
+    int data_efd;                   // producer -> sleeping consumer
+    int space_efd;                  // consumer -> sleeping producer
+    size_t map_len;
+} ShmRing;
+
+// One side's private state.
+typedef struct {
+    ShmRing *ring;
+    int producer;
+    uint64_t pos;                   // next slot to fill, or to read
+    uint64_t published;             // producer: head as last stored
+    uint64_t limit;                 // cached: producer tail + num_slots, consumer head
+    unsigned spin;                  // current spin budget
+    long long spin_hits;            // waits that ended while spinning
+    long long sleeps;               // waits that blocked on the eventfd
+    long long wakeups;              // eventfd writes to wake the peer
+} ShmRingEnd;
+
+// Ring for messages of `message_size` bytes. Returns 0 or -1 (errno set).
+static inline int shm_ring_create(ShmRing *r, int message_size) {
+    memset(r, 0, sizeof(*r));
+    r->slot_size = (sizeof(FrameHeader) + (size_t)message_size + 63) & ~(size_t)63;
+    unsigned n = SHM_RING_MIN_SLOTS;
+    while ((size_t)n * 2 * r->slot_size <= SHM_RING_BYTES) n *= 2;
+    r->num_slots = n;
+    r->map_len = sizeof(ShmRingShared) + (size_t)n * r->slot_size;
+
+    r->memfd = memfd_create("mt25020_ring", 0);
+    if (r->memfd < 0) return -1;
+    r->data_efd = eventfd(0, 0);
+    r->space_efd = eventfd(0, 0);
+    void *base = MAP_FAILED;
+    if (r->data_efd >= 0 && r->space_efd >= 0 && ftruncate(r->memfd, r->map_len) == 0)
+        base = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->memfd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        close(r->memfd);
+        if (r->data_efd >= 0) close(r->data_efd);
+        if (r->space_efd >= 0) close(r->space_efd);
+        errno = err;
+        return -1;
+    }
+    r->sh = (ShmRingShared*)base;
+    r->slots = (char*)base + sizeof(ShmRingShared);
+    r->sh->ctl.num_slots = n;
+    r->sh->ctl.slot_size = r->slot_size;
+    return 0;
+}
+
+static inline void shm_ring_destroy(ShmRing *r) {
+    munmap(r->sh, r->map_len);
+    close(r->memfd);
+    close(r->data_efd);
+    close(r->space_efd);
+}
+
+static inline void shm_ring_end_init(ShmRingEnd *e, ShmRing *r, int producer) {
+    memset(e, 0, sizeof(*e));
+    e->ring = r;
+    e->producer = producer;
+    e->limit = producer ? r->num_slots : 0;
+    e->spin = SHM_SPIN_MIN;
+}
+
+static inline char* shm_ring_slot(const ShmRing *r, uint64_t pos) {
+    return r->slots + (size_t)(pos & (r->num_slots - 1)) * r->slot_size;
+}
+
+static inline int shm_ring_closed(const ShmRing *r) {
+    return __atomic_load_n(&r->sh->ctl.closed, __ATOMIC_ACQUIRE);
+}
+
+// Either side: stop, and wake the peer if it sleeps.
+static inline void shm_ring_close(ShmRing *r) {
+    uint64_t one = 1;
+    __atomic_store_n(&r->sh->ctl.closed, 1, __ATOMIC_SEQ_CST);
+    if (write(r->data_efd, &one, sizeof(one)) < 0 || write(r->space_efd, &one, sizeof(one)) < 0)
+        perror("eventfd write failed");
+}
+
+// Reload the peer's index; true if this side can make progress.
+static inline int shm_ring_refresh(ShmRingEnd *e) {
+    ShmRingShared *sh = e->ring->sh;
+    if (e->producer)
+        e->limit = __atomic_load_n(&sh->cons.tail, __ATOMIC_ACQUIRE) + e->ring->num_slots;
+    else
+        e->limit = __atomic_load_n(&sh->prod.head, __ATOMIC_ACQUIRE);
+    return e->pos < e->limit;
+}
+
+// Spin, then sleep, until the peer moves its index. Returns -1 once closed.
+static inline int shm_ring_wait(ShmRingEnd *e) {
+    ShmRing *r = e->ring;
+    for (unsigned i = 0; i < e->spin; i++) {
+        if (shm_ring_refresh(e)) {
+            e->spin_hits++;
+            if (e->spin < SHM_SPIN_MAX) e->spin *= 2;
+            return 0;
+        }
+        if (shm_ring_closed(r)) return -1;
+        cpu_relax();
+    }
+    if (e->spin > SHM_SPIN_MIN) e->spin /= 2;
+
+    uint32_t *waiting = e->producer ? &r->sh->waiting.producer : &r->sh->waiting.consumer;
+    int efd = e->producer ? r->space_efd : r->data_efd;
+    int rc = 0;
+    while (1) {
+        __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (shm_ring_refresh(e)) break;
+        if (shm_ring_closed(r)) {
+            rc = -1;
+            break;
+        }
+        uint64_t count;
+        e->sleeps++;
+        if (read(efd, &count, sizeof(count)) < 0 && errno != EINTR) {
+            rc = -1;
+            break;
+        }
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    return rc;
+}
+
+// After moving this side's index: wake the peer if it went to sleep. The
+// flag is taken, so a sleep costs at most one write however many publishes
+// happen before the peer runs again.
+static inline void shm_ring_notify(ShmRingEnd *e) {
+    ShmRing *r = e->ring;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t *waiting = e->producer ? &r->sh->waiting.consumer : &r->sh->waiting.producer;
+    if (!__atomic_load_n(waiting, __ATOMIC_RELAXED) ||
+        !__atomic_exchange_n(waiting, 0, __ATOMIC_RELAXED))
+        return;
+    uint64_t one = 1;
+    if (write(e->producer ? r->data_efd : r->space_efd, &one, sizeof(one)) == sizeof(one))
+        e->wakeups++;
+}
+
+// --- Producer ---
+
+// Make the slots filled so far visible to the consumer.
+static inline void shm_ring_publish(ShmRingEnd *p) {
+    if (p->published == p->pos) return;
+    __atomic_store_n(&p->ring->sh->prod.head, p->pos, __ATOMIC_RELEASE);
+    p->published = p->pos;
+    shm_ring_notify(p);
+}
+
+// The next free slot, to be filled and then committed. Publishes what is
+// pending before it waits, so the consumer never waits on a sleeping
+// producer's unpublished slots. NULL once the ring is closed.
+static inline char* shm_ring_reserve(ShmRingEnd *p) {
+    if (shm_ring_closed(p->ring)) return NULL;
+    if (p->pos >= p->limit && !shm_ring_refresh(p)) {
+        shm_ring_publish(p);
+        if (shm_ring_wait(p) < 0) return NULL;
+    }
+    return shm_ring_slot(p->ring, p->pos);
+}
+
+// The reserved slot is filled; it goes out with the next publish.
+static inline void shm_ring_commit(ShmRingEnd *p) {
+    p->pos++;
+}
+
+// --- Consumer ---
+
+// The oldest unread slot, waiting for one if the ring is empty. NULL once
+// the ring is closed.
+static inline const char* shm_ring_peek(ShmRingEnd *c) {
+    if (c->pos >= c->limit && !shm_ring_refresh(c)) {
+        if (shm_ring_wait(c) < 0) return NULL;
+    }
+    return shm_ring_slot(c->ring, c->pos);
+}
+
+// Hand the slot returned by peek back to the producer.
+static inline void shm_ring_release(ShmRingEnd *c) {
+    c->pos++;
+    __atomic_store_n(&c->ring->sh->cons.tail, c->pos, __ATOMIC_RELEASE);
+    shm_ring_notify(c);
+}
+
+#endif
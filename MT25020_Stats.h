@@ -0,0 +1,214 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Structured run records and repetition statistics.
+//
+// Every measured run (one client invocation, or one bench repetition) can be
+// written as a single-line JSON record holding all of its raw metrics, so
+// results are appended and re-read instead of scraped from human output.
+// Runs of the same cell (impl, transport, message size, connections) are
+// summarized by their median with a percentile-bootstrap confidence
+// interval, and compared against a baseline file of earlier records: a
+// change is only called significant when the bootstrap interval of the
+// relative difference of medians excludes zero and the median moved by at
+// least the minimum effect size.
+
+#include "MT25020_Common.h"
+#include "MT25020_Histogram.h"
+#include <stdint.h>
+
+#define STATS_BOOTSTRAP_RESAMPLES 2000
+#define STATS_CONFIDENCE 0.95
+#define STATS_MIN_REPS 3            // fewer runs: report, but never flag
+
+typedef struct {
+    char impl[16];
+    char transport[24];
+    int msg_size;
+    int threads;
+    int rep;
+    int duration_s;
+    double throughput_gbps;
+    double latency_us;          // mean of per-connection means, as printed
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+    long long total_bytes;
+    long long messages;
+} RunRecord;
+
+static inline void run_record_write(FILE *f, const RunRecord *r) {
+    fprintf(f, "{\"impl\":\"%s\",\"transport\":\"%s\",\"msg_size\":%d,\"threads\":%d,"
+               "\"rep\":%d,\"duration_s\":%d,\"throughput_gbps\":%.6f,\"latency_us\":%.6f,"
+               "\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,"
+               "\"max_us\":%.3f,\"total_bytes\":%lld,\"messages\":%lld}\n",
+            r->impl, r->transport, r->msg_size, r->threads, r->rep, r->duration_s,
+            r->throughput_gbps, r->latency_us, r->p50_us, r->p90_us, r->p99_us,
+            r->p999_us, r->max_us, r->total_bytes, r->messages);
+    fflush(f);
+}
+
+// Percentiles and message count from a run's merged histogram.
+static inline void run_record_set_latency(RunRecord *r, const LatencyHistogram *h) {
+    r->p50_us = hist_percentile(h, 50) / 1000.0;
+    r->p90_us = hist_percentile(h, 90) / 1000.0;
+    r->p99_us = hist_percentile(h, 99) / 1000.0;
+    r->p999_us = hist_percentile(h, 99.9) / 1000.0;
+    r->max_us = h->max / 1000.0;
+    r->messages = (long long)h->total;
+}
+
+// Records are the flat objects written above, so a key lookup is enough.
+static inline const char* run_record_field(const char *line, const char *key) {
+    char pattern[48];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    return p ? p + strlen(pattern) : NULL;
+}
+
+static inline double run_record_number(const char *line, const char *key) {
+    const char *p = run_record_field(line, key);
+    return p ? atof(p) : 0;
+}
+
+static inline void run_record_string(const char *line, const char *key, char *out, size_t len) {
+    const char *p = run_record_field(line, key);
+    out[0] = '\0';
+    if (!p || *p != '"') return;
+    p++;
+    size_t n = 0;
+    while (p[n] && p[n] != '"' && n + 1 < len) n++;
+    memcpy(out, p, n);
+    out[n] = '\0';
+}
+
+// Returns 0 if the line held a record.
+static inline int run_record_parse(const char *line, RunRecord *r) {
+    if (!run_record_field(line, "throughput_gbps")) return -1;
+    memset(r, 0, sizeof(*r));
+    run_record_string(line, "impl", r->impl, sizeof(r->impl));
+    run_record_string(line, "transport", r->transport, sizeof(r->transport));
+    r->msg_size = (int)run_record_number(line, "msg_size");
+    r->threads = (int)run_record_number(line, "threads");
+    r->rep = (int)run_record_number(line, "rep");
+    r->duration_s = (int)run_record_number(line, "duration_s");
+    r->throughput_gbps = run_record_number(line, "throughput_gbps");
+    r->latency_us = run_record_number(line, "latency_us");
+    r->p50_us = run_record_number(line, "p50_us");
+    r->p90_us = run_record_number(line, "p90_us");
+    r->p99_us = run_record_number(line, "p99_us");
+    r->p999_us = run_record_number(line, "p999_us");
+    r->max_us = run_record_number(line, "max_us");
+    r->total_bytes = (long long)run_record_number(line, "total_bytes");
+    r->messages = (long long)run_record_number(line, "messages");
+    return 0;
+}
+
+// Load every record in `path`. Returns the count (array in *out, caller
+// frees), or -1 if the file cannot be read.
+static inline int run_records_load(const char *path, RunRecord **out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int count = 0, cap = 64;
+    RunRecord *recs = (RunRecord*)malloc(cap * sizeof(RunRecord));
+    char line[1024];
+    while (recs && fgets(line, sizeof(line), f)) {
+        if (count == cap) {
+            cap *= 2;
+            RunRecord *grown = (RunRecord*)realloc(recs, cap * sizeof(RunRecord));
+            if (!grown) break;
+            recs = grown;
+        }
+        if (run_record_parse(line, &recs[count]) == 0) count++;
+    }
+    fclose(f);
+    *out = recs;
+    return recs ? count : -1;
+}
+
+static inline int run_record_same_cell(const RunRecord *a, const RunRecord *b) {
+    return a->msg_size == b->msg_size && a->threads == b->threads &&
+           strcmp(a->impl, b->impl) == 0 && strcmp(a->transport, b->transport) == 0;
+}
+
+// --- Statistics ---
+
+static inline int stats_cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Median of n values; `scratch` (n entries) is overwritten.
+static inline double stats_median(const double *v, int n, double *scratch) {
+    if (n == 0) return 0;
+    memcpy(scratch, v, n * sizeof(double));
+    qsort(scratch, n, sizeof(double), stats_cmp_double);
+    return n % 2 ? scratch[n / 2] : (scratch[n / 2 - 1] + scratch[n / 2]) / 2;
+}
+
+// xorshift64*: deterministic, so reruns of an analysis agree.
+static inline uint64_t stats_rand(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static inline double stats_resample_median(const double *v, int n, double *draw,
+                                           double *scratch, uint64_t *seed) {
+    for (int i = 0; i < n; i++) draw[i] = v[stats_rand(seed) % n];
+    return stats_median(draw, n, scratch);
+}
+
+static inline void stats_interval(double *boot, int count, double *lo, double *hi) {
+    qsort(boot, count, sizeof(double), stats_cmp_double);
+    double tail = (1 - STATS_CONFIDENCE) / 2;
+    *lo = boot[(int)(tail * (count - 1))];
+    *hi = boot[(int)((1 - tail) * (count - 1))];
+}
+
+// Percentile-bootstrap confidence interval for the median of v.
+static inline void stats_median_ci(const double *v, int n, double *lo, double *hi) {
+    double *boot = (double*)malloc(STATS_BOOTSTRAP_RESAMPLES * sizeof(double));
+    double *draw = (double*)malloc(n * sizeof(double));
+    double *scratch = (double*)malloc(n * sizeof(double));
+    if (!boot || !draw || !scratch || n == 0) {
+        *lo = *hi = n ? v[0] : 0;
+    } else {
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        for (int i = 0; i < STATS_BOOTSTRAP_RESAMPLES; i++)
+            boot[i] = stats_resample_median(v, n, draw, scratch, &seed);
+        stats_interval(boot, STATS_BOOTSTRAP_RESAMPLES, lo, hi);
+    }
+    free(scratch);
+    free(draw);
+    free(boot);
+}
+
+// Bootstrap interval for median(cur) / median(base) - 1, resampling both
+// sides independently.
+static inline void stats_relative_change_ci(const double *base, int nb, const double *cur, int nc,
+                                            double *lo, double *hi) {
+    int n = nb > nc ? nb : nc;
+    double *boot = (double*)malloc(STATS_BOOTSTRAP_RESAMPLES * sizeof(double));
+    double *draw = (double*)malloc(n * sizeof(double));
+    double *scratch = (double*)malloc(n * sizeof(double));
+    *lo = *hi = 0;
+    if (boot && draw && scratch && nb > 0 && nc > 0) {
+        uint64_t seed = 0xD1B54A32D192ED03ULL;
+        int count = 0;
+        for (int i = 0; i < STATS_BOOTSTRAP_RESAMPLES; i++) {
+            double b = stats_resample_median(base, nb, draw, scratch, &seed);
+            double c = stats_resample_median(cur, nc, draw, scratch, &seed);
+            if (b != 0) boot[count++] = c / b - 1;
+        }
+        if (count > 0) stats_interval(boot, count, lo, hi);
+    }
+    free(scratch);
+    free(draw);
+    free(boot);
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef STRATEGIES_H
+#define STRATEGIES_H
+
+// Non-blocking send strategies for A1/A2/A3.
+//
+// Each SendStrategy issues one write of the current message from
+// c->offset and keeps its per-connection state in the ReactorConn. The
+// reactor drives them on write readiness, rpc_handle_client() and the
+// in-process bench harness drive them with strategy_send_message(), so the
+// copy behaviour measured is the same in every mode. Work done once per
+// write unit (marshalling, --frame headers, the zero-copy decision) is
+// guarded by c->unit_started, so a unit whose first write would block is
+// not begun twice.
+
+#include "MT25020_Reactor.h"
+#include "MT25020_Payload.h"
+#include "MT25020_ZeroCopy.h"
+#include "MT25020_Gather.h"
+#include <sys/uio.h>
+
+// --- A1: two copies (marshal into a linear buffer, then send) ---
+
+// c->priv is the resolved --gather kernel.
+static int a1_conn_init(ReactorConn *c) {
+    c->msg = acquire_message(c->opts, c->field_size);
+    c->priv = (void*)gather_kernel_find(c->opts->gather);
+    if (!c->opts->payload_cache) c->linear_buffer = (char*)malloc(c->message_size);
+    if (!c->msg || !c->priv || (!c->opts->payload_cache && !c->linear_buffer)) return -1;
+    return frame_writer_init(&c->frame, c->opts, c->msg, c->field_size, 0);
+}
+
+// A --batch of the prelinearized shared payload: one iovec per message,
+// plus one per header with --frame (`hdrs` non-NULL).
+static inline int linear_iov_from_offset(const FrameHeader *hdrs, const char *buf, int msg_len,
+                                         size_t total, size_t offset, struct iovec *iov) {
+    size_t hdr_len = hdrs ? sizeof(FrameHeader) : 0;
+    size_t record = hdr_len + msg_len;
+    int cnt = 0;
+    for (size_t pos = offset; pos < total; cnt++) {
+        size_t in = pos % record;
+        if (in < hdr_len) {
+            iov[cnt].iov_base = (char*)&hdrs[pos / record] + in;
+            iov[cnt].iov_len = hdr_len - in;
+        } else {
+            iov[cnt].iov_base = (char*)buf + (in - hdr_len);
+            iov[cnt].iov_len = record - in;
+        }
+        pos += iov[cnt].iov_len;
+    }
+    return cnt;
+}
+
+static ssize_t a1_send_step(ReactorConn *c) {
+    int flags = MSG_DONTWAIT | MSG_NOSIGNAL | stream_send_flags(c->opts);
+    int field_size = c->field_size;
+    int msg_len = field_size * NUM_FIELDS;
+    int first = !c->unit_started;
+    if (first) {
+        c->unit_started = 1;
+        frame_begin_unit(&c->frame, 0);
+    }
+    if (c->opts->payload_cache) {
+        struct iovec iov[2 * MAX_BATCH];
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = iov;
+        hdr.msg_iovlen = linear_iov_from_offset(c->frame.cur, payload_linear(c->msg), msg_len,
+                                                c->message_size, c->offset, iov);
+        return sendmsg(c->fd, &hdr, flags);
+    }
+    
+    // Copy #1 happens once per message, when its batch starts going out.
+    if (first) {
+        gather_message((const GatherKernel*)c->priv, c->opts->nt_threshold, c->linear_buffer,
+                       c->frame.cur, c->msg, field_size, c->opts->batch);
+    }
+    // Copy #2: the remainder of the linear buffer.
+    return send(c->fd, c->linear_buffer + c->offset, c->message_size - c->offset, flags);
+}
+
+static void a1_conn_free(ReactorConn *c) {
+    frame_writer_free(&c->frame);
+    free(c->linear_buffer);
+    release_message(c->opts, c->msg);
+}
+
+static const SendStrategy a1_strategy = {
+    .name = "A1",
+    .conn_init = a1_conn_init,
+    .send_step = a1_send_step,
+    .on_error_queue = NULL,
+    .conn_busy = NULL,
+    .conn_free = a1_conn_free,
+};
+
+// --- A2: one copy (sendmsg straight from the eight fields) ---
+
+static int a2_conn_init(ReactorConn *c) {
+    c->msg = acquire_message(c->opts, c->field_size);
+    if (!c->msg) return -1;
+    return frame_writer_init(&c->frame, c->opts, c->msg, c->field_size, 0);
+}
+
+static ssize_t a2_send_step(ReactorConn *c) {
+    if (!c->unit_started) {
+        c->unit_started = 1;
+        frame_begin_unit(&c->frame, 0);
+    }
+    struct iovec iov[NUM_FIELDS * MAX_BATCH];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = message_iov_from_offset(c->msg, c->field_size, c->frame.cur,
+                                             c->message_size, c->offset, iov);
+    return sendmsg(c->fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL | stream_send_flags(c->opts));
+}
+
+static void a2_conn_free(ReactorConn *c) {
+    frame_writer_free(&c->frame);
+    release_message(c->opts, c->msg);
+}
+
+static const SendStrategy a2_strategy = {
+    .name = "A2",
+    .conn_init = a2_conn_init,
+    .send_step = a2_send_step,
+    .on_error_queue = NULL,
+    .conn_busy = NULL,
+    .conn_free = a2_conn_free,
+};
+
+// --- A3: MSG_ZEROCOPY sends, completions drained on EPOLLERR ---
+
+static int a3_conn_init(ReactorConn *c) {
+    ZcTracker *zc = (ZcTracker*)malloc(sizeof(ZcTracker));
+    c->msg = acquire_message(c->opts, c->field_size);
+    if (!zc || !c->msg ||
+        frame_writer_init(&c->frame, c->opts, c->msg, c->field_size, ZC_RING_SIZE + 1) < 0) {
+        free(zc);
+        release_message(c->opts, c->msg);
+        return -1;
+    }
+    zc_tracker_init(zc, c->fd, c->opts);
+    zc->stamps = c->stamps;
+    zc->live = &c->live;
+    c->priv = zc;
+    return 0;
+}
+
+static ssize_t a3_send_step(ReactorConn *c) {
+    ZcTracker *zc = (ZcTracker*)c->priv;
+    if (!c->unit_started) {
+        c->unit_started = 1;
+        frame_begin_unit(&c->frame, zc_begin_message(zc));
+    }
+
+    size_t remaining = c->message_size - c->offset;
+    if (zc->cur_zerocopy && zc_must_wait(zc, remaining)) {
+        // Resumed by the EPOLLERR that delivers the next completion.
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    struct iovec iov[NUM_FIELDS * MAX_BATCH];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = message_iov_from_offset(c->msg, c->field_size, c->frame.cur,
+                                             c->message_size, c->offset, iov);
+    int flags = MSG_DONTWAIT | MSG_NOSIGNAL | stream_send_flags(c->opts) |
+                (zc->cur_zerocopy ? MSG_ZEROCOPY : 0);
+    ssize_t n = sendmsg(c->fd, &hdr, flags);
+    if (n > 0 && zc->cur_zerocopy) zc_record_send(zc, n);
+    return n;
+}
+
+// Edge-triggered: empty the whole error queue, not just one notification.
+static void a3_on_error_queue(ReactorConn *c) {
+    zc_process_errqueue(c->fd, (ZcTracker*)c->priv);
+}
+
+// The message and the --frame header ring stay pinned until every
+// zero-copy send has completed.
+static int a3_conn_busy(const ReactorConn *c) {
+    const ZcTracker *zc = (const ZcTracker*)c->priv;
+    return zc->head_id != zc->next_id;
+}
+
+// Called once a3_conn_busy() has cleared (conn_quiesce(), or a reactor's
+// or pool worker's linger list), or after CONN_LINGER_MS without it.
+static void a3_conn_free(ReactorConn *c) {
+    ZcTracker *zc = (ZcTracker*)c->priv;
+    zc_drain_all(c->fd, zc, 0);     // whatever arrived since; never blocks
+    zc_report("A3", c->id, zc);
+    free(zc);
+    frame_writer_free(&c->frame);
+    release_message(c->opts, c->msg);
+}
+
+static const SendStrategy a3_strategy = {
+    .name = "A3",
+    .conn_init = a3_conn_init,
+    .send_step = a3_send_step,
+    .on_error_queue = a3_on_error_queue,
+    .conn_busy = a3_conn_busy,
+    .conn_free = a3_conn_free,
+};
+
+#endif
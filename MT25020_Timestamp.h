@@ -0,0 +1,264 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+// Kernel software timestamps (SO_TIMESTAMPING) for the latency breakdown.
+//
+// The client's latency covers everything from the server's send() to its
+// own recv(). To split that up, the server (--tx-timestamps) asks the kernel
+// to report each send three times on the socket error queue:
+//
+//   SCHED  the segment carrying the send's last byte enters the qdisc
+//   SND    it is handed to the driver (loopback and veth stamp here too)
+//   ACK    the peer has acknowledged that byte
+//
+// With SOF_TIMESTAMPING_OPT_ID every report carries the offset of that last
+// byte in the stream (ee_data), so TxStamps keeps a ring of pending sends
+// keyed by the offset of their last byte, together with the time the
+// application started the send. One send gives three intervals:
+//
+//   app->sched  syscall entry until the qdisc: the kernel copy (or page
+//               pinning with MSG_ZEROCOPY) and any wait in TCP's send queue
+//   sched->snd  queueing in the qdisc and the device layer
+//   snd->ack    the wire, the peer's stack and the ACK coming back
+//
+// The client (--rx-timestamps) completes the picture with SOF_TIMESTAMPING_
+// RX_SOFTWARE: recvmsg() returns the time the last segment it read entered
+// the receive stack, and the gap to the moment the message is complete in
+// user memory is the wire-to-app time.
+//
+// TCP coalesces sends into one segment only while it has not gone out, and
+// the kernel keeps a single key per segment, so a send merged with the next
+// one is never reported. Those are counted as unmatched, not guessed at.
+// Timestamps are CLOCK_REALTIME; the client converts its CLOCK_MONOTONIC
+// clock once at start-up.
+
+#include "MT25020_Common.h"
+#include "MT25020_Histogram.h"
+#include <netinet/ip.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#ifndef SO_EE_ORIGIN_TIMESTAMPING
+#define SO_EE_ORIGIN_TIMESTAMPING 4
+#endif
+
+#define TS_RING_SIZE 1024           // sends awaiting their ACK stamp (power of 2)
+#define TS_DRAIN_EVERY 16           // blocking senders: read the error queue every N sends
+
+#define TS_TX_FLAGS (SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE | \
+                     SOF_TIMESTAMPING_TX_ACK | SOF_TIMESTAMPING_SOFTWARE |      \
+                     SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)
+#define TS_RX_FLAGS (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE)
+
+typedef struct {
+    uint32_t end_id;            // stream offset of the send's last byte
+    long long app_ns;           // just before the send call
+    long long sched_ns;         // 0 until reported
+    long long snd_ns;
+} TsSend;
+
+typedef struct {
+    uint32_t bytes;             // bytes sent since enabling; wraps like the kernel's key
+    unsigned head, tail;        // pending ring, oldest at head
+    unsigned since_drain;
+    TsSend ring[TS_RING_SIZE];
+    LatencyHistogram app_to_sched;
+    LatencyHistogram sched_to_snd;
+    LatencyHistogram snd_to_ack;
+    long long sends;
+    long long stamped;          // sends that got their ACK stamp
+    long long unmatched;        // sends the kernel never reported
+} TxStamps;
+
+static inline long long ts_realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Enable TX timestamps on a connected socket, before anything is sent so
+// the ids count from its first byte. NULL (with a warning) if the kernel
+// refuses; the caller then simply runs without.
+static inline TxStamps* tx_stamps_create(int fd) {
+    TxStamps *t = (TxStamps*)calloc(1, sizeof(TxStamps));
+    if (!t) return NULL;
+    int flags = TS_TX_FLAGS;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("SO_TIMESTAMPING unavailable, sending without TX timestamps");
+        free(t);
+        return NULL;
+    }
+    hist_init(&t->app_to_sched);
+    hist_init(&t->sched_to_snd);
+    hist_init(&t->snd_to_ack);
+    return t;
+}
+
+// Record a send call that started at app_ns (ts_realtime_ns()) and moved n
+// bytes. A full ring gives up on its oldest send.
+static inline void tx_stamps_note_send(TxStamps *t, long long app_ns, size_t n) {
+    if (t->tail - t->head == TS_RING_SIZE) {
+        t->head++;
+        t->unmatched++;
+    }
+    TsSend *s = &t->ring[t->tail++ & (TS_RING_SIZE - 1)];
+    t->bytes += (uint32_t)n;
+    s->end_id = t->bytes - 1;
+    s->app_ns = app_ns;
+    s->sched_ns = 0;
+    s->snd_ns = 0;
+    t->sends++;
+}
+
+// Blocking senders: whether it is time to read the error queue again.
+static inline int tx_stamps_due(TxStamps *t) {
+    if (++t->since_drain < TS_DRAIN_EVERY) return 0;
+    t->since_drain = 0;
+    return 1;
+}
+
+static inline void ts_record(LatencyHistogram *h, long long from, long long to) {
+    if (from && to) hist_record(h, to > from ? to - from : 0);
+}
+
+// Ring index of the pending send whose last byte is `id`, or the index of
+// the first newer one if it is not pending. Ids increase along the ring.
+static inline unsigned tx_stamps_find(const TxStamps *t, uint32_t id) {
+    unsigned lo = t->head, hi = t->tail;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if ((int32_t)(t->ring[mid & (TS_RING_SIZE - 1)].end_id - id) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Apply one error-queue message. Returns 1 if serr was a timestamp report
+// (consumed), 0 if it belongs to someone else (zero-copy completions).
+static inline int tx_stamps_on_error(TxStamps *t, struct msghdr *msg,
+                                     const struct sock_extended_err *serr) {
+    if (serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) return 0;
+    long long ns = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            const struct scm_timestamping *tss = (const struct scm_timestamping*)CMSG_DATA(cm);
+            ns = (long long)tss->ts[0].tv_sec * 1000000000LL + tss->ts[0].tv_nsec;
+        }
+    }
+    if (!t || !ns) return 1;
+
+    unsigned idx = tx_stamps_find(t, serr->ee_data);
+    TsSend *s = &t->ring[idx & (TS_RING_SIZE - 1)];
+    int found = idx != t->tail && s->end_id == serr->ee_data;
+    switch (serr->ee_info) {
+    case SCM_TSTAMP_SCHED:
+        if (found && !s->sched_ns) s->sched_ns = ns;
+        break;
+    case SCM_TSTAMP_SND:
+        if (found && !s->snd_ns) s->snd_ns = ns;   // a retransmit is reported again
+        break;
+    case SCM_TSTAMP_ACK:
+        // ACKs are cumulative: older sends still pending will never be reported.
+        t->unmatched += idx - t->head;
+        t->head = idx;
+        if (!found) break;
+        ts_record(&t->app_to_sched, s->app_ns, s->sched_ns);
+        ts_record(&t->sched_to_snd, s->sched_ns, s->snd_ns);
+        ts_record(&t->snd_to_ack, s->snd_ns, ns);
+        t->stamped++;
+        t->head++;
+        break;
+    }
+    return 1;
+}
+
+// Non-blocking: read every queued report. Only for sockets without
+// MSG_ZEROCOPY; A3 reads its error queue through zc_process_errqueue(),
+// which hands timestamp reports here. Returns -1 on a socket error.
+static inline int tx_stamps_process_errqueue(int fd, TxStamps *t) {
+    char control[256];
+    struct msghdr msg;
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                tx_stamps_on_error(t, &msg, (struct sock_extended_err*)CMSG_DATA(cm));
+        }
+    }
+}
+
+static inline void tx_stamps_report(const char *name, int conn_id, const TxStamps *t) {
+    printf("[%s tstamp conn %d] sends=%lld stamped=%lld unmatched=%lld "
+           "app->sched p50=%.1f p99=%.1f sched->snd p50=%.1f p99=%.1f "
+           "snd->ack p50=%.1f p99=%.1f us\n",
+           name, conn_id, t->sends, t->stamped, t->unmatched,
+           hist_percentile(&t->app_to_sched, 50) / 1000.0,
+           hist_percentile(&t->app_to_sched, 99) / 1000.0,
+           hist_percentile(&t->sched_to_snd, 50) / 1000.0,
+           hist_percentile(&t->sched_to_snd, 99) / 1000.0,
+           hist_percentile(&t->snd_to_ack, 50) / 1000.0,
+           hist_percentile(&t->snd_to_ack, 99) / 1000.0);
+    fflush(stdout);
+}
+
+// --- Receive side ---
+
+typedef struct {
+    long long last_ns;          // RX stamp of the last segment read, CLOCK_REALTIME
+    long long mono_to_real;     // add to a get_time_ns() value to get CLOCK_REALTIME
+    LatencyHistogram *hist;     // wire-to-app, per message
+} RxStamps;
+
+// Returns 0 on success; -1 (with a warning) if the kernel refuses.
+static inline int rx_stamps_init(RxStamps *r, int fd, LatencyHistogram *hist) {
+    memset(r, 0, sizeof(*r));
+    int flags = TS_RX_FLAGS;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("SO_TIMESTAMPING unavailable, receiving without RX timestamps");
+        return -1;
+    }
+    r->mono_to_real = ts_realtime_ns() - get_time_ns();
+    r->hist = hist;
+    return 0;
+}
+
+// recv() that also picks up the stamp of the last segment it read.
+static inline ssize_t rx_stamps_recv(RxStamps *r, int fd, void *buf, size_t len) {
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct iovec iov = { buf, len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n <= 0) return n;
+    r->last_ns = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            const struct scm_timestamping *tss = (const struct scm_timestamping*)CMSG_DATA(cm);
+            r->last_ns = (long long)tss->ts[0].tv_sec * 1000000000LL + tss->ts[0].tv_nsec;
+        }
+    }
+    return n;
+}
+
+// `count` messages became complete at `now` (get_time_ns()) with the last
+// read; with --recv-batch they all share that read's stamp. A read that
+// carried no stamp is skipped.
+static inline void rx_stamps_complete(RxStamps *r, long long now, long long count) {
+    if (!r->last_ns) return;
+    long long delay = now + r->mono_to_real - r->last_ns;
+    hist_record_n(r->hist, delay > 0 ? delay : 0, count);
+}
+
+#endif
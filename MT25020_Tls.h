@@ -0,0 +1,92 @@
+#ifndef TLS_H
+#define TLS_H
+
+// Kernel TLS (--ktls): TLS 1.3 AES-GCM-128 records built by the kernel.
+//
+// There is no handshake. Both ends install fixed, test-only keys directly
+// through the "tls" upper-layer protocol: the server encrypts with the
+// server key (TLS_TX) and decrypts with the client key (TLS_RX), the client
+// the other way round, and both record sequences start at zero. From then
+// on every send path hands plaintext to the kernel, which encrypts it while
+// building records: A1's send() from its linear buffer, A2's sendmsg()
+// iovecs and A5's sendfile()/splice(). The client's recv() returns
+// decrypted data. The keys are public constants, so this measures what
+// encryption costs, not whether it is secure.
+
+#include "MT25020_Common.h"
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TLS_RX_EXPECT_NO_PAD
+#define TLS_RX_EXPECT_NO_PAD 4
+#endif
+
+enum { KTLS_SERVER = 0, KTLS_CLIENT = 1 };
+
+// Indexed by the side that encrypts with them.
+static const unsigned char ktls_keys[2][TLS_CIPHER_AES_GCM_128_KEY_SIZE] = {
+    { 0x4d, 0x54, 0x32, 0x35, 0x30, 0x32, 0x30, 0x2d, 0x73, 0x65, 0x72, 0x76, 0x65, 0x72, 0x2d, 0x6b },
+    { 0x4d, 0x54, 0x32, 0x35, 0x30, 0x32, 0x30, 0x2d, 0x63, 0x6c, 0x69, 0x65, 0x6e, 0x74, 0x2d, 0x6b },
+};
+static const unsigned char ktls_salts[2][TLS_CIPHER_AES_GCM_128_SALT_SIZE] = {
+    { 0x53, 0x41, 0x4c, 0x54 },
+    { 0x73, 0x61, 0x6c, 0x74 },
+};
+static const unsigned char ktls_ivs[2][TLS_CIPHER_AES_GCM_128_IV_SIZE] = {
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 },
+    { 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00 },
+};
+
+static inline void ktls_crypto_info(struct tls12_crypto_info_aes_gcm_128 *ci, int side) {
+    memset(ci, 0, sizeof(*ci));
+    ci->info.version = TLS_1_3_VERSION;
+    ci->info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    memcpy(ci->key, ktls_keys[side], sizeof(ci->key));
+    memcpy(ci->salt, ktls_salts[side], sizeof(ci->salt));
+    memcpy(ci->iv, ktls_ivs[side], sizeof(ci->iv));
+}
+
+// Whether this kernel has the tls ULP. The ULP is looked up before the
+// socket state is checked, so an unconnected socket tells them apart:
+// ENOENT means no tls module, anything else means it exists.
+static inline int ktls_available(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    int ok = setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 || errno != ENOENT;
+    close(fd);
+    if (!ok) fprintf(stderr, "Kernel TLS is unavailable (CONFIG_TLS; try 'modprobe tls')\n");
+    return ok;
+}
+
+// Switch a connected TCP socket to kernel TLS as `side`. Returns 0, or -1
+// with errno set; the connection cannot carry plaintext after a failure.
+static inline int ktls_enable(int fd, int side) {
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) return -1;
+    struct tls12_crypto_info_aes_gcm_128 tx, rx;
+    ktls_crypto_info(&tx, side);
+    ktls_crypto_info(&rx, !side);
+    if (setsockopt(fd, SOL_TLS, TLS_TX, &tx, sizeof(tx)) < 0 ||
+        setsockopt(fd, SOL_TLS, TLS_RX, &rx, sizeof(rx)) < 0)
+        return -1;
+    // Our records are never padded; lets the kernel decrypt TLS 1.3 in
+    // place instead of copying first (Linux 6.0+; older kernels just refuse).
+    int one = 1;
+    setsockopt(fd, SOL_TLS, TLS_RX_EXPECT_NO_PAD, &one, sizeof(one));
+    return 0;
+}
+
+// Server accept paths: enable --ktls on a new connection. Returns -1 (with
+// a message) if the connection must be dropped.
+static inline int ktls_server_setup(const ServerOptions *opts, int fd) {
+    if (!opts->ktls || ktls_enable(fd, KTLS_SERVER) == 0) return 0;
+    perror("Kernel TLS setup failed; connection dropped");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,667 @@
+#ifndef UDP_H
+#define UDP_H
+
+// UDP transport (--udp on the A1-A3 servers and on the clients).
+//
+// Each client thread sends a UDP_HELLO datagram to the server port. The
+// server then streams to that address from a new socket in a thread of its
+// own (a "flow") until the client says UDP_BYE or its port stops answering.
+// A message is cut into datagrams of at most --udp=BYTES on the wire
+// (default: one Ethernet MTU), each carrying a FrameHeader:
+//   seq       datagram number per flow, so the client counts loss and reordering
+//   send_ns   when the message's unit was built, for the one-way delay
+//   length    message bytes in this datagram
+//   reserved  their offset in the message, so the client sees where messages end
+//   crc32c    CRC-32C of those bytes (verified by the client with --frame)
+//
+// The servers keep their copy counts. A1 marshals each unit's datagrams,
+// headers included, into one linear buffer. A2 points iovecs at the header
+// and the fields. A3 does the same with MSG_ZEROCOPY. A send also pins its
+// headers, so A3 keeps UDP_ZC_SLOTS units of headers and reuses one only
+// after the sends that used it have completed.
+//
+// --batch=K puts K messages' datagrams into one sendmmsg() call. --gso lets
+// the kernel cut one super-buffer of up to UDP_MAX_GSO_SEGS equal datagrams
+// (UDP_SEGMENT). Without either, every datagram costs its own sendmsg(),
+// which is the per-packet baseline the other modes are measured against. The
+// client drains up to --recv-batch datagram buffers per recvmmsg(), and
+// with --gro the kernel hands it runs of datagrams coalesced into one
+// buffer (UDP_GRO).
+
+#include "MT25020_Common.h"
+#include "MT25020_Frame.h"
+#include "MT25020_Gather.h"
+#include "MT25020_Payload.h"
+#include "MT25020_Perf.h"
+#include "MT25020_Placement.h"
+#include "MT25020_ZeroCopy.h"
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define UDP_MAX_GSO_SEGS 64         // the kernel's UDP_MAX_SEGMENTS
+#define UDP_MAX_UNIT 1024           // datagrams per unit: sendmmsg() takes at most UIO_MAXIOV
+#define UDP_ZC_SLOTS 16             // A3: units of headers that may be pinned at once
+#define UDP_ZC_MAX_FRAGS 17         // A3: pages one zerocopy skb can pin (MAX_SKB_FRAGS)
+// A3: the largest datagram that fits those frags however its header and
+// field pieces straddle page boundaries.
+#define UDP_ZC_MAX_DATAGRAM ((UDP_ZC_MAX_FRAGS - NUM_FIELDS - 2) * 4096)
+#define UDP_ZC_WAIT_MS 100          // A3: completion wait between --duration checks
+#define UDP_MAX_FLOWS 4096
+#define UDP_RX_BUFFER 65536         // one datagram, or one GRO run of them
+#define UDP_RX_TIMEOUT_MS 100       // client: re-check the clock while the server is quiet
+#define UDP_HELLO_TRIES 5
+#define UDP_HELLO_WAIT_MS 500
+
+#define UDP_CTL_MAGIC 0x4D54434Cu   // "MTCL"
+enum { UDP_HELLO = 1, UDP_BYE = 2 };
+
+enum { UDP_SEND_LINEAR, UDP_SEND_IOV, UDP_SEND_ZEROCOPY };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+} UdpControl;
+
+// How one message is cut into datagrams.
+typedef struct {
+    int message_size;
+    int chunk;                      // message bytes in every datagram but a message's last
+    int per_msg;                    // datagrams per message
+    int count;                      // datagrams per unit (--batch messages)
+    uint32_t *crcs;                 // CRC-32C of each chunk of the message, [per_msg]
+} UdpLayout;
+
+// iovecs covering bytes [off, off + len) of the eight fields laid end to
+// end. Returns how many were written (at most NUM_FIELDS).
+static inline int udp_message_iov(const char *const *fields, int field_size, size_t off,
+                                  size_t len, struct iovec *iov) {
+    int n = 0;
+    while (len > 0) {
+        size_t in = off % field_size;
+        size_t k = field_size - in < len ? field_size - in : len;
+        iov[n].iov_base = (char*)fields[off / field_size] + in;
+        iov[n].iov_len = k;
+        n++;
+        off += k;
+        len -= k;
+    }
+    return n;
+}
+
+static inline void udp_message_fields(const Message *msg, const char **fields) {
+    fields[0] = msg->field1; fields[1] = msg->field2; fields[2] = msg->field3;
+    fields[3] = msg->field4; fields[4] = msg->field5; fields[5] = msg->field6;
+    fields[6] = msg->field7; fields[7] = msg->field8;
+}
+
+// Datagram size a flow sends with: --udp, capped for A3.
+static inline int udp_datagram_size(int mode, const ServerOptions *opts) {
+    if (mode == UDP_SEND_ZEROCOPY && opts->udp > UDP_ZC_MAX_DATAGRAM) return UDP_ZC_MAX_DATAGRAM;
+    return opts->udp;
+}
+
+// Datagram layout for --udp=`datagram`. Returns 0, or -1 with a reason
+// printed if a unit would not fit one sendmmsg().
+static inline int udp_layout_init(UdpLayout *l, const Message *msg, int field_size, int datagram,
+                                  int batch) {
+    memset(l, 0, sizeof(*l));
+    l->message_size = field_size * NUM_FIELDS;
+    l->chunk = datagram - (int)sizeof(FrameHeader);
+    if (l->chunk > l->message_size) l->chunk = l->message_size;
+    l->per_msg = (l->message_size + l->chunk - 1) / l->chunk;
+    l->count = l->per_msg * batch;
+    if (l->count > UDP_MAX_UNIT) {
+        fprintf(stderr, "--batch=%d x %d datagrams per message exceeds %d per sendmmsg()\n",
+                batch, l->per_msg, UDP_MAX_UNIT);
+        return -1;
+    }
+    l->crcs = (uint32_t*)malloc(l->per_msg * sizeof(uint32_t));
+    if (!l->crcs) return -1;
+    const char *fields[NUM_FIELDS];
+    udp_message_fields(msg, fields);
+    crc32c_tables();
+    for (int k = 0; k < l->per_msg; k++) {
+        struct iovec iov[NUM_FIELDS];
+        size_t off = (size_t)k * l->chunk;
+        size_t len = k == l->per_msg - 1 ? l->message_size - off : (size_t)l->chunk;
+        int n = udp_message_iov(fields, field_size, off, len, iov);
+        uint32_t crc = 0;
+        for (int i = 0; i < n; i++)
+            crc = crc32c_extend(crc, (const char*)iov[i].iov_base, iov[i].iov_len);
+        l->crcs[k] = crc;
+    }
+    return 0;
+}
+
+// --- Server ---
+
+typedef union {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} UdpGsoCmsg;
+
+// One flow's sender.
+typedef struct {
+    int fd;
+    int mode;                       // UDP_SEND_*
+    int gso;
+    int per_call;                   // 0: sendmsg() per datagram, else sendmmsg()
+    const ServerOptions *opts;
+    UdpLayout l;
+    const char *fields[NUM_FIELDS];
+    int field_size;
+    const GatherKernel *gather;
+    FrameHeader *hdrs;              // [slots][l.count]
+    unsigned *slot_done;            // zero-copy id after the last send from each slot
+    int slots;
+    int slot;
+    char *linear;                   // UDP_SEND_LINEAR: the unit's datagrams back to back
+    struct iovec *iov;              // per datagram: its run of linear, or header + pieces
+    int *dgram_iov;                 // first iov of each datagram, [l.count + 1]
+    struct mmsghdr *msgs;
+    UdpGsoCmsg *cmsgs;
+    uint64_t next_seq;
+    ZcTracker zc;
+    LiveConn *live;
+    long long syscalls;
+    long long datagrams;
+    long long entries;              // mmsghdrs sent (super-buffers with --gso)
+    long long bytes;                // message bytes, headers excluded
+} UdpSender;
+
+static inline void udp_sender_free(UdpSender *s) {
+    free(s->cmsgs);
+    free(s->msgs);
+    free(s->dgram_iov);
+    free(s->iov);
+    free(s->linear);
+    free(s->slot_done);
+    free(s->hdrs);
+    free(s->l.crcs);
+}
+
+static inline int udp_sender_init(UdpSender *s, int fd, int mode, const Message *msg,
+                                  int field_size, const ServerOptions *opts, LiveConn *live) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->mode = mode;
+    s->gso = opts->gso;
+    s->per_call = opts->gso || opts->batch > 1;
+    s->opts = opts;
+    s->field_size = field_size;
+    s->gather = gather_kernel_find(opts->gather);
+    s->live = live;
+    udp_message_fields(msg, s->fields);
+    if (udp_layout_init(&s->l, msg, field_size, udp_datagram_size(s->mode, opts),
+                        opts->batch) < 0) return -1;
+
+    int n = s->l.count;
+    if (mode == UDP_SEND_ZEROCOPY) {
+        zc_tracker_init(&s->zc, fd, opts);
+        s->zc.live = live;
+        s->slots = UDP_ZC_SLOTS;
+    } else {
+        s->slots = 1;
+    }
+    s->hdrs = (FrameHeader*)calloc((size_t)s->slots * n, sizeof(FrameHeader));
+    s->slot_done = (unsigned*)calloc(s->slots, sizeof(unsigned));
+    s->dgram_iov = (int*)malloc((n + 1) * sizeof(int));
+    s->msgs = (struct mmsghdr*)calloc(n, sizeof(struct mmsghdr));
+    s->cmsgs = (UdpGsoCmsg*)calloc(n, sizeof(UdpGsoCmsg));
+    s->iov = (struct iovec*)malloc((size_t)n * (NUM_FIELDS + 1) * sizeof(struct iovec));
+    if (mode == UDP_SEND_LINEAR)
+        s->linear = (char*)malloc((size_t)opts->batch * s->l.message_size + n * sizeof(FrameHeader));
+    if (!s->hdrs || !s->slot_done || !s->dgram_iov || !s->msgs || !s->cmsgs || !s->iov ||
+        (mode == UDP_SEND_LINEAR && !s->linear)) {
+        udp_sender_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+// Headers and iovecs of the next unit: one iovec per datagram for A1 (into
+// the marshalled buffer), the header plus the fields' pieces for A2/A3.
+static inline void udp_build_unit(UdpSender *s, FrameHeader *h) {
+    const UdpLayout *l = &s->l;
+    int64_t now = get_time_ns();
+    int niov = 0;
+    char *dst = s->linear;
+    for (int d = 0; d < l->count; d++) {
+        int k = d % l->per_msg;
+        size_t off = (size_t)k * l->chunk;
+        size_t len = k == l->per_msg - 1 ? l->message_size - off : (size_t)l->chunk;
+        h[d].magic = FRAME_MAGIC;
+        h[d].length = len;
+        h[d].seq = s->next_seq++;
+        h[d].send_ns = now;
+        h[d].crc32c = l->crcs[k];
+        h[d].reserved = off;
+
+        s->dgram_iov[d] = niov;
+        if (s->mode == UDP_SEND_LINEAR) {
+            // Copy #1: the header and the fields' bytes, in wire order.
+            struct iovec pieces[NUM_FIELDS];
+            int np = udp_message_iov(s->fields, s->field_size, off, len, pieces);
+            s->iov[niov].iov_base = dst;
+            s->iov[niov].iov_len = sizeof(FrameHeader) + len;
+            niov++;
+            memcpy(dst, &h[d], sizeof(FrameHeader));
+            dst += sizeof(FrameHeader);
+            for (int i = 0; i < np; i++) {
+                s->gather->copy(dst, (const char*)pieces[i].iov_base, pieces[i].iov_len);
+                dst += pieces[i].iov_len;
+            }
+        } else {
+            s->iov[niov].iov_base = &h[d];
+            s->iov[niov].iov_len = sizeof(FrameHeader);
+            niov++;
+            niov += udp_message_iov(s->fields, s->field_size, off, len, &s->iov[niov]);
+        }
+    }
+    s->dgram_iov[l->count] = niov;
+}
+
+// Pages the iovecs of datagram d pin when sent with MSG_ZEROCOPY.
+static inline int udp_datagram_pages(const UdpSender *s, int d) {
+    int pages = 0;
+    for (int i = s->dgram_iov[d]; i < s->dgram_iov[d + 1]; i++) {
+        uintptr_t base = (uintptr_t)s->iov[i].iov_base;
+        pages += (base + s->iov[i].iov_len - 1) / 4096 - base / 4096 + 1;
+    }
+    return pages;
+}
+
+// Group the unit's datagrams into mmsghdr entries: one per datagram, or
+// with --gso runs of equal datagrams (the last may be shorter) that the
+// kernel cuts apart. Each entry's msg_len is its size on the wire. Returns
+// the number of entries.
+static inline int udp_group_unit(UdpSender *s, const FrameHeader *h) {
+    int zerocopy = s->mode == UDP_SEND_ZEROCOPY;
+    int n = 0;
+    int d = 0;
+    while (d < s->l.count) {
+        int first = d;
+        size_t seg = sizeof(FrameHeader) + h[d].length;
+        size_t total = seg;
+        int pages = zerocopy ? udp_datagram_pages(s, d) : 0;
+        d++;
+        while (s->gso && d < s->l.count && d - first < UDP_MAX_GSO_SEGS) {
+            size_t len = sizeof(FrameHeader) + h[d].length;
+            if (len > seg || total + len > UDP_MAX_PAYLOAD) break;
+            // A zerocopy super-buffer is one skb, and every pinned page
+            // is one of its frags; past the limit the send fails.
+            int more = zerocopy ? udp_datagram_pages(s, d) : 0;
+            if (pages + more > UDP_ZC_MAX_FRAGS) break;
+            pages += more;
+            total += len;
+            d++;
+            if (len < seg) break;
+        }
+
+        struct msghdr *m = &s->msgs[n].msg_hdr;
+        memset(m, 0, sizeof(*m));
+        m->msg_iov = &s->iov[s->dgram_iov[first]];
+        m->msg_iovlen = s->dgram_iov[d] - s->dgram_iov[first];
+        if (s->mode == UDP_SEND_LINEAR) {
+            // The datagrams are adjacent in the marshalled buffer.
+            m->msg_iov->iov_len = total;
+            m->msg_iovlen = 1;
+        }
+        if (d - first > 1) {
+            m->msg_control = s->cmsgs[n].buf;
+            m->msg_controllen = sizeof(s->cmsgs[n].buf);
+            struct cmsghdr *cm = CMSG_FIRSTHDR(m);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = seg;
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+        s->msgs[n].msg_len = total;
+        n++;
+    }
+    return n;
+}
+
+// Send entries [0, n). Returns 0, or -1 with errno set once the flow is
+// over (ECONNREFUSED: the client's port has closed).
+static inline int udp_send_entries(UdpSender *s, int n, int flags) {
+    int done = 0;
+    while (done < n) {
+        size_t want = 0;
+        for (int i = done; i < (s->per_call ? n : done + 1); i++) want += s->msgs[i].msg_len;
+        int sent;
+        if (s->per_call) {
+            sent = sendmmsg(s->fd, &s->msgs[done], n - done, flags);
+        } else {
+            ssize_t r = sendmsg(s->fd, &s->msgs[done].msg_hdr, flags);
+            sent = r < 0 ? -1 : 1;
+        }
+        s->syscalls++;
+        if (sent < 0) {
+            live_note_send(s->live, want, -1);
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY) && s->zc.head_id != s->zc.next_id) {
+                // optmem limit reached: wait for completions, then retry.
+                if (zc_wait(s->fd, &s->zc, UDP_ZC_WAIT_MS) < 0) return -1;
+                continue;
+            }
+            // A full qdisc or device queue only means "later".
+            if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) continue;
+            return -1;
+        }
+        size_t bytes = 0;
+        for (int i = done; i < done + sent; i++) {
+            bytes += s->msgs[i].msg_len;
+            if (flags & MSG_ZEROCOPY) zc_record_send(&s->zc, s->msgs[i].msg_len);
+        }
+        live_note_send(s->live, want, bytes);
+        done += sent;
+    }
+    return 0;
+}
+
+// Block until zero-copy completions free what the next unit needs: its
+// header slot, ring ids for `entries` sends and `bytes` of pinned budget.
+static inline int udp_zc_reserve(UdpSender *s, int entries, size_t bytes, const int *stop) {
+    ZcTracker *t = &s->zc;
+    while ((int)(s->slot_done[s->slot] - t->head_id) > 0 || zc_must_wait(t, bytes) ||
+           t->next_id - t->head_id + entries > ZC_RING_SIZE) {
+        if (__atomic_load_n(stop, __ATOMIC_RELAXED) || zc_wait(s->fd, t, UDP_ZC_WAIT_MS) < 0) return -1;
+    }
+    return 0;
+}
+
+// Build and send one unit of --batch messages. Returns -1 once the flow
+// is over.
+static inline int udp_send_unit(UdpSender *s, const int *stop) {
+    int flags = 0;
+    if (s->mode == UDP_SEND_ZEROCOPY) {
+        s->slot = (s->slot + 1) % s->slots;
+        if (zc_begin_message(&s->zc)) flags |= MSG_ZEROCOPY;
+    }
+    FrameHeader *h = s->hdrs + (size_t)s->slot * s->l.count;
+    size_t unit = (size_t)s->l.message_size * s->opts->batch + s->l.count * sizeof(FrameHeader);
+    // The slot's headers may still be pinned by the unit that last used it.
+    if (s->mode == UDP_SEND_ZEROCOPY && udp_zc_reserve(s, s->l.count, unit, stop) < 0) return -1;
+    udp_build_unit(s, h);
+    int n = udp_group_unit(s, h);
+    if (udp_send_entries(s, n, flags) < 0) return -1;
+    s->slot_done[s->slot] = s->zc.next_id;
+    s->datagrams += s->l.count;
+    s->entries += n;
+    s->bytes += (long long)s->l.message_size * s->opts->batch;
+    return 0;
+}
+
+typedef struct UdpServer UdpServer;
+
+typedef struct {
+    UdpServer *srv;
+    struct sockaddr_in peer;
+    int fd;                         // connected to peer
+    int id;
+    int active;                     // slot in use; guarded by srv->lock
+    int stop;                       // UDP_BYE received
+} UdpFlow;
+
+struct UdpServer {
+    const char *name;
+    int mode;                       // UDP_SEND_*
+    const ServerOptions *opts;
+    pthread_mutex_t lock;
+    UdpFlow flows[UDP_MAX_FLOWS];
+};
+
+static void* udp_flow_thread(void *arg) {
+    UdpFlow *f = (UdpFlow*)arg;
+    UdpServer *srv = f->srv;
+    const ServerOptions *opts = srv->opts;
+    int field_size = opts->message_size / NUM_FIELDS;
+
+    Message *msg = acquire_message(opts, field_size);
+    LiveConn live;
+    live_conn_open(&live, f->id, NULL);
+    UdpSender s;
+    if (!msg || udp_sender_init(&s, f->fd, srv->mode, msg, field_size, opts, &live) < 0) {
+        fprintf(stderr, "Failed to set up UDP flow %d\n", f->id);
+    } else {
+        PerfCounters pc;
+        perf_counters_open(&pc, opts->perf_counters);
+        long long start = get_time_ns();
+        while (!__atomic_load_n(&f->stop, __ATOMIC_RELAXED)) {
+            if (udp_send_unit(&s, &f->stop) < 0) {
+                if (errno != ECONNREFUSED && !__atomic_load_n(&f->stop, __ATOMIC_RELAXED))
+                    perror("UDP send failed");
+                break;
+            }
+        }
+        double elapsed = (get_time_ns() - start) / 1e9;
+        if (srv->mode == UDP_SEND_ZEROCOPY) {
+            zc_drain_all(f->fd, &s.zc, 1000);
+            zc_report(srv->name, f->id, &s.zc);
+        }
+        printf("[%s udp flow %d] messages=%lld datagrams=%lld sends=%lld (%.1f datagrams each) "
+               "syscalls=%lld (%.3f per message) throughput=%.6f Gbps\n",
+               srv->name, f->id, s.bytes / s.l.message_size, s.datagrams, s.entries,
+               s.entries ? (double)s.datagrams / s.entries : 0, s.syscalls,
+               s.bytes ? (double)s.syscalls * s.l.message_size / s.bytes : 0,
+               elapsed > 0 ? s.bytes * 8.0 / (elapsed * 1e9) : 0);
+        fflush(stdout);
+        char label[128];
+        placement_conn_label(label, sizeof(label), srv->name, f->id, f->fd, s.syscalls);
+        perf_counters_finish(&pc, label, s.bytes);
+        udp_sender_free(&s);
+    }
+    live_conn_close(&live);
+    release_message(opts, msg);
+    close(f->fd);
+    connection_closed();
+    pthread_mutex_lock(&srv->lock);
+    f->active = 0;
+    pthread_mutex_unlock(&srv->lock);
+    return NULL;
+}
+
+// Active flow to `peer`, or NULL. Call with srv->lock held.
+static inline UdpFlow* udp_flow_find(UdpServer *srv, const struct sockaddr_in *peer) {
+    for (int i = 0; i < UDP_MAX_FLOWS; i++) {
+        UdpFlow *f = &srv->flows[i];
+        if (f->active && f->peer.sin_port == peer->sin_port &&
+            f->peer.sin_addr.s_addr == peer->sin_addr.s_addr)
+            return f;
+    }
+    return NULL;
+}
+
+// Serve --udp: answer each client's UDP_HELLO with a flow of its own.
+// --max-conns bounds the flows; hellos beyond it are ignored and the
+// client gives up after UDP_HELLO_TRIES.
+static inline int run_udp_server(const char *name, int mode, const ServerOptions *opts) {
+    Placement placement;
+    if (placement_init(&placement, opts) < 0) return -1;
+    UdpServer *srv = (UdpServer*)calloc(1, sizeof(UdpServer));
+    if (!srv) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+    }
+    srv->name = name;
+    srv->mode = mode;
+    srv->opts = opts;
+    pthread_mutex_init(&srv->lock, NULL);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts->port);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        free(srv);
+        return -1;
+    }
+    placement_print(&placement, name);
+    int datagram = udp_datagram_size(mode, opts);
+    if (datagram < opts->udp)
+        fprintf(stderr, "%s: zerocopy datagrams pin at most %d pages; --udp capped at %d\n",
+                name, UDP_ZC_MAX_FRAGS, datagram);
+    int chunk = datagram - (int)sizeof(FrameHeader);
+    int per_msg = (opts->message_size + chunk - 1) / chunk;
+    printf("[%s udp] port %d: %d-byte datagrams, %d per message, batch=%d gso=%s%s\n", name,
+           opts->port, per_msg > 1 ? datagram : opts->message_size + (int)sizeof(FrameHeader),
+           per_msg, opts->batch, opts->gso ? "on" : "off",
+           mode == UDP_SEND_ZEROCOPY ? " zerocopy" : "");
+    fflush(stdout);
+
+    int next_id = 0;
+    while (1) {
+        UdpControl ctl;
+        struct sockaddr_in peer;
+        socklen_t len = sizeof(peer);
+        ssize_t n = recvfrom(fd, &ctl, sizeof(ctl), 0, (struct sockaddr*)&peer, &len);
+        if (n != sizeof(ctl) || ctl.magic != UDP_CTL_MAGIC) continue;
+
+        pthread_mutex_lock(&srv->lock);
+        UdpFlow *f = udp_flow_find(srv, &peer);
+        if (ctl.type == UDP_BYE && f) __atomic_store_n(&f->stop, 1, __ATOMIC_RELAXED);
+        if (ctl.type != UDP_HELLO || f) {
+            // A repeated hello: its flow is already running.
+            pthread_mutex_unlock(&srv->lock);
+            continue;
+        }
+        int active = 0;
+        for (int i = 0; i < UDP_MAX_FLOWS; i++) {
+            if (srv->flows[i].active) active++;
+            else if (!f) f = &srv->flows[i];
+        }
+        if (!f || (opts->max_conns > 0 && active >= opts->max_conns)) {
+            pthread_mutex_unlock(&srv->lock);
+            continue;
+        }
+        memset(f, 0, sizeof(*f));
+        f->srv = srv;
+        f->peer = peer;
+        f->id = next_id++;
+        f->active = 1;
+        pthread_mutex_unlock(&srv->lock);
+
+        f->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (f->fd < 0 || connect(f->fd, (struct sockaddr*)&peer, sizeof(peer)) < 0) {
+            perror("UDP flow setup failed");
+            if (f->fd >= 0) close(f->fd);
+            pthread_mutex_lock(&srv->lock);
+            f->active = 0;
+            pthread_mutex_unlock(&srv->lock);
+            continue;
+        }
+        connection_opened(name);
+        pthread_t t;
+        if (placement_spawn(&placement, f->fd, &t, udp_flow_thread, f) != 0) {
+            fprintf(stderr, "Failed to start a flow thread; client dropped\n");
+            close(f->fd);
+            connection_closed();
+            pthread_mutex_lock(&srv->lock);
+            f->active = 0;
+            pthread_mutex_unlock(&srv->lock);
+            continue;
+        }
+        pthread_detach(t);
+    }
+    return 0;
+}
+
+// --- Client ---
+
+static inline int udp_control_send(int fd, const struct sockaddr_in *server, int type) {
+    UdpControl ctl = { UDP_CTL_MAGIC, (uint32_t)type };
+    return sendto(fd, &ctl, sizeof(ctl), 0, (const struct sockaddr*)server, sizeof(*server)) ==
+           sizeof(ctl) ? 0 : -1;
+}
+
+typedef struct {
+    long long datagrams;
+    long long lost;                 // sequence numbers skipped and not seen since
+    long long reordered;            // arrived after a later datagram
+    long long crc_errors;           // --frame
+    long long malformed;            // bad magic, length or offset
+    long long buffers;              // receive buffers; a GRO run counts once
+    long long messages;             // datagrams that ended a message
+} UdpRxCounts;
+
+typedef struct {
+    uint64_t next_seq;              // one past the highest sequence number seen
+    int message_size;
+    int verify;                     // check each datagram's CRC-32C
+    UdpRxCounts counts;
+} UdpRx;
+
+static inline void udp_rx_init(UdpRx *rx, int message_size, int verify) {
+    memset(rx, 0, sizeof(*rx));
+    rx->message_size = message_size;
+    rx->verify = verify;
+    if (verify) crc32c_tables();
+}
+
+// Account one datagram. Returns 1 if it ends a message, with the time its
+// unit was built in *send_ns; 0 if it does not; -1 if it is malformed.
+// A late datagram was counted lost when the gap opened, so it is taken back
+// off; duplicates, which loopback never produces, would be taken off too.
+static inline int udp_rx_datagram(UdpRx *rx, const char *buf, size_t len, int64_t *send_ns) {
+    FrameHeader h;
+    if (len < sizeof(FrameHeader)) {
+        rx->counts.malformed++;
+        return -1;
+    }
+    memcpy(&h, buf, sizeof(h));
+    if (h.magic != FRAME_MAGIC || h.length != len - sizeof(FrameHeader) ||
+        (uint64_t)h.reserved + h.length > (uint64_t)rx->message_size) {
+        rx->counts.malformed++;
+        return -1;
+    }
+    rx->counts.datagrams++;
+    if (h.seq >= rx->next_seq) {
+        rx->counts.lost += h.seq - rx->next_seq;
+        rx->next_seq = h.seq + 1;
+    } else {
+        rx->counts.reordered++;
+        if (rx->counts.lost > 0) rx->counts.lost--;
+    }
+    if (rx->verify && crc32c_extend(0, buf + sizeof(FrameHeader), h.length) != h.crc32c)
+        rx->counts.crc_errors++;
+    if (h.reserved + h.length != (uint32_t)rx->message_size) return 0;
+    rx->counts.messages++;
+    *send_ns = h.send_ns;
+    return 1;
+}
+
+static inline void udp_rx_counts_add(UdpRxCounts *sum, const UdpRxCounts *c) {
+    sum->datagrams += c->datagrams;
+    sum->lost += c->lost;
+    sum->reordered += c->reordered;
+    sum->crc_errors += c->crc_errors;
+    sum->malformed += c->malformed;
+    sum->buffers += c->buffers;
+    sum->messages += c->messages;
+}
+
+static inline void udp_rx_counts_print(FILE *out, const UdpRxCounts *c, int verify) {
+    long long expected = c->datagrams + c->lost;
+    fprintf(out, "UDP: %lld datagrams, %lld lost (%.3f%%), %lld reordered, %lld malformed, "
+            "%.2f datagrams per receive buffer\n", c->datagrams, c->lost,
+            expected > 0 ? 100.0 * c->lost / expected : 0, c->reordered, c->malformed,
+            c->buffers > 0 ? (double)c->datagrams / c->buffers : 0);
+    if (verify)
+        fprintf(out, "Integrity: %lld datagrams verified (crc32c %s), %lld checksum errors\n",
+                c->datagrams, crc32c_impl(), c->crc_errors);
+}
+
+#endif
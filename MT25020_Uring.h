@@ -0,0 +1,146 @@
+#ifndef URING_H
+#define URING_H
+
+// Minimal io_uring wrapper built directly on the raw syscalls, so the A4
+// server does not depend on liburing being installed. Only what A4 needs is
+// implemented: ring setup, fixed-buffer registration, SQE allocation, one
+// batched io_uring_enter, and CQE iteration.
+
+#include "MT25020_Common.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+typedef struct {
+    int ring_fd;
+
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;          // local tail, published by uring_submit()
+    unsigned sqe_head;          // entries up to here are already published
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring_ptr;
+    size_t sq_ring_sz;
+    void *cq_ring_ptr;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+} Uring;
+
+static inline int uring_init(Uring *u, unsigned entries, unsigned cq_entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(u, 0, sizeof(*u));
+    if (cq_entries) {
+        p.flags |= IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries;
+    }
+
+    u->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (u->ring_fd < 0) return -1;
+
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_sz > u->sq_ring_sz) u->sq_ring_sz = u->cq_ring_sz;
+        u->cq_ring_sz = u->sq_ring_sz;
+    }
+
+    u->sq_ring_ptr = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring_ptr == MAP_FAILED) goto fail;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring_ptr = u->sq_ring_ptr;
+    } else {
+        u->cq_ring_ptr = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring_ptr == MAP_FAILED) goto fail;
+    }
+
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+
+    char *sq = (char*)u->sq_ring_ptr;
+    u->sq_head = (unsigned*)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)(sq + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->sqe_tail = u->sqe_head = *u->sq_tail;
+
+    char *cq = (char*)u->cq_ring_ptr;
+    u->cq_head = (unsigned*)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+    close(u->ring_fd);
+    return -1;
+}
+
+static inline int uring_register_buffers(Uring *u, const struct iovec *iov, unsigned nr) {
+    return syscall(__NR_io_uring_register, u->ring_fd, IORING_REGISTER_BUFFERS, iov, nr);
+}
+
+// Returns a zeroed SQE, or NULL if the submission queue is full.
+static inline struct io_uring_sqe* uring_get_sqe(Uring *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sqe_tail - head >= u->sq_entries) return NULL;
+    struct io_uring_sqe *sqe = &u->sqes[u->sqe_tail & *u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqe_tail++;
+    return sqe;
+}
+
+static inline unsigned uring_sq_space(Uring *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    return u->sq_entries - (u->sqe_tail - head);
+}
+
+// Publish every SQE queued since the last call and, in the same
+// io_uring_enter, wait for at least `wait_nr` completions.
+static inline int uring_submit_and_wait(Uring *u, unsigned wait_nr) {
+    unsigned mask = *u->sq_mask;
+    unsigned to_submit = u->sqe_tail - u->sqe_head;
+    for (unsigned i = u->sqe_head; i != u->sqe_tail; i++)
+        u->sq_array[i & mask] = i & mask;
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+    u->sqe_head = u->sqe_tail;
+
+    if (to_submit == 0 && wait_nr == 0) return 0;
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, u->ring_fd, to_submit, wait_nr, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+// Returns the next unconsumed CQE without removing it, or NULL.
+static inline struct io_uring_cqe* uring_peek_cqe(Uring *u) {
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &u->cqes[head & *u->cq_mask];
+}
+
+static inline void uring_cqe_seen(Uring *u) {
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+// MSG_ZEROCOPY completion tracking.
+//
+// Every successful sendmsg(MSG_ZEROCOPY) is assigned a 32-bit id by the
+// kernel, counting up from 0 per socket. When the kernel releases the pages
+// of a range of sends it queues one notification on the socket error queue
+// carrying [ee_info, ee_data]; ee_code has SO_EE_CODE_ZEROCOPY_COPIED set if
+// the data was copied after all (e.g. loopback or small sends).
+//
+// ZcTracker keeps a ring of in-flight send ids with their byte counts, so
+// the sender knows how much payload is still pinned, can apply backpressure
+// when that exceeds a budget, and can count copy fallbacks. In adaptive mode
+// it also decides per message whether to use MSG_ZEROCOPY at all or the plain
+// scatter-gather path (A2), based on message size and the observed copy ratio.
+//
+// With --tx-timestamps the same error queue also carries the kernel's
+// timestamp reports; zc_process_errqueue() hands those to `stamps`. With
+// --live-stats it publishes the completion counts to `live`.
+
+#include "MT25020_Common.h"
+#include "MT25020_Timestamp.h"
+#include "MT25020_Live.h"
+#include <poll.h>
+#include <netinet/ip.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+#define ZC_RING_SIZE 1024                   // max sends in flight (power of 2)
+#define ZC_ADAPT_WINDOW 64                  // completions per copy-ratio sample
+#define ZC_ADAPT_MAX_COPY_RATIO 0.5         // above this, zero-copy is not paying off
+#define ZC_ADAPT_PROBATION 4096             // messages on the copy path before re-probing
+
+typedef struct {
+    int enabled;                // SO_ZEROCOPY accepted by the socket
+    int adaptive;
+    size_t adaptive_threshold;
+    int message_size;           // bytes per write unit (a whole --batch)
+
+    // In-flight ring, indexed by id & (ZC_RING_SIZE - 1)
+    unsigned head_id;           // oldest send not yet completed
+    unsigned next_id;           // id the kernel will give the next send
+    unsigned bytes[ZC_RING_SIZE];
+    unsigned char done[ZC_RING_SIZE];
+    size_t inflight_bytes;
+    size_t max_inflight_bytes;
+
+    // Per-message decision
+    int cur_zerocopy;
+    int probation;              // messages left on the copy path
+
+    // Adaptive sample window
+    unsigned window_completed;
+    unsigned window_copied;
+
+    // Totals
+    long long zc_sends;
+    long long copy_messages;
+    long long completions;
+    long long copied;
+    long long notifications;
+    long long backpressure_waits;
+    int mode_switches;
+
+    TxStamps *stamps;           // --tx-timestamps, or NULL
+    LiveConn *live;             // --live-stats, or NULL
+} ZcTracker;
+
+static inline void zc_tracker_init(ZcTracker *t, int fd, const ServerOptions *opts) {
+    memset(t, 0, sizeof(*t));
+    int one = 1;
+    t->enabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    t->message_size = stream_unit_size(opts);
+    t->max_inflight_bytes = opts->zc_max_inflight;
+    t->adaptive = opts->zc_adaptive;
+    t->adaptive_threshold = opts->zc_adaptive_threshold;
+}
+
+// Decide how the next message goes out. Returns 1 for MSG_ZEROCOPY.
+static inline int zc_begin_message(ZcTracker *t) {
+    if (!t->enabled) {
+        t->cur_zerocopy = 0;
+    } else if (!t->adaptive) {
+        t->cur_zerocopy = 1;
+    } else if ((size_t)t->message_size < t->adaptive_threshold) {
+        t->cur_zerocopy = 0;
+    } else if (t->probation > 0) {
+        if (--t->probation == 0) t->mode_switches++;   // re-probe zero-copy
+        t->cur_zerocopy = 0;
+    } else {
+        t->cur_zerocopy = 1;
+    }
+    if (!t->cur_zerocopy) t->copy_messages++;
+    return t->cur_zerocopy;
+}
+
+// True if another `bytes` of zero-copy payload would exceed the pinned-memory
+// budget or the id ring, i.e. the caller must wait for completions first.
+static inline int zc_must_wait(const ZcTracker *t, size_t bytes) {
+    unsigned in_flight = t->next_id - t->head_id;
+    if (in_flight >= ZC_RING_SIZE) return 1;
+    return in_flight > 0 && t->inflight_bytes + bytes > t->max_inflight_bytes;
+}
+
+static inline void zc_record_send(ZcTracker *t, size_t bytes) {
+    unsigned idx = t->next_id & (ZC_RING_SIZE - 1);
+    t->bytes[idx] = bytes;
+    t->done[idx] = 0;
+    t->next_id++;
+    t->inflight_bytes += bytes;
+    t->zc_sends++;
+}
+
+static inline void zc_complete_range(ZcTracker *t, unsigned lo, unsigned hi, int copied) {
+    unsigned count = hi - lo + 1;
+    unsigned outstanding = t->next_id - t->head_id;
+    for (unsigned id = lo; id != hi + 1; id++) {
+        if (id - t->head_id < outstanding) t->done[id & (ZC_RING_SIZE - 1)] = 1;
+    }
+    while (t->head_id != t->next_id && t->done[t->head_id & (ZC_RING_SIZE - 1)]) {
+        t->inflight_bytes -= t->bytes[t->head_id & (ZC_RING_SIZE - 1)];
+        t->head_id++;
+    }
+
+    t->notifications++;
+    t->completions += count;
+    if (copied) t->copied += count;
+
+    if (!t->adaptive) return;
+    t->window_completed += count;
+    if (copied) t->window_copied += count;
+    if (t->window_completed >= ZC_ADAPT_WINDOW) {
+        double ratio = (double)t->window_copied / t->window_completed;
+        if (ratio > ZC_ADAPT_MAX_COPY_RATIO && t->probation == 0) {
+            t->probation = ZC_ADAPT_PROBATION;
+            t->mode_switches++;
+        }
+        t->window_completed = 0;
+        t->window_copied = 0;
+    }
+}
+
+// Drain every notification currently queued, without blocking. Each
+// notification may cover a whole range of sends. Returns the number of
+// notifications read, or -1 on a socket error.
+static inline int zc_process_errqueue(int fd, ZcTracker *t) {
+    int processed = 0;
+    char control[256];
+    struct msghdr msg;
+
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                live_note_zc(t->live, t->completions, t->copied);
+                return processed;
+            }
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            struct sock_extended_err *serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (tx_stamps_on_error(t->stamps, &msg, serr)) continue;
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) continue;
+            zc_complete_range(t, serr->ee_info, serr->ee_data,
+                              serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+            processed++;
+        }
+    }
+}
+
+// Block (up to timeout_ms, -1 = forever) until completions are available,
+// then drain them all. Returns -1 if the socket failed.
+static inline int zc_wait(int fd, ZcTracker *t, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = 0 };   // POLLERR is always reported
+    t->backpressure_waits++;
+    int r;
+    do {
+        r = poll(&pfd, 1, timeout_ms);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) return -1;
+    if (r == 0) return 0;
+    if (zc_process_errqueue(fd, t) < 0) return -1;
+    if (pfd.revents & (POLLHUP | POLLNVAL)) return -1;
+    return 0;
+}
+
+// Wait for the kernel to release every outstanding send, e.g. before the
+// payload is freed. Gives up after timeout_ms without progress.
+static inline void zc_drain_all(int fd, ZcTracker *t, int timeout_ms) {
+    while (t->head_id != t->next_id) {
+        unsigned before = t->head_id;
+        struct pollfd pfd = { .fd = fd, .events = 0 };
+        if (poll(&pfd, 1, timeout_ms) <= 0) break;
+        if (zc_process_errqueue(fd, t) < 0) break;
+        if (t->head_id == before && (pfd.revents & (POLLHUP | POLLNVAL))) break;
+    }
+}
+
+static inline void zc_report(const char *name, int conn_id, const ZcTracker *t) {
+    double copied_pct = t->completions > 0 ? 100.0 * t->copied / t->completions : 0;
+    printf("[%s conn %d] zc_sends=%lld completions=%lld notifications=%lld copied=%lld (%.1f%%) "
+           "copy_path_msgs=%lld backpressure_waits=%lld mode_switches=%d\n",
+           name, conn_id, t->zc_sends, t->completions, t->notifications, t->copied,
+           copied_pct, t->copy_messages, t->backpressure_waits, t->mode_switches);
+    fflush(stdout);
+}
+
+#endif